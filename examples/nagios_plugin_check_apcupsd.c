@@ -239,9 +239,14 @@ int main(int argc, char *argv[])
  */
 int fetch_data(char *host, int port)
 {
+   static int fetched = 0;
    int sockfd;
    int stat;
 
+   /* One answer serves every getupsvar() */
+   if (fetched)
+      return 1;
+
    if ((sockfd = net_open(host, NULL, port)) < 0) {
       printf("fetch_data: tcp_open failed for %s port %d", host, port);
       return 0;
@@ -249,6 +254,7 @@ int fetch_data(char *host, int port)
 
    stat = fill_buffer(sockfd);               /* fill statbuf */
    net_close(sockfd);
+   fetched = stat;
    return stat;
 
 } 
@@ -311,19 +317,27 @@ int getupsvar(char *host, int port, char *request, char *answer, int anslen)
  */
 int fill_buffer(int sockfd)
 {
-   int n, stat = 1; 
+   /* Only the keys main() reads; older apcupsd sends them all instead */
+   static const char *cmds[] = {
+      "get HOSTNAME MODEL UPSNAME STATFLAG LOADPCT TIMELEFT", "status", NULL
+   };
+   int i, n, stat = 1; 
    char buf[1000];
 
-   statbuf[0] = 0;
-   statlen = 0;
-   if (net_send(sockfd, "status", 6) != 6) {
-      printf("fill_buffer: write error on socket\n");
-      return 0;
-   }
+   for (i = 0; cmds[i]; i++) {
+      statbuf[0] = 0;
+      statlen = 0;
+      if (net_send(sockfd, cmds[i], strlen(cmds[i])) != (int)strlen(cmds[i])) {
+         printf("fill_buffer: write error on socket\n");
+         return 0;
+      }
 
-   while ((n = net_recv(sockfd, buf, sizeof(buf)-1)) > 0) {
-      buf[n] = 0;
-      strcat(statbuf, buf);
+      while ((n = net_recv(sockfd, buf, sizeof(buf)-1)) > 0) {
+         buf[n] = 0;
+         strncat(statbuf, buf, sizeof(statbuf) - strlen(statbuf) - 1);
+      }
+      if (n < 0 || strcmp(statbuf, "Invalid command\n") != 0)
+         break;
    }
    if (n < 0)
       stat = 0;
@@ -98,6 +98,7 @@
 
 #ifdef HAVE_SYS_SOCKET_H
 # include <sys/socket.h>
+# include <sys/un.h>
 #endif
 #include <sys/stat.h>
 
@@ -141,6 +142,7 @@
 #include "version.h"
 #include "defines.h"
 #include "struct.h"
+#include "linkhealth.h"
 #include "drivers.h"
 #include "nis.h"
 #include "extern.h"
@@ -0,0 +1,363 @@
+/* include/apcconfig.h.  Generated from config.h.in by configure.  */
+/* autoconf/config.h.in.  Generated from autoconf/configure.in by autoheader.  */
+
+/* Define to the type of elements in the array set by `getgroups'. Usually
+   this is either `int' or `gid_t'. */
+#define GETGROUPS_T gid_t
+
+/* Define to 1 if you have the `abort' function. */
+#define HAVE_ABORT 1
+
+/* Define to 1 if you have the `accept4' function. */
+#define HAVE_ACCEPT4 1
+
+/* Define if building for AIX */
+/* #undef HAVE_AIX_OS */
+
+/* Define if building apcsmart driver */
+#define HAVE_APCSMART_DRIVER /**/
+
+/* Define to 1 if you have the <arpa/inet.h> header file. */
+#define HAVE_ARPA_INET_H 1
+
+/* Define to 1 if you have the <arpa/nameser.h> header file. */
+#define HAVE_ARPA_NAMESER_H 1
+
+/* Define if building for BSDi */
+/* #undef HAVE_BSDI_OS */
+
+/* Define to 1 if you have the `calloc' function. */
+#define HAVE_CALLOC 1
+
+/* Define to 1 if you have the <ctype.h> header file. */
+#define HAVE_CTYPE_H 1
+
+/* Define if building for Darwin */
+/* #undef HAVE_DARWIN_OS */
+
+/* Define to 1 if you have the declaration of `tzname', and to 0 if you don't.
+   */
+/* #undef HAVE_DECL_TZNAME */
+
+/* Define if building simple signaling driver */
+#define HAVE_DUMB_DRIVER /**/
+
+/* Define to 1 if you have the <errno.h> header file. */
+#define HAVE_ERRNO_H 1
+
+/* Define to 1 if you have the <fcntl.h> header file. */
+#define HAVE_FCNTL_H 1
+
+/* Define to 1 if you have the `fork' function. */
+#define HAVE_FORK 1
+
+/* Define if building for FreeBSD */
+/* #undef HAVE_FREEBSD_OS */
+
+/* Define if system does not have gethostbyname_r */
+/* #undef HAVE_FUNC_GETHOSTBYNAME_R_0 */
+
+/* Define for 3 argument version of gethostbyname_r */
+/* #undef HAVE_FUNC_GETHOSTBYNAME_R_3 */
+
+/* Define for 5 argument version of gethostbyname_r */
+/* #undef HAVE_FUNC_GETHOSTBYNAME_R_5 */
+
+/* Define for 6 argument version of gethostbyname_r */
+#define HAVE_FUNC_GETHOSTBYNAME_R_6 /**/
+
+/* Define if you have getoptlong */
+#define HAVE_GETOPTLONG /**/
+
+/* Define to 1 if you have the `getpid' function. */
+#define HAVE_GETPID 1
+
+/* Define if building for HPUX */
+/* #undef HAVE_HPUX_OS */
+
+/* Define if you have inetpton */
+#define HAVE_INETPTON /**/
+
+/* Define to 1 if you have the <inttypes.h> header file. */
+#define HAVE_INTTYPES_H 1
+
+/* Define to 1 if you have the `ioctl' function. */
+#define HAVE_IOCTL 1
+
+/* Define to 1 if you have the `kill' function. */
+#define HAVE_KILL 1
+
+/* Define to 1 if you have the `socket' library (-lsocket). */
+/* #undef HAVE_LIBSOCKET */
+
+/* Define if you have libwrap */
+/* #undef HAVE_LIBWRAP */
+
+/* Define to 1 if you have the <limits.h> header file. */
+#define HAVE_LIMITS_H 1
+
+/* Define if building for Linux */
+#define HAVE_LINUX_OS /**/
+
+/* Define if you have localtime_r */
+#define HAVE_LOCALTIME_R /**/
+
+/* Define if you have memmove */
+#define HAVE_MEMMOVE /**/
+
+/* Define to 1 if you have the <memory.h> header file. */
+#define HAVE_MEMORY_H 1
+
+/* Define if building for MINGW */
+/* #undef HAVE_MINGW */
+
+/* Define if building MODBUS driver */
+#define HAVE_MODBUS_DRIVER /**/
+
+/* Define if building MODBUS/USB driver */
+/* #undef HAVE_MODBUS_USB_DRIVER */
+
+/* Define if you have nameser.h */
+#define HAVE_NAMESER_H /**/
+
+/* Define if you have the nanosleep function. */
+#define HAVE_NANOSLEEP 1
+
+/* Define if building for NetBSD */
+/* #undef HAVE_NETBSD_OS */
+
+/* Define to 1 if you have the <netdb.h> header file. */
+#define HAVE_NETDB_H 1
+
+/* Define to 1 if you have the <netinet/in.h> header file. */
+#define HAVE_NETINET_IN_H 1
+
+/* Define if building net driver */
+#define HAVE_NET_DRIVER /**/
+
+/* Define if apcupsd NIS library is being built */
+#define HAVE_NISLIB /**/
+
+/* Define if apcupsd NIS server is being built */
+#define HAVE_NISSERVER /**/
+
+/* Define if building for OpenBSD */
+/* #undef HAVE_OPENBSD_OS */
+
+/* Define if building for OSF1 */
+/* #undef HAVE_OSF1_OS */
+
+/* Define if building PCNET driver */
+#define HAVE_PCNET_DRIVER /**/
+
+/* Define if you have pthreads */
+#define HAVE_PTHREADS 1
+
+/* Define if building for QNX */
+/* #undef HAVE_QNX_OS */
+
+/* Define to 1 if you have the `rewind' function. */
+#define HAVE_REWIND 1
+
+/* Define to 1 if you have the `select' function. */
+#define HAVE_SELECT 1
+
+/* Define to 1 if you have the `setsid' function. */
+#define HAVE_SETSID 1
+
+/* Define if building for IRIX */
+/* #undef HAVE_SGI_OS */
+
+/* Define to 1 if you have the `signal' function. */
+#define HAVE_SIGNAL 1
+
+/* Define to 1 if you have the <signal.h> header file. */
+#define HAVE_SIGNAL_H 1
+
+/* Define if building snmplite driver */
+#define HAVE_SNMPLITE_DRIVER /**/
+
+/* Define to 1 if you have the `snprintf' function. */
+#define HAVE_SNPRINTF 1
+
+/* Define to 1 if you have the <stdarg.h> header file. */
+#define HAVE_STDARG_H 1
+
+/* Define to 1 if you have the <stdint.h> header file. */
+#define HAVE_STDINT_H 1
+
+/* Define to 1 if you have the <stdio.h> header file. */
+#define HAVE_STDIO_H 1
+
+/* Define to 1 if you have the <stdlib.h> header file. */
+#define HAVE_STDLIB_H 1
+
+/* Define if you have strcasecmp */
+#define HAVE_STRCASECMP /**/
+
+/* Define to 1 if you have the `strerror' function. */
+#define HAVE_STRERROR 1
+
+/* Define to 1 if you have the `strftime' function. */
+#define HAVE_STRFTIME 1
+
+/* Define to 1 if you have the <strings.h> header file. */
+#define HAVE_STRINGS_H 1
+
+/* Define to 1 if you have the <string.h> header file. */
+#define HAVE_STRING_H 1
+
+/* Define to 1 if you have the `strlcat' function. */
+/* #undef HAVE_STRLCAT */
+
+/* Define to 1 if you have the `strlcpy' function. */
+/* #undef HAVE_STRLCPY */
+
+/* Define to 1 if you have the `strncmp' function. */
+#define HAVE_STRNCMP 1
+
+/* Define to 1 if you have the `strncpy' function. */
+#define HAVE_STRNCPY 1
+
+/* Define if you have strstr */
+#define HAVE_STRSTR /**/
+
+/* Define to 1 if `tm_zone' is member of `struct tm'. */
+#define HAVE_STRUCT_TM_TM_ZONE 1
+
+/* Define if building for SunOS */
+/* #undef HAVE_SUN_OS */
+
+/* Define to 1 if you have the <syslog.h> header file. */
+#define HAVE_SYSLOG_H 1
+
+/* Define to 1 if you have the <sys/ioctl.h> header file. */
+#define HAVE_SYS_IOCTL_H 1
+
+/* Define to 1 if you have the <sys/socket.h> header file. */
+#define HAVE_SYS_SOCKET_H 1
+
+/* Define to 1 if you have the <sys/stat.h> header file. */
+#define HAVE_SYS_STAT_H 1
+
+/* Define to 1 if you have the <sys/types.h> header file. */
+#define HAVE_SYS_TYPES_H 1
+
+/* Define to 1 if you have <sys/wait.h> that is POSIX.1 compatible. */
+#define HAVE_SYS_WAIT_H 1
+
+/* Define to 1 if you have the `tcgetattr' function. */
+#define HAVE_TCGETATTR 1
+
+/* Define to 1 if you have the <termios.h> header file. */
+#define HAVE_TERMIOS_H 1
+
+/* Define if building test driver */
+#define HAVE_TEST_DRIVER /**/
+
+/* Define to 1 if your `struct tm' has `tm_zone'. Deprecated, use
+   `HAVE_STRUCT_TM_TM_ZONE' instead. */
+#define HAVE_TM_ZONE 1
+
+/* Define to 1 if you don't have `tm_zone' but do have the external array
+   `tzname'. */
+/* #undef HAVE_TZNAME */
+
+/* Define to 1 if you have the <unistd.h> header file. */
+#define HAVE_UNISTD_H 1
+
+/* Define if building USB driver */
+#define HAVE_USB_DRIVER /**/
+
+/* Define to 1 if you have the `vfprintf' function. */
+#define HAVE_VFPRINTF 1
+
+/* Define to 1 if you have the `vsnprintf' function. */
+#define HAVE_VSNPRINTF 1
+
+/* Define to 1 if you have the `wait' function. */
+#define HAVE_WAIT 1
+
+/* Define to 1 if you have the `wait3' function. */
+#define HAVE_WAIT3 1
+
+/* Define to 1 if you have the `waitpid' function. */
+#define HAVE_WAITPID 1
+
+/* Name of system on which apcupsd will run */
+#define HOST "debian"
+
+/* Default directory in which log is written */
+#define LOGDIR "/var/log"
+
+/* Default port number for NIS server */
+#define NISPORT 3551
+
+/* Default directory in which nologin file is written */
+#define NOLOGDIR "/etc"
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME ""
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING ""
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION ""
+
+/* Default directory in which pid file is written */
+#define PIDDIR "/var/run"
+
+/* Default directory in which powerfail flag file is written */
+#define PWRFAILDIR "/etc/apcupsd"
+
+/* Define as the return type of signal handlers (`int' or `void'). */
+#define RETSIGTYPE void
+
+/* Define to 1 if the `S_IS*' macros in <sys/stat.h> do not work properly. */
+/* #undef STAT_MACROS_BROKEN */
+
+/* Define to 1 if you have the ANSI C header files. */
+#define STDC_HEADERS 1
+
+/* Default directory in which apcupsd config files are stored */
+#define SYSCONFDIR "/etc/apcupsd"
+
+/* Define if you have gdImageGif in libgd */
+/* #undef SYS_IMGFMT_GIF */
+
+/* Define if you have gdImagePng in libgd */
+/* #undef SYS_IMGFMT_PNG */
+
+/* Define to 1 if you can safely include both <sys/time.h> and <time.h>. */
+#define TIME_WITH_SYS_TIME 1
+
+/* Define to 1 if your <sys/time.h> declares `struct tm'. */
+/* #undef TM_IN_SYS_TIME */
+
+/* Define to 1 if the X Window System is missing or not being used. */
+/* #undef X_DISPLAY_MISSING */
+
+/* Define to `int' if <sys/types.h> doesn't define. */
+/* #undef gid_t */
+
+/* Define to `int' if <sys/types.h> does not define. */
+/* #undef mode_t */
+
+/* Define to `long int' if <sys/types.h> does not define. */
+/* #undef off_t */
+
+/* Define to `int' if <sys/types.h> does not define. */
+/* #undef pid_t */
+
+/* Define to `unsigned int' if <sys/types.h> does not define. */
+/* #undef size_t */
+
+/* Define to `int' if <sys/types.h> doesn't define. */
+/* #undef uid_t */
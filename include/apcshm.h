@@ -0,0 +1,129 @@
+/*
+ * apcshm.h
+ *
+ * Layout of the shared memory status segment and its client interface
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#ifndef __APCSHM_H
+#define __APCSHM_H
+
+/*
+ * With STATUSSHM set, apcupsd publishes the status of the UPS in a
+ * POSIX shared memory object of that name. Readers map it and copy
+ * out APCSHMDATA with shm_snapshot(); no system call is needed per
+ * read and nothing is parsed.
+ *
+ * The layout only ever grows at the end of APCSHMDATA. Anything else
+ * changes APCSHM_VERSION, and readers refuse a version they do not
+ * know. Values have the meaning and units of the UPSINFO members
+ * they are copied from; times are seconds since the epoch.
+ */
+
+#define APCSHM_MAGIC    0x41504353 /* "APCS" */
+#define APCSHM_VERSION  1
+#define APCSHM_NCAPS    128        /* room for UPS_Cap[] */
+
+typedef struct {
+   int64_t poll_time;
+   int64_t start_time;
+   int64_t last_master_connect_time;
+   int64_t last_onbatt_time;
+   int64_t last_offbatt_time;
+   int64_t LastSelfTest;
+
+   uint32_t Status;
+   int32_t sharenet;               /* SHARENET type */
+   int32_t num_xfers;
+   int32_t cum_time_on_batt;
+   int32_t percent;
+   int32_t runtime;
+   int32_t maxtime;
+   int32_t dwake;
+   int32_t dshutd;
+   int32_t dlowbatt;
+   int32_t lotrans;
+   int32_t hitrans;
+   int32_t rtnpct;
+   int32_t lastxfer;
+   int32_t testresult;
+   int32_t dipsw;
+   int32_t reg1;
+   int32_t reg2;
+   int32_t reg3;
+   int32_t NomOutputVoltage;
+   int32_t NomInputVoltage;
+   int32_t NomPower;
+   int32_t NomApparentPower;
+   int32_t extbatts;
+   int32_t badbatts;
+
+   double LineVoltage;
+   double UPSLoad;
+   double LoadApparent;
+   double BattChg;
+   double TimeLeft;
+   double PredRuntime;             /* negative if not known */
+   double LineMax;
+   double LineMin;
+   double OutputVoltage;
+   double UPSTemp;
+   double BattVoltage;
+   double LineFreq;
+   double OutputCurrent;
+   double nombattv;
+   double humidity;
+   double ambtemp;
+
+   char cap[APCSHM_NCAPS];         /* UPS_Cap[] */
+
+   char upsname[100];
+   char upsmodel[256];
+   char cable[64];                 /* long names as in the status */
+   char driver[64];
+   char upsclass[64];
+   char share[64];
+   char master_name[256];
+   char sensitivity[8];
+   char beepstate[8];
+   char selftest[16];
+   char birth[20];
+   char serial[32];
+   char battdat[20];
+   char firmrev[20];
+} APCSHMDATA;
+
+typedef struct apcshm {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t size;                  /* of the whole segment */
+   uint32_t seq;                   /* odd while an update is under way */
+   uint32_t pid;                   /* of the publishing apcupsd */
+   uint32_t reserved;
+   APCSHMDATA data;
+} APCSHM;
+
+/* In apcshm.c: client side */
+extern const APCSHM *shm_attach(const char *name);
+extern bool shm_snapshot(const APCSHM *shm, APCSHMDATA *out);
+extern void shm_detach(const APCSHM *shm);
+extern void shm_to_ups(const APCSHMDATA *d, UPSINFO *ups);
+
+#endif   /* __APCSHM_H */
@@ -0,0 +1,55 @@
+/*
+ * apcsmtp.h
+ *
+ * Simple SMTP mail client shared by the smtp program and apcupsd.
+ */
+
+/*
+ * Copyright (C) 2000-2004 Kern Sibbald and John Walker
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#ifndef _APCSMTP_H
+#define _APCSMTP_H
+
+/* One mail message. Unused optional fields are NULL. */
+typedef struct {
+   const char *mailhost;           /* NULL for $SMTPSERVER or localhost */
+   int mailport;                   /* 0 for the default of 25 */
+   const char *from;               /* NULL for user@host */
+   const char *const *to;          /* recipients */
+   int nto;
+   const char *cc;
+   const char *subject;
+   const char *reply_to;
+   const char *errors_to;
+   const char *body;               /* lines separated by '\n' */
+} SMTPMSG;
+
+/*
+ * Send a message. Returns 0 on success or -1 on failure with a
+ * description of the problem in errmsg.
+ */
+int smtp_send(const SMTPMSG *msg, char *errmsg, int errlen);
+
+/*
+ * Send several messages over one connection to the first message's
+ * server. Returns the number delivered, or -1 if the server could not
+ * be reached. errmsg holds the first problem seen, if any.
+ */
+int smtp_send_batch(const SMTPMSG *msgs, int nmsgs, char *errmsg, int errlen);
+
+#endif   /* _APCSMTP_H */
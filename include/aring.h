@@ -0,0 +1,77 @@
+/*
+ * aring.h
+ *
+ * Fixed size lock-free ring for one producer and one consumer thread
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#ifndef __ARING_H
+#define __ARING_H
+
+/*
+ * N must be a power of two. The producer only ever writes _head and
+ * the consumer only _tail, so no lock is needed as long as each side
+ * stays on its own thread.
+ */
+template<class T, unsigned int N>
+class aring
+{
+public:
+
+   aring() : _head(0), _tail(0) {}
+
+   /* Returns false, dropping elem, if the ring is full */
+   bool push(const T &elem)
+   {
+      unsigned int head = _head;
+
+      if (head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE) == N)
+         return false;
+
+      _elems[head & (N - 1)] = elem;
+      __atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+      return true;
+   }
+
+   /* Returns false if the ring is empty */
+   bool pop(T &elem)
+   {
+      unsigned int tail = _tail;
+
+      if (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) == tail)
+         return false;
+
+      elem = _elems[tail & (N - 1)];
+      __atomic_store_n(&_tail, tail + 1, __ATOMIC_RELEASE);
+      return true;
+   }
+
+private:
+
+   T _elems[N];
+   unsigned int _head;             /* next slot to fill */
+   unsigned int _tail;             /* next slot to drain */
+
+   // Prevent use
+   aring(const aring &rhs);
+   aring &operator=(const aring &rhs);
+};
+
+#endif   /* __ARING_H */
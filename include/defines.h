@@ -332,13 +332,18 @@ enum {
 #define ACCESS_MAGIC_SIZE       4 * ((sizeof(APC_MAGIC) + 3) / 4)
 
 
-#define MAX_THREADS             7
+#define MAX_UPS                 16 /* UPSes managed by one daemon */
+#define MAX_THREADS             (7 + 2 * MAX_UPS)
 
 /* Find members position in the UPSINFO and GLOBALCFG structures. */
 #define WHERE(MEMBER) ((size_t) &((UPSINFO *)0)->MEMBER)
 #define AT(UPS,OFFSET) ((size_t)UPS + OFFSET)
 #define SIZE(MEMBER) ((GENINFO *)sizeof(((UPSINFO *)0)->MEMBER))
 
+/* What a configuration reload changed; see reload_config() */
+#define RELOAD_REPORTS          0x01 /* status/data/history settings */
+#define RELOAD_HOOKS            0x02 /* EVENTHOOK list was replaced */
+
 
 /*
  * These are the commands understood by the apccontrol shell script.
@@ -143,6 +143,7 @@ typedef struct upsdriver {
 #define DEVICE_CMD_GET_SELFTEST_MSG 0x02
 #define DEVICE_CMD_CHECK_SELFTEST   0x03
 #define DEVICE_CMD_SET_DUMB_MODE    0x04
+#define DEVICE_CMD_GET_SERIAL       0x05  /* data: char[sizeof(ups->serial)] */
 
 /* Support routines. */
 UpsDriver *attach_driver(UPSINFO *ups);
@@ -71,7 +71,7 @@ extern int parse_options(int argc, char *argv[]);
 
 /* In apcupsd.c */
 extern void apcupsd_terminate(int sig);
-extern void clear_files(void);
+extern void clear_files(UPSINFO *ups);
 
 /* In apcdevice.c */
 bool setup_device(UPSINFO *ups);
@@ -79,12 +79,19 @@ extern void initiate_hibernate(UPSINFO *ups);
 extern void initiate_shutdown(UPSINFO *ups);
 extern void prep_device(UPSINFO *ups);
 extern void do_device(UPSINFO *ups);
+extern void start_device(UPSINFO *ups, char *argv0);
+extern void device_command(UPSINFO *ups, int command);
 extern int fillUPS(UPSINFO *ups);
 
 /* In apcaction.c */
 extern void do_action(UPSINFO *ups);
 extern void generate_event(UPSINFO *ups, int event);
 
+/* In eventhooks.c */
+extern void start_event_hooks(UPSINFO *ups, char *argv0);
+extern bool run_event_hooks(UPSINFO *ups, int event, bool wait);
+extern void execute_event(UPSINFO *ups, int event);
+
 /* In apclock.c */
 extern int create_lockfile(UPSINFO *ups);
 extern void delete_lockfile(UPSINFO *ups);
@@ -98,9 +105,14 @@ extern void make_pid(void);
 extern char APCCONF[APC_FILENAME_MAX];
 extern void init_ups_struct(UPSINFO *ups);
 extern void check_for_config(UPSINFO *ups, char *cfgfile);
+extern void request_reload(int sig);
+extern bool reload_pending(UPSINFO *ups);
+extern int reload_config(UPSINFO *ups);
+extern pthread_mutex_t evhooks_mutex;
 
 /* In apcnis.c */
 extern void do_server(UPSINFO *ups);
+extern void do_metrics_server(UPSINFO *ups);
 extern int check_wrappers(char *av, int newsock);
 
 /* In apcstatus.c */
@@ -113,14 +125,39 @@ extern void stat_print(UPSINFO *ups, const char *fmt, ...);
 /* In apcevents.c */
 extern int trim_eventfile(UPSINFO *ups);
 extern int output_events(int sockfd, FILE *events_file);
+extern void events_open(UPSINFO *ups);
+extern void events_add(const UPSINFO *ups, const char *datetime, const char *msg);
+extern int output_events_since(UPSINFO *ups, int sockfd, unsigned long long since);
+
+/* In apchistory.c */
+extern int history_open(UPSINFO *ups, int interval);
+extern void history_close(UPSINFO *ups);
+extern void history_add(UPSINFO *ups, time_t now);
+extern int output_history(UPSINFO *ups, int sockfd, long start, long end, int tier);
 
 /* In apcreports.c */
-extern void clear_files(void);
+extern void clear_files(UPSINFO *ups);
 extern int log_status(UPSINFO *ups);
 extern void do_reports(UPSINFO *ups);
+extern void reset_reports(UPSINFO *ups);
+
+/* In apccache.c */
+extern struct capcache *cache_load(UPSINFO *ups);
+extern const char *cache_serial(const struct capcache *cache);
+extern void cache_apply(UPSINFO *ups, const struct capcache *cache);
+extern void cache_free(struct capcache *cache);
+extern void cache_save(UPSINFO *ups);
+
+/* In apcsched.c */
+extern long long mono_msec(void);
+extern long long mono_nsec(void);
+extern bool poll_sched_begin(UPSINFO *ups);
+extern void poll_sched_end(UPSINFO *ups);
+extern bool poll_ci_due(UPSINFO *ups, int ci);
+extern int poll_sched_wait(UPSINFO *ups);
 
 /* In apcsignal.c */
-extern void init_signals(void (*handler) (int));
+extern void init_signals(void (*handler) (int), void (*reload) (int));
 
 /* In newups.c */
 extern UPSINFO *new_ups(void);
@@ -139,10 +176,34 @@ extern void _read_unlock(const char *file, int line, UPSINFO *ups);
 extern void _write_lock(const char *file, int line, UPSINFO *ups);
 extern void _write_unlock(const char *file, int line, UPSINFO *ups);
 
+/* In apcpredict.c */
+extern bool predict_update(UPSINFO *ups, PREDICT *save);
+extern void predict_save(UPSINFO *ups, const PREDICT *p);
+
+/* In apcshm.c */
+extern void shm_publish(UPSINFO *ups);
+extern void shm_close(UPSINFO *ups);
+
+/* In apcmetrics.c */
+extern void metrics_enable(UPSINFO *head);
+extern void metrics_render(UPSINFO *ups);
+extern char *metrics_document(UPSINFO *head, size_t *len);
+
+/* In apcstats.c */
+extern void lathist_add(LATHIST *h, long long usec);
+extern void stats_retries(UPSINFO *ups, unsigned long n);
+extern void stats_nis_request(UPSINFO *ups, long long usec);
+extern int output_lathist_header(int sockfd);
+extern int output_lathist(int sockfd, const char *name, const LATHIST *h);
+extern int output_selfstats(UPSINFO *ups, int sockfd);
+
 /* In apcexec.c */
 extern int start_thread(UPSINFO *ups, void (*action) (UPSINFO * ups),
    const char *proctitle, char *argv0);
 extern int execute_command(UPSINFO *ups, UPSCOMMANDS cmd);
+extern int launch_command(UPSINFO *ups, UPSCOMMANDS cmd);
+extern void start_exec_launcher(UPSINFO *ups, char *argv0);
+extern int output_exec_stats(int sockfd);
 extern void clean_threads(void);
 
 /* In apclog.c */
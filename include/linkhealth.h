@@ -0,0 +1,75 @@
+/*
+ * linkhealth.h
+ *
+ * Link health tracking and reconnect pacing shared by the drivers
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#ifndef __LINKHEALTH_H
+#define __LINKHEALTH_H
+
+/*
+ * A driver reports the outcome of each exchange with the UPS through
+ * success() and failure(). The first retry is made at once; after
+ * that attempts are spaced by an exponential backoff with jitter, up
+ * to max_ms, and ready() says whether one may be made now. Once the
+ * backoff has run out a single attempt is let through, and its
+ * success brings the link straight back up.
+ *
+ * COMMLOST is declared, with its event, once there have been at least
+ * `threshold` consecutive failures spanning at least `grace_ms`. The
+ * next success clears it and sends COMMOK. The caller provides
+ * whatever locking it already uses around generate_event().
+ */
+class LinkHealth
+{
+public:
+
+   LinkHealth(UPSINFO *ups, int threshold = 1, int grace_ms = 0,
+              int min_ms = 1000, int max_ms = 5000);
+
+   bool ready() const;
+   int delay_ms() const;           /* until ready(), 0 if now */
+   void wait() const;              /* sleep until ready() */
+   void kick();                    /* the UPS showed signs of life */
+
+   void success();
+   void failure();
+
+   bool is_down() const { return _failures > 0; }
+
+private:
+
+   UPSINFO *_ups;
+   int _threshold;
+   int _grace_ms;
+   int _min_ms;
+   int _max_ms;
+
+   int _failures;                  /* consecutive failures */
+   bool _lost;                     /* COMMFAILURE has been sent */
+   int _backoff_ms;                /* current backoff ceiling */
+   long long _first_fail;          /* mono_msec() of first failure */
+   long long _next_try;            /* earliest next attempt */
+   time_t _last_log;               /* last "still lost" log entry */
+   unsigned int _seed;
+};
+
+#endif   /* __LINKHEALTH_H */
@@ -20,8 +20,27 @@
  * MA 02110-1335, USA.
  */
 
+#ifndef __NIS_H
+#define __NIS_H
+
 #include "defines.h"
 
+/*
+ * Messages are framed by a 16 bit length in network byte order. After
+ * a client has sent "framing 2", the length NIS_EXTLEN is followed by
+ * a 32 bit one, for messages longer than NIS_MAXMSG. Readers accept
+ * either at any time; no message of NIS_EXTLEN bytes is ever sent.
+ */
+#define NIS_MAXMSG   0xfffe
+#define NIS_EXTLEN   0xffff
+
+/* Buffered reading of the messages from one socket */
+typedef struct {
+   sock_t fd;
+   int start, end;                 /* of what is buffered */
+   char buf[4096];
+} NETREADER;
+
 /* 
  * Receive a message from the other end. Each message consists of
  * two packets. The first is a header that contains the size
@@ -33,6 +52,10 @@
  */
 int net_recv(sock_t sockfd, char *buff, int maxlen);
 
+/* As net_recv(), but reading ahead into r, set up by net_reader_init() */
+void net_reader_init(NETREADER *r, sock_t sockfd);
+int net_recv_buffered(NETREADER *r, char *buff, int maxlen);
+
 /*
  * Send a message over the network. The send consists of
  * two network packets. The first is sends a short containing
@@ -43,16 +66,32 @@ int net_recv(sock_t sockfd, char *buff, int maxlen);
  */
 int net_send(sock_t sockfd, const char *buff, int len);
 
+/*
+ * Collect what this thread sends to sockfd until net_batch_end(), then
+ * send it all at once. With framing 2 the messages up to each empty one
+ * are merged into a single message.
+ *
+ * net_batch_end() returns 0, or -errno if sending failed
+ */
+void net_batch_begin(sock_t sockfd, int framing);
+int net_batch_end(void);
+
 /*     
- * Open a TCP connection to the UPS network server
+ * Open a connection to the UPS network server, over TCP, or over a
+ * Unix domain socket if host is a path
  *
- * Returns -1 on error
+ * Returns -errno on error
  * Returns socket file descriptor otherwise
  */
 sock_t net_open(const char *host, char *service, int port);
 
+/* Split host[:port], [ipv6addr][:port] or a socket path for net_open() */
+void net_split_host(const char *spec, char *host, size_t size, int *port);
+
 /* Close the network connection */
 void net_close(sock_t sockfd);
 
-/* Wait for and accept a new TCP connection */
-sock_t net_accept(sock_t fd, struct sockaddr_in *cli_addr);
+/* Wait for and accept a new connection */
+sock_t net_accept(sock_t fd, struct sockaddr_storage *cli_addr);
+
+#endif   /* __NIS_H */
@@ -24,10 +24,13 @@
 #include "alist.h"
 #include "astring.h"
 
-#define MAX_STATS 256
-#define MAX_DATA  100
-
-
+/*
+ * Status of one apcupsd, fetched over NIS. The text of the last status
+ * is kept as received in one buffer, split in place into keys and
+ * values, with a hash table over the keys so Get() does not search.
+ * Generation() changes only when a value other than the time stamps
+ * does, so callers can skip redrawing what has not changed.
+ */
 class StatMgr
 {
 public:
@@ -40,6 +43,7 @@ public:
    bool GetAll(alist<astring> &keys, alist<astring> &values);
    bool GetEvents(alist<astring> &events);
    bool GetSummary(int &battstat, astring &statstr, astring &upsname);
+   unsigned int Generation();
 
 private:
 
@@ -53,13 +57,23 @@ private:
    void lock();
    void unlock();
 
+   void index();
+   int find(const char *key);
+
    struct keyval {
       const char *key;
-      const char *value;
-      char data[MAX_DATA];
+      const char *value;            /* NULL if the line had no ':' */
    };
 
-   keyval          m_stats[MAX_STATS];
+   char           *m_text;          /* received lines, NUL-separated */
+   unsigned int    m_textsize;
+   keyval         *m_stats;
+   int             m_nstats;
+   int             m_maxstats;
+   int            *m_hash;          /* index into m_stats, or -1 */
+   unsigned int    m_hashsize;      /* a power of two */
+   unsigned int    m_gen;
+   uint64_t        m_sum;           /* of the values that count for m_gen */
    astring         m_host;
    unsigned short  m_port;
    sock_t          m_socket;
@@ -124,6 +124,32 @@ typedef enum {
    TEST_UNKNOWN
 } SelfTestResult;
 
+/* Built-in event hooks (EVENTHOOK directive) */
+typedef enum {
+   HOOK_NONE = 0,
+   HOOK_APCCONTROL,      /* Also run apccontrol */
+   HOOK_TOUCH,           /* Create or update a flag file */
+   HOOK_REMOVE,          /* Remove a flag file */
+   HOOK_UDP,             /* Send a UDP datagram to host:port */
+   HOOK_UNIX,            /* Send a datagram to a local socket */
+   HOOK_HTTP,            /* POST to an http:// URL */
+   HOOK_MAIL             /* Send mail via SMTP */
+} HookType;
+
+typedef struct evhook {
+   struct evhook *next;
+   char event[32];                 /* apccontrol event name or "*" */
+   int cmd;                        /* CMD* index, -1 for "*", -2 unresolved */
+   int type;                       /* HookType */
+   char arg[MAXSTRING];
+} EVHOOK;
+
+/* UPSCONF directive: configuration file of another UPS to manage */
+typedef struct upsfile {
+   struct upsfile *next;
+   char path[APC_FILENAME_MAX];
+} UPSFILE;
+
 typedef struct geninfo {
    const char *name;               /* JHNC: name mustn't contain whitespace */
    const char *long_name;
@@ -137,6 +163,83 @@ typedef struct internalgeninfo {
 } INTERNALGENINFO;                 /* for assigning into upsinfo */
 
 class UpsDriver;
+struct apchist;
+struct apcshm;
+struct metrics;
+struct pollq;
+struct capcache;
+
+/* CI refresh groups of the poll scheduler, fastest first */
+enum {
+   POLL_STATUS = 0,                /* status word, charge, runtime */
+   POLL_ELECTRICAL,                /* voltages, load, frequency */
+   POLL_ENVIRON,                   /* temperatures, dates, counters */
+   POLL_NGROUPS
+};
+
+typedef struct {
+   long long due;                  /* monotonic msec, see mono_msec() */
+   int group;
+} POLLTIMER;
+
+typedef struct {
+   POLLTIMER heap[POLL_NGROUPS];   /* min-heap of group deadlines */
+   int nheap;
+   unsigned int skip;              /* bit per group not refreshed now */
+   bool tight;                     /* periods shortened for an outage */
+} POLLSCHED;
+
+/* Latency histogram, see lathist_add() */
+#define LATHIST_BUCKETS 24         /* 2 usec up to 16 sec, then the rest */
+typedef struct {
+   unsigned long count;
+   unsigned long long sum_us;
+   unsigned long long max_us;
+   unsigned long long last_us;
+   unsigned long bucket[LATHIST_BUCKETS];
+} LATHIST;
+
+/* Runtime estimator state, see apcpredict.c */
+typedef struct {
+   double n, sx, sy, sxx, sxy;     /* decaying sums: load vs. drain rate */
+   double nlow, lowbatt_min;       /* decaying sums: full to low battery */
+   double runtime;                 /* PREDRUNTIME in minutes, <0 unknown */
+   bool started;
+   bool active;                    /* on battery */
+   bool full;                      /* ... and started fully charged */
+   bool dirty;                     /* learned something, save it */
+   time_t mains_since;             /* on mains since */
+   long long start;                /* mono_msec() the outage began */
+   long long lowbatt_at;           /* ... and the battery ran low */
+   long long anchor_t;             /* start of the current stretch */
+   double anchor_chg;              /* ... and the charge then */
+   double load_ms;                 /* load integrated over the stretch */
+   long long last_t;
+} PREDICT;
+
+/* Counters kept by LinkHealth, see linkhealth.h */
+typedef struct {
+   unsigned long attempts;         /* exchanges with the UPS */
+   unsigned long failures;         /* ... that failed */
+   unsigned long outages;          /* times COMMLOST was declared */
+   unsigned long recoveries;       /* times it was cleared again */
+   long long last_outage_ms;       /* length of the last outage */
+   int backoff_ms;                 /* last delay before a retry */
+} LINKSTATS;
+
+/* What apcupsd measures about itself, see the NIS stats command */
+typedef struct {
+   LATHIST poll_volatile;          /* read_volatile_data() */
+   LATHIST poll_static;            /* read_static_data() */
+   unsigned long poll_errors;      /* ... either of them failed */
+   LATHIST lock_wait;              /* waiting for the UPS lock */
+   LATHIST read_hold;              /* read lock held */
+   LATHIST write_hold;             /* write lock held */
+   long long lock_taken;           /* mono_nsec() the lock was taken */
+   unsigned long retries;          /* transport retries, atomic */
+   LATHIST nis_request;            /* NIS command in to reply out, see
+                                      stats_nis_request() */
+} SELFSTATS;
 
 class UPSINFO {
  public:
@@ -238,8 +341,6 @@ class UPSINFO {
    INTERNALGENINFO upsclass;       /* UPSCLASS directive */
    INTERNALGENINFO sharenet;       /* UPSMODE directive */
 
-   int num_execed_children;        /* children created in execute_command() */
-
    /* Internal state flags set in response to UPS condition */
    time_t ShutDown;                /* set when doing shutdown */
    time_t SelfTest;                /* start time of self test */
@@ -260,6 +361,24 @@ class UPSINFO {
    int cum_time_on_batt;           /* total time on batteries since startup */
    int wait_time;                  /* suggested wait time for drivers in 
                                     * device_check_state() */
+   int reload_gen;                 /* last configuration reload applied */
+   POLLSCHED pollsched;            /* which CI groups fillUPS() refreshes */
+   struct pollq *pollq;            /* link to the poller thread */
+   LINKSTATS linkstats;            /* health of the link to the UPS */
+   long long event_stamp;          /* mono_nsec() of a pending status change */
+   LATHIST event_latency;          /* status change seen to event raised */
+   SELFSTATS selfstats;            /* apcupsd timing itself */
+   PREDICT predict;                /* runtime learned from past outages */
+
+   /* State kept by do_action() and do_reports() */
+   bool action_started;
+   int requested_logoff;           /* asked users to log off */
+   bool reports_started;
+   FILE *statusfile;               /* open STATFILE */
+   time_t last_time_status;
+   time_t last_time_logging;
+   time_t last_time_history;
+   int data_toggle;
 
    /* Items reported by smart UPS */
    /* Volatile items -- i.e. they change with the state of the UPS */
@@ -331,9 +450,13 @@ class UPSINFO {
    int polltime;                   /* Time interval to poll the UPS */
    int percent;                    /* shutdown when batt % less than this */
    int runtime;                    /* shutdown when runtime less than this */
-   char nisip[64];                 /* IP for NIS */
+   int predshutdown;               /* ... or when PREDRUNTIME is */
+   char nisip[256];                /* addresses and socket paths for NIS */
    int statusport;                 /* NIS port */
+   char nisgroup[64];              /* group allowed on NIS Unix sockets */
+   int nisacceptors;               /* listening sockets per NIS address */
    int netstats;                   /* turn on/off network status */
+   int metricsport;                /* HTTP port for metrics, 0 if off */
    int logstats;                   /* turn on/off logging of status info */
    char device[MAXSTRING];         /* device name in use */
    char configfile[APC_FILENAME_MAX];   /* config filename */
@@ -341,18 +464,36 @@ class UPSINFO {
    char eventfile[APC_FILENAME_MAX];    /* temp events file */
    int eventfilemax;               /* max size of eventfile in kilobytes */
    int event_fd;                   /* fd for eventfile */
+   struct eventring *events;       /* recent events, numbered */
+   char histfile[APC_FILENAME_MAX];     /* history data file */
+   int histsize;                   /* records per history tier */
+   struct apchist *history;        /* open history store */
+   char shmname[APC_FILENAME_MAX];      /* shared memory status object */
+   struct apcshm *shm;             /* ... mapped, once created */
+   char shmopen[APC_FILENAME_MAX];      /* ... name it was created under */
+   struct metrics *metrics;        /* rendered Prometheus metrics */
+   char capcache[APC_FILENAME_MAX];     /* capability cache file */
+   char predfile[APC_FILENAME_MAX];     /* learned runtime model */
 
    char master_name[APC_FILENAME_MAX];
    char lockpath[APC_FILENAME_MAX];
    int lockfile;
 
    char scriptdir[APC_FILENAME_MAX];    /* Path to apccontrol dir */
+   int evwindow;                   /* event coalescing window in seconds */
+   int evmaxprocs;                 /* max concurrent apccontrol children */
+   EVHOOK *evhooks;                /* EVENTHOOK directives */
+   char smtpserver[MAXSTRING];     /* mail host[:port] for mail hooks */
+   char smtpfrom[MAXSTRING];       /* From: address for mail hooks */
    char pwrfailpath[APC_FILENAME_MAX];  /* Path to powerfail flag file dir */
    char nologinpath[APC_FILENAME_MAX];  /* Path to nologin dir */
+   UPSFILE *upsfiles;              /* UPSCONF directives */
+   UPSINFO *next_ups;              /* next UPS run by this daemon */
 
    int ChangeBattCounter;          /* For UPS_REPLACEBATT, see apcaction.c */
 
    pthread_mutex_t mutex;
+   pthread_mutex_t stats_mutex;    /* selfstats.nis_request */
    int refcnt;                     /* thread attach count */
 
    UpsDriver *driver;              /* UPS driver for this UPSINFO */
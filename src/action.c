@@ -82,12 +82,54 @@ UPSCMDMSG event_msg[] = {
    {LOG_CRIT,    "Battery reattached."}
 };
 
+/*
+ * True if the runtime left is below MINUTES, by the UPS's estimate or,
+ * with PREDRUNTIME on, by our own one learned from past outages.
+ */
+static bool runtime_low(UPSINFO *ups)
+{
+   if (ups->UPS_Cap[CI_RUNTIM] && ups->TimeLeft <= ups->runtime)
+      return true;
+
+   return ups->predshutdown && ups->predict.runtime >= 0 &&
+          ups->predict.runtime <= ups->runtime;
+}
+
+/*
+ * Events raised by do_action() when the status word changes. The
+ * time from the poller seeing such a change to the event goes into
+ * the event_latency histogram; do_device() stamps the change.
+ */
+static void note_event_latency(UPSINFO *ups, int event)
+{
+   switch (event) {
+   case CMDPOWEROUT:
+   case CMDSTARTSELFTEST:
+   case CMDFAILING:
+   case CMDEMERGENCY:
+   case CMDOFFBATTERY:
+   case CMDMAINSBACK:
+   case CMDBATTDETACH:
+   case CMDBATTATTACH:
+      if (ups->event_stamp) {
+         lathist_add(&ups->event_latency,
+            (mono_nsec() - ups->event_stamp) / 1000);
+         ups->event_stamp = 0;
+      }
+      break;
+   default:
+      break;
+   }
+}
+
 void generate_event(UPSINFO *ups, int event)
 {
+   note_event_latency(ups, event);
+
    /* Log message and execute script for this event */
    log_event(ups, event_msg[event].level, event_msg[event].msg);
-   Dmsg(80, "calling execute_ups_event %s event=%d\n", ups_event[event], event);
-   execute_command(ups, ups_event[event]);
+   Dmsg(80, "calling execute_ups_event %s event=%d\n", ups_event[event].command, event);
+   execute_event(ups, event);
 
    /*
     * Additional possible actions. For certain, we now do a
@@ -137,7 +179,7 @@ void generate_event(UPSINFO *ups, int event)
  * ok = 2  => power failure
  * ok = 3  => remote shutdown
  */
-static void powerfail(int ok)
+static void powerfail(UPSINFO *ups, int ok)
 {
    /*
     * If apcupsd terminates here, it will never get a chance to
@@ -148,7 +190,7 @@ static void powerfail(int ok)
     */
 
    if (ok == 2) {
-      clear_files();
+      clear_files(ups);
       if (terminate_on_powerfail) {
          /*
           * This sends a SIGTERM signal to itself.
@@ -216,14 +258,19 @@ static void do_shutdown(UPSINFO *ups, int cmdtype)
        * as it will shutoff the UPS power, and you cannot
        * be guaranteed that the shutdown command will have
        * succeeded. This PROBABLY should be executed AFTER
-       * the shutdown command is given (the execute_command below).
+       * the shutdown command is given (the launch_command below).
        */
       if (kill_on_powerfail)
          initiate_hibernate(ups);
    }
 
-   /* Now execute the shutdown command */
-   execute_command(ups, ups_event[cmdtype]);
+   /*
+    * Now execute the shutdown command. This bypasses the event queue
+    * since powerfail() below may terminate us before it is drained.
+    * Its hooks are run first and waited for, for the same reason.
+    */
+   run_event_hooks(ups, cmdtype, true);
+   launch_command(ups, ups_event[cmdtype]);
 
    /*
     * On some systems we may stop on the previous
@@ -231,9 +278,9 @@ static void do_shutdown(UPSINFO *ups, int cmdtype)
     */
 
    if (cmdtype == CMDREMOTEDOWN)
-      powerfail(3);
+      powerfail(ups, 3);
    else
-      powerfail(2);
+      powerfail(ups, 2);
 }
 
 /* These are the different "states" that the UPS can be in. */
@@ -348,15 +395,16 @@ static const char *testresult_to_string(SelfTestResult res)
 void do_action(UPSINFO *ups)
 {
    time_t now;
-   static int requested_logoff = 0;     /* asked user to logoff */
-   static int first = 1;
    enum a_state state;
+   PREDICT model;
+   bool save;
 
    write_lock(ups);
 
    time(&now);                     /* get current time */
-   if (first) {
-      first = 0;
+   save = predict_update(ups, &model);
+   if (!ups->action_started) {
+      ups->action_started = true;
       ups->last_time_nologon = ups->last_time_annoy = now;
       ups->last_time_on_line = now;
       
@@ -401,6 +449,8 @@ void do_action(UPSINFO *ups)
       }
       ups->PrevStatus = ups->Status;
       write_unlock(ups);
+      if (save)
+         predict_save(ups, &model);
       return;
    }
 
@@ -443,7 +493,7 @@ void do_action(UPSINFO *ups)
 
       /* Check if selftest */
       Dmsg(80, "Power failure detected. 0x%x\n", ups->Status);
-      device_entry_point(ups, DEVICE_CMD_CHECK_SELFTEST, NULL);
+      device_command(ups, DEVICE_CMD_CHECK_SELFTEST);
 
       if (ups->SelfTest)
          generate_event(ups, CMDSTARTSELFTEST);
@@ -456,7 +506,7 @@ void do_action(UPSINFO *ups)
       ups->num_xfers++;
 
       /* Enable DTR on dumb UPSes with CUSTOM_SIMPLE cable. */
-      device_entry_point(ups, DEVICE_CMD_DTR_ENABLE, NULL);
+      device_command(ups, DEVICE_CMD_DTR_ENABLE);
       break;
 
    case st_SelfTest:
@@ -517,14 +567,14 @@ void do_action(UPSINFO *ups)
             ups->clear_shut_load();
          }
 
-         if (ups->UPS_Cap[CI_RUNTIM] && ups->TimeLeft <= ups->runtime) {
+         if (runtime_low(ups)) {
             if (!ups->is_shut_ltime()) {
                Dmsg(100, "CI_RUNTIM shutdown\n");
                ups->set_shut_ltime();
                ups->start_shut_ltime = now;
             }
          } else {
-            if (ups->UPS_Cap[CI_RUNTIM] && ups->is_shut_ltime())
+            if (ups->is_shut_ltime())
                Dmsg(100, "CI_RUNTIM glitch\n");
             ups->clear_shut_ltime();
          }
@@ -560,16 +610,16 @@ void do_action(UPSINFO *ups)
          /* Announce to LogOff, with initial delay. */
          if (((now - ups->last_time_on_line) > ups->annoydelay) &&
              ((now - ups->last_time_annoy) > ups->annoy) && ups->nologin_file) {
-            if (!requested_logoff) {
+            if (!ups->requested_logoff) {
                /* generate log message once */
                generate_event(ups, CMDANNOYME);
             } else {
                /* but execute script every time */
-               execute_command(ups, ups_event[CMDANNOYME]);
+               execute_event(ups, CMDANNOYME);
             }
 
             time(&ups->last_time_annoy);
-            requested_logoff = true;
+            ups->requested_logoff = true;
          }
 
          /* Delay NoLogons. */
@@ -610,10 +660,10 @@ void do_action(UPSINFO *ups)
          ups->SelfTest = 0;
 
          /* Get last selftest results, only for smart UPSes. */
-         device_entry_point(ups, DEVICE_CMD_GET_SELFTEST_MSG, NULL);
+         device_command(ups, DEVICE_CMD_GET_SELFTEST_MSG);
          log_event(ups, LOG_ALERT, "UPS Self Test completed: %s",
             testresult_to_string(ups->testresult));
-         execute_command(ups, ups_event[CMDENDSELFTEST]);
+         execute_event(ups, CMDENDSELFTEST);
       } else {
          generate_event(ups, CMDMAINSBACK);
       }
@@ -623,8 +673,8 @@ void do_action(UPSINFO *ups)
 
       logonfail(ups, 1);
       ups->nologin_file = false;
-      requested_logoff = false;
-      device_entry_point(ups, DEVICE_CMD_DTR_ST_DISABLE, NULL);
+      ups->requested_logoff = false;
+      device_command(ups, DEVICE_CMD_DTR_ST_DISABLE);
       ups->last_offbatt_time = now;
 
       /*
@@ -650,14 +700,12 @@ void do_action(UPSINFO *ups)
       break;
    }
 
-   /* Do a non-blocking wait on any exec()ed children */
-   if (ups->num_execed_children > 0) {
-      while (waitpid(-1, NULL, WNOHANG) > 0)
-         ups->num_execed_children--;
-   }
-
    /* Remember status */
    ups->PrevStatus = ups->Status;
 
    write_unlock(ups);
+
+   /* File I/O is kept out from under the lock */
+   if (save)
+      predict_save(ups, &model);
 }
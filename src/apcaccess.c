@@ -24,89 +24,471 @@
  */
 
 #include "apc.h"
+#include "apcshm.h"
+#include <getopt.h>
 
 /* These are all the possible unit labels generated in src/lib/apcstatus.c
  * -u removes them. (To make life easier for scripts.)
  */
 const char *const units[] = {
-  " Minutes\n",
-  " Seconds\n",
-  " Percent\n",
-  " Volts\n",
-  " Watts\n",
-  " Hz\n",
-  " C\n",
+  "Minutes",
+  "Seconds",
+  "Percent",
+  "Volts",
+  "Watts",
+  "Hz",
+  "C",
+};
+
+/* Values apcupsd prints as bare numbers, without a unit */
+static const char *const count_keys[] = {
+  "NUMXFERS",
+  "EXTBATTS",
+  "BADBATTS",
 };
 
 /* Behavior modifying flags */
 #define NO_UNITS 0x1
 
-/* Get and print status from apcupsd NIS server */
-static int do_pthreads_status(const char *host, int port, const char *par, int flags)
+/* Seconds between updates with --watch and no interval given */
+#define WATCH_DEFAULT 10
+
+/* How the status is printed */
+enum { FMT_TEXT, FMT_JSON, FMT_NDJSON };
+
+/* One apcupsd asked for its status */
+typedef struct {
+   char spec[MAXSTRING];            /* host:port, as printed */
+   char host[MAXSTRING];
+   int port;
+   sock_t fd;                       /* kept open with --watch */
+   NETREADER reader;                /* of what comes from fd */
+   char *text;                      /* status as received */
+   size_t len, size;
+   char err[MAXSTRING];             /* why there is no status */
+   bool noget;                      /* apcupsd too old for "get" */
+   pthread_t tid;
+} NISHOST;
+
+static const char *par;
+static int outflags;
+static int format = FMT_TEXT;
+static int watch;                   /* seconds between updates, or 0 */
+static int nhosts;
+static pthread_mutex_t out_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void append_text(NISHOST *h, const char *line, size_t len)
 {
-   sock_t sockfd;
-   int n;
-   char recvline[MAXSTRING + 1];
-   char *line;
+   if (h->len + len + 1 > h->size) {
+      h->size = (h->len + len + 1) * 2;
+      h->text = (char *)realloc(h->text, h->size);
+   }
+   memcpy(h->text + h->len, line, len);
+   h->len += len;
+   h->text[h->len] = '\0';
+}
 
-   if ((sockfd = net_open(host, NULL, port)) < 0) {
-      fprintf(stderr, "Error contacting apcupsd @ %s:%d: %s\n",
-         host, port, strerror(-sockfd));
-      return 1;
+/*
+ * Split a "KEY      : value" line in place into its name and its value,
+ * without the newline. Returns false if it is not such a line.
+ */
+static bool split_line(char *line, char **key, char **val)
+{
+   char *colon = strchr(line, ':');
+   char *end;
+
+   if (colon == NULL)
+      return false;
+
+   for (end = colon; end > line && end[-1] == ' '; end--)
+      ;
+   *end = '\0';
+   *key = line;
+
+   for (colon++; *colon == ' '; colon++)
+      ;
+   *val = colon;
+   colon[strcspn(colon, "\n")] = '\0';
+   return true;
+}
+
+/* Remove a unit label ending a value. Returns true if there was one. */
+static bool strip_units(char *val)
+{
+   char *sp = strrchr(val, ' ');
+   size_t i;
+
+   if (sp == NULL)
+      return false;
+   for (i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+      if (strcmp(sp + 1, units[i]) == 0) {
+         *sp = '\0';
+         return true;
+      }
    }
+   return false;
+}
 
-   net_send(sockfd, "status", 6);
+/* Whether a value is a plain decimal number, such as apcupsd prints */
+static bool is_number(const char *s)
+{
+   if (*s == '-')
+      s++;
+   if (!isdigit((unsigned char)*s))
+      return false;
+   while (isdigit((unsigned char)*s))
+      s++;
+   if (*s == '.') {
+      s++;
+      if (!isdigit((unsigned char)*s))
+         return false;
+      while (isdigit((unsigned char)*s))
+         s++;
+   }
+   return *s == '\0';
+}
 
-   while ((n = net_recv(sockfd, recvline, sizeof(recvline))) > 0) {
-      recvline[n] = 0;
-      line = recvline;
-      if (par) { /* Check for match against parameter name */
-         char *r = NULL;
-         char *var;
+/*
+ * Whether a value is to be given as a number in JSON: it has a unit or
+ * is a count. Other values made of digits, such as a serial number,
+ * are only strings that happen to look like numbers.
+ */
+static bool is_count_key(const char *key)
+{
+   size_t i;
 
-         var = strtok_r(recvline, ":", &r);
-         if (!var)   // No : separator? Skip it.
-            continue;
-         line = recvline + strlen(var) + 1;
-         if ((r = strchr(var, ' ')))
-            *r = '\0';
-         if (strcmp(par, var)) // Doesn't match parameter? Skip it.
+   for (i = 0; i < sizeof(count_keys) / sizeof(count_keys[0]); i++) {
+      if (strcmp(key, count_keys[i]) == 0)
+         return true;
+   }
+   return false;
+}
+
+/*
+ * Print the status of one host as text. With a parameter name only its
+ * value is printed. Several hosts are told apart by a prefix to each
+ * line. Returns false if the parameter was not found.
+ */
+static bool print_text(const NISHOST *h)
+{
+   char line[MAXSTRING + 1];
+   const char *p, *eol;
+   char *key, *val;
+   size_t len;
+
+   for (p = h->text; *p; p = eol) {
+      eol = p + strcspn(p, "\n");
+      if (*eol)
+         eol++;
+      len = MIN((size_t)(eol - p), sizeof(line) - 1);
+      memcpy(line, p, len);
+      line[len] = '\0';
+
+      if (par) {
+         if (!split_line(line, &key, &val) || strcmp(key, par) != 0)
             continue;
-         while (*line == ' ')
-            line++;
-      }
-      if (flags & NO_UNITS) { /* Remove units labels */
-         size_t i;
-         for (i = 0; i < sizeof units / sizeof units[0]; i++) {
-            const char * const u = units[i];
-            size_t ulen = strlen(u);
-            size_t llen = strlen(line);
-
-            if (llen >= ulen && !strcmp (line + llen - ulen, u)) {
-               line[llen - ulen] = '\n';
-               line[llen+1 - ulen] = '\0';
-               break;
-            }
-         }
+      } else {
+         val = line;
+         val[strcspn(val, "\n")] = '\0';
       }
-      fputs(line, stdout);
-      // If we had a param to match and we got this far we must have
-      // matched it. Clear par to indicate success and bail out.
-      if (par) {
-         par = NULL;
+
+      if (outflags & NO_UNITS)
+         strip_units(val);
+      if (nhosts > 1)
+         printf("%s ", h->spec);
+      printf("%s\n", val);
+      if (par)
+         return true;
+   }
+
+   return par == NULL;
+}
+
+static void json_string(const char *s)
+{
+   putchar('"');
+   for (; *s; s++) {
+      switch (*s) {
+      case '"':
+         fputs("\\\"", stdout);
+         break;
+      case '\\':
+         fputs("\\\\", stdout);
+         break;
+      default:
+         if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+         else
+            putchar(*s);
          break;
       }
    }
+   putchar('"');
+}
+
+/*
+ * Print the status of one host as a JSON object on one line. Numbers
+ * with a unit, and counts, are given as numbers and without the unit;
+ * everything else as a string. Returns false if a
+ * parameter was asked for and not found.
+ */
+static bool print_json(const NISHOST *h)
+{
+   char line[MAXSTRING + 1];
+   const char *p, *eol;
+   char num[MAXSTRING + 1];
+   char *key, *val;
+   bool first = true;
+   size_t len;
+
+   fputs("{\"host\":", stdout);
+   json_string(h->spec);
+   if (h->err[0]) {
+      fputs(",\"error\":", stdout);
+      json_string(h->err);
+      putchar('}');
+      return false;
+   }
+
+   fputs(",\"status\":{", stdout);
+   for (p = h->text; *p; p = eol) {
+      eol = p + strcspn(p, "\n");
+      if (*eol)
+         eol++;
+      len = MIN((size_t)(eol - p), sizeof(line) - 1);
+      memcpy(line, p, len);
+      line[len] = '\0';
+
+      if (!split_line(line, &key, &val) || (par && strcmp(key, par) != 0))
+         continue;
+      for (len = strlen(val); len > 0 && val[len - 1] == ' '; len--)
+         val[len - 1] = '\0';
+
+      if (!first)
+         putchar(',');
+      first = false;
+      json_string(key);
+      putchar(':');
+
+      strlcpy(num, val, sizeof(num));
+      if ((strip_units(num) || is_count_key(key)) && is_number(num))
+         printf("%.15g", strtod(num, NULL));
+      else
+         json_string(val);
+   }
+   fputs("}}", stdout);
+
+   return par == NULL || !first;
+}
+
+/*
+ * Ask one apcupsd for its status, on the connection left open by the
+ * last update if there is one. With a parameter name only that line is
+ * asked for, unless apcupsd does not know the "get" command.
+ */
+static bool fetch_status(NISHOST *h)
+{
+   static const char invalid[] = "Invalid command\n";
+   char recvline[MAXSTRING + 1];
+   char cmd[MAXSTRING];
+   bool get;
+   int n, len;
+
+   h->len = 0;
+   h->err[0] = '\0';
+   append_text(h, "", 0);
+
+   if (h->fd == INVALID_SOCKET) {
+      if ((h->fd = net_open(h->host, NULL, h->port)) < 0) {
+         asnprintf(h->err, sizeof(h->err), "Error contacting apcupsd @ %s: %s",
+            h->spec, strerror(-h->fd));
+         h->fd = INVALID_SOCKET;
+         return false;
+      }
+      net_reader_init(&h->reader, h->fd);
+   }
+
+again:
+   get = par && !h->noget;
+   len = get ? asnprintf(cmd, sizeof(cmd), "get %s", par) :
+               asnprintf(cmd, sizeof(cmd), "status");
+   if ((n = net_send(h->fd, cmd, len)) == len) {
+      while ((n = net_recv_buffered(&h->reader, recvline,
+                                    sizeof(recvline) - 1)) > 0)
+         append_text(h, recvline, n);
+   }
 
-   if (n < 0) {
-      fprintf(stderr, "Error reading status from apcupsd @ %s:%d: %s\n",
-         host, port, strerror(-n));
-      net_close(sockfd);
+   if (get && n == 0 && strcmp(h->text, invalid) == 0) {
+      h->noget = true;
+      h->len = 0;
+      append_text(h, "", 0);
+      goto again;
+   }
+
+   /* The answer to "get" is empty if the UPS lacks the parameter */
+   if (n < 0 || (n == 0 && h->len == 0 && !get)) {
+      asnprintf(h->err, sizeof(h->err),
+         "Error reading status from apcupsd @ %s: %s", h->spec,
+         n < 0 ? strerror(-n) : "Connection closed");
+      net_close(h->fd);
+      h->fd = INVALID_SOCKET;
+      return false;
+   }
+
+   if (!watch) {
+      net_close(h->fd);
+      h->fd = INVALID_SOCKET;
+   }
+   return true;
+}
+
+/* Print one host as asked. Returns false if the parameter was missing. */
+static bool print_host(const NISHOST *h)
+{
+   if (format != FMT_TEXT)
+      return print_json(h);
+   if (h->err[0]) {
+      fprintf(stderr, "%s\n", h->err);
+      return true;
+   }
+   return print_text(h);
+}
+
+static void *fetch_thread(void *arg)
+{
+   fetch_status((NISHOST *)arg);
+   return NULL;
+}
+
+/* Keep printing updates from one host until killed */
+static void *watch_thread(void *arg)
+{
+   NISHOST *h = (NISHOST *)arg;
+
+   for (;;) {
+      fetch_status(h);
+      P(out_mutex);
+      print_host(h);
+      if (format != FMT_TEXT)
+         putchar('\n');
+      fflush(stdout);
+      V(out_mutex);
+      sleep(watch);
+   }
+   return NULL;
+}
+
+/*
+ * Get and print the status of every host. They are all asked at once,
+ * each from a thread of its own, and printed in the order given.
+ * Returns 1 if any could not be reached, 2 if a parameter asked for was
+ * missing, else 0.
+ */
+static int do_pthreads_status(NISHOST *hosts)
+{
+   bool missing = false, failed = false;
+   int i;
+
+   if (nhosts == 1 && !watch) {
+      fetch_status(&hosts[0]);
+   } else {
+      for (i = 0; i < nhosts; i++) {
+         if (pthread_create(&hosts[i].tid, NULL,
+                watch ? watch_thread : fetch_thread, &hosts[i]) != 0) {
+            fprintf(stderr, "Cannot start thread: %s\n", strerror(errno));
+            return 1;
+         }
+      }
+      for (i = 0; i < nhosts; i++)
+         pthread_join(hosts[i].tid, NULL);
+   }
+
+   if (format == FMT_JSON && nhosts > 1)
+      putchar('[');
+   for (i = 0; i < nhosts; i++) {
+      if (format == FMT_JSON && i > 0)
+         putchar(',');
+      if (!print_host(&hosts[i]))
+         missing = true;
+      if (hosts[i].err[0])
+         failed = true;
+      if (format == FMT_NDJSON)
+         putchar('\n');
+   }
+   if (format == FMT_JSON)
+      fputs(nhosts > 1 ? "]\n" : "\n", stdout);
+
+   return failed ? 1 : missing ? 2 : 0;
+}
+
+/*
+ * Status from the shared memory segment of a local apcupsd, formatted
+ * by the same code the NIS server uses. output_status() hands over
+ * one line at a time through these callbacks.
+ */
+static void shm_status_open(UPSINFO *ups)
+{
+}
+
+static NISHOST *shm_host;
+
+static void shm_status_write(UPSINFO *ups, const char *fmt, ...)
+{
+   char line[MAXSTRING + 1];
+   va_list arg_ptr;
+   int len;
+
+   va_start(arg_ptr, fmt);
+   len = avsnprintf(line, sizeof(line), fmt, arg_ptr);
+   va_end(arg_ptr);
+
+   append_text(shm_host, line, len);
+}
+
+static int shm_status_close(UPSINFO *ups, int fd)
+{
+   return 0;
+}
+
+static int do_shm_status(const char *name)
+{
+   const APCSHM *shm;
+   APCSHMDATA data;
+   UPSINFO *ups;
+   NISHOST host;
+   bool found;
+
+   if ((shm = shm_attach(name)) == NULL) {
+      fprintf(stderr, "Error attaching to apcupsd shared memory %s: %s\n",
+         name, errno == EPROTO ? "Not a known status layout" : strerror(errno));
+      return 1;
+   }
+
+   if (!shm_snapshot(shm, &data)) {
+      fprintf(stderr, "Error reading apcupsd shared memory %s: "
+         "update never completed\n", name);
+      shm_detach(shm);
       return 1;
    }
+   shm_detach(shm);
 
-   net_close(sockfd);
-   return par ? 2 : 0;
+   ups = new_ups();
+   init_ups_struct(ups);
+   shm_to_ups(&data, ups);
+
+   memset(&host, 0, sizeof(host));
+   strlcpy(host.spec, name, sizeof(host.spec));
+   shm_host = &host;
+   append_text(&host, "", 0);
+   output_status(ups, 0, shm_status_open, shm_status_write, shm_status_close);
+   detach_ups(ups);
+
+   found = print_host(&host);
+   if (format != FMT_TEXT)
+      putchar('\n');
+   free(host.text);
+
+   return found ? 0 : 2;
 }
 
 /*********************************************************************/
@@ -118,34 +500,85 @@ static int do_pthreads_status(const char *host, int port, const char *par, int f
 void usage()
 {
    fprintf(stderr, 
-      "Usage: apcaccess [-f <config-file>] [-h <host>[:<port>]] "
-                       "[-p <parameter-name>] [-u] [<command>] [<host>[:<port>]]\n"
+      "Usage: apcaccess [-f <config-file>] [-h <host>[:<port>]]... "
+                       "[-p <parameter-name>] [-u]\n"
+      "                 [--json | --ndjson] [-w[<secs>]] [--shm[=<name>]]\n"
+      "                 [<command>] [<host>[:<port>]...]\n"
       "\n"
       " -f  Load default host,port from given conf file (default: %s)\n"
-      " -h  Connect to host and port (supercedes conf file)\n"
+      " -h  Connect to host and port (supercedes conf file); may be repeated.\n"
+      "     An IPv6 address goes in brackets if a port is given; a path is\n"
+      "     taken as the Unix domain socket of apcupsd\n"
       " -p  Return only the value of the named parameter rather than all parameters and values\n"
       " -u  Strip unit labels\n"
+      " -j, --json    Print the status as JSON, numbers without their units\n"
+      " -n, --ndjson  Print the status of each host as one line of JSON\n"
+      " -w, --watch[=<secs>]  Keep printing updates every <secs> seconds (default %d)\n"
+      " -s, --shm  Read the status from shared memory rather than over the network\n"
+      "            (default name: STATUSSHM from the conf file)\n"
       "\n"
       "Supported commands: 'status' (default)\n"
-      "Trailing host/port spec overrides -h and conf file.\n"
-      , APCCONF);
+      "Trailing host/port specs override -h and conf file.\n"
+      "Several hosts are asked at once.\n"
+      , APCCONF, WATCH_DEFAULT);
+}
+
+/*
+ * Fill in a host from host[:port], [ipv6addr][:port] or a socket path,
+ * the port defaulting to the given one
+ */
+static void parse_host(NISHOST *h, const char *spec, int port)
+{
+   char first[MAXSTRING];
+
+   memset(h, 0, sizeof(*h));
+   h->fd = INVALID_SOCKET;
+   h->port = port;
+
+   // NISIP in apcupsd.conf may list several addresses, the first will do
+   strlcpy(first, spec, sizeof(first));
+   first[strcspn(first, " \t,")] = '\0';
+   net_split_host(first, h->host, sizeof(h->host), &h->port);
+
+   // Translate host of 0.0.0.0 to localhost
+   // This is due to NISIP in apcupsd.conf being 0.0.0.0 for listening on all
+   // interfaces. In that case just use loopback.
+   if (!*h->host || !strcmp(h->host, "0.0.0.0") || !strcmp(h->host, "::"))
+      strlcpy(h->host, "localhost", sizeof(h->host));
+
+   if (h->host[0] == '/')
+      strlcpy(h->spec, h->host, sizeof(h->spec));
+   else if (strchr(h->host, ':'))
+      asnprintf(h->spec, sizeof(h->spec), "[%s]:%d", h->host, h->port);
+   else
+      asnprintf(h->spec, sizeof(h->spec), "%s:%d", h->host, h->port);
 }
 
 int main(int argc, char **argv)
 {
-   const char *par = NULL;
    char *cfgfile = NULL;
-   char DEFAULT_HOST[] = "localhost";
-   char *host = NULL;
+   const char **specs = NULL;
+   int nspecs = 0;
    const char *cmd = "status";
    int port = NISPORT;
-   int flags = 0;
    FILE *cfg;
    UPSINFO ups;
+   bool use_shm = false;
+   const char *shmname = NULL;
+   NISHOST *hosts;
+   int i, rc;
+
+   static const struct option longopts[] = {
+      {"json", no_argument, NULL, 'j'},
+      {"ndjson", no_argument, NULL, 'n'},
+      {"watch", optional_argument, NULL, 'w'},
+      {"shm", optional_argument, NULL, 's'},
+      {NULL, 0, NULL, 0}
+   };
 
    // Process standard options
    int ch;
-   while ((ch = getopt(argc, argv, "f:h:p:u")) != -1)
+   while ((ch = getopt_long(argc, argv, "f:h:p:ujnw::s", longopts, NULL)) != -1)
    {
       switch (ch)
       {
@@ -153,13 +586,31 @@ int main(int argc, char **argv)
          cfgfile = optarg;
          break;
       case 'h':
-         host = optarg;
+         specs = (const char **)realloc(specs, (nspecs + 1) * sizeof(*specs));
+         specs[nspecs++] = optarg;
          break;
       case 'p':
          par = optarg;
          break;
       case 'u':
-         flags |= NO_UNITS;
+         outflags |= NO_UNITS;
+         break;
+      case 'j':
+         format = FMT_JSON;
+         break;
+      case 'n':
+         format = FMT_NDJSON;
+         break;
+      case 'w':
+         watch = optarg ? atoi(optarg) : WATCH_DEFAULT;
+         if (watch <= 0) {
+            usage();
+            return 1;
+         }
+         break;
+      case 's':
+         use_shm = true;
+         shmname = optarg;
          break;
       case '?':
       default:
@@ -182,8 +633,12 @@ int main(int argc, char **argv)
       init_ups_struct(&ups);
       check_for_config(&ups, cfgfile);
       port = ups.statusport;
-      if (!host) // Don't override command line -h
-         host = ups.nisip;
+      if (!nspecs) { // Don't override command line -h
+         specs = (const char **)malloc(sizeof(*specs));
+         specs[nspecs++] = ups.nisip;
+      }
+      if (!shmname && ups.shmname[0])
+         shmname = ups.shmname;
    }
    else if (fatal)
    {
@@ -198,29 +653,48 @@ int main(int argc, char **argv)
    int optleft = argc - optind;
    if (optleft >= 1)
       cmd = argv[optind];
-   if (optleft >= 2)
-      host = argv[optind + 1];
+   if (optleft >= 2) {
+      nspecs = 0;
+      specs = (const char **)realloc(specs, (optleft - 1) * sizeof(*specs));
+      for (i = optind + 1; i < argc; i++)
+         specs[nspecs++] = argv[i];
+   }
 
    // If still no host, use default
-   if (!host || !*host)
-      host = DEFAULT_HOST;
-
-   // Separate host and port
-   char *p = strchr(host, ':');
-   if (p) {
-      *p++ = 0;
-      port = atoi(p);
+   if (!nspecs) {
+      specs = (const char **)malloc(sizeof(*specs));
+      specs[nspecs++] = "localhost";
    }
 
-   // Translate host of 0.0.0.0 to localhost
-   // This is due to NISIP in apcupsd.conf being 0.0.0.0 for listening on all
-   // interfaces. In that case just use loopback.
-   if (!strcmp(host, "0.0.0.0"))
-      host = DEFAULT_HOST;
+   // A stream of updates cannot be one JSON document
+   if (watch && format == FMT_JSON)
+      format = FMT_NDJSON;
 
-   if (!strcmp(cmd, "status"))
+   if (use_shm)
+   {
+      if (strcmp(cmd, "status")) {
+         fprintf(stderr, "Only status is available from shared memory\n");
+         return 1;
+      }
+      if (!shmname) {
+         fprintf(stderr, "No shared memory name given and STATUSSHM "
+            "not set in %s\n", cfgfile);
+         return 1;
+      }
+      return do_shm_status(shmname);
+   }
+   else if (!strcmp(cmd, "status"))
    {
-      return do_pthreads_status(host, port, par, flags);
+      nhosts = nspecs;
+      hosts = (NISHOST *)calloc(nhosts, sizeof(*hosts));
+      for (i = 0; i < nhosts; i++)
+         parse_host(&hosts[i], specs[i], port);
+      rc = do_pthreads_status(hosts);
+      for (i = 0; i < nhosts; i++)
+         free(hosts[i].text);
+      free(hosts);
+      free(specs);
+      return rc;
    }
    else
    {
@@ -142,6 +142,9 @@ class StatMgr;
    // C++ object which handles polling the UPS
    StatMgr *statmgr;
 
+   // StatMgr generation of the status in the status window
+   unsigned int statusGen;
+
    // If system support Notification Center (10.8 and above)
    BOOL haveNotifCtr;
 
@@ -84,6 +84,7 @@
    prevPort = [config port];
    prevRefresh = [config refresh];
    statmgr = NULL;
+   statusGen = 0;
    lastStatus = [@"" retain];
 
    // Create timer object used by the thread
@@ -186,11 +187,15 @@
       [statusWindow setTitle:
          [NSString stringWithFormat:@"Status for UPS: %s",upsname.str()]];
 
-      // Update raw status table
-      alist<astring> keys, values;
-      statmgr->GetAll(keys, values);
-      [statusDataSource populate:keys values:values];
-      [statusGrid reloadData];
+      // Update raw status table, unless it has not changed
+      if (statmgr->Generation() != statusGen)
+      {
+         statusGen = statmgr->Generation();
+         alist<astring> keys, values;
+         statmgr->GetAll(keys, values);
+         [statusDataSource populate:keys values:values];
+         [statusGrid reloadData];
+      }
 
       // Update status text
       [statusText setStringValue:[NSString stringWithUTF8String:statstr]];
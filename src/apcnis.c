@@ -24,6 +24,11 @@
 
 #include "apc.h"
 
+#ifndef HAVE_MINGW
+# include <grp.h>
+# include <pwd.h>
+#endif
+
 #ifdef HAVE_NISSERVER
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -119,101 +124,67 @@ static void status_write(UPSINFO *ups, const char *fmt, ...)
 }
 
 
-void do_server(UPSINFO *ups)
+/* Leaves the status in largebuf, and the mutex held, for output_get() */
+static int get_close(UPSINFO *ups, int nsockfd)
 {
-   int newsockfd, sockfd;
-   struct sockaddr_in cli_addr;    /* client's address */
-   struct sockaddr_in serv_addr;   /* our address */
-   int tlog;
-   struct s_arg *arg;
-   struct in_addr local_ip;
-#ifndef HAVE_MINGW
-   int turnon = 1;
-#endif
+   return 0;
+}
 
-   for (tlog = 0; (ups = attach_ups(ups)) == NULL; tlog -= 5 * 60) {
-      if (tlog <= 0) {
-         tlog = 60 * 60;
-         log_event(ups, LOG_ERR, "apcserver: Cannot attach SYSV IPC.\n");
-      }
-      sleep(5 * 60);
-   }
+/*
+ * Send the status lines of the keys asked for, separated by spaces in
+ * keys, in the order asked and all in one message. Keys the UPS does
+ * not report are left out.
+ *
+ * Returns -1 on error or EOF
+ *          0 OK
+ */
+static int output_get(UPSINFO *ups, int nsockfd, char *keys)
+{
+   char reply[sizeof(largebuf)];
+   const char *line, *colon, *eol;
+   char *key, *save;
+   size_t len, klen, rlen = 0;
 
-   local_ip.s_addr = INADDR_ANY;
+   output_status(ups, nsockfd, status_open, status_write, get_close);
 
-   if (ups->nisip[0]) {
-      if (inet_pton(AF_INET, ups->nisip, &local_ip) != 1) {
-         log_event(ups, LOG_WARNING, "Invalid NISIP specified: '%s'", ups->nisip);
-         local_ip.s_addr = INADDR_ANY;
-      }
-   }
+   for (key = strtok_r(keys, " \t", &save); key != NULL;
+        key = strtok_r(NULL, " \t", &save)) {
+      klen = strlen(key);
+      for (line = largebuf; *line; line = eol) {
+         eol = line + strcspn(line, "\n");
+         if (*eol)
+            eol++;
+         if ((colon = (const char *)memchr(line, ':', eol - line)) == NULL)
+            continue;
+         for (len = colon - line; len > 0 && line[len - 1] == ' '; len--)
+            ;
+         if (len != klen || strncasecmp(line, key, klen) != 0)
+            continue;
 
-   /* Open a TCP socket */
-   for (tlog = 0; (sockfd = socket_cloexec(AF_INET, SOCK_STREAM, 0)) < 0; tlog -= 5 * 60) {
-      if (tlog <= 0) {
-         tlog = 60 * 60;
-         log_event(ups, LOG_ERR, "apcserver: cannot open stream socket");
+         len = MIN((size_t)(eol - line), sizeof(reply) - rlen);
+         memcpy(reply + rlen, line, len);
+         rlen += len;
+         break;
       }
-      sleep(5 * 60);
    }
 
-   /* Reuse old sockets */
-#ifndef HAVE_MINGW
-   if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (void*)&turnon, sizeof(turnon)) < 0) {
-      log_event(ups, LOG_WARNING, "Cannot set SO_REUSEADDR on socket: %s\n",
-         strerror(errno));
-   }
-#endif
-   
-   /* Bind our local address so that the client can send to us. */
-   memset((char *)&serv_addr, 0, sizeof(serv_addr));
-   serv_addr.sin_family = AF_INET;
-   serv_addr.sin_addr = local_ip;
-   serv_addr.sin_port = htons(ups->statusport);
-
-   for (tlog = 0; bind(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0;
-      tlog -= 5 * 60) {
-      if (tlog <= 0) {
-         tlog = 60 * 60;
-         log_event(ups, LOG_ERR, "apcserver: cannot bind port %d. ERR=%s",
-            ups->statusport, strerror(errno));
-      }
-      sleep(5 * 60);
-   }
-   listen(sockfd, 5);              /* tell system we are ready */
-
-   log_event(ups, LOG_INFO, "NIS server startup succeeded");
-
-   for (;;) {
-      /* Wait for a connection from a client process. */
-      for (tlog = 0; (newsockfd = net_accept(sockfd, &cli_addr)) < 0; tlog -= 5 * 60) {
-         if (tlog <= 0) {
-            tlog = 60 * 60;
-            log_event(ups, LOG_ERR, "apcserver: accept error. ERR=%s",
-               strerror(errno));
-         }
-         sleep(5 * 60);
-      }
-
-#ifdef HAVE_LIBWRAP
-      /*
-       * This function checks the incoming client and if it's not
-       * allowed closes the connection.
-       */
-      if (check_wrappers(argvalue, newsockfd) == FAILURE) {
-         net_close(newsockfd);
-         continue;
-      }
-#endif
+   V(mutex);
 
-      arg = (struct s_arg *)malloc(sizeof(struct s_arg));
-      arg->newsockfd = newsockfd;
-      arg->ups = ups;
+   if (rlen > 0 && net_send(nsockfd, reply, rlen) <= 0)
+      return -1;
+   return net_send(nsockfd, NULL, 0) < 0 ? -1 : 0;
+}
 
-      pthread_t tid;
-      pthread_create(&tid, NULL, handle_client_request, arg);
+/* Find a UPS run by this daemon by its UPSNAME */
+static UPSINFO *find_ups(UPSINFO *head, const char *name)
+{
+   UPSINFO *ups;
 
+   for (ups = head; ups; ups = ups->next_ups) {
+      if (strcasecmp(ups->upsname, name) == 0)
+         return ups;
    }
+   return NULL;
 }
 
 /* 
@@ -231,24 +202,36 @@ void *handle_client_request(void *arg)
    const char errmsg[] = "Invalid command\n";
    const char notavail[] = "Not available\n";
    const char notrun[] = "Apcupsd internal error\n";
+   const char unknown[] = "Unknown UPS\n";
+   const char ok[] = "OK\n";
    int nsockfd = ((struct s_arg *)arg)->newsockfd;
-   UPSINFO *ups = ((struct s_arg *)arg)->ups;
+   UPSINFO *head = ((struct s_arg *)arg)->ups;
+   UPSINFO *ups, *sel;
+   long long start;
+   NETREADER reader;
+   int framing = 1;
    int fd;
    free(arg);
 
    pthread_detach(pthread_self());
 
-   if ((ups = attach_ups(ups)) == NULL) {
+   /* Commands apply to the main UPS until the client selects another */
+   if ((ups = attach_ups(head)) == NULL) {
       net_send(nsockfd, notrun, sizeof(notrun));
       net_send(nsockfd, NULL, 0);
       net_close(nsockfd);
       return NULL;
    }
 
+   net_reader_init(&reader, nsockfd);
    for (;;) {
       /* Read command */
-      if ((len = net_recv(nsockfd, line, sizeof(line))) <= 0)
+      if ((len = net_recv_buffered(&reader, line, sizeof(line) - 1)) <= 0)
          break;                    /* connection terminated */
+      start = mono_nsec();
+
+      /* Each answer goes out in one piece when it is complete */
+      net_batch_begin(nsockfd, framing);
 
       if (len == 6 && strncmp("status", line, 6) == 0) {
          if (output_status(ups, nsockfd, status_open, status_write,
@@ -272,19 +255,756 @@ void *handle_client_request(void *arg)
                break;
             }
          }
+      } else if (len > 4 && strncmp("get ", line, 4) == 0) {
+         line[len] = 0;
+         if (output_get(ups, nsockfd, line + 4) < 0)
+            break;
+      } else if (len > 13 && strncmp("events since ", line, 13) == 0) {
+         line[len] = 0;
+         if (ups->events == NULL) {
+            net_send(nsockfd, notavail, sizeof(notavail));
+            if (net_send(nsockfd, NULL, 0) < 0)
+               break;
+         } else if (output_events_since(ups, nsockfd,
+                       strtoull(line + 13, NULL, 10)) < 0) {
+            break;
+         }
+      } else if (len == 9 && strncmp("execstats", line, 9) == 0) {
+         if (output_exec_stats(nsockfd) < 0)
+            break;
+      } else if (len == 7 && strncmp("latency", line, 7) == 0) {
+         LATHIST hist;
+
+         read_lock(ups);
+         hist = ups->event_latency;
+         read_unlock(ups);
+         if (output_lathist_header(nsockfd) < 0 ||
+             output_lathist(nsockfd, "EVENT", &hist) < 0 ||
+             net_send(nsockfd, NULL, 0) < 0)
+            break;
+      } else if (len == 5 && strncmp("stats", line, 5) == 0) {
+         if (output_selfstats(ups, nsockfd) < 0)
+            break;
+      } else if (len >= 7 && strncmp("history", line, 7) == 0 &&
+                 (len == 7 || line[7] == ' ')) {
+         long start = -24 * 60 * 60, end = 0;
+         int tier = -1;
+
+         line[len] = 0;
+         sscanf(line + 7, "%ld %ld %d", &start, &end, &tier);
+         if (output_history(ups, nsockfd, start, end, tier) < 0)
+            break;
+      } else if (len == 7 && strncmp("upslist", line, 7) == 0) {
+         for (sel = head; sel; sel = sel->next_ups) {
+            asnprintf(line, sizeof(line), "%s\n", sel->upsname);
+            if (net_send(nsockfd, line, strlen(line)) < 0)
+               break;
+         }
+         if (sel || net_send(nsockfd, NULL, 0) < 0)
+            break;
+      } else if (len > 4 && strncmp("ups ", line, 4) == 0) {
+         line[len] = 0;
+         if ((sel = find_ups(head, line + 4)) != NULL &&
+             (sel = attach_ups(sel)) != NULL) {
+            detach_ups(ups);
+            ups = sel;
+            net_send(nsockfd, ok, sizeof(ok));
+         } else {
+            net_send(nsockfd, unknown, sizeof(unknown));
+         }
+         if (net_send(nsockfd, NULL, 0) < 0)
+            break;
+      } else if (len == 9 && strncmp("framing ", line, 8) == 0 &&
+                 (line[8] == '1' || line[8] == '2')) {
+         /* The answer still goes out as before, what follows does not */
+         net_send(nsockfd, ok, sizeof(ok));
+         if (net_send(nsockfd, NULL, 0) < 0)
+            break;
+         framing = line[8] - '0';
       } else {
          net_send(nsockfd, errmsg, sizeof(errmsg));
          if (net_send(nsockfd, NULL, 0) < 0)
             break;
       }
+      if (net_batch_end() < 0)
+         break;
+
+      /* Time to answer, charged to the UPS the command ended up with */
+      stats_nis_request(ups, (mono_nsec() - start) / 1000);
    }
 
+   net_batch_end();
    net_close(nsockfd);
 
    detach_ups(ups);
    return NULL;
 }
 
+/*
+ * Just enough HTTP for a Prometheus scraper: one GET per connection,
+ * answered with Connection: close. The whole request, reading it and
+ * sending the reply, has to be over within HTTP_TIMEOUT of the accept.
+ */
+#define HTTP_TIMEOUT 5             /* seconds a client may take */
+
+/*
+ * Bound the next receive or send by what is left until deadline, a
+ * mono_msec() time. Returns false once the deadline has passed.
+ */
+static bool http_time_left(int sockfd, long long deadline)
+{
+   long long left = deadline - mono_msec();
+
+   if (left <= 0)
+      return false;
+
+#ifndef HAVE_MINGW
+   struct timeval tv;
+
+   tv.tv_sec = left / 1000;
+   tv.tv_usec = (left % 1000) * 1000;
+   setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+   setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv));
+#endif
+   return true;
+}
+
+static int http_send(int sockfd, const char *buf, size_t len,
+                     long long deadline)
+{
+   ssize_t n;
+
+   while (len > 0) {
+      if (!http_time_left(sockfd, deadline))
+         return -1;
+      n = send(sockfd, buf, len, 0);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return -1;
+      buf += n;
+      len -= n;
+   }
+   return 0;
+}
+
+static void http_reply(int sockfd, const char *status, const char *type,
+                       const char *body, size_t len, long long deadline)
+{
+   char hdr[256];
+   int n;
+
+   n = asnprintf(hdr, sizeof(hdr),
+      "HTTP/1.0 %s\r\n"
+      "Content-Type: %s\r\n"
+      "Content-Length: %lu\r\n"
+      "Connection: close\r\n\r\n", status, type, (unsigned long)len);
+   if (http_send(sockfd, hdr, n, deadline) == 0 && len > 0)
+      http_send(sockfd, body, len, deadline);
+}
+
+static void http_request(UPSINFO *head, int sockfd, long long deadline)
+{
+   static const char notfound[] = "Not found\n";
+   static const char badmethod[] = "Only GET is supported\n";
+   char req[1024];
+   size_t len = 0;
+   ssize_t n;
+   char *doc, *path, *end;
+
+   /* Read up to the end of the headers; the request line is all we use */
+   while (len < sizeof(req) - 1) {
+      if (!http_time_left(sockfd, deadline))
+         return;
+      n = recv(sockfd, req + len, sizeof(req) - 1 - len, 0);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return;
+      len += n;
+      req[len] = 0;
+      if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+         break;
+   }
+   req[len] = 0;
+
+   if (strncmp(req, "GET ", 4) != 0) {
+      http_reply(sockfd, "405 Method Not Allowed", "text/plain",
+         badmethod, sizeof(badmethod) - 1, deadline);
+      return;
+   }
+
+   path = req + 4;
+   if ((end = strpbrk(path, " ?\r\n")) != NULL)
+      *end = 0;
+
+   if (strcmp(path, "/metrics") != 0) {
+      http_reply(sockfd, "404 Not Found", "text/plain",
+         notfound, sizeof(notfound) - 1, deadline);
+      return;
+   }
+
+   doc = metrics_document(head, &len);
+   http_reply(sockfd, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+      doc, len, deadline);
+   free(doc);
+}
+
+/*
+ * The NIS and metrics servers listen on each address in NISIP: an IPv4
+ * or IPv6 address, the latter optionally in brackets, or the path of a
+ * Unix domain socket. Each address has its own sockets and threads
+ * accepting on them; with NISACCEPTORS above 1 a TCP address is bound
+ * that many times with SO_REUSEPORT, and the kernel spreads the new
+ * connections over the sockets.
+ */
+#define NIS_MAXLISTEN  8           /* addresses in NISIP */
+#define NIS_MAXSHARDS  16          /* sockets per address */
+#define NIS_RETRY      (5 * 60)    /* seconds between tries of an address */
+
+#ifdef SO_PEERCRED
+# define NIS_UNIX_MODE 0666        /* who may connect is checked instead */
+#else
+# define NIS_UNIX_MODE 0660
+#endif
+
+typedef struct nisservice NISSERVICE;
+
+/* One address being listened on */
+typedef struct {
+   const NISSERVICE *svc;
+   UPSINFO *ups;
+   char spec[MAXSTRING];           /* as in NISIP */
+   int port;                       /* default port it was opened with */
+   int shards;                     /* sockets, each with a thread */
+   sock_t fd[NIS_MAXSHARDS];
+   pthread_t tid[NIS_MAXSHARDS];
+   int stop;                       /* tells the threads to return */
+   bool up;
+   time_t retry;                   /* when to try again if not up */
+   time_t logged;                  /* last failure logged */
+} NISLISTENER;
+
+struct nisservice {
+   const char *name;               /* for the log */
+   const char *tag;                /* ... of errors */
+   bool tcponly;                   /* no Unix domain sockets */
+   bool reload;                    /* follows configuration reloads */
+   void (*config)(UPSINFO *ups, char *addrs, size_t size, int *port,
+                  int *shards);
+   void (*serve)(UPSINFO *ups, sock_t fd);
+};
+
+struct s_acceptor {
+   NISLISTENER *l;
+   int shard;
+};
+
+/* Name an address and port for the log */
+static void nis_describe(const char *spec, int port, char *buf, size_t size)
+{
+   char host[MAXSTRING];
+   int unused;
+
+   net_split_host(spec, host, sizeof(host), &unused);
+   if (host[0] == '/')
+      strlcpy(buf, host, size);
+   else if (strchr(host, ':'))
+      asnprintf(buf, size, "[%s]:%d", host, port);
+   else
+      asnprintf(buf, size, "%s:%d", host[0] ? host : "0.0.0.0", port);
+}
+
+#ifndef HAVE_MINGW
+
+/*
+ * Open a Unix domain socket listening at path. A socket left there by
+ * an apcupsd that is gone is replaced; one still answering is not.
+ */
+static int nis_listen_unix(UPSINFO *ups, const char *tag, const char *path,
+                           bool verbose)
+{
+   struct sockaddr_un addr;
+   struct stat st;
+   int sockfd, probe;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      if (verbose)
+         log_event(ups, LOG_ERR, "%s: socket path too long: %s", tag, path);
+      return -1;
+   }
+   strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+   if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+      if ((probe = net_open(path, NULL, 0)) >= 0) {
+         net_close(probe);
+         if (verbose)
+            log_event(ups, LOG_ERR, "%s: %s is in use", tag, path);
+         return -1;
+      }
+      unlink(path);
+   }
+
+   if ((sockfd = socket_cloexec(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      if (verbose)
+         log_event(ups, LOG_ERR, "%s: cannot open stream socket", tag);
+      return -1;
+   }
+
+   if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      if (verbose) {
+         log_event(ups, LOG_ERR, "%s: cannot bind %s. ERR=%s", tag, path,
+            strerror(errno));
+      }
+      net_close(sockfd);
+      return -1;
+   }
+   chmod(path, NIS_UNIX_MODE);
+   listen(sockfd, 5);
+
+   return sockfd;
+}
+
+/*
+ * Whether the peer on a Unix domain socket may connect: root, the user
+ * apcupsd runs as, and members of NISGROUP are let in.
+ */
+static bool nis_peer_allowed(UPSINFO *ups, const char *tag, sock_t fd)
+{
+#ifdef SO_PEERCRED
+   struct ucred cred;
+   socklen_t len = sizeof(cred);
+   char group[sizeof(ups->nisgroup)];
+   struct group gr, *grp = NULL;
+   struct passwd pw, *pwp = NULL;
+   char buf[8192], pwbuf[4096];
+   char **mem;
+
+   if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+      log_event(ups, LOG_WARNING, "%s: cannot get peer credentials. ERR=%s",
+         tag, strerror(errno));
+      return false;
+   }
+   if (cred.uid == 0 || cred.uid == geteuid())
+      return true;
+
+   read_lock(ups);
+   strlcpy(group, ups->nisgroup, sizeof(group));
+   read_unlock(ups);
+
+   if (group[0] && getgrnam_r(group, &gr, buf, sizeof(buf), &grp) == 0 &&
+       grp != NULL) {
+      if (grp->gr_gid == cred.gid)
+         return true;
+      if (getpwuid_r(cred.uid, &pw, pwbuf, sizeof(pwbuf), &pwp) == 0 &&
+          pwp != NULL) {
+         for (mem = grp->gr_mem; *mem; mem++) {
+            if (strcmp(*mem, pwp->pw_name) == 0)
+               return true;
+         }
+      }
+   }
+
+   log_event(ups, LOG_WARNING, "%s: connection from uid %u refused",
+      tag, (unsigned int)cred.uid);
+   return false;
+#else
+   return true;                    /* left to the mode of the socket */
+#endif
+}
+
+#endif   /* HAVE_MINGW */
+
+/*
+ * Open a listening socket on one address of NISIP. Returns the socket
+ * or -1, with the problem logged if verbose is set.
+ */
+static int nis_listen(UPSINFO *ups, const char *tag, const char *spec,
+                      int port, bool reuseport, bool verbose)
+{
+   struct addrinfo hints, *res;
+   char host[MAXSTRING], portstr[16];
+   int sockfd, unused;
+#ifndef HAVE_MINGW
+   int turnon = 1;
+#endif
+
+#ifndef HAVE_MINGW
+   if (spec[0] == '/')
+      return nis_listen_unix(ups, tag, spec, verbose);
+#endif
+
+   /* The port is the service's, a bracketed IPv6 address is accepted */
+   net_split_host(spec, host, sizeof(host), &unused);
+   asnprintf(portstr, sizeof(portstr), "%d", port);
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+   if (getaddrinfo(host[0] ? host : "0.0.0.0", portstr, &hints, &res) != 0) {
+      /* As ever, an address that makes no sense means all of them */
+      if (verbose) {
+         log_event(ups, LOG_WARNING,
+            "Invalid NISIP specified: '%s', listening on all addresses", spec);
+      }
+      if (getaddrinfo("0.0.0.0", portstr, &hints, &res) != 0)
+         return -1;
+   }
+
+   /* Open a TCP socket */
+   if ((sockfd = socket_cloexec(res->ai_family, SOCK_STREAM, 0)) < 0) {
+      if (verbose)
+         log_event(ups, LOG_ERR, "%s: cannot open stream socket", tag);
+      freeaddrinfo(res);
+      return -1;
+   }
+
+#ifndef HAVE_MINGW
+   /* Reuse old sockets */
+   if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (void*)&turnon, sizeof(turnon)) < 0) {
+      log_event(ups, LOG_WARNING, "Cannot set SO_REUSEADDR on socket: %s\n",
+         strerror(errno));
+   }
+
+# ifdef SO_REUSEPORT
+   /* Share the address with the other sockets of the same listener */
+   if (reuseport &&
+       setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*)&turnon, sizeof(turnon)) < 0) {
+      log_event(ups, LOG_WARNING, "Cannot set SO_REUSEPORT on socket: %s\n",
+         strerror(errno));
+   }
+# endif
+
+   /* "::" takes IPv4 connections as well, a given IPv6 address does not */
+   if (res->ai_family == AF_INET6) {
+      int v6only = !IN6_IS_ADDR_UNSPECIFIED(
+         &((struct sockaddr_in6 *)res->ai_addr)->sin6_addr);
+
+      setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, (void*)&v6only,
+         sizeof(v6only));
+   }
+#endif
+
+   /* Bind our local address so that the client can send to us. */
+   if (bind(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
+      if (verbose) {
+         log_event(ups, LOG_ERR, "%s: cannot bind port %d. ERR=%s",
+            tag, port, strerror(errno));
+      }
+      net_close(sockfd);
+      freeaddrinfo(res);
+      return -1;
+   }
+   freeaddrinfo(res);
+   listen(sockfd, 5);              /* tell system we are ready */
+
+   return sockfd;
+}
+
+/* Accept connections on one socket of a listener until it is stopped */
+static void *nis_acceptor(void *arg)
+{
+   NISLISTENER *l = ((struct s_acceptor *)arg)->l;
+   sock_t sockfd = l->fd[((struct s_acceptor *)arg)->shard];
+   struct sockaddr_storage cli_addr;    /* client's address */
+   struct timeval tv;
+   fd_set rfds;
+   int newsockfd;
+   int tlog = 0;
+
+   free(arg);
+
+   while (!__atomic_load_n(&l->stop, __ATOMIC_ACQUIRE)) {
+      /* Wake up now and then to see whether we are to stop */
+      FD_ZERO(&rfds);
+      FD_SET(sockfd, &rfds);
+      tv.tv_sec = 5;
+      tv.tv_usec = 0;
+      if (select(sockfd + 1, &rfds, NULL, NULL, &tv) <= 0)
+         continue;
+
+      /* Log the first failure, then once an hour while it goes on */
+      if ((newsockfd = net_accept(sockfd, &cli_addr)) < 0) {
+         if (tlog <= 0) {
+            tlog = 60 * 60;
+            log_event(l->ups, LOG_ERR, "%s: accept error. ERR=%s",
+               l->svc->tag, strerror(-newsockfd));
+         }
+         sleep(5);
+         tlog -= 5;
+         continue;
+      }
+
+#ifndef HAVE_MINGW
+      if (l->spec[0] == '/') {
+         if (!nis_peer_allowed(l->ups, l->svc->tag, newsockfd)) {
+            net_close(newsockfd);
+            continue;
+         }
+      } else
+#endif
+      {
+#ifdef HAVE_LIBWRAP
+         /*
+          * This function checks the incoming client and if it's not
+          * allowed closes the connection.
+          */
+         if (check_wrappers(argvalue, newsockfd) == FAILURE) {
+            net_close(newsockfd);
+            continue;
+         }
+#endif
+      }
+
+      l->svc->serve(l->ups, newsockfd);
+   }
+
+   return NULL;
+}
+
+/* Open the sockets of a listener and start accepting on them */
+static bool nis_start(NISLISTENER *l, bool verbose)
+{
+   struct s_acceptor *arg;
+   int i, n;
+
+   for (n = 0; n < l->shards; n++) {
+      l->fd[n] = nis_listen(l->ups, l->svc->tag, l->spec, l->port,
+         l->shards > 1, verbose);
+      if (l->fd[n] < 0)
+         break;
+   }
+   if (n < l->shards) {
+      for (i = 0; i < n; i++)
+         net_close(l->fd[i]);
+      return false;
+   }
+
+   l->stop = 0;
+   for (i = 0; i < n; i++) {
+      arg = (struct s_acceptor *)malloc(sizeof(struct s_acceptor));
+      arg->l = l;
+      arg->shard = i;
+      pthread_create(&l->tid[i], NULL, nis_acceptor, arg);
+   }
+   l->up = true;
+   return true;
+}
+
+/* Stop accepting and close the sockets, once the threads are done */
+static void nis_stop(NISLISTENER *l)
+{
+   int i;
+
+   if (!l->up)
+      return;
+
+   __atomic_store_n(&l->stop, 1, __ATOMIC_RELEASE);
+   for (i = 0; i < l->shards; i++) {
+      pthread_join(l->tid[i], NULL);
+      net_close(l->fd[i]);
+   }
+#ifndef HAVE_MINGW
+   if (l->spec[0] == '/')
+      unlink(l->spec);
+#endif
+   l->up = false;
+}
+
+/*
+ * Try to bring up a listener that is down, when it is due. The first
+ * failure is logged, then once an hour while retrying.
+ */
+static void nis_try(NISLISTENER *l, time_t now, bool quiet)
+{
+   char where[MAXSTRING];
+   bool verbose;
+
+   if (l->up || now < l->retry)
+      return;
+
+   verbose = !quiet && now - l->logged >= 60 * 60;
+   if (nis_start(l, verbose)) {
+      nis_describe(l->spec, l->port, where, sizeof(where));
+      log_event(l->ups, LOG_INFO, "%s listening on %s", l->svc->name, where);
+   } else if (!quiet) {
+      l->retry = now + NIS_RETRY;
+      if (verbose)
+         l->logged = now;
+   }
+}
+
+/*
+ * Keep the listeners of a service in line with its configuration,
+ * checked every few seconds if it follows reloads. A new address is
+ * tried before the ones it replaces are closed, so a mistake in NISIP
+ * leaves the server reachable where it was if the addresses clash.
+ */
+static void nis_run(UPSINFO *ups, const NISSERVICE *svc)
+{
+   NISLISTENER *ls[2 * NIS_MAXLISTEN];
+   NISLISTENER *l;
+   char addrs[sizeof(ups->nisip)];
+   char specs[NIS_MAXLISTEN][MAXSTRING];
+   bool keep[2 * NIS_MAXLISTEN];
+   bool configured = false;
+   const char *p;
+   int nls = 0, nspec, port, shards, i, j, len;
+   time_t now;
+
+   for (;;) {
+      if (!configured || svc->reload) {
+         svc->config(ups, addrs, sizeof(addrs), &port, &shards);
+         configured = true;
+
+#ifndef SO_REUSEPORT
+         shards = 1;
+#endif
+         shards = MAX(1, MIN(shards, NIS_MAXSHARDS));
+
+         /* The addresses wanted, all of them if none is given */
+         nspec = 0;
+         for (p = addrs; *(p += strspn(p, " \t,")); p += len) {
+            len = strcspn(p, " \t,");
+            if (p[0] == '/' && svc->tcponly)
+               continue;
+            if (nspec == NIS_MAXLISTEN) {
+               log_event(ups, LOG_WARNING, "%s: too many addresses in NISIP",
+                  svc->tag);
+               break;
+            }
+            strlcpy(specs[nspec++], p, MIN(MAXSTRING, len + 1));
+         }
+         if (nspec == 0)
+            specs[nspec++][0] = '\0';
+
+         /* Add those not listened on yet */
+         memset(keep, 0, sizeof(keep));
+         for (j = 0; j < nspec; j++) {
+            for (i = 0; i < nls; i++) {
+               if (strcmp(ls[i]->spec, specs[j]) == 0 && ls[i]->port == port &&
+                   (ls[i]->shards == shards || specs[j][0] == '/'))
+                  break;
+            }
+            keep[i] = true;
+            if (i < nls)
+               continue;
+
+            l = (NISLISTENER *)calloc(1, sizeof(NISLISTENER));
+            l->svc = svc;
+            l->ups = ups;
+            strlcpy(l->spec, specs[j], sizeof(l->spec));
+            l->port = port;
+            l->shards = specs[j][0] == '/' ? 1 : shards;
+            l->logged = -60 * 60;
+            ls[nls++] = l;
+            nis_try(l, time(NULL), true);
+         }
+
+         /* Then close those no longer wanted */
+         for (i = j = 0; i < nls; i++) {
+            if (keep[i]) {
+               ls[j++] = ls[i];
+            } else {
+               nis_stop(ls[i]);
+               free(ls[i]);
+            }
+         }
+         nls = j;
+      }
+
+      now = time(NULL);
+      for (i = 0; i < nls; i++)
+         nis_try(ls[i], now, false);
+
+      sleep(5);
+   }
+}
+
+static void nis_config(UPSINFO *ups, char *addrs, size_t size, int *port,
+                       int *shards)
+{
+   read_lock(ups);
+   strlcpy(addrs, ups->nisip, size);
+   *port = ups->statusport;
+   *shards = ups->nisacceptors;
+   read_unlock(ups);
+}
+
+/* Each client is served by a thread of its own */
+static void nis_serve(UPSINFO *ups, sock_t newsockfd)
+{
+   struct s_arg *arg;
+   pthread_t tid;
+
+   arg = (struct s_arg *)malloc(sizeof(struct s_arg));
+   arg->newsockfd = newsockfd;
+   arg->ups = ups;
+
+   pthread_create(&tid, NULL, handle_client_request, arg);
+}
+
+static const NISSERVICE nis_service = {
+   "NIS server", "apcserver", false, true, nis_config, nis_serve
+};
+
+void do_server(UPSINFO *ups)
+{
+   int tlog;
+
+   for (tlog = 0; (ups = attach_ups(ups)) == NULL; tlog -= 5 * 60) {
+      if (tlog <= 0) {
+         tlog = 60 * 60;
+         log_event(ups, LOG_ERR, "apcserver: Cannot attach SYSV IPC.\n");
+      }
+      sleep(5 * 60);
+   }
+
+   log_event(ups, LOG_INFO, "NIS server startup succeeded");
+
+   nis_run(ups, &nis_service);
+}
+
+static void metrics_config(UPSINFO *ups, char *addrs, size_t size, int *port,
+                           int *shards)
+{
+   read_lock(ups);
+   strlcpy(addrs, ups->nisip, size);
+   *port = ups->metricsport;
+   *shards = 1;
+   read_unlock(ups);
+}
+
+/* The document is already rendered, so a request is over as soon as sent */
+static void metrics_serve(UPSINFO *ups, sock_t newsockfd)
+{
+   /* A client that stalls or trickles must not hold up the next scrape */
+   http_request(ups, newsockfd, mono_msec() + HTTP_TIMEOUT * 1000LL);
+   net_close(newsockfd);
+}
+
+static const NISSERVICE metrics_service = {
+   "Metrics server", "apcmetrics", true, false, metrics_config, metrics_serve
+};
+
+/*
+ * Serve /metrics on METRICSPORT at the TCP addresses of NISIP. Requests
+ * are handled one at a time by the thread accepting them on each
+ * address.
+ */
+void do_metrics_server(UPSINFO *ups)
+{
+   if ((ups = attach_ups(ups)) == NULL) {
+      log_event(core_ups, LOG_ERR, "apcmetrics: Cannot attach SYSV IPC.\n");
+      return;
+   }
+
+   nis_run(ups, &metrics_service);
+}
+
 #else   /* HAVE_NISSERVER */
 
 void do_server(UPSINFO *ups)
@@ -293,6 +1013,11 @@ void do_server(UPSINFO *ups)
    exit(1);
 }
 
+void do_metrics_server(UPSINFO *ups)
+{
+   log_event(ups, LOG_ERR, "apcmetrics: code not enabled in config.\n");
+}
+
 #endif   /* HAVE_NISSERVER */
 
 
@@ -214,7 +214,7 @@ void apctest_terminate(int sig)
       pmsg("apctest exiting, signal %u\n", sig);
    }
 
-   clear_files();
+   clear_files(ups);
 
    device_close(ups);
 
@@ -326,7 +326,7 @@ int main(int argc, char *argv[])
       apctest_terminate(0);
    }
 
-   init_signals(apctest_terminate);
+   init_signals(apctest_terminate, NULL);
 
    pmsg("Doing prep_device() ...\n");
    prep_device(ups);
@@ -45,15 +45,20 @@ extern char *pidfile;
 void apcupsd_terminate(int sig)
 {
    UPSINFO *ups = core_ups;
+   UPSINFO *u;
 
    if (sig != 0)
       log_event(ups, LOG_WARNING, "apcupsd exiting, signal %u", sig);
 
    clean_threads();
-   clear_files();
-   if (ups->driver)
-      device_close(ups);
-   delete_lockfile(ups);
+   for (u = ups; u; u = u->next_ups) {
+      clear_files(u);
+      history_close(u);
+      shm_close(u);
+      if (u->driver)
+         device_close(u);
+      delete_lockfile(u);
+   }
    if (pidcreated)
       unlink(pidfile);
    log_event(ups, LOG_NOTICE, "apcupsd shutdown succeeded");
@@ -64,9 +69,13 @@ void apcupsd_terminate(int sig)
 
 void apcupsd_error_cleanup(UPSINFO *ups)
 {
-   if (ups->driver)
-      device_close(ups);
-   delete_lockfile(ups);
+   UPSINFO *u;
+
+   for (u = ups; u; u = u->next_ups) {
+      if (u->driver)
+         device_close(u);
+      delete_lockfile(u);
+   }
    if (pidcreated)
       unlink(pidfile);
    clean_threads();
@@ -98,6 +107,46 @@ void apcupsd_error_out(const char *file, int line, const char *fmt, va_list arg_
    apcupsd_error_cleanup(core_ups);     /* finish the work */
 }
 
+/*
+ * Read the file named by each UPSCONF directive into a UPSINFO of its
+ * own and chain it after the main one. NIS clients pick a UPS by
+ * name, so every additional UPS must have a distinct UPSNAME.
+ */
+static void load_ups_configs(UPSINFO *ups)
+{
+   UPSINFO *u, *other, *tail = ups;
+   UPSFILE *file;
+   int n = 1;
+
+   for (file = ups->upsfiles; file; file = file->next) {
+      if (++n > MAX_UPS)
+         Error_abort("Too many UPSCONF directives; at most %d UPSes\n", MAX_UPS);
+
+      u = new_ups();
+      init_ups_struct(u);
+      check_for_config(u, file->path);
+
+      if (u->upsfiles) {
+         log_event(ups, LOG_WARNING, "UPSCONF in %s ignored; only the "
+            "main configuration file may list UPSes", file->path);
+      }
+      if (u->upsname[0] == 0)
+         Error_abort("UPSNAME must be set in %s\n", file->path);
+      for (other = ups; other; other = other->next_ups) {
+         if (strcasecmp(other->upsname, u->upsname) == 0)
+            Error_abort("UPSNAME %s in %s is already in use\n",
+               u->upsname, file->path);
+      }
+
+      attach_driver(u);
+      if (u->driver == NULL)
+         Error_abort("No valid driver for the UPS in %s\n", file->path);
+
+      tail->next_ups = u;
+      tail = u;
+   }
+}
+
 /*
  * ApcupsdMain is called from win32/winmain.cpp
  * we need to eliminate "main" as an entry point,
@@ -112,6 +161,7 @@ void apcupsd_error_out(const char *file, int line, const char *fmt, va_list arg_
 int main(int argc, char *argv[])
 {
    UPSINFO *ups;
+   UPSINFO *u;
    int tmp_fd, i;
 
    /* Set specific error_* handlers. */
@@ -195,7 +245,11 @@ int main(int argc, char *argv[])
    if (ups->driver == NULL)
       Error_abort("Apcupsd cannot continue without a valid driver.\n");
 
-   ups->start_time = time(NULL);
+   /* Any further UPSes, each with its own driver */
+   load_ups_configs(ups);
+
+   for (u = ups; u; u = u->next_ups)
+      u->start_time = time(NULL);
 
    if (!hibernate_ups && !shutdown_ups && go_background) {
       daemon_start();
@@ -204,21 +258,27 @@ int main(int argc, char *argv[])
       openlog("apcupsd", LOG_CONS | LOG_PID, ups->sysfac);
    }
 
-   init_signals(apcupsd_terminate);
+   init_signals(apcupsd_terminate, request_reload);
 
    /* Create temp events file if we are not doing a hibernate or shutdown */
-   if (!hibernate_ups && !shutdown_ups && ups->eventfile[0] != 0) {
-      ups->event_fd = open(ups->eventfile, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
-      if (ups->event_fd < 0) {
-         log_event(ups, LOG_WARNING, "Could not open events file %s: %s\n",
-            ups->eventfile, strerror(errno));
+   for (u = ups; u; u = u->next_ups) {
+      if (!hibernate_ups && !shutdown_ups && u->eventfile[0] != 0) {
+         u->event_fd = open(u->eventfile, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+         if (u->event_fd < 0) {
+            log_event(u, LOG_WARNING, "Could not open events file %s: %s\n",
+               u->eventfile, strerror(errno));
+         }
       }
+      if (!hibernate_ups && !shutdown_ups)
+         events_open(u);
    }
 
-   if (create_lockfile(ups) == LCKERROR) {
-      Error_abort("Unable to create UPS lock file.\n"
-                   "  If apcupsd or apctest is already running,\n"
-                   "  please stop it and run this program again.\n");
+   for (u = ups; u; u = u->next_ups) {
+      if (create_lockfile(u) == LCKERROR) {
+         Error_abort("Unable to create UPS lock file.\n"
+                      "  If apcupsd or apctest is already running,\n"
+                      "  please stop it and run this program again.\n");
+      }
    }
 
    make_pid_file();
@@ -227,7 +287,8 @@ int main(int argc, char *argv[])
    if (hibernate_ups || shutdown_ups)
    {
       // If we're hibernating or shutting down the UPS, setup is a one-shot.
-      // If it fails, we're toast; no retries
+      // If it fails, we're toast; no retries. Only the main UPS is
+      // handled; UPSes from UPSCONF files are left alone.
       if (!setup_device(ups))
          Error_abort("Unable to open UPS device for hibernate or shutdown");
 
@@ -245,15 +306,37 @@ int main(int argc, char *argv[])
     * on write locks and up to date data in the shared structure.
     */
 
+   /* Event launcher; apccontrol is run asynchronously from here on */
+   start_exec_launcher(ups, argv[0]);
+   for (u = ups; u; u = u->next_ups)
+      start_event_hooks(u, argv[0]);
+
    /* Network status information server */
    if (ups->netstats) {
       start_thread(ups, do_server, "apcnis", argv[0]);
       Dmsg(10, "NIS thread started.\n");
    }
 
+   /* Prometheus metrics over HTTP */
+   if (ups->metricsport > 0) {
+      metrics_enable(ups);
+      start_thread(ups, do_metrics_server, "apcmetrics", argv[0]);
+      Dmsg(10, "Metrics thread started.\n");
+   }
+
    log_event(ups, LOG_NOTICE,
       "apcupsd " APCUPSD_RELEASE " (" ADATE ") " APCUPSD_HOST " startup succeeded");
 
+   /*
+    * Every UPS gets a poller thread for its driver I/O. Each further
+    * UPS also gets a thread for its decision loop so a hung device
+    * cannot hold up the others. The main UPS uses this one.
+    */
+   for (u = ups; u; u = u->next_ups)
+      start_device(u, argv[0]);
+   for (u = ups->next_ups; u; u = u->next_ups)
+      start_thread(u, do_device, "apcupsd-ups", argv[0]);
+
    /* main processing loop */
    do_device(ups);
 
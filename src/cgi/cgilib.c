@@ -67,6 +67,39 @@ int extractcgiargs()
         return 1;
 }
 
+/*
+ * The hosts named by MONITOR lines in xxx/hosts.conf, read once.
+ * Returns their number, or -1 if there is no hosts.conf.
+ */
+int cgi_hosts(const char *const **list)
+{
+    static char **hosts;
+    static int nhosts = -2;
+    FILE    *hostlist;
+    char    fn[256], buf[500], addr[256];
+
+    if (nhosts == -2) {
+        nhosts = -1;
+        asnprintf(fn, sizeof(fn), "%s/hosts.conf", SYSCONFDIR);
+        hostlist = fopen(fn, "r");
+        if (hostlist != NULL) {
+            nhosts = 0;
+            while (fgets(buf, (size_t) sizeof(buf), hostlist)) {
+                if (strncmp("MONITOR", buf, 7) == 0 &&
+                    sscanf (buf, "%*s %255s", addr) == 1) {
+                    hosts = (char **)realloc(hosts,
+                        (nhosts + 1) * sizeof(*hosts));
+                    hosts[nhosts++] = strdup(addr);
+                }
+            }
+            (void) fclose (hostlist);
+        }
+    }
+
+    *list = (const char *const *)hosts;
+    return nhosts;
+}
+
 /* 
  * Checks if the host to be monitored is in xxx/hosts.conf
  * Returns:
@@ -75,25 +108,19 @@ int extractcgiargs()
  */
 int checkhost(const char *check)
 {
-    FILE    *hostlist;
-    char    fn[256], buf[500], addr[256];
+    const char *const *hosts;
+    int     i, nhosts;
 
-    asnprintf(fn, sizeof(fn), "%s/hosts.conf", SYSCONFDIR);
-    hostlist = fopen(fn, "r");
-    if (hostlist == NULL) {
+    nhosts = cgi_hosts(&hosts);
+    if (nhosts < 0) {
         return 1;               /* default to allow */
     }
 
-    while (fgets(buf, (size_t) sizeof(buf), hostlist)) {
-        if (strncmp("MONITOR", buf, 7) == 0) {
-            sscanf (buf, "%*s %s", addr);
-            if (strncmp(addr, check, strlen(check)) == 0) {
-                (void) fclose (hostlist);
-                return 1;       /* allowed */
-            }
+    for (i = 0; i < nhosts; i++) {
+        if (strncmp(hosts[i], check, strlen(check)) == 0) {
+            return 1;           /* allowed */
         }
     }
-    (void) fclose (hostlist);
     return 0;               /* denied */
 }       
 
@@ -26,6 +26,18 @@ int extractcgiargs(void);
 /* see if a host is allowed per the hosts.conf */
 int checkhost(const char *check);
 
+/* list the MONITOR hosts of hosts.conf, -1 if there is none */
+int cgi_hosts(const char *const **list);
+
+/*
+ * With --listen [addr:]port on the command line, become a small HTTP
+ * server that answers each request in a child process. Returns in that
+ * child, set up like a CGI for the rest of main() to answer the request,
+ * or at once if not asked to listen. A fetch_timeout_ms other than 0
+ * keeps the status of the hosts.conf hosts fetched in the server.
+ */
+void cgi_serve(int argc, char **argv, int fetch_timeout_ms);
+
 /*
  * Output a string taking care to assure that any html meta characters
  * are output properly.
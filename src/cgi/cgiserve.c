@@ -0,0 +1,363 @@
+/*
+ * cgiserve.c
+ *
+ * Long-running mode for the CGI programs: a small HTTP server that keeps
+ * the configuration and the status of the monitored hosts between
+ * requests.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * Each program calls cgi_serve() once it has read its configuration.
+ * Without --listen that returns at once and the program is an ordinary
+ * CGI. With it, the process listens and, for every request, forks a
+ * child that inherits everything already read and fetched. The child
+ * returns from cgi_serve() with QUERY_STRING and friends set as a web
+ * server would set them and stdout going to a temporary file; when the
+ * program exits, what it printed is sent back as the HTTP response.
+ *
+ * Before each fork the server fetches again any host status older than
+ * SERVE_MAXAGE_MS, over NIS connections it keeps open, so a page costs
+ * neither a process start nor a connection to each apcupsd.
+ *
+ * Each program answers on its own port. The web server in front maps
+ * the URL of each program to its port, so the links between the pages
+ * work as they do with plain CGI.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgiconfig.h"
+#include "cgilib.h"
+#include "upsfetch.h"
+
+#ifndef HAVE_MINGW
+
+#define SERVE_MAXAGE_MS  5000      /* oldest status a page is given */
+#define SERVE_RETRY_MS   60000     /* between tries of a host that failed */
+#define SERVE_REQ_MAX    8192      /* longest request header accepted */
+#define SERVE_IO_SECS    10        /* for a client to send or take */
+#define SERVE_BUSY_MS    100       /* pause when accept() keeps failing */
+
+static int client = -1;
+static bool head_only;
+static char protocol[16];
+
+static void send_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void send_error(int fd, const char *status)
+{
+    char buf[256];
+    int len;
+
+    len = asnprintf(buf, sizeof(buf),
+        "HTTP/1.0 %s\r\nContent-Type: text/plain\r\n"
+        "Content-Length: %d\r\nConnection: close\r\n\r\n%s\n",
+        status, (int)strlen(status) + 1, status);
+    send_all(fd, buf, len);
+}
+
+/*
+ * Called at exit of a child: turn the CGI output collected in stdout
+ * into an HTTP response. The "Status:" header, if any, becomes the
+ * status line, as a web server would do.
+ */
+static void send_response(void)
+{
+    char status[64] = "200 OK";
+    char line[512];
+    char *out, *hdr, *eol, *body;
+    size_t size, bodylen, n;
+    off_t end;
+    int len;
+
+    fflush(stdout);
+    if ((end = lseek(STDOUT_FILENO, 0, SEEK_END)) < 0 ||
+        lseek(STDOUT_FILENO, 0, SEEK_SET) < 0) {
+        send_error(client, "500 Internal Server Error");
+        return;
+    }
+
+    size = end;
+    out = (char *)malloc(size + 1);
+    for (n = 0; n < size; n += len) {
+        if ((len = read(STDOUT_FILENO, out + n, size - n)) <= 0)
+            break;
+    }
+    out[n] = '\0';
+
+    /* The headers end at the first empty line */
+    body = strstr(out, "\n\n");
+    if (body == NULL) {
+        send_error(client, "500 Internal Server Error");
+        free(out);
+        return;
+    }
+    *++body = '\0';
+    body++;
+    bodylen = out + n - body;
+
+    for (hdr = out; *hdr; hdr = eol + 1) {
+        eol = strchr(hdr, '\n');
+        *eol = '\0';
+        if (strncasecmp(hdr, "Status:", 7) == 0)
+            strlcpy(status, hdr + 7 + strspn(hdr + 7, " "), sizeof(status));
+        *eol = '\n';
+    }
+
+    len = asnprintf(line, sizeof(line), "%s %s\r\n", protocol, status);
+    send_all(client, line, len);
+    for (hdr = out; *hdr; hdr = eol + 1) {
+        eol = strchr(hdr, '\n');
+        if (strncasecmp(hdr, "Status:", 7) == 0)
+            continue;
+        send_all(client, hdr, eol - hdr);
+        send_all(client, "\r\n", 2);
+    }
+    len = asnprintf(line, sizeof(line),
+        "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+        (unsigned long)bodylen);
+    send_all(client, line, len);
+    if (!head_only)
+        send_all(client, body, bodylen);
+
+    free(out);
+    shutdown(client, SHUT_WR);
+    close(client);
+}
+
+/* Take the value of one request header, or NULL if it is not there */
+static char *find_header(char *headers, const char *name)
+{
+    size_t len = strlen(name);
+    char *p, *eol;
+
+    for (p = headers; (eol = strchr(p, '\n')) != NULL; p = eol + 1) {
+        if (strncasecmp(p, name, len) == 0 && p[len] == ':') {
+            p += len + 1;
+            p += strspn(p, " \t");
+            while (eol > p && (eol[-1] == '\r' || eol[-1] == ' '))
+                eol--;
+            *eol = '\0';
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Read and check a request in the child, and set up the environment of
+ * a CGI for it. Returns false if the client was sent an error instead.
+ */
+static bool read_request(int fd)
+{
+    char req[SERVE_REQ_MAX + 1];
+    char method[16], target[SERVE_REQ_MAX];
+    char *query, *inm, *end = NULL;
+    size_t len = 0;
+    ssize_t n;
+
+    while (len < SERVE_REQ_MAX) {
+        n = read(fd, req + len, SERVE_REQ_MAX - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        len += n;
+        req[len] = '\0';
+        if ((end = strstr(req, "\r\n\r\n")) != NULL ||
+            (end = strstr(req, "\n\n")) != NULL)
+            break;
+    }
+    if (end == NULL) {
+        send_error(fd, "431 Request Header Fields Too Large");
+        return false;
+    }
+
+    if (sscanf(req, "%15s %8191s %15s", method, target, protocol) != 3 ||
+        strncmp(protocol, "HTTP/", 5) != 0) {
+        send_error(fd, "400 Bad Request");
+        return false;
+    }
+    if (strcmp(method, "HEAD") == 0) {
+        head_only = true;
+    } else if (strcmp(method, "GET") != 0) {
+        send_error(fd, "405 Method Not Allowed");
+        return false;
+    }
+
+    /* Whatever the path, the query is for this program */
+    query = strchr(target, '?');
+    setenv("QUERY_STRING", query ? query + 1 : "", 1);
+    setenv("REQUEST_METHOD", method, 1);
+    setenv("SERVER_PROTOCOL", protocol, 1);
+    if ((inm = find_header(strchr(req, '\n') + 1, "If-None-Match")) != NULL)
+        setenv("HTTP_IF_NONE_MATCH", inm, 1);
+    else
+        unsetenv("HTTP_IF_NONE_MATCH");
+
+    /* Answer in the version asked in, but no newer than ours */
+    if (strcmp(protocol, "HTTP/1.0") != 0)
+        strlcpy(protocol, "HTTP/1.1", sizeof(protocol));
+
+    return true;
+}
+
+static int open_listener(const char *spec)
+{
+    struct sockaddr_in addr;
+    char host[256];
+    const char *port;
+    int fd, on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if ((port = strrchr(spec, ':')) != NULL) {
+        strlcpy(host, spec, MIN((size_t)(port - spec + 1), sizeof(host)));
+        port++;
+        addr.sin_addr.s_addr = inet_addr(host);
+        if (addr.sin_addr.s_addr == INADDR_NONE) {
+            fprintf(stderr, "Bad address to listen on: %s\n", host);
+            return -1;
+        }
+    } else {
+        port = spec;
+    }
+    addr.sin_port = htons(atoi(port));
+    if (addr.sin_port == 0) {
+        fprintf(stderr, "Bad port to listen on: %s\n", port);
+        return -1;
+    }
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(on));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 16) < 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", spec, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void cgi_serve(int argc, char **argv, int fetch_timeout_ms)
+{
+    const char *const *hosts;
+    const char *spec = NULL;
+    struct timeval tv;
+    FILE *out;
+    int i, lfd, fd, nhosts;
+    bool stalled = false;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc)
+            spec = argv[++i];
+        else if (strncmp(argv[i], "--listen=", 9) == 0)
+            spec = argv[i] + 9;
+    }
+    if (spec == NULL)
+        return;
+
+    if ((lfd = open_listener(spec)) < 0)
+        exit(EXIT_FAILURE);
+
+    signal(SIGCHLD, SIG_IGN);      /* children need no reaping */
+    signal(SIGPIPE, SIG_IGN);
+    nhosts = fetch_timeout_ms ? cgi_hosts(&hosts) : 0;
+
+    for (;;) {
+        if ((fd = accept(lfd, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            /* Out of descriptors or memory: wait for some to be freed */
+            if (!stalled) {
+                fprintf(stderr, "Cannot accept connections: %s\n",
+                    strerror(errno));
+                stalled = true;
+            }
+            usleep(SERVE_BUSY_MS * 1000);
+            continue;
+        }
+        stalled = false;
+
+        /* Bring the statuses up to date for this and later requests */
+        if (nhosts > 0) {
+            fetch_expire(SERVE_MAXAGE_MS, SERVE_RETRY_MS);
+            fetch_hosts(hosts, nhosts, fetch_timeout_ms);
+        }
+
+        switch (fork()) {
+        case 0:
+            close(lfd);
+            signal(SIGCHLD, SIG_DFL);
+            tv.tv_sec = SERVE_IO_SECS;
+            tv.tv_usec = 0;
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv));
+            if (!read_request(fd))
+                _exit(EXIT_SUCCESS);
+
+            /* The program prints its answer to stdout as any CGI does */
+            if ((out = tmpfile()) == NULL ||
+                dup2(fileno(out), STDOUT_FILENO) < 0) {
+                send_error(fd, "500 Internal Server Error");
+                _exit(EXIT_FAILURE);
+            }
+            client = fd;
+            atexit(send_response);
+            return;
+
+        case -1:
+            send_error(fd, "503 Service Unavailable");
+            break;
+        }
+        close(fd);
+    }
+}
+
+#else
+
+void cgi_serve(int argc, char **argv, int fetch_timeout_ms)
+{
+}
+
+#endif /* HAVE_MINGW */
@@ -103,6 +103,7 @@ static  int     numfields = 0;
 static  int     use_celsius;
 static  char    *desc;
 static  int     refresh = DEFAULT_REFRESH;
+static  int     timeout = FETCH_TIMEOUT_MS;
 
 void parsearg(const char *var, const char *value)
 {
@@ -516,6 +517,11 @@ static void readconf(void)
 
         } else if (strncmp (buf, "TEMPF", 5) == 0) {
              use_celsius = 0;
+
+        } else if (strncmp (buf, "TIMEOUT", 7) == 0) {
+             timeout = atoi (&buf[7]) * 1000;
+             if (timeout <= 0)
+                 timeout = FETCH_TIMEOUT_MS;
         }
     }
     fclose (conf);
@@ -534,12 +540,53 @@ static void defaultfields(void)
     addfield ("DATA",  "Data", "All data");
 }       
 
-int main(int argc, char **argv) 
+/* A host from hosts.conf */
+typedef struct {
+    char    addr[256];
+    char    desc[256];
+} monhost_t;
+
+/* Read hosts.conf. Returns the number of hosts, or -1 if not there */
+static int readhosts(monhost_t **hosts)
 {
     FILE    *conf;
+    char    buf[256], fn[MAXPATHLEN], addr[256], *d;
+    int     restofs, n = 0;
+
+    *hosts = NULL;
+    snprintf (fn, sizeof(fn), "%s/hosts.conf", SYSCONFDIR);
+    conf = fopen (fn, "r");
+    if (conf == NULL)
+        return -1;
+
+    while (fgets (buf, sizeof(buf), conf)) {
+        if (sscanf(buf, "MONITOR %s %n", addr, &restofs) == 1) {
+            d = buf + restofs;
+            if (*d == '\"')
+               restofs = strcspn(++d, "\n\r\"");
+            else
+               restofs = strcspn(d, "\n\r");
+            d[restofs] = '\0';
+            if (*d == '\0')
+               d = (char *)"UNKNOWN";
+
+            *hosts = (monhost_t *)realloc(*hosts, (n + 1) * sizeof(**hosts));
+            strlcpy((*hosts)[n].addr, addr, sizeof((*hosts)[n].addr));
+            strlcpy((*hosts)[n].desc, d, sizeof((*hosts)[n].desc));
+            n++;
+        }
+    }
+    fclose (conf);
+    return n;
+}
+
+int main(int argc, char **argv) 
+{
     time_t  tod;
-    char    buf[256], fn[MAXPATHLEN], addr[256], timestr[256];
-    int     restofs;
+    char    timestr[256];
+    const char **addrs;
+    monhost_t *hosts;
+    int     i, nhosts;
     ftype_t   *tmp;
 
     /* set default according to compile time, but config may override */
@@ -551,10 +598,25 @@ int main(int argc, char **argv)
     readconf();
     if (firstfield == NULL)         /* nothing from config file? */
             defaultfields();
+    nhosts = readhosts(&hosts);
 
+    cgi_serve(argc, argv, timeout);
     (void) extractcgiargs();
     html_begin("Multimon: UPS Status Page", refresh);
 
+    /*
+     * Ask every host at once before printing anything, so the page
+     * takes as long as the slowest host rather than all of them added
+     * up, and no longer than the timeout however many are down.
+     */
+    if (nhosts > 0) {
+        addrs = (const char **)malloc(nhosts * sizeof(*addrs));
+        for (i = 0; i < nhosts; i++)
+            addrs[i] = hosts[i].addr;
+        fetch_hosts(addrs, nhosts, timeout);
+        free(addrs);
+    }
+
     printf ("<table class=\"Outer\" cellpadding=\"5\">\n");
 
     time (&tod);
@@ -570,28 +632,14 @@ int main(int argc, char **argv)
     (void) puts ("</tr>"); 
 
     /* ups status */
-    snprintf (fn, sizeof(fn), "%s/hosts.conf", SYSCONFDIR);
-    conf = fopen (fn, "r");
-    if (conf == NULL) {
+    if (nhosts < 0) {
         printf ("<tr><td colspan=\"%d\" class=\"Fault\">Error: Cannot open hosts file</td></tr>\n",
                    numfields);
     } else {
-        while (fgets (buf, sizeof(buf), conf)) {
-            if (sscanf(buf, "MONITOR %s %n", addr, &restofs) == 1) {
-                desc = buf + restofs;                
-                if (*desc == '\"')
-                   restofs = strcspn(++desc, "\n\r\"");
-                else
-                   restofs = strcspn(desc, "\n\r");
-                desc[restofs] = '\0';
-                if (*desc == '\0') {
-                   strlcpy(buf, "UNKNOWN", sizeof(buf));
-                   desc = buf;
-                }
-                getinfo(addr);  /* get and print info for this host */
-            }
+        for (i = 0; i < nhosts; i++) {
+            desc = hosts[i].desc;
+            getinfo(hosts[i].addr);  /* print info for this host */
         }
-        fclose (conf);
     }
     (void) puts ("</table>");
 
@@ -26,8 +26,7 @@
 #include "cgiconfig.h"
 #include "apcconfig.h"
 #include "nis.h"
-
-static int fill_buffer(sock_t sockfd);
+#include "upsfetch.h"
 
 char statbuf[4096];
 size_t  statlen = 0;
@@ -90,44 +89,379 @@ static const struct {
 };
 
 /*
- * Read data into memory buffer to be used by getupsvar()
- * Returns 0 on error
- * Returns 1 if data fetched
+ * The status of every host asked for during this run, fetched all at
+ * once by fetch_hosts() and split into its variables. A host that
+ * could not be reached stays that way for the rest of the run rather
+ * than being tried again for each field on the page. A long-running
+ * server ages the entries with fetch_expire() instead, and the NIS
+ * connection is kept open to ask again.
  */
-static int fetch_data(const char *host)
+#define MAXVARS 128
+
+enum { FS_CONNECT, FS_SEND, FS_RECV, FS_DONE, FS_FAILED };
+
+typedef struct {
+   char host[256];
+   int state;
+   long long fetched;              /* mono_msec() when done or failed */
+   char err[200];                  /* why it failed */
+   char text[sizeof(statbuf)];     /* status as sent by apcupsd */
+   size_t textlen;
+   int nvars;
+   struct {
+      char key[16];
+      const char *val;             /* into text, to the end of line */
+   } vars[MAXVARS];
+
+   /* While fetching */
+   sock_t fd;                      /* kept open once done */
+   bool reused;                    /* asking again on an open connection */
+   int port;
+   size_t txoff;                   /* of the "status" request sent */
+   unsigned char rx[2048];         /* NIS records not yet decoded */
+   size_t rxlen;
+} HOSTDATA;
+
+static HOSTDATA **hostdata;
+static int nhostdata;
+
+static const char status_req[] = { 0, 6, 's', 't', 'a', 't', 'u', 's' };
+
+static HOSTDATA *find_host(const char *host)
 {
-   int nis_port = NISPORT;
-   sock_t sockfd;
-   int stat;
-   char *p;
-   char lhost[200];
+   int i;
 
-   if (statlen != 0 && (strcmp(last_host, host) == 0))
-       return 1;                      /* alread have data this host */
-   strncpy(last_host, host, sizeof(last_host)); 
-   last_host[sizeof(last_host) - 1] = '\0';
-   statlen = 0;
-   strncpy(lhost, host, sizeof(lhost)-1);
-   lhost[sizeof(lhost)-1] = '\0';
-   p = strchr(lhost, ':');
-   if (p) {
-      *p++ = '\0';
-      nis_port = atoi(p);
+   for (i = 0; i < nhostdata; i++) {
+      if (strcmp(hostdata[i]->host, host) == 0)
+         return hostdata[i];
    }
-   if ((sockfd = net_open(lhost, NULL, nis_port)) < 0) {
-      (void) snprintf(errmsg, sizeof (errmsg),
-         "upsfetch: tcp_open failed for %s port %d", lhost, nis_port);
-      return 0;
+   return NULL;
+}
+
+static void fetch_start(HOSTDATA *h);
+
+static void fetch_failed(HOSTDATA *h, const char *why)
+{
+   if (h->fd != INVALID_SOCKET) {
+      net_close(h->fd);
+      h->fd = INVALID_SOCKET;
    }
 
-   stat = fill_buffer(sockfd);               /* fill statbuf */
-   if (stat == 0) {
-      *last_host = '\0';
-      statlen = 0;
+   /* apcupsd may have closed a connection we kept; try a new one */
+   if (h->reused) {
+      h->reused = false;
+      h->txoff = h->rxlen = h->textlen = 0;
+      fetch_start(h);
+      return;
    }
-   net_close(sockfd);
-   return stat;
-} 
+
+   asnprintf(h->err, sizeof(h->err), "upsfetch: %s for %s", why, h->host);
+   h->state = FS_FAILED;
+}
+
+/* Start a non-blocking connection to the NIS server of one host */
+static void fetch_start(HOSTDATA *h)
+{
+   struct addrinfo hints, *res = NULL;
+   struct sockaddr_storage addr;
+   socklen_t addrlen;
+   char lhost[sizeof(h->host)];
+   char portstr[16];
+   int nonblock = 1;
+
+   h->fd = INVALID_SOCKET;
+   h->port = NISPORT;
+   net_split_host(h->host, lhost, sizeof(lhost), &h->port);
+
+   memset(&addr, 0, sizeof(addr));
+#ifndef HAVE_MINGW
+   if (lhost[0] == '/') {
+      struct sockaddr_un *un = (struct sockaddr_un *)&addr;
+
+      un->sun_family = AF_UNIX;
+      strlcpy(un->sun_path, lhost, sizeof(un->sun_path));
+      addrlen = sizeof(*un);
+   } else
+#endif
+   {
+      /* Only the first address is tried, there is no time for more */
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_ADDRCONFIG;
+      asnprintf(portstr, sizeof(portstr), "%d", h->port);
+      if (getaddrinfo(lhost, portstr, &hints, &res) != 0 ||
+          res->ai_addrlen > sizeof(addr)) {
+         if (res)
+            freeaddrinfo(res);
+         fetch_failed(h, "cannot resolve host");
+         return;
+      }
+      memcpy(&addr, res->ai_addr, res->ai_addrlen);
+      addrlen = res->ai_addrlen;
+      freeaddrinfo(res);
+   }
+
+   if ((h->fd = socket_cloexec(addr.ss_family, SOCK_STREAM, 0)) == INVALID_SOCKET ||
+       ioctl(h->fd, FIONBIO, &nonblock) != 0) {
+      fetch_failed(h, "tcp_open failed");
+      return;
+   }
+
+   /* fetch_hosts() waits with select(), which cannot go past this */
+   if (h->fd >= FD_SETSIZE) {
+      fetch_failed(h, "too many open files");
+      return;
+   }
+
+   if (connect(h->fd, (struct sockaddr *)&addr, addrlen) == 0)
+      h->state = FS_SEND;
+   else if (errno == EINPROGRESS || errno == EWOULDBLOCK)
+      h->state = FS_CONNECT;
+   else
+      fetch_failed(h, "tcp_open failed");
+}
+
+/* Take whole NIS records out of rx; the empty one ends the status */
+static void fetch_decode(HOSTDATA *h)
+{
+   size_t pos = 0, n, copy;
+
+   while (h->state == FS_RECV && pos + 2 <= h->rxlen) {
+      n = (h->rx[pos] << 8) | h->rx[pos + 1];
+      if (n == 0) {
+         h->state = FS_DONE;
+         h->reused = false;
+      } else if (n > sizeof(h->rx) - 2) {
+         fetch_failed(h, "oversized reply");
+      } else if (pos + 2 + n <= h->rxlen) {
+         /* Like strncat() into statbuf, anything past the end is lost */
+         copy = n;
+         if (copy > sizeof(h->text) - 1 - h->textlen)
+            copy = sizeof(h->text) - 1 - h->textlen;
+         memcpy(h->text + h->textlen, h->rx + pos + 2, copy);
+         h->textlen += copy;
+         h->text[h->textlen] = '\0';
+      } else {
+         break;                    /* rest of the record still to come */
+      }
+      pos += 2 + n;
+   }
+
+   if (h->state == FS_RECV) {
+      memmove(h->rx, h->rx + pos, h->rxlen - pos);
+      h->rxlen -= pos;
+   }
+}
+
+/* Move one host along after select() found its socket ready */
+static void fetch_step(HOSTDATA *h)
+{
+   int err = 0;
+   socklen_t errlen = sizeof(err);
+   int n;
+
+   switch (h->state) {
+   case FS_CONNECT:
+      if (getsockopt(h->fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen) != 0 ||
+          err != 0) {
+         fetch_failed(h, "tcp_open failed");
+         return;
+      }
+      h->state = FS_SEND;
+      /* Fall through */
+
+   case FS_SEND:
+      n = send(h->fd, status_req + h->txoff, sizeof(status_req) - h->txoff, 0);
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            fetch_failed(h, "write error on socket");
+         return;
+      }
+      h->txoff += n;
+      if (h->txoff == sizeof(status_req))
+         h->state = FS_RECV;
+      return;
+
+   case FS_RECV:
+      n = recv(h->fd, (char *)h->rx + h->rxlen, sizeof(h->rx) - h->rxlen, 0);
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            fetch_failed(h, "read error on socket");
+         return;
+      }
+      if (n == 0) {
+         fetch_failed(h, "connection closed early");
+         return;
+      }
+      h->rxlen += n;
+      fetch_decode(h);
+      return;
+   }
+}
+
+/* Index the variables of a status so getupsvar() need not search it */
+static void fetch_parse(HOSTDATA *h)
+{
+   const char *line, *colon, *eol;
+   size_t klen;
+
+   h->nvars = 0;
+   for (line = h->text; *line && h->nvars < MAXVARS; line = eol + 1) {
+      if ((eol = strchr(line, '\n')) == NULL)
+         break;
+      colon = (const char *)memchr(line, ':', eol - line);
+      if (colon == NULL)
+         continue;
+      for (klen = colon - line; klen > 0 && line[klen - 1] == ' '; klen--)
+         ;
+      if (klen == 0 || klen >= sizeof(h->vars[0].key))
+         continue;
+      memcpy(h->vars[h->nvars].key, line, klen);
+      h->vars[h->nvars].key[klen] = '\0';
+      h->vars[h->nvars].val = colon + 1 + (colon[1] == ' ');
+      h->nvars++;
+   }
+}
+
+/*
+ * Fetch the status of several hosts at once. Connections to all of
+ * them are made together and serviced as they become ready, so the
+ * wait is that of the slowest host that answers, and never more than
+ * timeout_ms in all. Hosts fetched earlier in this run are not asked
+ * again. Returns the number of hosts whose status is available.
+ */
+int fetch_hosts(const char *const *hosts, int nhosts, int timeout_ms)
+{
+   long long deadline = mono_msec() + timeout_ms;
+   long long left;
+   struct timeval tv;
+   fd_set rfds, wfds;
+   HOSTDATA *h;
+   int i, maxfd, active, ok;
+
+   for (i = 0; i < nhosts; i++) {
+      if (find_host(hosts[i]))
+         continue;
+      h = (HOSTDATA *)calloc(1, sizeof(HOSTDATA));
+      strlcpy(h->host, hosts[i], sizeof(h->host));
+      hostdata = (HOSTDATA **)realloc(hostdata,
+         (nhostdata + 1) * sizeof(*hostdata));
+      hostdata[nhostdata++] = h;
+      fetch_start(h);
+   }
+
+   for (;;) {
+      FD_ZERO(&rfds);
+      FD_ZERO(&wfds);
+      maxfd = -1;
+      active = 0;
+      for (i = 0; i < nhostdata; i++) {
+         h = hostdata[i];
+         if (h->state == FS_DONE || h->state == FS_FAILED)
+            continue;
+         FD_SET(h->fd, h->state == FS_RECV ? &rfds : &wfds);
+         if ((int)h->fd > maxfd)
+            maxfd = h->fd;
+         active++;
+      }
+
+      if (active == 0 || (left = deadline - mono_msec()) <= 0)
+         break;
+
+      tv.tv_sec = left / 1000;
+      tv.tv_usec = (left % 1000) * 1000;
+      if (select(maxfd + 1, &rfds, &wfds, NULL, &tv) < 0 && errno != EINTR)
+         break;
+
+      for (i = 0; i < nhostdata; i++) {
+         h = hostdata[i];
+         if (h->state == FS_DONE || h->state == FS_FAILED)
+            continue;
+         if (FD_ISSET(h->fd, &rfds) || FD_ISSET(h->fd, &wfds))
+            fetch_step(h);
+      }
+   }
+
+   /* Whatever is still going has had its time */
+   for (ok = 0, i = 0; i < nhostdata; i++) {
+      h = hostdata[i];
+      if (h->state != FS_DONE && h->state != FS_FAILED) {
+         h->reused = false;
+         fetch_failed(h, "no answer in time");
+      }
+      if (h->fetched == 0) {
+         h->fetched = mono_msec();
+         if (h->state == FS_DONE)
+            fetch_parse(h);
+      }
+      if (h->state == FS_DONE)
+         ok++;
+   }
+
+   return ok;
+}
+
+/*
+ * Mark statuses older than max_age_ms, and failures older than
+ * retry_ms, to be fetched again by the next fetch_hosts(). Those that
+ * were fetched are asked again on the connection already open.
+ */
+void fetch_expire(int max_age_ms, int retry_ms)
+{
+   long long now = mono_msec();
+   HOSTDATA *h;
+   int i;
+
+   for (i = 0; i < nhostdata; i++) {
+      h = hostdata[i];
+      if (h->state == FS_DONE && now - h->fetched >= max_age_ms) {
+         h->fetched = 0;
+         h->nvars = 0;
+         h->txoff = h->rxlen = h->textlen = 0;
+         h->text[0] = '\0';
+         if (h->fd != INVALID_SOCKET) {
+            h->reused = true;
+            h->state = FS_SEND;
+         } else {
+            fetch_start(h);
+         }
+      } else if (h->state == FS_FAILED && now - h->fetched >= retry_ms) {
+         h->fetched = 0;
+         h->txoff = h->rxlen = h->textlen = 0;
+         fetch_start(h);
+      }
+   }
+
+   *last_host = '\0';
+}
+
+/*
+ * Make the status of host the current one, fetching it if need be.
+ * Returns NULL with errmsg set if it is not available.
+ */
+static HOSTDATA *fetch_data(const char *host)
+{
+   HOSTDATA *h;
+
+   if ((h = find_host(host)) == NULL) {
+      fetch_hosts(&host, 1, FETCH_TIMEOUT_MS);
+      h = find_host(host);
+   }
+
+   if (h->state != FS_DONE) {
+      strlcpy(errmsg, h->err, sizeof(errmsg));
+      return NULL;
+   }
+
+   /* Keep statbuf as it always was for anyone who looks there */
+   if (strcmp(last_host, host) != 0) {
+      strlcpy(last_host, host, sizeof(last_host));
+      memcpy(statbuf, h->text, h->textlen + 1);
+      statlen = h->textlen;
+   }
+   return h;
+}
 
 /*
  * Read data into memory buffer to be used by getupsvar()
@@ -139,20 +473,16 @@ int fetch_events(const char *host)
    int nis_port = NISPORT;
    char buf[500];
    sock_t sockfd;
-   int n, stat = 1;
-   char *p;
+   int n, i, stat = 1;
    char lhost[200];
-   size_t len;
+   char *text = NULL;
+   size_t *recs = NULL;
+   size_t len, outlen = 0, textlen = 0, textsize = 0;
+   int nrecs = 0, maxrecs = 0;
 
    statlen = 0;
    statbuf[0] = '\0';
-   strncpy(lhost, host, sizeof(lhost)-1);
-   lhost[sizeof(lhost)-1] = '\0';
-   p = strchr(lhost, ':');
-   if (p) {
-      *p++ = '\0';
-      nis_port = atoi(p);
-   }
+   net_split_host(host, lhost, sizeof(lhost), &nis_port);
    if ((sockfd = net_open(lhost, NULL, nis_port)) < 0) {
       snprintf(errmsg, sizeof(errmsg),
           "upsfetch: tcp_open failed for %s port %d", lhost, nis_port);
@@ -170,20 +500,39 @@ int fetch_events(const char *host)
     * Now read the events and invert them for the list box,
     * with most recend event at the beginning.  
     * by dg2fer.  
+    * They are all read first and then copied once, newest first, as
+    * far as they fit.
     */
    while ((n = net_recv(sockfd, buf, sizeof(buf)-1)) > 0) {
       /* terminate string for strlen()-calls in next lines */
       buf[n] = '\0';                     /* ensure string terminated */
       len = strlen(buf);
+      if (nrecs == maxrecs) {
+         maxrecs = maxrecs ? maxrecs * 2 : 64;
+         recs = (size_t *)realloc(recs, (maxrecs + 1) * sizeof(*recs));
+      }
+      if (textlen + len > textsize) {
+         textsize = (textlen + len) * 2;
+         text = (char *)realloc(text, textsize);
+      }
+      memcpy(text + textlen, buf, len);
+      recs[nrecs++] = textlen;
+      textlen += len;
+   }
+   if (nrecs > 0)
+      recs[nrecs] = textlen;       /* end of the last one */
+
+   for (i = nrecs - 1; i >= 0 && outlen < sizeof(statbuf) - 1; i--) {
+      len = recs[i + 1] - recs[i];
       /* if message is bigger than the buffer, truncate it */
-      if (len > sizeof(statbuf)-1)
-         len = sizeof(statbuf)-1;
-      /* move previous messages to the end of the buffer */
-      memmove(statbuf+len, statbuf, sizeof(statbuf)-len-1);
-      /* copy new message */
-      memcpy(statbuf, buf, len);
-      statbuf[sizeof(statbuf)-1] = '\0';
+      if (len > sizeof(statbuf) - 1 - outlen)
+         len = sizeof(statbuf) - 1 - outlen;
+      memcpy(statbuf + outlen, text + recs[i], len);
+      outlen += len;
    }
+   statbuf[outlen] = '\0';
+   free(recs);
+   free(text);
 
    if (n < 0) {
       stat = 0;
@@ -195,8 +544,7 @@ int fetch_events(const char *host)
 } 
 
 
-/* In our version, we have prefetched all the data, so the
- * host argument is ignored here.
+/*
  * Returns 1 if var found
  *   answer has var
  * Returns 0 if variable name not found
@@ -209,14 +557,15 @@ int fetch_events(const char *host)
 int getupsvar(const char *host, const char *request,
     char *answer, size_t anslen) 
 {
-    int i;
+    HOSTDATA *h;
     const char *stat_match = NULL;
-    char *find;
+    const char *val;
+    size_t len;
+    int i;
     int nfields = 0;
      
-    if (fetch_data(host) == 0) {
-        strncpy(answer, "N/A", anslen);
-        answer[anslen - 1] = '\0';
+    if ((h = fetch_data(host)) == NULL) {
+        strlcpy(answer, "N/A", anslen);
         return -1;
     }
 
@@ -227,50 +576,24 @@ int getupsvar(const char *host, const char *request,
         }
 
     if (stat_match != NULL) {
-        if ((find=strstr(statbuf, stat_match)) != NULL) {
-             if (nfields == 1)  /* get one field */
-                 sscanf (find, "%*s %*s %s", answer);
-             else {             /* get everything to eol */
-                 i = 0;
-                 find += 11;  /* skip label */
-                 while (*find != '\n')
-                     answer[i++] = *find++;
-                 answer[i] = '\0';
-             }
-             if (strcmp(answer, "N/A") == 0)
-                 return 0;
-             return 1;
+        for (i = 0; i < h->nvars; i++) {
+            if (strcmp(h->vars[i].key, stat_match) != 0)
+                continue;
+            val = h->vars[i].val;
+            if (nfields == 1)  /* get one field */
+                len = strcspn(val, " \n");
+            else               /* get everything to eol */
+                len = strcspn(val, "\n");
+            if (len > anslen - 1)
+                len = anslen - 1;
+            memcpy(answer, val, len);
+            answer[len] = '\0';
+            if (strcmp(answer, "N/A") == 0)
+                return 0;
+            return 1;
         }
     }
 
-    strncpy(answer, "Not found", anslen);
-    answer[anslen - 1] = '\0';
+    strlcpy(answer, "Not found", anslen);
     return 0;
 }
-
-/* Fill buffer with data from UPS network daemon   
- * Returns 0 on error
- * Returns 1 if OK
- */
-static int fill_buffer(sock_t sockfd)
-{
-   int n, stat = 1; 
-   char buf[1000];
-
-   statbuf[0] = '\0';
-   statlen = 0;
-   if (net_send(sockfd, "status", 6) != 6) {
-      snprintf(errmsg, sizeof(errmsg), "fill_buffer: write error on socket\n");
-      return 0;
-   }
-
-   while ((n = net_recv(sockfd, buf, sizeof(buf)-1)) > 0) {
-      buf[n] = '\0';
-      strncat(statbuf, buf, sizeof(statbuf)-statlen-1);
-      statlen = strlen(statbuf);
-   }
-   if (n < 0)
-      stat = 0;
-
-   return stat;
-}
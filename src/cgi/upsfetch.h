@@ -26,6 +26,15 @@ extern char statbuf[4096];
 extern size_t statlen;
 extern char errmsg[200];
 
+/* Longest a page waits for the status of its hosts, in msec */
+#define FETCH_TIMEOUT_MS 10000
+
+/* Fetch the status of several hosts at once for getupsvar() */
+int fetch_hosts (const char *const *hosts, int nhosts, int timeout_ms);
+
+/* Have the next fetch_hosts() ask again for statuses this old */
+void fetch_expire (int max_age_ms, int retry_ms);
+
 /* Read data into memory buffer to be used by getupsvar() */
 int fetch_events (const char *host);
 
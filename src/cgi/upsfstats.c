@@ -44,6 +44,7 @@ int main(int argc, char **argv)
 {
     char   answer[256];
 
+    cgi_serve(argc, argv, FETCH_TIMEOUT_MS);
     (void) extractcgiargs();
 
     html_begin("APCUPSD Full Status Page", refresh);
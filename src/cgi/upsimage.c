@@ -23,6 +23,12 @@
  *
  * Modified by Riccardo Facchetti to support both GIF and PNG formats.
  *
+ * Rendered images are kept in a small on-disk cache, keyed by the graph
+ * and its values rounded to the tenth that the image shows, so that
+ * many browsers refreshing the same page share one rendering. Each
+ * image carries an ETag made from the same key; a browser that already
+ * has it is answered with a 304 and nothing is drawn or read.
+ *
  */
 
 #include "apc.h"
@@ -34,10 +40,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef HAVE_MINGW
+#include <dirent.h>
+#endif
 
 #include "cgiconfig.h"
 #include "cgilib.h"
 
+/*
+ * Where rendered images are kept, unless APCUPSD_IMGCACHE names another
+ * directory in the environment of the CGI, and for how long. The cache
+ * is only used if the directory belongs to the user the CGI runs as.
+ */
+#define IMGCACHE_DIR     "/tmp/apcupsd-img"
+#define IMGCACHE_TTL     60        /* seconds */
+#define IMGCACHE_PRUNE   600       /* seconds between sweeps */
+#define IMGCACHE_VERSION 1         /* change when the drawing changes */
+
+#ifdef SYS_IMGFMT_PNG
+# define IMGEXT "png"
+#else
+# define IMGEXT "gif"
+#endif
+
 static char    mycmd[16] = "";
 static char    upsval[16] = "";
 static char    upsval2[16] = "";
@@ -129,7 +154,7 @@ void parsearg(const char *var, const char *value)
 }
 
 
-static void imgheader (void)
+static void imgheader (const char *etag)
 {
 #ifdef SYS_IMGFMT_PNG
     puts ("Content-Type: image/png");
@@ -138,24 +163,22 @@ static void imgheader (void)
 #endif
     /*
      * Since this image is generated based on the parameters passed in
-     * the URL, caching is acceptable. No need for Cache-Control.
+     * the URL, caching is acceptable.
      */
+    if (etag) {
+        printf ("ETag: %s\n", etag);
+        printf ("Cache-Control: max-age=%d\n", IMGCACHE_TTL);
+    }
     puts ("");
 }
 
-static void TermImage(gdImagePtr im)
+static gdImagePtr TermImage(gdImagePtr im)
 {
     DrawTickLines(im);
-    imgheader();
-#ifdef SYS_IMGFMT_PNG
-    gdImagePng (im, stdout);
-#else
-    gdImageGif (im, stdout);
-#endif
-    gdImageDestroy (im);
-}  
+    return im;
+}
 
-static void drawbattcap(const char *battcaps, const char *minbchgs)
+static gdImagePtr drawbattcap(const char *battcaps, const char *minbchgs)
 {
     gdImagePtr	    im;
     char	   batttxt[16];
@@ -180,10 +203,10 @@ static void drawbattcap(const char *battcaps, const char *minbchgs)
     (void) snprintf(batttxt, sizeof(batttxt), "%.1f %%", battcap);
     gdImageString(im, gdFontLarge, 70, 320, (unsigned char *)batttxt, black);
 
-    TermImage(im);
+    return TermImage(im);
 }
 
-static void drawbattvolt(const char *battvolts, const char *nombattvs) 
+static gdImagePtr drawbattvolt(const char *battvolts, const char *nombattvs) 
 {
     gdImagePtr	    im;
     char	   batttxt[16];
@@ -247,7 +270,7 @@ static void drawbattvolt(const char *battvolts, const char *nombattvs)
     (void) snprintf (batttxt, sizeof(batttxt), "%.1f VDC", battvolt);
     gdImageString(im, gdFontLarge, 70, 320, (unsigned char *)batttxt, black);
 
-    TermImage(im);
+    return TermImage(im);
 }
 
 #if 0
@@ -265,7 +288,7 @@ static void noimage (void)
 
     gdImageString (im, gdFontLarge, 0, 0, (unsigned char *)"Data not available", black);
 
-    imgheader();
+    imgheader(NULL);
 #ifdef SYS_IMGFMT_PNG
     gdImagePng (im, stdout);
 #else
@@ -275,7 +298,7 @@ static void noimage (void)
 }
 #endif
 
-static void drawupsload(const char *upsloads) 
+static gdImagePtr drawupsload(const char *upsloads) 
 {
     gdImagePtr	    im;
     char	   loadtxt[16];
@@ -297,12 +320,12 @@ static void drawupsload(const char *upsloads)
     (void) snprintf(loadtxt, sizeof(loadtxt), "%.1f %%", upsload);
     gdImageString(im, gdFontLarge, 70, 320, (unsigned char *)loadtxt, black);
 
-    TermImage(im);
+    return TermImage(im);
 }
 
 /*
  * Input Voltage */
-static void drawutility (const char *utilitys, const char *translos,
+static gdImagePtr drawutility (const char *utilitys, const char *translos,
     const char *transhis) 
 {
     gdImagePtr	    im;
@@ -344,13 +367,13 @@ static void drawutility (const char *utilitys, const char *translos,
     (void) snprintf (utiltxt, sizeof(utiltxt), "%.1f VAC", utility);
     gdImageString (im, gdFontLarge, 65, 320, (unsigned char *)utiltxt, black); 
 
-    TermImage(im);
+    return TermImage(im);
 }
 
 /*
  * Output Voltage
  */
-static void drawupsout (const char *upsouts) 
+static gdImagePtr drawupsout (const char *upsouts) 
 {
     gdImagePtr	    im;
     char	   utiltxt[16];
@@ -384,10 +407,10 @@ static void drawupsout (const char *upsouts)
     (void) snprintf(utiltxt, sizeof(utiltxt), "%.1f VAC", upsout);
     gdImageString(im, gdFontLarge, 65, 320, (unsigned char *)utiltxt, black); 
 
-    TermImage(im);
+    return TermImage(im);
 }
 
-static void drawruntime (const char *upsrunts, const char *lowbatts)
+static gdImagePtr drawruntime (const char *upsrunts, const char *lowbatts)
 {
     gdImagePtr	    im;
     char	   utiltxt[16];
@@ -416,42 +439,226 @@ static void drawruntime (const char *upsrunts, const char *lowbatts)
 
     (void) snprintf(utiltxt, sizeof(utiltxt), "%.1f mins", upsrunt);
     gdImageString(im, gdFontLarge, 65, 320, (unsigned char *)utiltxt, black); 
- 
-    TermImage(im);
+
+    return TermImage(im);
 }
 
 
-int main (int argc, char **argv)
+static gdImagePtr render(void)
 {
-#ifdef WIN32
-    setmode(fileno(stdout), O_BINARY);
-#endif
+    if (strcmp(mycmd, "upsload") == 0)
+	return drawupsload(upsval);
+    else if (strcmp(mycmd, "battcap") == 0)
+	return drawbattcap(upsval, upsval2);
+    else if (strcmp(mycmd, "battvolt") == 0)
+	return drawbattvolt(upsval, upsval2);
+    else if (strcmp(mycmd, "utility") == 0)
+	return drawutility(upsval, upsval2, upsval3);
+    else if (strcmp(mycmd, "outputv") == 0)
+	return drawupsout(upsval);
+    else if (strcmp(mycmd, "runtime") == 0)
+	return drawruntime(upsval, upsval2);
+    return NULL;
+}
 
-    (void) extractcgiargs();
+/* Number of values each graph takes; the rest do not go in the key */
+static int graph_values(const char *graph)
+{
+    static const struct {
+        const char *name;
+        int nvalues;
+    } graphs[] = {
+        { "upsload",  1 },
+        { "battcap",  2 },
+        { "battvolt", 2 },
+        { "utility",  3 },
+        { "outputv",  1 },
+        { "runtime",  2 },
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(graphs) / sizeof(graphs[0]); i++) {
+        if (strcmp(graph, graphs[i].name) == 0)
+            return graphs[i].nvalues;
+    }
+    return -1;
+}
 
-    if (strcmp(mycmd, "upsload") == 0) {
-	drawupsload(upsval);
+/*
+ * Round a value to the tenth the image is labelled with, and bound it,
+ * so that it makes a short, safe file name and readings that draw the
+ * same image share one cache entry.
+ */
+static void quantize(char *value, size_t size)
+{
+    double v = strtod(value, NULL);
 
-    } else if (strcmp(mycmd, "battcap") == 0) {
-	drawbattcap(upsval, upsval2);
+    if (!(v > -1e6))                /* also catches NaN */
+        v = -1e6;
+    else if (v > 1e6)
+        v = 1e6;
+    snprintf(value, size, "%.1f", v);
+}
 
-    } else if (strcmp(mycmd, "battvolt") == 0) {
-	drawbattvolt(upsval, upsval2);
+#ifndef HAVE_MINGW
 
-    } else if (strcmp(mycmd, "utility") == 0) {
-	drawutility(upsval, upsval2, upsval3);
+static const char *cache_dir(void)
+{
+    const char *dir = getenv("APCUPSD_IMGCACHE");
+    struct stat st;
 
-    } else if (strcmp(mycmd, "outputv") == 0) {
-	drawupsout(upsval);
+    if (dir == NULL || *dir == '\0')
+        dir = IMGCACHE_DIR;
 
-    } else if (strcmp(mycmd, "runtime") == 0) {
-	drawruntime(upsval, upsval2);
+    /* Refuse a directory someone else could fill or has replaced */
+    mkdir(dir, 0700);
+    if (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid())
+        return NULL;
 
-    } else {
+    return dir;
+}
+
+static bool send_cached(const char *fn, const char *etag)
+{
+    struct stat st;
+    char buf[4096];
+    size_t n;
+    FILE *fp;
+
+    if (stat(fn, &st) != 0 || time(NULL) - st.st_mtime >= IMGCACHE_TTL)
+        return false;
+    if ((fp = fopen(fn, "rb")) == NULL)
+        return false;
+
+    imgheader(etag);
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        fwrite(buf, 1, n, stdout);
+    fclose(fp);
+    return true;
+}
+
+/* Remove expired images, at most once every IMGCACHE_PRUNE seconds */
+static void prune_cache(const char *dir)
+{
+    char fn[MAXSTRING];
+    struct dirent *de;
+    struct stat st;
+    time_t now = time(NULL);
+    DIR *dp;
+    int fd;
+
+    asnprintf(fn, sizeof(fn), "%s/.pruned", dir);
+    if (stat(fn, &st) == 0 && now - st.st_mtime < IMGCACHE_PRUNE)
+        return;
+    if ((fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+        return;
+    close(fd);
+
+    if ((dp = opendir(dir)) == NULL)
+        return;
+    while ((de = readdir(dp)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        asnprintf(fn, sizeof(fn), "%s/%s", dir, de->d_name);
+        if (lstat(fn, &st) == 0 && now - st.st_mtime >= IMGCACHE_TTL)
+            unlink(fn);
+    }
+    closedir(dp);
+}
+
+/* Written under a private name and renamed, so readers never see half */
+static void store_cached(const char *dir, const char *fn, const void *data,
+    int size)
+{
+    char tmp[MAXSTRING];
+    int fd;
+    bool ok;
+
+    asnprintf(tmp, sizeof(tmp), "%s.%d", fn, (int)getpid());
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0)
+        return;
+    ok = write(fd, data, size) == size;
+    if (close(fd) != 0)
+        ok = false;
+    if (!ok || rename(tmp, fn) != 0)
+        unlink(tmp);
+
+    prune_cache(dir);
+}
+
+#else
+
+static const char *cache_dir(void) { return NULL; }
+static bool send_cached(const char *, const char *) { return false; }
+static void store_cached(const char *, const char *, const void *, int) {}
+
+#endif /* HAVE_MINGW */
+
+int main (int argc, char **argv)
+{
+    char *values[] = { upsval, upsval2, upsval3 };
+    char key[128], etag[160], fn[MAXSTRING];
+    const char *dir, *inm;
+    gdImagePtr im;
+    void *data;
+    int i, nvalues, len, size;
+
+#ifdef WIN32
+    setmode(fileno(stdout), O_BINARY);
+#endif
+
+    cgi_serve(argc, argv, 0);
+    (void) extractcgiargs();
+
+    if ((nvalues = graph_values(mycmd)) < 0) {
         puts("Status: 400 Bad request");
         puts("Content-Type: text/plain; charset=utf-8\n");
         puts("400 Bad request");
 	exit(EXIT_FAILURE);
     }
+
+    len = asnprintf(key, sizeof(key), "%s", mycmd);
+    for (i = 0; i < nvalues; i++) {
+        quantize(values[i], sizeof(upsval));
+        len += asnprintf(key + len, sizeof(key) - len, "_%s", values[i]);
+    }
+    asnprintf(etag, sizeof(etag), "\"%d-%s\"", IMGCACHE_VERSION, key);
+
+    /* The key says everything about the image: no need to look further */
+    inm = getenv("HTTP_IF_NONE_MATCH");
+    if (inm && (strstr(inm, etag) || strcmp(inm, "*") == 0)) {
+        puts("Status: 304 Not Modified");
+        printf("ETag: %s\n", etag);
+        printf("Cache-Control: max-age=%d\n\n", IMGCACHE_TTL);
+        exit(EXIT_SUCCESS);
+    }
+
+    dir = cache_dir();
+    if (dir) {
+        asnprintf(fn, sizeof(fn), "%s/%s-%d.%s", dir, key, IMGCACHE_VERSION,
+            IMGEXT);
+        if (send_cached(fn, etag))
+            exit(EXIT_SUCCESS);
+    }
+
+    im = render();
+#ifdef SYS_IMGFMT_PNG
+    data = gdImagePngPtr(im, &size);
+#else
+    data = gdImageGifPtr(im, &size);
+#endif
+    gdImageDestroy(im);
+    if (data == NULL)
+        exit(EXIT_FAILURE);
+
+    imgheader(etag);
+    fwrite(data, 1, size, stdout);
+    fflush(stdout);
+
+    if (dir)
+        store_cached(dir, fn, data, size);
+    gdFree(data);
+
     exit(EXIT_SUCCESS);
 }
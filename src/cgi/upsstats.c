@@ -175,6 +175,7 @@ int main(int argc, char **argv)
     char *p;
     char   answer[256];
 
+    cgi_serve(argc, argv, FETCH_TIMEOUT_MS);
     (void) extractcgiargs();
 
     p = strstr(monhost, "%3");
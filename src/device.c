@@ -45,9 +45,12 @@
  */
 
 #include "apc.h"
+#include "aring.h"
+#include "autil.h"
 
-/* Forward referenced function */
+/* Forward referenced functions */
 static int device_wait_time(UPSINFO *ups);
+static bool device_io_ready(UPSINFO *ups);
 
 /*********************************************************************/
 bool setup_device(UPSINFO *ups)
@@ -65,8 +68,10 @@ void initiate_hibernate(UPSINFO *ups)
 
    if (ups->mode.type == DUMB_UPS) {
       /* Make sure we are on battery */
-      for (killcount = 0; killcount < 3; killcount++)
-         device_read_volatile_data(ups);
+      if (device_io_ready(ups)) {
+         for (killcount = 0; killcount < 3; killcount++)
+            device_read_volatile_data(ups);
+      }
    }
 
    /*
@@ -127,7 +132,8 @@ void initiate_hibernate(UPSINFO *ups)
          return;
       } else {
          /* it must be a SmartUPS or BackUPS */
-         device_kill_power(ups);
+         if (device_io_ready(ups))
+            device_kill_power(ups);
       }
    }
 }
@@ -143,10 +149,9 @@ void initiate_shutdown(UPSINFO *ups)
  * After the device is initialized, we come here
  * to read all the information we can about the UPS.
  */
-void prep_device(UPSINFO *ups)
+/* Fill in what the UPS did not tell us about itself */
+static void tidy_static_data(UPSINFO *ups)
 {
-   device_read_static_data(ups);
-
    /* If no UPS name found, use hostname, or "default" */
    if (ups->upsname[0] == 0) {     /* no name given */
       gethostname(ups->upsname, sizeof(ups->upsname) - 1);
@@ -162,113 +167,432 @@ void prep_device(UPSINFO *ups)
    }
 }
 
-/* Called once every 5 seconds to read all UPS info */
+/*
+ * Time a call into the driver to read data from the UPS and count it
+ * if it fails.
+ */
+static void timed_read(UPSINFO *ups, bool volatile_data)
+{
+   long long start = mono_nsec();
+   bool ok;
+
+   if (volatile_data)
+      ok = device_read_volatile_data(ups);
+   else
+      ok = device_read_static_data(ups);
+
+   write_lock(ups);
+   lathist_add(volatile_data ? &ups->selfstats.poll_volatile :
+      &ups->selfstats.poll_static, (mono_nsec() - start) / 1000);
+   if (!ok)
+      ups->selfstats.poll_errors++;
+   write_unlock(ups);
+}
+
+void prep_device(UPSINFO *ups)
+{
+   timed_read(ups, false);
+   tidy_static_data(ups);
+}
+
+/*
+ * Restore capabilities and static data saved by an earlier run if the
+ * UPS still reports the same serial number. Returns false if the UPS
+ * has to be probed in full.
+ */
+static bool use_cache(UPSINFO *ups)
+{
+   struct capcache *cache;
+   char serial[sizeof(ups->serial)];
+   bool ok;
+
+   if ((cache = cache_load(ups)) == NULL)
+      return false;
+
+   serial[0] = 0;
+   device_entry_point(ups, DEVICE_CMD_GET_SERIAL, serial);
+   ok = serial[0] && strcmp(serial, cache_serial(cache)) == 0;
+   if (ok)
+      cache_apply(ups, cache);
+   else
+      Dmsg(50, "Serial \"%s\" does not match cache, probing UPS\n", serial);
+
+   cache_free(cache);
+   return ok;
+}
+
+/*
+ * Probe the UPS in full after starting from the cache, and log it if
+ * the UPS turns out to have changed. The cached capabilities stay in
+ * effect while the probe runs, so do_action() and the reports keep
+ * every value they had. A driver that only ever sets capabilities
+ * cannot withdraw one this way, but a UPS with the same serial number
+ * is not expected to lose any.
+ */
+static void revalidate_cache(UPSINFO *ups)
+{
+   char caps[sizeof(ups->UPS_Cap)];
+
+   read_lock(ups);
+   memcpy(caps, ups->UPS_Cap, sizeof(caps));
+   read_unlock(ups);
+
+   device_get_capabilities(ups);
+   prep_device(ups);
+
+   if (memcmp(caps, ups->UPS_Cap, sizeof(caps)) != 0)
+      log_event(ups, LOG_NOTICE, "UPS capabilities changed since they were cached");
+   cache_save(ups);
+}
+
+/*
+ * Poll the UPS for whichever CI groups are due. Drivers that query
+ * CIs one by one consult poll_ci_due(); the others are simply polled
+ * at the rate of the fastest group. Returns 1 if the UPS was polled.
+ */
 int fillUPS(UPSINFO *ups)
 {
-   device_read_volatile_data(ups);
+   int polled = 0;
 
-   return 0;
+   if (poll_sched_begin(ups)) {
+      timed_read(ups, true);
+      polled = 1;
+   }
+   poll_sched_end(ups);
+
+   return polled;
 }
 
-static void open_ups(UPSINFO *ups)
+/*
+ * Returns true if the capabilities and static data came from the
+ * cache and still need to be checked against the UPS.
+ */
+static bool open_ups(UPSINFO *ups)
 {
    // Don't issue a COMMLOST event until we've been running for a little while
-   static const time_t COMMLOST_EVENT_GRACE_PERIOD = 60;
+   static const int COMMLOST_EVENT_GRACE_PERIOD = 60 * 1000;
 
-   time_t event_time = 0;
+   LinkHealth link(ups, 1, COMMLOST_EVENT_GRACE_PERIOD);
 
    while (!device_open(ups))
    {
-      // Failed to communicate with UPS: we're COMMLOST now
+      // Failed to communicate with UPS: we're COMMLOST now, but the
+      // event waits until we've retried for a while
+      link.failure();
       ups->set_commlost();
-
-      // Do not generate COMMLOST event until we've retried a few times
-      time_t now = time(NULL);
-      if (now - ups->start_time >= COMMLOST_EVENT_GRACE_PERIOD)
-      {
-         // Generate an event once
-         if (event_time == 0)
-         {
-            generate_event(ups, CMDCOMMFAILURE);
-            event_time = now;
-         }
-
-         // Log every 10 minutes thereafter
-         if ((now - event_time) >= 10*60)
-         {
-            event_time = now;
-            log_event(ups, event_msg[CMDCOMMFAILURE].level,
-               event_msg[CMDCOMMFAILURE].msg);            
-         }
-      }
-
-      sleep(5);
+      link.wait();
    }
 
    // If we were commlost, we're not any more
-   if (ups->is_commlost())
-   {
-      ups->clear_commlost();
-      if (event_time)
-         generate_event(ups, CMDCOMMOK);
-   }
+   link.success();
 
    // Complete remainder of UPS setup
    device_setup(ups);
+   if (use_cache(ups)) {
+      Dmsg(10, "Using cached capabilities from %s\n", ups->capcache);
+      tidy_static_data(ups);
+      return true;
+   }
+
    device_get_capabilities(ups);
    prep_device(ups);
+   cache_save(ups);
+   return false;
+}
+
+/*
+ * Apply a SIGHUP reload between polls. The driver and device stay as
+ * they are; the NIS server notices a new address by itself.
+ */
+static void reload(UPSINFO *ups)
+{
+   int changed = reload_config(ups);
+
+   if (changed < 0)
+      return;
+   if (changed & RELOAD_REPORTS)
+      reset_reports(ups);
+   if (changed & RELOAD_HOOKS)
+      start_event_hooks(ups, argvalue);
+}
+
+/*
+ * The poller thread owns all routine driver I/O and tells do_device()
+ * about each pass through a lock-free ring. A pipe serves as doorbell
+ * so do_device() can sleep until either a sample or its next tick.
+ */
+typedef struct {
+   long long when;                 /* mono_msec() at end of pass */
+   long long changed;              /* mono_nsec() if an event bit changed */
+   int32_t Status;
+} POLLSAMPLE;
+
+/* Status bits whose change do_action() turns into an event at once */
+static const int32_t EVENT_BITS =
+   UPS_online | UPS_onbatt | UPS_battlow | UPS_battpresent;
+
+struct pollq {
+   aring<POLLSAMPLE, 16> samples;
+   int bell[2];
+   pthread_mutex_t io_mutex;       /* held while inside the driver */
+   pthread_cond_t acted;           /* do_action() has seen a change */
+   bool acting;                    /* ... and is yet to, under io_mutex */
+   bool io_held;                   /* do_device() holds io_mutex */
+   int32_t last_status;            /* as of the last sample */
+};
+
+/* Longest the poller stays out of the driver for do_action() */
+static const int ACT_WAIT_MS = 2000;
+
+/* do_device() ticks this many msec after each second of time() */
+static const int TICK_SLACK = 5;
+
+/*
+ * Tell do_device() about a poll, or about a status change seen since.
+ * Called with io_mutex held.
+ *
+ * When an event bit has changed, do_action() is about to act on it and
+ * may well need the driver, for instance to check for a self test on a
+ * power failure. Rather than have it wait for the next check_state()
+ * to time out, stay out of the driver until do_action() has run.
+ */
+static void publish_sample(UPSINFO *ups, bool polled)
+{
+   struct timespec abstime;
+   struct pollq *q = ups->pollq;
+   POLLSAMPLE s;
+   char c = 0;
+
+   read_lock(ups);
+   s.Status = ups->Status;
+   read_unlock(ups);
+   if (!polled && s.Status == q->last_status)
+      return;
+   s.changed = (s.Status ^ q->last_status) & EVENT_BITS ? mono_nsec() : 0;
+   q->last_status = s.Status;
+   s.when = mono_msec();
+
+   /*
+    * If the ring is full do_device() is already due to wake and will
+    * find the newest data in UPSINFO regardless.
+    */
+   if (s.changed)
+      q->acting = true;
+   if (q->samples.push(s))
+      write(q->bell[1], &c, 1);
+
+   if (s.changed) {
+      calc_abstimeout(ACT_WAIT_MS, &abstime);
+      while (q->acting) {
+         if (pthread_cond_timedwait(&q->acted, &q->io_mutex, &abstime) != 0)
+            break;
+      }
+      q->acting = false;
+   }
 }
 
 /* NOTE! This is the starting point for a separate process (thread). */
-void do_device(UPSINFO *ups)
+static void poll_device(UPSINFO *ups)
 {
+   struct pollq *q = ups->pollq;
+   bool polled, cached;
+
    /* Open the UPS device and ensure we can talk to it. This does not return
       until the UPS is successfully contacted */
-   open_ups(ups);
-
-   /* get all data so apcaccess is happy */
-   fillUPS(ups);
+   cached = open_ups(ups);
 
    while(1)
    {
+      /* Get the info that is due from the UPS by asking it questions */
+      P(q->io_mutex);
+      polled = fillUPS(ups);
+      publish_sample(ups, polled);
+      V(q->io_mutex);
+
+      /* The first sample is out, so now there is time to check the cache */
+      if (cached) {
+         P(q->io_mutex);
+         revalidate_cache(ups);
+         V(q->io_mutex);
+         cached = false;
+      }
+
       /* compute appropriate wait time */
       ups->wait_time = device_wait_time(ups);
 
-      Dmsg(70, "Before do_action: 0x%x (OB:%d).\n",
+      Dmsg(70, "Before device_check_state: 0x%x (OB:%d).\n",
          ups->Status, ups->is_onbatt());
 
-      /* take event actions */
-      do_action(ups);
+      /*
+       * Check the UPS to see if has changed state.
+       * This routine waits a reasonable time to prevent
+       * consuming too much CPU time.
+       */
+      P(q->io_mutex);
+      device_check_state(ups);
 
-      Dmsg(70, "Before fillUPS: 0x%x (OB:%d).\n",
-         ups->Status, ups->is_onbatt());
+      /*
+       * Drivers that catch events, such as an alert from the UPS or a
+       * HID report, may have updated the status already. Pass that on
+       * now rather than after the next full poll.
+       */
+      publish_sample(ups, false);
+      V(q->io_mutex);
+   }
+}
 
-      /* Get all info available from UPS by asking it questions */
-      fillUPS(ups);
+/* Set up the poller for a UPS and start its thread */
+void start_device(UPSINFO *ups, char *argv0)
+{
+   struct pollq *q = new pollq;
+   int i;
+
+   if (pipe(q->bell) == -1)
+      Error_abort("Cannot create pipe: %s\n", strerror(errno));
+   for (i = 0; i < 2; i++) {
+      fcntl(q->bell[i], F_SETFL, fcntl(q->bell[i], F_GETFL) | O_NONBLOCK);
+      fcntl(q->bell[i], F_SETFD, FD_CLOEXEC);
+   }
+   pthread_mutex_init(&q->io_mutex, NULL);
+   pthread_cond_init(&q->acted, NULL);
+   q->acting = false;
+   q->io_held = false;
+   q->last_status = 0;
+
+   ups->pollq = q;
+   start_thread(ups, poll_device, "apcupsd-poll", argv0);
+}
 
-      Dmsg(70, "Before do_action: 0x%x (OB:%d).\n",
-         ups->Status, ups->is_onbatt());
+/* Call a driver entry point from do_action() */
+void device_command(UPSINFO *ups, int command)
+{
+   if (device_io_ready(ups))
+      device_entry_point(ups, command, NULL);
+}
 
-      /* take event actions */
-      do_action(ups);
+/*
+ * May do_action() call into the driver? It holds the UPS write lock,
+ * and the poller takes io_mutex before the UPS lock, so io_mutex must
+ * have been taken ahead of it; do_device() does so on every pass that
+ * may need the driver. Should the status have changed after it looked,
+ * the poller is usually parked in publish_sample() with io_mutex free.
+ * Otherwise the driver call is skipped, as waiting would deadlock.
+ * Before start_device() there is no poller to keep out.
+ */
+static bool device_io_ready(UPSINFO *ups)
+{
+   struct pollq *q = ups->pollq;
 
-      Dmsg(70, "Before do_reports: 0x%x (OB:%d).\n",
-         ups->Status, ups->is_onbatt());
+   if (q == NULL || q->io_held)
+      return true;
 
-      do_reports(ups);
+   if (pthread_mutex_trylock(&q->io_mutex) == 0) {
+      q->io_held = true;           /* do_device() releases it */
+      return true;
+   }
 
-      /* compute appropriate wait time */
-      ups->wait_time = device_wait_time(ups);
+   Dmsg(50, "Poller is in the driver, skipping driver call.\n");
+   return false;
+}
 
-      Dmsg(70, "Before device_check_state: 0x%x (OB:%d).\n",
-         ups->Status, ups->is_onbatt());
+/*
+ * Milliseconds until the next tick. do_action() measures its timeouts
+ * in whole seconds of time(), so ticking just after each second begins
+ * acts on every deadline within a few milliseconds of it passing.
+ */
+static int tick_wait(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return 1000 - tv.tv_usec / 1000 + TICK_SLACK;
+}
+
+/*
+ * NOTE! This is the starting point for a separate process (thread).
+ *
+ * The decision loop. Actions and reports run on every sample from the
+ * poller and on every tick, so a slow or hung driver cannot delay a
+ * shutdown decision.
+ */
+void do_device(UPSINFO *ups)
+{
+   struct pollq *q = ups->pollq;
+   POLLSAMPLE s;
+   long long last = 0;
+   bool changed;
+   struct timeval tv;
+   fd_set rfds;
+   char buf[64];
+   int msec;
+   bool io;
+
+   while(1)
+   {
+      if (reload_pending(ups))
+         reload(ups);
+
+      msec = tick_wait();
+      tv.tv_sec = msec / 1000;
+      tv.tv_usec = (msec % 1000) * 1000;
+      FD_ZERO(&rfds);
+      FD_SET(q->bell[0], &rfds);
+      if (select(q->bell[0] + 1, &rfds, NULL, NULL, &tv) > 0) {
+         while (read(q->bell[0], buf, sizeof(buf)) > 0)
+            ;
+      }
+
+      changed = false;
+      while (q->samples.pop(s)) {
+         last = s.when;
+         if (s.changed && !changed) {
+            ups->event_stamp = s.changed;
+            changed = true;
+         }
+      }
+
+      /* Nothing to act on until the UPS has been contacted */
+      if (last == 0)
+         continue;
+
+      Dmsg(70, "Before do_action: 0x%x (OB:%d), data %lld ms old.\n",
+         ups->Status, ups->is_onbatt(), mono_msec() - last);
 
       /*
-       * Check the UPS to see if has changed state.
-       * This routine waits a reasonable time to prevent
-       * consuming too much CPU time.
+       * Keep the poller out of the driver for the whole of an action that
+       * may need it: io_mutex goes before the UPS lock. Quiet passes on
+       * mains need no driver, and do not wait out a check_state() that
+       * may last a minute.
        */
-      device_check_state(ups);
+      read_lock(ups);
+      io = changed || ups->is_onbatt() || (ups->PrevStatus & UPS_onbatt) ||
+           ups->is_shut_remote() || ups->is_shutdown();
+      read_unlock(ups);
+      if (io) {
+         P(q->io_mutex);
+         q->io_held = true;
+      }
+
+      /* take event actions */
+      do_action(ups);
+
+      /* A change that raised no event this time is not timed later */
+      ups->event_stamp = 0;
+
+      /* Let the poller back into the driver */
+      if (q->io_held) {
+         if (changed) {
+            q->acting = false;
+            pthread_cond_signal(&q->acted);
+         }
+         q->io_held = false;
+         V(q->io_mutex);
+      }
+
+      Dmsg(70, "Before do_reports: 0x%x (OB:%d).\n",
+         ups->Status, ups->is_onbatt());
+
+      do_reports(ups);
    }
 }
 
@@ -283,21 +607,24 @@ void do_device(UPSINFO *ups)
  */
 static int device_wait_time(UPSINFO *ups)
 {
-   int wait_time;
+   int wait_time, sched_wait;
 
-   if (ups->is_fastpoll() || !ups->is_battpresent())
+   /*
+    * Be quick on battery even before do_action() has set fastpoll, so
+    * device_command() never waits long. Reports run on their own
+    * timer in do_device() and need no wakeups here.
+    */
+   if (ups->is_fastpoll() || ups->is_onbatt() || !ups->is_battpresent())
       wait_time = TIMER_FAST;
    else if (ups->is_commlost())
       wait_time = TIMER_FAST*5;
    else
       wait_time = ups->polltime;    /* normally 60 seconds */
 
-   /* Make sure we do data and stats when asked */
-   if (ups->datatime && ups->datatime < wait_time)
-      wait_time = ups->datatime;
-
-   if (ups->stattime && ups->stattime < wait_time)
-      wait_time = ups->stattime;
+   /* Wake up in time for the next poll that is due */
+   sched_wait = poll_sched_wait(ups);
+   if (sched_wait < wait_time)
+      wait_time = sched_wait;
 
    /* Sanity check */
    if (wait_time < TIMER_FAST)
@@ -69,6 +69,8 @@ private:
    struct termios _oldtio;
    struct termios _newtio;
    bool _linkcheck;
+   LinkHealth _link;                    /* Paces UPSlinkCheck() retries */
+   char _answer[2000];                  /* Last smart_poll() reply */
 };
 
 #endif   /* _APCSMART_H */
@@ -119,7 +119,8 @@ LastXferCause ApcSmartUpsDriver::decode_lastxfer(char *str)
 
 ApcSmartUpsDriver::ApcSmartUpsDriver(UPSINFO *ups) :
    UpsDriver(ups),
-   _linkcheck(false)
+   _linkcheck(false),
+   _link(ups, 1, COMMLOST_TIMEOUT_MS, 1000, 1000)
 {
    memset(&_oldtio, 0, sizeof(_oldtio));
    memset(&_newtio, 0, sizeof(_newtio));
@@ -138,28 +139,29 @@ void ApcSmartUpsDriver::writechar(char a)
  */
 char *ApcSmartUpsDriver::smart_poll(char cmd)
 {
-   static char answer[2000];
    int stat, retry;
 
-   *answer = 0;
+   *_answer = 0;
    if (_ups->fd == -1)
-      return answer;
+      return _answer;
 
    /* Don't retry Y/SM command */
    retry = (cmd == 'Y') ? 0 : 2;
 
    do {
       write(_ups->fd, &cmd, 1);
-      stat = getline(answer, sizeof answer);
+      stat = getline(_answer, sizeof(_answer));
 
       /* If nothing returned, the link is probably down */
-      if (*answer == 0 && stat == FAILURE) {
+      if (*_answer == 0 && stat == FAILURE) {
          UPSlinkCheck();           /* wait for link to come up */
-         *answer = 0; /* UPSlinkCheck invokes us recursively, so clean up */
+         *_answer = 0; /* UPSlinkCheck invokes us recursively, so clean up */
+         if (retry > 0)
+            stats_retries(_ups, 1);
       }
-   } while (*answer == 0 && stat == FAILURE && retry--);
+   } while (*_answer == 0 && stat == FAILURE && retry--);
 
-   return answer;
+   return _answer;
 }
 
 /*
@@ -338,8 +340,6 @@ int ApcSmartUpsDriver::getline(char *s, int len)
 /* Note this routine MUST be called with the UPS write lock held! */
 void ApcSmartUpsDriver::UPSlinkCheck()
 {
-   struct timeval now, prev, start;
-
    if (_linkcheck)
       return;
 
@@ -354,32 +354,17 @@ void ApcSmartUpsDriver::UPSlinkCheck()
 
    write_unlock(_ups);
 
-   gettimeofday(&start, NULL);
-   prev = start;
-
    tcflush(_ups->fd, TCIOFLUSH);
    while (strcmp(smart_poll('Y'), "SM") != 0) {
-      /* Declare commlost only if COMMLOST_TIMEOUT_MS has expired */
-      gettimeofday(&now, NULL);
-      if (TV_DIFF_MS(start, now) >= COMMLOST_TIMEOUT_MS) {
-         /* Generate commlost event if we've not done so yet */
-         if (!_ups->is_commlost()) {
-            _ups->set_commlost();
-            generate_event(_ups, CMDCOMMFAILURE);
-            prev = now;
-         }
-
-         /* Log an event every 10 minutes */
-         if (TV_DIFF_MS(prev, now) >= 10*60*1000) {
-            log_event(_ups, event_msg[CMDCOMMFAILURE].level,
-               event_msg[CMDCOMMFAILURE].msg);
-            prev = now;
-         }
-      }
+      /*
+       * Declares commlost once COMMLOST_TIMEOUT_MS has expired and logs
+       * an event every 10 minutes after that.
+       */
+      _link.failure();
 
       /*
        * If we've declared COMMLOST, close the port and reopen it after we
-       * sleep a little while. This is helpful for cases where the serial
+       * wait a little while. This is helpful for cases where the serial
        * device is removable and the user might have yanked it out and the dev
        * node will change when they plug it back in.
        */
@@ -387,12 +372,12 @@ void ApcSmartUpsDriver::UPSlinkCheck()
          Close();
 
       /*
-       * This sleep should not be necessary since the smart_poll() 
-       * routine normally waits TIMER_FAST (1) seconds. However,
-       * in case the serial port is broken and generating spurious
-       * characters, we sleep to reduce CPU consumption. 
+       * smart_poll() normally waits TIMER_FAST (1) seconds already, but
+       * a broken serial port may be generating spurious characters, and
+       * a port that cannot be opened fails at once. The backoff waits
+       * up to a second, so a retry comes about every two seconds.
        */
-      sleep(1);
+      _link.wait();
 
       /*
        * Open the port again. This might fail, in which case _ups->fd will be
@@ -408,10 +393,8 @@ void ApcSmartUpsDriver::UPSlinkCheck()
 
    write_lock(_ups);
 
-   if (_ups->is_commlost()) {
-      _ups->clear_commlost();
-      generate_event(_ups, CMDCOMMOK);
-   }
+   /* Back in contact: clears commlost and resets the backoff */
+   _link.success();
 
    _linkcheck = false;
 }
@@ -420,7 +403,8 @@ void ApcSmartUpsDriver::UPSlinkCheck()
  *
  *  This subroutine is called to load our shared memory with
  *  information that is changing inside the UPS depending
- *  on the state of the UPS and the mains power.
+ *  on the state of the UPS and the mains power. Only the CIs
+ *  whose refresh group is due are asked for.
  */
 bool ApcSmartUpsDriver::read_volatile_data()
 {
@@ -433,7 +417,7 @@ bool ApcSmartUpsDriver::read_volatile_data()
    _ups->poll_time = time(NULL);    /* save time stamp */
 
    /* UPS_STATUS */
-   if (_ups->UPS_Cap[CI_STATUS]) {
+   if (poll_ci_due(_ups, CI_STATUS)) {
       char status[10];
       int retries = 5;             /* Number of retries on status read */
 
@@ -462,14 +446,14 @@ bool ApcSmartUpsDriver::read_volatile_data()
    }
 
    /* ONBATT_STATUS_FLAG -- line quality */
-   if (_ups->UPS_Cap[CI_LQUAL]) {
+   if (poll_ci_due(_ups, CI_LQUAL)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_LQUAL]);
       Dmsg(80, "Got CI_LQUAL: %s\n", answer);
       strlcpy(_ups->linequal, answer, sizeof(_ups->linequal));
    }
 
    /* Reason for last transfer to batteries */
-   if (_ups->UPS_Cap[CI_WHY_BATT]) {
+   if (poll_ci_due(_ups, CI_WHY_BATT)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_WHY_BATT]);
       Dmsg(80, "Got CI_WHY_BATT: %s\n", answer);
       _ups->lastxfer = decode_lastxfer(answer);
@@ -485,98 +469,98 @@ bool ApcSmartUpsDriver::read_volatile_data()
    }
 
    /* Results of last self test */
-   if (_ups->UPS_Cap[CI_ST_STAT]) {
+   if (poll_ci_due(_ups, CI_ST_STAT)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_ST_STAT]);
       Dmsg(80, "Got CI_ST_STAT: %s\n", answer);
       _ups->testresult = decode_testresult(answer);
    }
 
    /* LINE_VOLTAGE */
-   if (_ups->UPS_Cap[CI_VLINE]) {
+   if (poll_ci_due(_ups, CI_VLINE)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_VLINE]);
       Dmsg(80, "Got CI_VLINE: %s\n", answer);
       _ups->LineVoltage = atof(answer);
    }
 
    /* UPS_LINE_MAX */
-   if (_ups->UPS_Cap[CI_VMAX]) {
+   if (poll_ci_due(_ups, CI_VMAX)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_VMAX]);
       Dmsg(80, "Got CI_VMAX: %s\n", answer);
       _ups->LineMax = atof(answer);
    }
 
    /* UPS_LINE_MIN */
-   if (_ups->UPS_Cap[CI_VMIN]) {
+   if (poll_ci_due(_ups, CI_VMIN)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_VMIN]);
       Dmsg(80, "Got CI_VMIN: %s\n", answer);
       _ups->LineMin = atof(answer);
    }
 
    /* OUTPUT_VOLTAGE */
-   if (_ups->UPS_Cap[CI_VOUT]) {
+   if (poll_ci_due(_ups, CI_VOUT)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_VOUT]);
       Dmsg(80, "Got CI_VOUT: %s\n", answer);
       _ups->OutputVoltage = atof(answer);
    }
 
    /* BATT_FULL Battery level percentage */
-   if (_ups->UPS_Cap[CI_BATTLEV]) {
+   if (poll_ci_due(_ups, CI_BATTLEV)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_BATTLEV]);
       Dmsg(80, "Got CI_BATTLEV: %s\n", answer);
       _ups->BattChg = atof(answer);
    }
 
    /* BATT_VOLTAGE */
-   if (_ups->UPS_Cap[CI_VBATT]) {
+   if (poll_ci_due(_ups, CI_VBATT)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_VBATT]);
       Dmsg(80, "Got CI_VBATT: %s\n", answer);
       _ups->BattVoltage = atof(answer);
    }
 
    /* UPS_LOAD */
-   if (_ups->UPS_Cap[CI_LOAD]) {
+   if (poll_ci_due(_ups, CI_LOAD)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_LOAD]);
       Dmsg(80, "Got CI_LOAD: %s\n", answer);
       _ups->UPSLoad = atof(answer);
    }
 
    /* LINE_FREQ */
-   if (_ups->UPS_Cap[CI_FREQ]) {
+   if (poll_ci_due(_ups, CI_FREQ)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_FREQ]);
       Dmsg(80, "Got CI_FREQ: %s\n", answer);
       _ups->LineFreq = atof(answer);
    }
 
    /* UPS_RUNTIME_LEFT */
-   if (_ups->UPS_Cap[CI_RUNTIM]) {
+   if (poll_ci_due(_ups, CI_RUNTIM)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_RUNTIM]);
       Dmsg(80, "Got CI_RUNTIM: %s\n", answer);
       _ups->TimeLeft = atof(answer);
    }
 
    /* UPS_TEMP */
-   if (_ups->UPS_Cap[CI_ITEMP]) {
+   if (poll_ci_due(_ups, CI_ITEMP)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_ITEMP]);
       Dmsg(80, "Got CI_ITEMP: %s\n", answer);
       _ups->UPSTemp = atof(answer);
    }
 
    /* DIP_SWITCH_SETTINGS */
-   if (_ups->UPS_Cap[CI_DIPSW]) {
+   if (poll_ci_due(_ups, CI_DIPSW)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_DIPSW]);
       Dmsg(80, "Got CI_DIPSW: %s\n", answer);
       _ups->dipsw = strtoul(answer, NULL, 16);
    }
 
    /* Register 1 */
-   if (_ups->UPS_Cap[CI_REG1]) {
+   if (poll_ci_due(_ups, CI_REG1)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_REG1]);
       Dmsg(80, "Got CI_REG1: %s\n", answer);
       _ups->reg1 = strtoul(answer, NULL, 16);
    }
 
    /* Register 2 */
-   if (_ups->UPS_Cap[CI_REG2]) {
+   if (poll_ci_due(_ups, CI_REG2)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_REG2]);
       Dmsg(80, "Got CI_REG2: %s\n", answer);
       _ups->reg2 = strtoul(answer, NULL, 16);
@@ -584,28 +568,28 @@ bool ApcSmartUpsDriver::read_volatile_data()
    }
 
    /* Register 3 */
-   if (_ups->UPS_Cap[CI_REG3]) {
+   if (poll_ci_due(_ups, CI_REG3)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_REG3]);
       Dmsg(80, "Got CI_REG3: %s\n", answer);
       _ups->reg3 = strtoul(answer, NULL, 16);
    }
 
    /* Humidity percentage */
-   if (_ups->UPS_Cap[CI_HUMID]) {
+   if (poll_ci_due(_ups, CI_HUMID)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_HUMID]);
       Dmsg(80, "Got CI_HUMID: %s\n", answer);
       _ups->humidity = atof(answer);
    }
 
    /* Ambient temperature */
-   if (_ups->UPS_Cap[CI_ATEMP]) {
+   if (poll_ci_due(_ups, CI_ATEMP)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_ATEMP]);
       Dmsg(80, "Got CI_ATEMP: %s\n", answer);
       _ups->ambtemp = atof(answer);
    }
 
    /* Hours since self test */
-   if (_ups->UPS_Cap[CI_ST_TIME]) {
+   if (poll_ci_due(_ups, CI_ST_TIME)) {
       answer = smart_poll(_ups->UPS_Cmd[CI_ST_TIME]);
       Dmsg(80, "Got CI_ST_TIME: %s\n", answer);
       _ups->LastSTTime = atof(answer);
@@ -798,6 +782,12 @@ bool ApcSmartUpsDriver::entry_point(int command, void *data)
       printf("Going dumb: %s\n", ans);
       break;
 
+   case DEVICE_CMD_GET_SERIAL:
+      /* Cheap identity check for the capability cache */
+      strlcpy((char *)data, smart_poll(_ups->UPS_Cmd[CI_SERNO]),
+         sizeof(_ups->serial));
+      break;
+
    case DEVICE_CMD_GET_SELFTEST_MSG:
       /* Results of last self test */
       if (_ups->UPS_Cap[CI_ST_STAT]) {
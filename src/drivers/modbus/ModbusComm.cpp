@@ -143,8 +143,13 @@ bool ModbusComm::SendAndWait(
    txfrm[txsz+3] = crc >> 8;
 
    int retries = 2;
+   bool retry = false;
    do
    {
+      if (retry)
+         _retries++;
+      retry = true;
+
       if (!ModbusTx(&txfrm, txsz+4))
       {
          // Failure to send is immediately fatal
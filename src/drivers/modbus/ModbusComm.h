@@ -31,7 +31,7 @@ class ModbusComm
 {
 public:
    ModbusComm(uint8_t slaveaddr = DEFAULT_SLAVE_ADDR) : 
-      _slaveaddr(slaveaddr), _open(false) {}
+      _slaveaddr(slaveaddr), _open(false), _retries(0) {}
    virtual ~ModbusComm() {}
 
    virtual bool Open(const char *dev) = 0;
@@ -40,6 +40,9 @@ public:
    virtual uint8_t *ReadRegister(uint16_t addr, unsigned int nregs);
    virtual bool WriteRegister(uint16_t reg, unsigned int nregs, const uint8_t *data);
 
+   // Retries since the last call
+   unsigned long TakeRetries() { unsigned long n = _retries; _retries = 0; return n; }
+
 protected:
 
    uint16_t ModbusCrc(const uint8_t *data, unsigned int sz);
@@ -71,6 +74,7 @@ protected:
 
    uint8_t _slaveaddr;
    bool _open;
+   unsigned long _retries;
 
 private:
 
@@ -570,6 +570,7 @@ bool ModbusUpsDriver::read_static_data()
    write_lock(_ups);
    bool ret = UpdateCis(false);
    write_unlock(_ups);
+   stats_retries(_ups, _comm->TakeRetries());
    return ret;
 }
 
@@ -589,6 +590,7 @@ bool ModbusUpsDriver::read_volatile_data()
       _ups->poll_time = time(NULL);
    }
    write_unlock(_ups);
+   stats_retries(_ups, _comm->TakeRetries());
    return ret;
 }
 
@@ -132,8 +132,7 @@ NetUpsDriver::NetUpsDriver(UPSINFO *ups) :
    _got_static_data(false),
    _last_fill_time(0),
    _statlen(0),
-   _tlog(0),
-   _comm_err(false),
+   _link(ups),
    _comm_loss(0)
 {
    memset(_device, 0, sizeof(_device));
@@ -197,6 +196,7 @@ bool NetUpsDriver::poll_ups()
 {
    int n, stat = 1;
    char buf[1000];
+   NETREADER reader;
 
    _statbuf[0] = 0;
    _statlen = 0;
@@ -218,7 +218,8 @@ bool NetUpsDriver::poll_ups()
    }
 
    Dmsg(99, "===============\n");
-   while ((n = net_recv(_sockfd, buf, sizeof(buf) - 1)) > 0) {
+   net_reader_init(&reader, _sockfd);
+   while ((n = net_recv_buffered(&reader, buf, sizeof(buf) - 1)) > 0) {
       buf[n] = 0;
       strlcat(_statbuf, buf, sizeof(_statbuf));
       Dmsg(99, "Partial buf (%d, %d):\n%s", n, strlen(_statbuf), buf);
@@ -257,26 +258,22 @@ bool NetUpsDriver::fill_status_buffer()
       return true;
    }
 
-   if (!poll_ups()) {
-      /* generate event once */
-      if (!_comm_err) {
-         execute_command(_ups, ups_event[CMDCOMMFAILURE]);
-         _comm_err = true;
-      }
+   /* While the master is unreachable, retry only when the backoff allows */
+   if (!_link.ready()) {
+      Dmsg(90, "Exit fill_status_buffer, waiting to reconnect\n");
+      return false;
+   }
 
-      /* log every 10 minutes */
-      if (now - _tlog >= 10 * 60) {
-         _tlog = now;
-         log_event(_ups, event_msg[CMDCOMMFAILURE].level,
-            event_msg[CMDCOMMFAILURE].msg);
-      }
+   if (!poll_ups()) {
+      /*
+       * Generates the event once, then logs every 10 minutes. The event
+       * goes through generate_event() like the other drivers', which
+       * logs it and runs the hooks and apccontrol just as the direct
+       * execute_event() and log_event() did.
+       */
+      _link.failure();
    } else {
-      if (_comm_err) {
-         generate_event(_ups, CMDCOMMOK);
-         _tlog = 0;
-         _comm_err = false;
-      }
-
+      _link.success();
       _last_fill_time = now;
 
       if (!_got_caps)
@@ -286,7 +283,7 @@ bool NetUpsDriver::fill_status_buffer()
          read_static_data();
    }
 
-   return !_comm_err;
+   return !_link.is_down();
 }
 
 bool NetUpsDriver::get_ups_status_flag(int fill)
@@ -383,19 +380,11 @@ bool NetUpsDriver::Open()
    strlcpy(_ups->master_name, _ups->device, sizeof(_ups->master_name));
    strlcpy(_ups->upsclass.long_name, "Net Slave", sizeof(_ups->upsclass.long_name));
 
-   /* Now split the device. */
+   /* Now split the device, using the NIS port as default. */
+   _port = _ups->statusport;
+   net_split_host(_ups->device, _device, sizeof(_device), &_port);
    _hostname = _device;
 
-   char *cp = strchr(_device, ':');
-   if (cp) {
-      *cp = '\0';
-      cp++;
-      _port = atoi(cp);
-   } else {
-      /* use NIS port as default */
-      _port = _ups->statusport;
-   }
-
    _statbuf[0] = 0;
    _statlen = 0;
 
@@ -70,8 +70,7 @@ private:
    time_t _last_fill_time;
    char _statbuf[BIGBUF];
    int _statlen;
-   time_t _tlog;
-   bool _comm_err;
+   LinkHealth _link;
    int _comm_loss;
 };
 
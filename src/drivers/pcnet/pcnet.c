@@ -343,9 +343,8 @@ bool PcnetUpsDriver::pcnet_process_data(const char *key, const char *value)
    return ret;
 }
 
-char *PcnetUpsDriver::digest2ascii(md5_byte_t *digest)
+char *PcnetUpsDriver::digest2ascii(md5_byte_t *digest, char *ascii)
 {
-   static char ascii[33];
    char byte[3];
    int idx;
 
@@ -353,19 +352,12 @@ char *PcnetUpsDriver::digest2ascii(md5_byte_t *digest)
    ascii[0] = '\0';
    for (idx=0; idx<16; idx++) {
       snprintf(byte, sizeof(byte), "%02x", (unsigned char)digest[idx]);
-      strlcat(ascii, byte, sizeof(ascii));
+      strlcat(ascii, byte, DIGEST_ASCII_LEN);
    }
 
    return ascii;
 }
 
-struct pair {
-   const char* key;
-   const char* value;
-};
-
-#define MAX_PAIRS 256
-
 const char *PcnetUpsDriver::lookup_key(const char *key, struct pair table[])
 {
    int idx;
@@ -385,7 +377,8 @@ struct pair *PcnetUpsDriver::auth_and_map_packet(char *buf, int len)
 {
    char *key, *end, *ptr, *value;
    const char *val, *hash=NULL;
-   static struct pair pairs[MAX_PAIRS+1];
+   struct pair *pairs = _pairs;
+   char ascii[DIGEST_ASCII_LEN];
    md5_state_t ms;
    md5_byte_t digest[16];
    unsigned int idx;
@@ -404,11 +397,11 @@ struct pair *PcnetUpsDriver::auth_and_map_packet(char *buf, int len)
       md5_finish(&ms, digest);
 
       /* Convert binary digest to ascii */
-      hash = digest2ascii(digest);
+      hash = digest2ascii(digest, ascii);
    }
 
    /* Build a table of pointers to key/value pairs */
-   memset(pairs, 0, sizeof(pairs));
+   memset(_pairs, 0, sizeof(_pairs));
    ptr = buf;
    idx = 0;
    while (*ptr && idx < MAX_PAIRS) {
@@ -789,6 +782,7 @@ bool PcnetUpsDriver::kill_power()
    int len=0, temp=0;
    char *start;
    const char *cs, *hash;
+   char ascii[DIGEST_ASCII_LEN];
    struct pair *map;
    md5_state_t ms;
    md5_byte_t digest[16];
@@ -896,7 +890,7 @@ bool PcnetUpsDriver::kill_power()
    md5_append(&ms, (md5_byte_t*)_user, strlen(_user));
    md5_append(&ms, (md5_byte_t*)_pass, strlen(_pass));
    md5_finish(&ms, digest);
-   hash = digest2ascii(digest);
+   hash = digest2ascii(digest, ascii);
 
    /* Send the shutdown request */
    asnprintf(data, sizeof(data),
@@ -9,6 +9,14 @@
 
 #include "md5.h"
 
+struct pair {
+   const char* key;
+   const char* value;
+};
+
+#define MAX_PAIRS 256
+#define DIGEST_ASCII_LEN 33             /* MD5 digest as hex plus NUL */
+
 class PcnetUpsDriver: public UpsDriver
 {
 public:
@@ -35,7 +43,7 @@ private:
 
    static SelfTestResult decode_testresult(const char* str);
    static LastXferCause decode_lastxfer(const char *str);
-   static char *digest2ascii(md5_byte_t *digest);
+   static char *digest2ascii(md5_byte_t *digest, char *ascii);
    static const char *lookup_key(const char *key, struct pair table[]);
 
    char _device[MAXSTRING];             /* Copy of ups->device */
@@ -48,6 +56,7 @@ private:
    time_t _datatime;                    /* Last time we got valid data */
    bool _runtimeInSeconds;              /* UPS reports runtime in seconds */
    sock_t _fd;                          /* Socket connection */
+   struct pair _pairs[MAX_PAIRS+1];     /* Fields of the last packet */
 };
 
 #endif   /* _PCNET_H */
@@ -343,7 +343,7 @@ bool SnmpEngine::issue(Message *msg)
 
 Message *SnmpEngine::rspwait(unsigned int msec, bool trap)
 {
-   static unsigned char data[8192];
+   unsigned char data[8192];
    struct sockaddr_in fromaddr;
 
    sock_t sock = trap ? _trapsock : _socket;
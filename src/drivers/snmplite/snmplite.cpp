@@ -35,8 +35,7 @@ SnmpLiteUpsDriver::SnmpLiteUpsDriver(UPSINFO *ups) :
    _vendor(NULL),
    _community(NULL),
    _snmp(NULL),
-   _error_count(0),
-   _commlost_time(0),
+   _link(ups, 3),
    _strategy(NULL),
    _traps(false)
 {
@@ -323,6 +322,10 @@ bool SnmpLiteUpsDriver::check_state()
          Dmsg(80, "Got TRAP: generic=%d, specific=%d\n", 
             trap->Generic(), trap->Specific());
          delete trap;
+
+         // The agent is evidently reachable again, so don't wait out
+         // the backoff before asking it
+         _link.kick();
       }
    }
    else
@@ -376,52 +379,34 @@ bool SnmpLiteUpsDriver::read_volatile_data()
 {
    write_lock(_ups);
 
-   int ret = update_cis(true);
-
-   time_t now = time(NULL);
-   if (ret)
+   // While the agent is unreachable only query it when the backoff allows
+   if (!_link.ready())
    {
-      // Successful query
-      _error_count = 0;
-      _ups->poll_time = now;    /* save time stamp */
-
-      // If we were commlost, we're not any more
-      if (_ups->is_commlost())
-      {
-         _ups->clear_commlost();
-         generate_event(_ups, CMDCOMMOK);
-      }
+      write_unlock(_ups);
+      return false;
    }
-   else
+
+   // Retrying after failures: start over with a fresh SNMP session
+   if (_link.is_down())
    {
-      // Query failed. Close and reopen SNMP to help recover.
       _snmp->Close();
       _snmp->Open(_host, _port, _community);
       if (_traps)
          _snmp->EnableTraps();
+   }
 
-      if (_ups->is_commlost())
-      {
-         // We already know we're commlost.
-         // Log an event every 10 minutes.
-         if ((now - _commlost_time) >= 10*60)
-         {
-            _commlost_time = now;
-            log_event(_ups, event_msg[CMDCOMMFAILURE].level,
-               event_msg[CMDCOMMFAILURE].msg);            
-         }
-      }
-      else
-      {
-         // Check to see if we've hit enough errors to declare commlost.
-         // If we have, set commlost flag and log an event.
-         if (++_error_count >= 3)
-         {
-            _commlost_time = now;
-            _ups->set_commlost();
-            generate_event(_ups, CMDCOMMFAILURE);
-         }
-      }
+   int ret = update_cis(true);
+
+   if (ret)
+   {
+      // Successful query. If we were commlost, we're not any more.
+      _ups->poll_time = time(NULL);    /* save time stamp */
+      _link.success();
+   }
+   else
+   {
+      // Declares commlost after 3 consecutive failures
+      _link.failure();
    }
 
    write_unlock(_ups);
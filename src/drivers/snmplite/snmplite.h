@@ -69,8 +69,7 @@ private:
    const char *_vendor;           /* SNMP vendor: APC or APC_NOTRAP */
    const char *_community;        /* Community name */
    Snmp::SnmpEngine *_snmp;       /* SNMP engine instance */
-   int _error_count;              /* Number of consecutive SNMP network errors */
-   time_t _commlost_time;         /* Time at which we declared COMMLOST */
+   LinkHealth _link;              /* Paces retries, declares COMMLOST */
    const MibStrategy *_strategy;  /* MIB strategy to use */
    bool _traps;                   /* true if catching SNMP traps */
 };
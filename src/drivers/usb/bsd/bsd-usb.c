@@ -282,7 +282,7 @@ bool BsdUsbUpsDriver::usb_link_check()
          log_event(_ups, event_msg[CMDCOMMFAILURE].level,
                    event_msg[CMDCOMMFAILURE].msg);
          if (once) {               /* execute script once */
-            execute_command(_ups, ups_event[CMDCOMMFAILURE]);
+            execute_event(_ups, CMDCOMMFAILURE);
             once = false;
          }
       }
@@ -308,7 +308,7 @@ bool LinuxUsbUpsDriver::usb_link_check()
          log_event(_ups, event_msg[CMDCOMMFAILURE].level,
             event_msg[CMDCOMMFAILURE].msg);
          if (once) {               /* execute script once */
-            execute_command(_ups, ups_event[CMDCOMMFAILURE]);
+            execute_event(_ups, CMDCOMMFAILURE);
             once = false;
          }
       }
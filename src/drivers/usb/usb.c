@@ -814,12 +814,21 @@ bool UsbUpsDriver::read_volatile_data()
    write_lock(_ups);
    _ups->poll_time = now;           /* save time stamp */
 
-   /* Clear APC status bits; let the various CIs set them again */
-   _ups->Status &= ~0xFF;
+   /*
+    * Clear APC status bits; let the various CIs set them again. Only
+    * on polls that refresh the status group, or polls of the slower
+    * groups alone would drop ONLINE, ONBATT and BATTLOW.
+    */
+   if (poll_ci_due(_ups, CI_STATUS))
+      _ups->Status &= ~0xFF;
 
-   /* Loop through all known data, polling those marked volatile */
+   /*
+    * Loop through all known data, polling those marked volatile whose
+    * refresh group is due
+    */
    for (int i=0; _known_info[i].usage_code; i++) {
-      if (_known_info[i].isvolatile && _known_info[i].ci != CI_NONE)
+      if (_known_info[i].isvolatile && _known_info[i].ci != CI_NONE &&
+          poll_ci_due(_ups, _known_info[i].ci))
          usb_update_value(_known_info[i].ci);
    }
 
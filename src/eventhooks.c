@@ -0,0 +1,529 @@
+/*
+ * eventhooks.c
+ *
+ * Built-in reactions to UPS events, run without starting apccontrol.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * EVENTHOOK directives attach built-in actions to apccontrol events.
+ * When an event has hooks of its own, apccontrol is run for it only if
+ * one of them is of type "apccontrol"; hooks for "*" apply to every
+ * event and do not replace apccontrol. The doshutdown script is always
+ * run regardless.
+ *
+ * Hooks are run in order on a worker thread so a slow HTTP collector
+ * never delays the main loop. Mail has a worker of its own, so that an
+ * SMTP session with a slow or unreachable server, which may take
+ * minutes, does not hold up the other hooks either.
+ */
+
+#include "apc.h"
+#include "apcsmtp.h"
+#include "aqueue.h"
+
+#ifndef HAVE_MINGW
+# include <sys/un.h>
+#endif
+
+#define NUM_EVENTS  (CMDBATTATTACH + 1)
+#define HOOK_TIMEOUT 10            /* seconds to wait for an HTTP reply */
+#define MAX_MAIL_BATCH 16          /* messages sent per SMTP session */
+
+/* The hook is copied so a config reload can free the list meanwhile */
+typedef struct {
+   UPSINFO *ups;
+   EVHOOK hook;
+   int event;
+   time_t when;
+} HOOKJOB;
+
+static aqueue<HOOKJOB> *hook_queue = NULL;
+static aqueue<HOOKJOB> *mail_queue = NULL;
+static pthread_mutex_t hook_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Mail waiting to be sent; used only by the mail worker */
+typedef struct {
+   UPSINFO *ups;
+   char host[MAXSTRING];           /* SMTPSERVER of that UPS */
+   bool sent;
+   char rcpts[MAXSTRING];
+   const char *to[16];
+   char subject[MAXSTRING];
+   char *body;
+   SMTPMSG msg;
+} HOOKMAIL;
+
+static HOOKMAIL mail_batch[MAX_MAIL_BATCH];
+static int nmail = 0;
+
+/* Status report buffer for mail hooks; used only by the mail worker */
+static char hook_status[4096];
+
+static void hook_status_open(UPSINFO *ups)
+{
+   hook_status[0] = 0;
+}
+
+static void hook_status_write(UPSINFO *ups, const char *fmt, ...)
+{
+   va_list ap;
+   char buf[MAXSTRING];
+
+   va_start(ap, fmt);
+   avsnprintf(buf, sizeof(buf), fmt, ap);
+   va_end(ap);
+
+   strlcat(hook_status, buf, sizeof(hook_status));
+}
+
+static int hook_status_close(UPSINFO *ups, int fd)
+{
+   return 0;
+}
+
+/* Split "host:port", returning the port or -1 if there is none */
+static int split_hostport(const char *arg, char *host, int hostlen)
+{
+   const char *p = strrchr(arg, ':');
+
+   if (p == NULL)
+      return -1;
+
+   strlcpy(host, arg, MIN(hostlen, p - arg + 1));
+   return atoi(p + 1);
+}
+
+static int resolve_inet(UPSINFO *ups, const char *host, int port,
+   struct sockaddr_in *addr)
+{
+   memset(addr, 0, sizeof(*addr));
+   addr->sin_family = AF_INET;
+   addr->sin_port = htons(port);
+
+   if (inet_pton(AF_INET, host, &addr->sin_addr) != 1) {
+      struct hostent he;
+      char *tmphstbuf = NULL;
+      size_t hstbuflen = 0;
+      struct hostent *hp = gethostname_re(host, &he, &tmphstbuf, &hstbuflen);
+
+      if (!hp || hp->h_addrtype != AF_INET ||
+          hp->h_length != sizeof(addr->sin_addr)) {
+         free(tmphstbuf);
+         log_event(ups, LOG_WARNING, "Event hook: cannot resolve %s", host);
+         return -1;
+      }
+      memcpy(&addr->sin_addr, hp->h_addr, sizeof(addr->sin_addr));
+      free(tmphstbuf);
+   }
+
+   return 0;
+}
+
+static void hook_touch(UPSINFO *ups, const EVHOOK *hook, const char *line)
+{
+   int fd = open(hook->arg, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+   if (fd < 0) {
+      log_event(ups, LOG_WARNING, "Event hook: cannot create %s: %s",
+         hook->arg, strerror(errno));
+      return;
+   }
+   write(fd, line, strlen(line));
+   close(fd);
+}
+
+static void hook_remove(UPSINFO *ups, const EVHOOK *hook)
+{
+   if (unlink(hook->arg) < 0 && errno != ENOENT) {
+      log_event(ups, LOG_WARNING, "Event hook: cannot remove %s: %s",
+         hook->arg, strerror(errno));
+   }
+}
+
+static void hook_udp(UPSINFO *ups, const EVHOOK *hook, const char *line)
+{
+   char host[MAXSTRING];
+   struct sockaddr_in addr;
+   int port, s;
+
+   port = split_hostport(hook->arg, host, sizeof(host));
+   if (port <= 0) {
+      log_event(ups, LOG_WARNING, "Event hook: bad udp address %s", hook->arg);
+      return;
+   }
+
+   if (resolve_inet(ups, host, port, &addr) < 0)
+      return;
+
+   if ((s = socket_cloexec(AF_INET, SOCK_DGRAM, 0)) < 0)
+      return;
+
+   if (sendto(s, line, strlen(line), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      log_event(ups, LOG_WARNING, "Event hook: udp send to %s failed: %s",
+         hook->arg, strerror(errno));
+   }
+   close(s);
+}
+
+static void hook_unix(UPSINFO *ups, const EVHOOK *hook, const char *line)
+{
+#ifdef HAVE_MINGW
+   log_event(ups, LOG_WARNING, "Event hook: unix sockets not supported");
+#else
+   struct sockaddr_un addr;
+   int s;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strlcpy(addr.sun_path, hook->arg, sizeof(addr.sun_path));
+
+   if ((s = socket_cloexec(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+      return;
+
+   if (sendto(s, line, strlen(line), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      log_event(ups, LOG_WARNING, "Event hook: send to %s failed: %s",
+         hook->arg, strerror(errno));
+   }
+   close(s);
+#endif
+}
+
+static void hook_http(UPSINFO *ups, const EVHOOK *hook, const char *line)
+{
+   char host[MAXSTRING], authority[MAXSTRING];
+   char req[MAXSTRING * 2], reply[MAXSTRING];
+   const char *hp, *path;
+   int port = 80, len, n;
+   sock_t s;
+
+   if (strncasecmp(hook->arg, "http://", 7) != 0) {
+      log_event(ups, LOG_WARNING, "Event hook: only http:// URLs are supported: %s",
+         hook->arg);
+      return;
+   }
+
+   hp = hook->arg + 7;
+   path = strchr(hp, '/');
+   len = path ? path - hp : (int)strlen(hp);
+   if (path == NULL)
+      path = "/";
+   strlcpy(authority, hp, MIN((int)sizeof(authority), len + 1));
+   net_split_host(authority, host, sizeof(host), &port);
+
+   if ((s = net_open(host, NULL, port)) < 0) {
+      log_event(ups, LOG_WARNING, "Event hook: cannot connect to %s: %s",
+         hook->arg, strerror(-s));
+      return;
+   }
+
+#ifndef HAVE_MINGW
+   struct timeval tv;
+   tv.tv_sec = HOOK_TIMEOUT;
+   tv.tv_usec = 0;
+   setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+#endif
+
+   len = asnprintf(req, sizeof(req),
+      "POST %s HTTP/1.0\r\n"
+      "Host: %s\r\n"
+      "User-Agent: apcupsd/" APCUPSD_RELEASE "\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: %d\r\n"
+      "\r\n"
+      "%s", path, authority, (int)strlen(line), line);
+
+   if (send(s, req, len, 0) != len) {
+      log_event(ups, LOG_WARNING, "Event hook: send to %s failed", hook->arg);
+      net_close(s);
+      return;
+   }
+
+   /* Only the status line matters */
+   n = recv(s, reply, sizeof(reply) - 1, 0);
+   reply[n > 0 ? n : 0] = 0;
+   if (strncmp(reply, "HTTP/", 5) != 0 || !strchr(reply, ' ') ||
+       strchr(reply, ' ')[1] != '2') {
+      log_event(ups, LOG_WARNING, "Event hook: %s replied: %.40s",
+         hook->arg, n > 0 ? reply : "nothing");
+   }
+
+   net_close(s);
+}
+
+/*
+ * Send the mail formatted by hook_mail(), one session per mail server
+ * since each UPS may name its own.
+ */
+static void flush_mail(void)
+{
+   char errmsg[MAXSTRING];
+   SMTPMSG msgs[MAX_MAIL_BATCH];
+   int i, j, n, sent;
+
+   for (i = 0; i < nmail; i++) {
+      if (mail_batch[i].sent)
+         continue;
+
+      for (n = 0, j = i; j < nmail; j++) {
+         if (!mail_batch[j].sent && strcmp(mail_batch[j].host, mail_batch[i].host) == 0 &&
+             mail_batch[j].msg.mailport == mail_batch[i].msg.mailport) {
+            mail_batch[j].sent = true;
+            msgs[n++] = mail_batch[j].msg;
+         }
+      }
+
+      sent = smtp_send_batch(msgs, n, errmsg, sizeof(errmsg));
+      if (sent < n)
+         log_event(mail_batch[i].ups, LOG_WARNING,
+            "Event hook: %d of %d mail messages failed: %s",
+            sent < 0 ? n : n - sent, n, errmsg);
+   }
+
+   for (i = 0; i < nmail; i++)
+      free(mail_batch[i].body);
+   nmail = 0;
+}
+
+/*
+ * Mail hooks only format their message here. The mail worker sends
+ * whatever has piled up in one SMTP session once its queue is drained,
+ * so a burst of events costs one connection rather than one per message.
+ */
+static void hook_mail(UPSINFO *ups, const EVHOOK *hook, int event, const char *line)
+{
+   HOOKMAIL *m;
+   char *p, *save;
+   int port;
+
+   if (nmail == MAX_MAIL_BATCH)
+      flush_mail();
+   m = &mail_batch[nmail++];
+
+   memset(&m->msg, 0, sizeof(m->msg));
+   m->ups = ups;
+   m->sent = false;
+   m->host[0] = 0;
+   if (ups->smtpserver[0]) {
+      port = split_hostport(ups->smtpserver, m->host, sizeof(m->host));
+      if (port < 0)
+         strlcpy(m->host, ups->smtpserver, sizeof(m->host));
+      m->msg.mailhost = m->host;
+      m->msg.mailport = port > 0 ? port : 0;
+   }
+
+   /* Recipients are separated by commas and/or spaces */
+   strlcpy(m->rcpts, hook->arg, sizeof(m->rcpts));
+   for (p = strtok_r(m->rcpts, ", ", &save); p && m->msg.nto < 16;
+        p = strtok_r(NULL, ", ", &save))
+      m->to[m->msg.nto++] = p;
+   m->msg.to = m->to;
+   m->msg.from = ups->smtpfrom[0] ? ups->smtpfrom : NULL;
+
+   asnprintf(m->subject, sizeof(m->subject), "UPS %s: %s",
+      ups->upsname, event_msg[event].msg);
+   m->msg.subject = m->subject;
+
+   /* Body is the event line followed by the current status */
+   output_status(ups, 0, hook_status_open, hook_status_write, hook_status_close);
+   m->body = (char *)malloc(strlen(line) + strlen(hook_status) + 2);
+   strcpy(m->body, line);
+   strcat(m->body, "\n");
+   strcat(m->body, hook_status);
+   m->msg.body = m->body;
+}
+
+static void run_hook(UPSINFO *ups, const HOOKJOB &job)
+{
+   const EVHOOK *hook = &job.hook;
+   char line[MAXSTRING];
+
+   asnprintf(line, sizeof(line), "%s %s %ld %s\n", ups->upsname,
+      ups_event[job.event].command, (long)job.when, event_msg[job.event].msg);
+
+   Dmsg(100, "Event hook %s %s for %s\n", hook->event, hook->arg,
+      ups_event[job.event].command);
+
+   switch (hook->type) {
+   case HOOK_TOUCH:
+      hook_touch(ups, hook, line);
+      break;
+   case HOOK_REMOVE:
+      hook_remove(ups, hook);
+      break;
+   case HOOK_UDP:
+      hook_udp(ups, hook, line);
+      break;
+   case HOOK_UNIX:
+      hook_unix(ups, hook, line);
+      break;
+   case HOOK_HTTP:
+      hook_http(ups, hook, line);
+      break;
+   case HOOK_MAIL:
+      hook_mail(ups, hook, job.event, line);
+      break;
+   default:
+      break;
+   }
+}
+
+/* One worker serves the hooks of every UPS this daemon runs */
+static void hook_worker(UPSINFO *ups)
+{
+   for (;;) {
+      HOOKJOB job = hook_queue->dequeue();
+
+      run_hook(job.ups, job);
+   }
+}
+
+/* ... and another their mail */
+static void mail_worker(UPSINFO *ups)
+{
+   for (;;) {
+      HOOKJOB job = mail_queue->dequeue();
+
+      do {
+         run_hook(job.ups, job);
+      } while (nmail < MAX_MAIL_BATCH && mail_queue->dequeue(job, 0));
+
+      flush_mail();
+   }
+}
+
+/*
+ * Check the event names given in EVENTHOOK directives and start the
+ * worker thread if there are any hooks.
+ */
+void start_event_hooks(UPSINFO *ups, char *argv0)
+{
+   EVHOOK *hook;
+   bool hooks;
+   int i;
+
+   P(evhooks_mutex);
+   for (hook = ups->evhooks; hook; hook = hook->next) {
+      if (strcmp(hook->event, "*") == 0) {
+         hook->cmd = -1;
+         continue;
+      }
+
+      for (i = 0; i < NUM_EVENTS; i++) {
+         if (strcasecmp(hook->event, ups_event[i].command) == 0)
+            break;
+      }
+
+      if (i == NUM_EVENTS) {
+         log_event(ups, LOG_WARNING, "EVENTHOOK: unknown event %s ignored",
+            hook->event);
+         hook->type = HOOK_NONE;
+      }
+      hook->cmd = i;
+   }
+   hooks = ups->evhooks != NULL;
+   V(evhooks_mutex);
+
+   /* Several UPS threads may get here at once after a reload */
+   P(hook_mutex);
+   if (hooks && hook_queue == NULL) {
+      hook_queue = new aqueue<HOOKJOB>;
+      mail_queue = new aqueue<HOOKJOB>;
+      start_thread(ups, hook_worker, "apchooks", argv0);
+      start_thread(ups, mail_worker, "apcmail", argv0);
+   }
+   V(hook_mutex);
+}
+
+/*
+ * Queue the hooks for an event. Returns true if apccontrol should
+ * also be run for it.
+ *
+ * With wait set, as for doshutdown, the hooks other than mail are run
+ * here before returning, so that they are done before the system goes
+ * down. The caller may hold the UPS write lock then: none of them take
+ * it, and an HTTP hook gives up after HOOK_TIMEOUT. Mail, which formats
+ * the status under the lock and may take minutes to send, is left to
+ * its worker.
+ *
+ * The jobs carry copies of the hooks, since a reload may free the list
+ * as soon as evhooks_mutex is released. Without the workers they are
+ * run here, but only after that, so a slow hook does not hold up a
+ * reload. That happens only before start_event_hooks(), so never from
+ * do_action(); the caller must not hold the UPS lock, which mail hooks
+ * take to format the status.
+ */
+bool run_event_hooks(UPSINFO *ups, int event, bool wait)
+{
+   bool own = false, apccontrol = false;
+   EVHOOK *hook;
+   HOOKJOB job, *jobs = NULL;
+   int i, njobs = 0;
+
+   job.ups = ups;
+   job.event = event;
+   job.when = time(NULL);
+
+   P(evhooks_mutex);
+   for (hook = ups->evhooks; hook; hook = hook->next) {
+      if (hook->type == HOOK_NONE || hook->cmd == -2 ||
+          (hook->cmd != -1 && hook->cmd != event))
+         continue;
+
+      if (hook->cmd != -1)
+         own = true;
+
+      if (hook->type == HOOK_APCCONTROL) {
+         apccontrol = true;
+         continue;
+      }
+
+      job.hook = *hook;
+      job.hook.next = NULL;
+      if (hook_queue && hook->type == HOOK_MAIL) {
+         mail_queue->enqueue(job);
+      } else if (hook_queue && !wait) {
+         hook_queue->enqueue(job);
+      } else if (wait && hook->type == HOOK_MAIL) {
+         continue;                 /* see above */
+      } else {
+         jobs = (HOOKJOB *)realloc(jobs, (njobs + 1) * sizeof(HOOKJOB));
+         jobs[njobs++] = job;
+      }
+   }
+   V(evhooks_mutex);
+
+   if (njobs) {
+      for (i = 0; i < njobs; i++)
+         run_hook(ups, jobs[i]);
+      free(jobs);
+      if (hook_queue == NULL)      /* else the batch is the worker's */
+         flush_mail();
+   }
+
+   return !own || apccontrol;
+}
+
+/* Run the built-in hooks and, unless they replace it, apccontrol */
+void execute_event(UPSINFO *ups, int event)
+{
+   if (run_event_hooks(ups, event, false))
+      execute_command(ups, ups_event[event]);
+}
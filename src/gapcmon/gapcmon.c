@@ -157,6 +157,11 @@ static gboolean gapc_util_text_view_clear_buffer(GtkWidget * view);
 static gboolean gapc_util_treeview_get_iter_from_monitor(GtkTreeModel * model,
    GtkTreeIter * iter, gint i_value);
 static gint gapc_util_update_hashtable(PGAPC_MONITOR pm, gchar * pch_unparsed);
+static void gapc_net_queue_refresh(PGAPC_MONITOR pm);
+static void gapc_monitor_unref(PGAPC_MONITOR pm);
+static guint gapc_monitor_timeout_add(PGAPC_MONITOR pm, guint interval,
+   GSourceFunc function);
+static void cb_util_line_chart_startup_done(PGAPC_HISTORY pg);
 static void cb_panel_systray_icon_destroy(GtkObject * object, gpointer gp);
 static void cb_main_interface_button_quit(GtkWidget * button, PGAPC_CONFIG pcfg);
 static void gapc_monitor_interface_destroy(PGAPC_CONFIG pcfg, gint i_monitor);
@@ -178,6 +183,7 @@ struct hostent * gethostname_re
  * Some small number of globals are required
 */
 static gboolean lg_graph_debug = FALSE;
+static GThreadPool *gapc_net_pool = NULL;   /* network workers for all monitors */
 
 
 /* ************************************************************************* */
@@ -211,7 +217,7 @@ static gint lg_graph_data_series_draw (PLGRAPH plg, PLG_SERIES psd)
         point_pos[0].x = plg->plot_box.x;
         point_pos[0].y =
             (plg->plot_box.y + plg->plot_box.height) -
-            ((psd->lg_point_dvalue[0] *
+            ((LG_SERIES_POINT (psd, 0) *
               (gdouble) ((gdouble) plg->plot_box.height /
                          (gdouble) plg->y_range.i_max_scale)));
 
@@ -224,7 +230,7 @@ static gint lg_graph_data_series_draw (PLGRAPH plg, PLG_SERIES psd)
     {
         point_pos[v_index].x = plg->plot_box.x + (v_index * plg->x_range.i_minor_inc);
         point_pos[v_index].y = (plg->plot_box.y + plg->plot_box.height) -
-            ((psd->lg_point_dvalue[v_index] *
+            ((LG_SERIES_POINT (psd, v_index) *
               (gdouble) ((gdouble) plg->plot_box.height /
                          (gdouble) plg->y_range.i_max_scale)));
 
@@ -289,7 +295,7 @@ static gboolean lg_graph_data_series_add_value (PLGRAPH plg, gint i_series_numbe
 {
     PLG_SERIES  psd = NULL;
     GList      *data_sets = NULL;
-    gint        v_index = 0, time_count = 0;
+    gint        v_index = 0, i_size = 0;
     gboolean    b_found = FALSE;
 
     g_return_val_if_fail (plg != NULL, FALSE);
@@ -318,18 +324,18 @@ static gboolean lg_graph_data_series_add_value (PLGRAPH plg, gint i_series_numbe
         y_value = (gdouble) plg->y_range.i_max_scale * 0.98;
     }
 
-    if (psd->i_point_count == psd->i_max_points + 1)
+    /* once the ring is full the newest point replaces the oldest */
+    i_size = psd->i_max_points + 1;
+    if (psd->i_point_count == i_size)
     {
-        for (v_index = 0; v_index < psd->i_max_points; v_index++)
-        {
-            psd->lg_point_dvalue[v_index] = psd->lg_point_dvalue[v_index + 1];
-        }
-        psd->lg_point_dvalue[psd->i_max_points] = y_value;
+        v_index = psd->i_point_head;
+        psd->i_point_head = (psd->i_point_head + 1) % i_size;
     }
     else
     {
-        psd->lg_point_dvalue[psd->i_point_count++] = y_value;
+        v_index = (psd->i_point_head + psd->i_point_count++) % i_size;
     }
+    psd->lg_point_dvalue[v_index] = y_value;
 
     psd->d_max_value = MAX (y_value, psd->d_max_value);
     psd->d_min_value = MIN (y_value, psd->d_min_value);
@@ -339,25 +345,22 @@ static gboolean lg_graph_data_series_add_value (PLGRAPH plg, gint i_series_numbe
     /* record current time with data points */
     if (psd->i_series_id == plg->i_num_series - 1)
     {
-        GList      *gl_remove = NULL;
-
-        gl_remove = g_list_first (plg->lg_series_time);
-        
-        time_count = g_list_length (plg->lg_series_time);    
-        if (time_count == psd->i_max_points + 1)
+        if (plg->i_time_count == plg->i_time_size)
         {
-            plg->lg_series_time =
-                g_list_remove_all (plg->lg_series_time, gl_remove->data);
+            plg->lg_series_time[plg->i_time_head] = time (NULL);
+            plg->i_time_head = (plg->i_time_head + 1) % plg->i_time_size;
+        }
+        else
+        {
+            LG_SERIES_TIME (plg, plg->i_time_count++) = time (NULL);
         }
-        plg->lg_series_time =
-            g_list_append (plg->lg_series_time, GINT_TO_POINTER ((time_t) time (NULL)));
     }
 
     if (lg_graph_debug)
     {
         g_print
          ("DataSeriesAddValue: series=%d, value=%3.1f, index=%d, count=%d, time_count=%d, max_pts=%d\n",
-          i_series_number, y_value, v_index, psd->i_point_count, time_count, psd->i_max_points);
+          i_series_number, y_value, v_index, psd->i_point_count, plg->i_time_count, psd->i_max_points);
     }
 
     return TRUE;
@@ -386,9 +389,12 @@ static gboolean lg_graph_data_series_remove_all (PLGRAPH plg)
         i_count++;
     }
     g_list_free (plg->lg_series);
-    g_list_free (plg->lg_series_time);
+    g_free (plg->lg_series_time);
     plg->lg_series = NULL;
     plg->lg_series_time = NULL;
+    plg->i_time_head = 0;
+    plg->i_time_count = 0;
+    plg->i_time_size = 0;
     plg->i_num_series = 0;
     plg->i_points_available = 0;    
 
@@ -424,6 +430,13 @@ static gint lg_graph_data_series_add (PLGRAPH plg, gchar * pch_legend_text,
 
     g_snprintf (psd->ch_legend_text, sizeof (psd->ch_legend_text), "%s", pch_legend_text);
     psd->i_max_points = plg->x_range.i_max_scale;
+
+    /* one sample time is kept for each point of the series */
+    if (plg->lg_series_time == NULL)
+    {
+        plg->i_time_size = psd->i_max_points + 1;
+        plg->lg_series_time = g_new0 (time_t, plg->i_time_size);
+    }
     gdk_color_parse (pch_color_text, &psd->legend_color);
     g_snprintf (psd->ch_legend_color, sizeof (psd->ch_legend_color), "%s",
                 pch_color_text);
@@ -890,7 +903,7 @@ static gint lg_graph_draw_tooltip (PLGRAPH plg)
         gchar      *pch_time = NULL;
         time_t      point_time;
 
-        point_time = (time_t) g_list_nth_data (plg->lg_series_time, v_index);
+        point_time = LG_SERIES_TIME (plg, v_index);
 
         pch_time = ctime_r (&point_time, ch_time_r);
 
@@ -908,7 +921,7 @@ static gint lg_graph_draw_tooltip (PLGRAPH plg)
                 g_snprintf (ch_buffer, sizeof (ch_buffer),
                             "%s{%3.0f%% <span foreground=\"%s\">%s</span>}",
                             ch_work,
-                            psd->lg_point_dvalue[v_index],
+                            LG_SERIES_POINT (psd, v_index),
                             psd->ch_legend_color, psd->ch_legend_text);
             }
             data_sets = g_list_next (data_sets);
@@ -1745,7 +1758,7 @@ static gboolean cb_monitor_automatic_refresh(PGAPC_MONITOR pm)
       return FALSE;                /* stop timers */
 
    if (pm->b_timer_control) {
-      g_timeout_add(100, (GSourceFunc) cb_monitor_refresh_control, pm);
+      gapc_monitor_timeout_add(pm, 100, (GSourceFunc) cb_monitor_refresh_control);
       return FALSE;
    }
 
@@ -1794,7 +1807,7 @@ static gboolean cb_monitor_automatic_refresh(PGAPC_MONITOR pm)
 
    /*
     * This is the work request to network queue */
-   g_async_queue_push(pm->q_network, (gpointer) pm);
+   gapc_net_queue_refresh(pm);
 
    g_mutex_unlock(pm->gm_update);
    gdk_flush();
@@ -2638,115 +2651,213 @@ static void sknet_net_shutdown (PSKCOMM psk)
 /*
  * performs a complete NIS transaction by sending cmd and
  * loading each result line into the pch array.
- * also, refreshes status key/value pairs in hastable.
+ * also, refreshes status key/value pairs in hastable, for the lines
+ * that changed since the last transaction.
+ * the connection is kept open for the next transaction; one that was
+ * dropped by the server is reopened once.
  * return error = 0,  or number of lines read from network
  */
 static gint gapc_net_transaction_service(PGAPC_MONITOR pm, gchar * cp_cmd, gchar ** pch)
 {
-   gint n = 0, iflag = 0;
+   gint n = 0, iflag = 0, i_tries = 0, i_index = 0;
+   gboolean b_status = FALSE;
    GIOChannel   *ioc = NULL;
    
    g_return_val_if_fail(pm, -1);
    g_return_val_if_fail(pm->psk, -1);   
    g_return_val_if_fail(pm->pch_host, -1);
 
+   b_status = g_str_equal(cp_cmd, "status");
 
-   ioc = sknet_net_open(pm->psk);
-   if (ioc == NULL) {
-      return 0;
-   }
+   for (i_tries = 0; i_tries < 2; i_tries++) {
+      ioc = pm->psk->ioc;
+      if (ioc == NULL) {
+         i_tries++;                /* a new connection gets no second try */
+         ioc = sknet_net_open(pm->psk);
+         if (ioc == NULL) {
+            return 0;
+         }
+      }
+
+      n = sknet_net_send( ioc, cp_cmd, g_utf8_strlen(cp_cmd, -1));
+      if (n > 0) {
+         n = sknet_net_recv(ioc, pm->psk->ch_session_message,
+                            sizeof(pm->psk->ch_session_message) - 1);
+         if (n >= 0) {
+            break;
+         }
+      }
 
-   n = sknet_net_send( ioc, cp_cmd, g_utf8_strlen(cp_cmd, -1));
-   if (n <= 0) {
       sknet_net_close( ioc, TRUE);
+      pm->psk->ioc = NULL;
+   }
+   if (pm->psk->ioc == NULL) {
       return 0;
    }
 
-   /* clear current data */
-   for (iflag = 0; iflag < GAPC_MAX_ARRAY; iflag++) {
-      if (pch[iflag] != NULL) {
+   /* n holds the first record, or 0 if there was none */
+   iflag = 0;
+   while (n > 0 && iflag < GAPC_MAX_ARRAY) {
+      pm->psk->ch_session_message[n] = 0;
+
+      if (pch[iflag] == NULL || !g_str_equal(pch[iflag], pm->psk->ch_session_message)) {
          g_free(pch[iflag]);
+         pch[iflag] = g_strdup(pm->psk->ch_session_message);
+
+         if (b_status && iflag > 0)
+            gapc_util_update_hashtable(pm, pm->psk->ch_session_message);
       }
-      pch[iflag] = NULL;
+      iflag++;
+
+      n = sknet_net_recv(ioc, pm->psk->ch_session_message,
+                         sizeof(pm->psk->ch_session_message) - 1);
    }
 
-   iflag = 0;
-   while (iflag < GAPC_MAX_ARRAY) {
-      n = sknet_net_recv(ioc, pm->psk->ch_session_message, sizeof(pm->psk->ch_session_message));
-      if (n < 1)
-         break;
+   /* drop what is left of the last answer */
+   for (i_index = iflag; i_index < GAPC_MAX_ARRAY; i_index++) {
+      if (pch[i_index] != NULL) {
+         g_free(pch[i_index]);
+      }
+      pch[i_index] = NULL;
+   }
 
-      pm->psk->ch_session_message[n] = 0;
-      pch[iflag++] = g_strdup(pm->psk->ch_session_message);
+   /* out of step with the server: start over on a new connection */
+   if (n < 0 || iflag == GAPC_MAX_ARRAY) {
+      sknet_net_close(ioc, TRUE);
+      pm->psk->ioc = NULL;
+   }
+
+   return iflag;                   /* count of records received */
+}
+
+/*
+ * The NIS server keeps no count of its events, so one is made here from
+ * the status records that change whenever apcupsd logs an event.
+ * return TRUE if the events should be fetched again
+ */
+static gboolean gapc_net_events_changed(PGAPC_MONITOR pm)
+{
+   static const gchar *pch_keys[] = { "STATUS", "STATFLAG", "NUMXFERS",
+      "LASTXFER", "XONBATT", "XOFFBATT", "SELFTEST", "LASTSTEST", NULL };
+   gchar *pch = NULL;
+   guint i_gen = 0;
+   gint i_index = 0;
 
-      if (g_str_equal(cp_cmd, "status") && iflag > 1)
-         gapc_util_update_hashtable(pm, pm->psk->ch_session_message);
+   for (i_index = 0; pch_keys[i_index] != NULL; i_index++) {
+      pch = g_hash_table_lookup(pm->pht_Status, pch_keys[i_index]);
+      i_gen = i_gen * 31 + ((pch != NULL) ? g_str_hash(pch) : 0);
    }
 
-   sknet_net_close(ioc, TRUE);
+   /* events not tied to the status are picked up every so often */
+   if ((i_gen == pm->i_events_gen) &&
+       (++pm->i_events_skipped < GAPC_EVENTS_MAX_SKIP)) {
+      return FALSE;
+   }
 
-   return iflag;                   /* count of records received */
+   pm->i_events_gen = i_gen;
+   pm->i_events_skipped = 0;
+
+   return TRUE;
 }
 
 /*
- * Worker thread for network communications.
+ * Worker of the network pool: refreshes one monitor.
  */
-static gpointer *gapc_net_thread_qwork(PGAPC_MONITOR pm)
+static void gapc_net_thread_qwork(PGAPC_MONITOR pm, gpointer gp_unused)
 {
    gint rc = 0;
-   GAsyncQueue *thread_queue = NULL;
 
-   g_return_val_if_fail(pm != NULL, NULL);
-   g_return_val_if_fail(pm->q_network != NULL, NULL);
-
-   g_async_queue_ref(pm->q_network);
-   thread_queue = pm->q_network;
+   g_return_if_fail(pm != NULL);
 
-   if (pm->psk == NULL) {
-      pm->psk = sknet_net_client_init (pm->pch_host, pm->i_port);
-      if (pm->psk == NULL) {
-         g_async_queue_unref(thread_queue);
-         g_thread_exit(GINT_TO_POINTER(0));
+   if (pm->b_run) {
+      g_mutex_lock(pm->gm_update);
+      if (pm->b_run) {             /* may have waited a while for lock */
+         rc = gapc_net_transaction_service(pm, "status", pm->pach_status);
+         if ((rc > 0) && gapc_net_events_changed(pm)) {
+            gapc_net_transaction_service(pm, "events", pm->pach_events);
+         }
       }
+      g_mutex_unlock(pm->gm_update);
    }
 
-   while ((pm = (PGAPC_MONITOR) g_async_queue_pop(thread_queue))) {
-      if (pm->b_thread_stop) {
-         break;
-      }
+   if (rc > 0) {
+      pm->b_data_available = TRUE;
+   } else {
+      pm->b_data_available = FALSE;
+   }
 
-      if (pm->b_run) {
-         g_mutex_lock(pm->gm_update);
-         if (!pm->b_run) {         /* may have waited a while for lock */
-            g_mutex_unlock(pm->gm_update);
-            continue;
-         }
+   g_atomic_int_set(&pm->i_net_queued, FALSE);
 
-         if ((rc = gapc_net_transaction_service(pm, "status", pm->pach_status))) {
-            gapc_net_transaction_service(pm, "events", pm->pach_events);
-         }
-         g_mutex_unlock(pm->gm_update);
+   /* the monitor may have been destroyed while this refresh ran */
+   gapc_monitor_unref(pm);
+}
 
-         if (rc > 0) {
-            pm->b_data_available = TRUE;
-         } else {
-            pm->b_data_available = FALSE;
-         }
-      } else {
-         pm->b_data_available = FALSE;
-      }
-   }                               /* end-while */
+/*
+ * Hand a monitor to the network pool, unless it is already waiting there.
+ */
+static void gapc_net_queue_refresh(PGAPC_MONITOR pm)
+{
+   g_return_if_fail(gapc_net_pool != NULL);
+
+   if (g_atomic_int_compare_and_exchange(&pm->i_net_queued, FALSE, TRUE)) {
+      g_atomic_int_inc(&pm->i_refs);
+      g_thread_pool_push(gapc_net_pool, pm, NULL);
+   }
+}
+
+/*
+ * Drop a reference to a monitor. The last one, held by the window, by
+ * a refresh in the network pool or by a one-shot timer, frees what the
+ * network worker uses; the window has already released everything of GTK.
+ */
+static void gapc_monitor_unref(PGAPC_MONITOR pm)
+{
+   gint h_index = 0;
+
+   if (!g_atomic_int_dec_and_test(&pm->i_refs)) {
+      return;
+   }
 
    if (pm->psk != NULL) {
-       sknet_net_shutdown (pm->psk);
-       pm->psk = NULL;
+      if (pm->psk->ioc != NULL) {
+         sknet_net_close(pm->psk->ioc, TRUE);
+      }
+      sknet_net_shutdown(pm->psk);
+      pm->psk = NULL;
+   }
+
+   g_mutex_free(pm->gm_update);
+
+   if (pm->pht_Status != NULL) {
+      g_hash_table_destroy(pm->pht_Status);
+      pm->pht_Status = NULL;
    }
-   
-   g_async_queue_unref(thread_queue);
 
-   g_thread_exit(GINT_TO_POINTER(1));
+   for (h_index = 0; h_index < GAPC_MAX_ARRAY; h_index++) {
+      if (pm->pach_events[h_index] != NULL) {
+         g_free(pm->pach_events[h_index]);
+      }
+      pm->pach_events[h_index] = NULL;
+      if (pm->pach_status[h_index] != NULL) {
+         g_free(pm->pach_status[h_index]);
+      }
+      pm->pach_status[h_index] = NULL;
+   }
+
+   g_free(pm);
+}
+
+/*
+ * Add a one-shot timer that holds a reference to the monitor until it
+ * is removed, so that it cannot fire on a monitor already freed.
+ */
+static guint gapc_monitor_timeout_add(PGAPC_MONITOR pm, guint interval,
+   GSourceFunc function)
+{
+   g_atomic_int_inc(&pm->i_refs);
 
-   return NULL;
+   return g_timeout_add_full(G_PRIORITY_DEFAULT, interval, function, pm,
+                             (GDestroyNotify) gapc_monitor_unref);
 }
 
 /*
@@ -4542,9 +4653,9 @@ static void cb_monitor_interface_button_refresh(GtkWidget * button, PGAPC_MONITO
       return;
    }
 
-   g_async_queue_push(pm->q_network, pm);
-   g_timeout_add(GAPC_REFRESH_FACTOR_ONE_TIME,
-      (GSourceFunc) cb_monitor_dedicated_one_time_refresh, pm);
+   gapc_net_queue_refresh(pm);
+   gapc_monitor_timeout_add(pm, GAPC_REFRESH_FACTOR_ONE_TIME,
+      (GSourceFunc) cb_monitor_dedicated_one_time_refresh);
 
    return;
 }
@@ -5174,16 +5285,6 @@ static void cb_monitor_interface_destroy(GtkWidget * widget, PGAPC_MONITOR pm)
       g_source_remove(pm->tid_automatic_refresh);
    }
 
-   if (pm->tid_thread_qwork != NULL) {
-      pm->b_thread_stop = TRUE;
-      g_async_queue_push(pm->q_network, pm);
-      g_thread_join(pm->tid_thread_qwork);
-   }
-
-   g_mutex_free(pm->gm_update);
-   g_async_queue_unref(pm->q_network);
-
-
    for (h_index = 0; h_index < GAPC_LINEGRAPH_MAX_SERIES; h_index++) {
       if (pm->phs.sq[h_index].gm_graph != NULL) {
          g_mutex_free(pm->phs.sq[h_index].gm_graph);
@@ -5192,20 +5293,7 @@ static void cb_monitor_interface_destroy(GtkWidget * widget, PGAPC_MONITOR pm)
 
    if (pm->pht_Widgets != NULL) {
       g_hash_table_destroy(pm->pht_Widgets);
-      g_hash_table_destroy(pm->pht_Status);
       pm->pht_Widgets = NULL;
-      pm->pht_Status = NULL;
-   }
-
-   for (h_index = 0; h_index < GAPC_MAX_ARRAY; h_index++) {
-      if (pm->pach_events[h_index] != NULL) {
-         g_free(pm->pach_events[h_index]);
-      }
-      pm->pach_events[h_index] = NULL;
-      if (pm->pach_status[h_index] != NULL) {
-         g_free(pm->pach_status[h_index]);
-      }
-      pm->pach_status[h_index] = NULL;
    }
 
    if (pm->tray_icon != NULL) {
@@ -5232,8 +5320,9 @@ static void cb_monitor_interface_destroy(GtkWidget * widget, PGAPC_MONITOR pm)
       gtk_statusbar_push(GTK_STATUSBAR(sbar), pcfg->i_info_context, pch);
       g_free(pch);
    }
-   
-   g_free(pm);
+
+   /* a refresh still in the network pool frees the rest when done */
+   gapc_monitor_unref(pm);
    return;
 }
 
@@ -5537,12 +5626,23 @@ static gint gapc_monitor_history_page(PGAPC_MONITOR pm, GtkWidget * notebook)
 
    /* collect one right away */
    pphs->b_startup = TRUE;
-   g_timeout_add((guint) (pm->d_refresh * GAPC_REFRESH_FACTOR_1K + 75),
-      (GSourceFunc) cb_util_line_chart_refresh, pphs);
+   g_atomic_int_inc(&pm->i_refs);
+   g_timeout_add_full(G_PRIORITY_DEFAULT,
+      (guint) (pm->d_refresh * GAPC_REFRESH_FACTOR_1K + 75),
+      (GSourceFunc) cb_util_line_chart_refresh, pphs,
+      (GDestroyNotify) cb_util_line_chart_startup_done);
 
    return i_page;
 }
 
+/*
+ * Release the monitor held by the startup collection timer
+*/
+static void cb_util_line_chart_startup_done(PGAPC_HISTORY pg)
+{
+   gapc_monitor_unref((PGAPC_MONITOR) pg->gp);
+}
+
 /*
  * Add a new data point until xrange is reached
  * then rotate back the y points and add new point to end
@@ -5565,7 +5665,8 @@ static gboolean cb_util_line_chart_refresh(PGAPC_HISTORY pg)
       return FALSE;
 
    if (pm->b_graph_control) {
-      g_timeout_add(100, (GSourceFunc) cb_util_line_chart_refresh_control, pm);
+      gapc_monitor_timeout_add(pm, 100,
+         (GSourceFunc) cb_util_line_chart_refresh_control);
       return FALSE;
    }
 
@@ -6149,6 +6250,7 @@ static GtkWidget *gapc_monitor_interface_create(PGAPC_CONFIG pcfg, gint i_monito
    pm = g_new0(GAPC_MONITOR, 1);
    g_return_val_if_fail(pm != NULL, NULL);
    pm->cb_id = CB_MONITOR_ID;
+   pm->i_refs = 1;                 /* the window's */
    pm->cb_monitor_num = i_monitor;
    pm->gp = (gpointer) pcfg;
    pm->phs.gp = (gpointer) pm;
@@ -6202,13 +6304,11 @@ static GtkWidget *gapc_monitor_interface_create(PGAPC_CONFIG pcfg, gint i_monito
    }
 
    /*
-    * Start the central network thread */
-   pm->q_network = g_async_queue_new();
-   g_return_val_if_fail(pm->q_network != NULL, NULL);
-
-   pm->b_thread_stop = FALSE;
-   pm->tid_thread_qwork =
-      g_thread_create((GThreadFunc) gapc_net_thread_qwork, pm, TRUE, NULL);
+    * Connection used by the network pool for this monitor */
+   if (pm->psk == NULL) {
+      pm->psk = sknet_net_client_init(pm->pch_host, pm->i_port);
+      g_return_val_if_fail(pm->psk != NULL, NULL);
+   }
 
    /*
     * Create the top level window for the notebook to be packed into.*/
@@ -6309,7 +6409,7 @@ static GtkWidget *gapc_monitor_interface_create(PGAPC_CONFIG pcfg, gint i_monito
 
    gapc_panel_systray_icon_create(pm);
 
-   g_async_queue_push(pm->q_network, (gpointer) pm);
+   gapc_net_queue_refresh(pm);
 
    pm->tid_automatic_refresh =
       g_timeout_add((guint) (pm->d_refresh * GAPC_REFRESH_FACTOR_1K),
@@ -6398,6 +6498,11 @@ extern int main(int argc, char *argv[])
    g_type_init();
    g_thread_init(NULL);
 
+   /*
+    * One pool of network workers serves every monitor */
+   gapc_net_pool = g_thread_pool_new((GFunc) gapc_net_thread_qwork, NULL,
+                                     GAPC_NET_MAX_THREADS, FALSE, NULL);
+
    gdk_threads_init();
 
    gtk_init(&argc, &argv);
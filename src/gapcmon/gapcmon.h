@@ -78,6 +78,8 @@ G_BEGIN_DECLS
 #define GAPC_LINEGRAPH_YMAX 110
 #define GAPC_LINEGRAPH_MAX_SERIES 5
 #define GAPC_LINEGRAPH_REFRESH_FACTOR 30.0      /* Num refreshes per collection  */
+#define GAPC_NET_MAX_THREADS 4   /* network workers shared by all monitors */
+#define GAPC_EVENTS_MAX_SKIP 30  /* most refreshes between two events fetches */
 
 #define SKNET_HUGE_ARRAY 4096
 #define SKNET_REG_ARRAY  1024
@@ -215,7 +217,8 @@ typedef struct _LGRAPH_SERIES {
     GdkColor    legend_color;
     gdouble     d_max_value;
     gdouble     d_min_value;
-    gdouble    *lg_point_dvalue;    /* array of doubles y values zero based, x = index */
+    gint        i_point_head;   /* ring index of the oldest point */
+    gdouble    *lg_point_dvalue;    /* ring of i_max_points + 1 y values, see LG_SERIES_POINT */
     GdkPoint   *point_pos;      /* last gdk position each point - recalc on evey draw */
 } LG_SERIES, *PLG_SERIES;
 
@@ -243,7 +246,10 @@ typedef struct _LG_GRAPH {
     /* data points and tooltip info */
     gint        i_num_series;   /* 1 based */
     GList      *lg_series;      /* double-linked list of data series PLG_SERIES */
-    GList      *lg_series_time; /* time_t of each sample */
+    time_t     *lg_series_time; /* ring of sample times, see LG_SERIES_TIME */
+    gint        i_time_head;    /* ring index of the oldest time */
+    gint        i_time_count;
+    gint        i_time_size;
     gint        i_points_available;
     gboolean    b_tooltip_active;
     /* actual size of graph area */
@@ -275,6 +281,12 @@ typedef struct _LG_GRAPH {
     LG_RANGE    y_range;
 } LGRAPH   , *PLGRAPH;
 
+/* i-th oldest point of a series, and the time it was sampled at */
+#define LG_SERIES_POINT(psd, i) \
+   ((psd)->lg_point_dvalue[((psd)->i_point_head + (i)) % ((psd)->i_max_points + 1)])
+#define LG_SERIES_TIME(plg, i) \
+   ((plg)->lg_series_time[((plg)->i_time_head + (i)) % (plg)->i_time_size])
+
 /* * Control structure for GtkExtra Charts in Information Window */
 typedef struct _History_Page_Data {
    GAPCDataID cb_id;                  /* This is REQUIRED TO BE 1ST in struct   */
@@ -308,10 +320,11 @@ typedef struct _Monitor_Instance_Data {
    guint i_info_context;           /* StatusBar message Context */
 
    gboolean b_run;                 /* controller for all monitor resources -- except thread */
-   gboolean b_thread_stop;         /* single flag to stop thread */
-   GThread *tid_thread_qwork;      /* Background Thread */
+   gint i_net_queued;              /* TRUE while a refresh waits in the network pool */
+   gint i_refs;                    /* window, queued refresh, one-shot timers */
    GMutex *gm_update;              /* Control mutex for hashtables and thread */
-   GAsyncQueue *q_network;
+   guint i_events_gen;             /* hash of the status records events change */
+   guint i_events_skipped;         /* refreshes since events were last fetched */
    guint i_netbusy_counter;
    guint tid_automatic_refresh;    /* monitor refresh timer id */
    guint tid_graph_refresh;
@@ -0,0 +1,241 @@
+/*
+ * apccache.c
+ *
+ * Capability and static data cache. Probing the capabilities of a
+ * smart UPS and reading its EEPROM takes one round trip per command;
+ * the results are saved here so a restart can skip both once the UPS
+ * has been recognized by its serial number.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#include "apc.h"
+
+#define CACHE_MAGIC    "APCCAPS"
+#define CACHE_VERSION  1
+
+/*
+ * Fields filled in by read_static_data(). A name from UPSNAME in the
+ * configuration always wins over the cached one.
+ */
+#define FIELD(m) WHERE(m), sizeof(((UPSINFO *)0)->m)
+static const struct {
+   size_t offset;
+   size_t size;
+   bool if_empty;                  /* restore only if not configured */
+} cache_fields[] = {
+   { FIELD(upsmodel),         false },
+   { FIELD(firmrev),          false },
+   { FIELD(serial),           false },
+   { FIELD(birth),            false },
+   { FIELD(battdat),          false },
+   { FIELD(selftest),         false },
+   { FIELD(sensitivity),      false },
+   { FIELD(beepstate),        false },
+   { FIELD(eprom),            false },
+   { FIELD(upsname),          true  },
+   { FIELD(NomOutputVoltage), false },
+   { FIELD(nombattv),         false },
+   { FIELD(extbatts),         false },
+   { FIELD(badbatts),         false },
+   { FIELD(lotrans),          false },
+   { FIELD(hitrans),          false },
+   { FIELD(rtnpct),           false },
+   { FIELD(dlowbatt),         false },
+   { FIELD(dwake),            false },
+   { FIELD(dshutd),           false },
+   { 0, 0, false }
+};
+
+/*
+ * The key identifies the driver and port; the caller checks the serial
+ * number. The model is not checked: a UPS with the same serial is the
+ * same unit, and asking for the model would cost another round trip.
+ */
+typedef struct {
+   char magic[8];
+   uint32_t version;
+   uint32_t ncaps;                 /* CI_MAXCI + 1 when written */
+   uint32_t datasize;              /* bytes of cache_fields data */
+   int32_t upstype;
+   int32_t cabletype;
+   char device[MAXSTRING];
+} CACHEHDR;
+
+struct capcache {
+   CACHEHDR hdr;
+   char cap[CI_MAXCI + 1];
+   uint32_t cmd[CI_MAXCI + 1];
+   char *data;
+   const char *serial;             /* within data */
+};
+
+static size_t data_size(void)
+{
+   size_t size = 0;
+   int i;
+
+   for (i = 0; cache_fields[i].size; i++)
+      size += cache_fields[i].size;
+   return size;
+}
+
+static void fill_header(UPSINFO *ups, CACHEHDR *hdr)
+{
+   memset(hdr, 0, sizeof(*hdr));
+   memcpy(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic));
+   hdr->version = CACHE_VERSION;
+   hdr->ncaps = CI_MAXCI + 1;
+   hdr->datasize = data_size();
+   hdr->upstype = ups->mode.type;
+   hdr->cabletype = ups->cable.type;
+   strlcpy(hdr->device, ups->device, sizeof(hdr->device));
+}
+
+/*
+ * Read the cache for this UPS. Returns NULL if there is none, if it
+ * was written for another driver, cable or device, or if it holds no
+ * serial number to check the UPS against.
+ */
+struct capcache *cache_load(UPSINFO *ups)
+{
+   struct capcache *cache;
+   CACHEHDR want;
+   size_t off;
+   int fd, i;
+
+   if (ups->capcache[0] == 0)
+      return NULL;
+
+   if ((fd = open(ups->capcache, O_RDONLY|O_CLOEXEC)) == -1) {
+      Dmsg(50, "No capability cache %s: %s\n", ups->capcache, strerror(errno));
+      return NULL;
+   }
+
+   cache = (struct capcache *)calloc(1, sizeof(*cache));
+   cache->data = (char *)malloc(data_size());
+   fill_header(ups, &want);
+
+   if (read(fd, &cache->hdr, sizeof(cache->hdr)) != sizeof(cache->hdr) ||
+       memcmp(&cache->hdr, &want, sizeof(want)) != 0 ||
+       read(fd, cache->cap, sizeof(cache->cap)) != sizeof(cache->cap) ||
+       read(fd, cache->cmd, sizeof(cache->cmd)) != sizeof(cache->cmd) ||
+       read(fd, cache->data, want.datasize) != (ssize_t)want.datasize ||
+       !cache->cap[CI_SERNO]) {
+      Dmsg(50, "Capability cache %s does not match this UPS\n", ups->capcache);
+      close(fd);
+      cache_free(cache);
+      return NULL;
+   }
+   close(fd);
+
+   for (off = 0, i = 0; cache_fields[i].size; i++) {
+      if (cache_fields[i].offset == WHERE(serial)) {
+         cache->serial = cache->data + off;
+         cache->data[off + cache_fields[i].size - 1] = 0;
+      }
+      off += cache_fields[i].size;
+   }
+
+   return cache;
+}
+
+const char *cache_serial(const struct capcache *cache)
+{
+   return cache->serial;
+}
+
+/* Install the cached capabilities and static data */
+void cache_apply(UPSINFO *ups, const struct capcache *cache)
+{
+   char *base = (char *)ups;
+   size_t off;
+   int i;
+
+   write_lock(ups);
+
+   memcpy(ups->UPS_Cap, cache->cap, sizeof(ups->UPS_Cap));
+   for (i = 0; i <= CI_MAXCI; i++)
+      ups->UPS_Cmd[i] = cache->cmd[i];
+
+   for (off = 0, i = 0; cache_fields[i].size; i++) {
+      if (!cache_fields[i].if_empty || base[cache_fields[i].offset] == 0)
+         memcpy(base + cache_fields[i].offset, cache->data + off,
+            cache_fields[i].size);
+      off += cache_fields[i].size;
+   }
+
+   write_unlock(ups);
+}
+
+void cache_free(struct capcache *cache)
+{
+   if (cache) {
+      free(cache->data);
+      free(cache);
+   }
+}
+
+/*
+ * Save the capabilities and static data of a UPS that has just been
+ * probed. The file is replaced atomically so a crash cannot leave a
+ * half-written cache behind.
+ */
+void cache_save(UPSINFO *ups)
+{
+   char tmp[APC_FILENAME_MAX + 8];
+   const char *base = (const char *)ups;
+   uint32_t cmd[CI_MAXCI + 1];
+   CACHEHDR hdr;
+   bool ok;
+   int fd, i;
+
+   if (ups->capcache[0] == 0)
+      return;
+
+   asnprintf(tmp, sizeof(tmp), "%s.new", ups->capcache);
+   if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) == -1) {
+      log_event(ups, LOG_WARNING, "Cannot write capability cache %s: %s",
+         tmp, strerror(errno));
+      return;
+   }
+
+   fill_header(ups, &hdr);
+
+   read_lock(ups);
+   for (i = 0; i <= CI_MAXCI; i++)
+      cmd[i] = ups->UPS_Cmd[i];
+   ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        write(fd, ups->UPS_Cap, sizeof(ups->UPS_Cap)) == sizeof(ups->UPS_Cap) &&
+        write(fd, cmd, sizeof(cmd)) == sizeof(cmd);
+   for (i = 0; ok && cache_fields[i].size; i++) {
+      ok = write(fd, base + cache_fields[i].offset, cache_fields[i].size) ==
+         (ssize_t)cache_fields[i].size;
+   }
+   read_unlock(ups);
+
+   if (close(fd) != 0)
+      ok = false;
+
+   if (!ok || rename(tmp, ups->capcache) != 0) {
+      log_event(ups, LOG_WARNING, "Cannot write capability cache %s: %s",
+         ups->capcache, strerror(errno));
+      unlink(tmp);
+   }
+}
@@ -26,6 +26,7 @@
  */
 
 #include "apc.h"
+#include <stddef.h>
 
 char argvalue[MAXSTRING];
 
@@ -41,6 +42,7 @@ typedef int (HANDLER) (UPSINFO *, int, const GENINFO *, const char *);
 
 static HANDLER match_int, match_range, match_str;
 static HANDLER match_facility, match_index;
+static HANDLER match_hook, match_upsconf;
 static HANDLER obsolete;
 
 #ifdef UNSUPPORTED_CODE
@@ -112,6 +114,17 @@ static const GENINFO types[] = {
    { NULL,       "*invalid-ups-type*",  NO_UPS },
 };
 
+static const GENINFO hooktypes[] = {
+   { "apccontrol", "Run apccontrol",          HOOK_APCCONTROL },
+   { "touch",      "Create flag file",        HOOK_TOUCH },
+   { "remove",     "Remove flag file",        HOOK_REMOVE },
+   { "udp",        "UDP datagram",            HOOK_UDP },
+   { "unix",       "Local socket datagram",   HOOK_UNIX },
+   { "http",       "HTTP POST",               HOOK_HTTP },
+   { "mail",       "SMTP mail",               HOOK_MAIL },
+   { NULL,         "*invalid-hook-type*",     HOOK_NONE },
+};
+
 typedef struct {
    const char *key;
    HANDLER *handler;
@@ -134,6 +147,8 @@ static const PAIRS table[] = {
    {"SCRIPTDIR",  match_str, WHERE(scriptdir),   SIZE(scriptdir)},
    {"PWRFAILDIR", match_str, WHERE(pwrfailpath), SIZE(pwrfailpath)},
    {"NOLOGINDIR", match_str, WHERE(nologinpath), SIZE(nologinpath)},
+   {"CAPCACHE",   match_str, WHERE(capcache),    SIZE(capcache)},
+   {"RUNTIMEMODEL", match_str, WHERE(predfile),  SIZE(predfile)},
 
    /* Configuration parameters used during power failures */
    {"ANNOY",          match_int,   WHERE(annoy),       0},
@@ -143,16 +158,28 @@ static const PAIRS table[] = {
    {"NOLOGON",        match_range, WHERE(nologin),     logins},
    {"BATTERYLEVEL",   match_int,   WHERE(percent),     0},
    {"MINUTES",        match_int,   WHERE(runtime),     0},
+   {"PREDRUNTIME",    match_index, WHERE(predshutdown), onoroff},
    {"KILLDELAY",      match_int,   WHERE(killdelay),   0},
 
    /* Configuration parmeters for network information server */
    {"NETSERVER", match_index, WHERE(netstats),   onoroff},
    {"NISIP",     match_str,   WHERE(nisip),      SIZE(nisip)},
    {"NISPORT",   match_int,   WHERE(statusport), 0},
+   {"NISGROUP",  match_str,   WHERE(nisgroup),   SIZE(nisgroup)},
+   {"NISACCEPTORS", match_int, WHERE(nisacceptors), 0},
+   {"METRICSPORT", match_int, WHERE(metricsport), 0},
 
    /* Configuration parameters for event logging */
    {"EVENTSFILE",    match_str, WHERE(eventfile),    SIZE(eventfile)},
    {"EVENTSFILEMAX", match_int, WHERE(eventfilemax), 0},
+   {"EVENTWINDOW",   match_int, WHERE(evwindow),     0},
+   {"EVENTMAXPROCS", match_int, WHERE(evmaxprocs),   0},
+   {"EVENTHOOK",     match_hook, WHERE(evhooks),     hooktypes},
+   {"SMTPSERVER",    match_str, WHERE(smtpserver),   SIZE(smtpserver)},
+   {"SMTPFROM",      match_str, WHERE(smtpfrom),     SIZE(smtpfrom)},
+
+   /* Further UPSes run by this daemon */
+   {"UPSCONF", match_upsconf, WHERE(upsfiles), 0},
 
    /* Configuration parameters to control system logging */
    {"FACILITY", match_facility, 0,               0},
@@ -160,6 +187,11 @@ static const PAIRS table[] = {
    {"LOGSTATS", match_index,    WHERE(logstats), onoroff},
    {"STATTIME", match_int,      WHERE(stattime), 0},
    {"DATATIME", match_int,      WHERE(datatime), 0},
+   {"STATUSSHM", match_str,     WHERE(shmname),  SIZE(shmname)},
+
+   /* Configuration parameters for the sample history store */
+   {"HISTORYFILE", match_str, WHERE(histfile), SIZE(histfile)},
+   {"HISTORYSIZE", match_int, WHERE(histsize), 0},
 
    /* Values used to set UPS EPROM for --configure */
    {"SELFTEST",     match_str, WHERE(selftest),         SIZE(selftest)},
@@ -337,6 +369,89 @@ static int match_str(UPSINFO *ups, int offset, const GENINFO * gen, const char *
    return SUCCESS;
 }
 
+/*
+ * EVENTHOOK <event> <type> [<argument>]
+ *
+ * Appends a built-in hook to the list at offset. The event name is
+ * checked by the daemon when the hooks are started since the list of
+ * events is not known here.
+ */
+static int match_hook(UPSINFO *ups, int offset, const GENINFO * vs, const char *v)
+{
+   char event[MAXSTRING], type[MAXSTRING];
+   EVHOOK *hook, **tail;
+   int n = 0;
+
+   if (sscanf(v, "%s %s %n", event, type, &n) < 2)
+      return FAILURE;
+
+   for (; vs->name; vs++)
+      if (!strcasecmp(type, vs->name))
+         break;
+
+   if (vs->name == NULL) {
+      log_event(ups, LOG_WARNING,
+         "%s: Bogus configuration value (%s)\n", argvalue, vs->long_name);
+      fprintf(stderr,
+         "%s: Bogus configuration value (%s)\n", argvalue, vs->long_name);
+      return FAILURE;
+   }
+
+   hook = (EVHOOK *)calloc(1, sizeof(EVHOOK));
+   strlcpy(hook->event, event, sizeof(hook->event));
+   hook->type = vs->type;
+   hook->cmd = -2;                 /* resolved by start_event_hooks() */
+
+   /* The argument is the rest of the line less any comment */
+   strlcpy(hook->arg, v + n, sizeof(hook->arg));
+   char *ptr = strchr(hook->arg, '#');
+   if (ptr)
+      *ptr = '\0';
+   ptr = hook->arg + strlen(hook->arg) - 1;
+   while (ptr >= hook->arg && isspace(*ptr))
+      *ptr-- = '\0';
+
+   if (hook->arg[0] == 0 && hook->type != HOOK_APCCONTROL) {
+      fprintf(stderr, "%s: EVENTHOOK %s %s requires an argument\n",
+         argvalue, event, type);
+      free(hook);
+      return FAILURE;
+   }
+
+   /* Keep hooks in configuration order */
+   for (tail = (EVHOOK **)AT(ups, offset); *tail; tail = &(*tail)->next)
+      ;
+   *tail = hook;
+
+   return SUCCESS;
+}
+
+/*
+ * UPSCONF <file>
+ *
+ * Appends the configuration file of another UPS for this daemon to
+ * manage. Files are read by the daemon once the main one is done.
+ */
+static int match_upsconf(UPSINFO *ups, int offset, const GENINFO * junk, const char *v)
+{
+   UPSFILE *file, **tail;
+
+   /* Same rules for comments and whitespace as any other path */
+   file = (UPSFILE *)calloc(1, sizeof(UPSFILE));
+   match_str((UPSINFO *)file, offsetof(UPSFILE, path),
+      (GENINFO *)sizeof(file->path), v);
+   if (file->path[0] == 0) {
+      free(file);
+      return FAILURE;
+   }
+
+   for (tail = (UPSFILE **)AT(ups, offset); *tail; tail = &(*tail)->next)
+      ;
+   *tail = file;
+
+   return SUCCESS;
+}
+
 static int match_facility(UPSINFO *ups, int offset,
    const GENINFO *junk, const char *v)
 {
@@ -514,8 +629,10 @@ void init_ups_struct(UPSINFO *ups)
    ups->polltime = 60;
    ups->percent = 10;
    ups->runtime = 5;
+   ups->predshutdown = FALSE;
    ups->netstats = TRUE;
    ups->statusport = NISPORT;
+   ups->metricsport = 0;           /* no metrics server as default */
    ups->upsmodel[0] = 0;           /* end of string */
 
 
@@ -533,6 +650,8 @@ void init_ups_struct(UPSINFO *ups)
    strlcpy(ups->beepstate, "-1", sizeof(ups->beepstate));      /* no value */
 
    ups->nisip[0] = 0;              /* no nis IP file as default */
+   ups->nisgroup[0] = 0;
+   ups->nisacceptors = 1;
 
    ups->lockfile = -1;
 
@@ -548,6 +667,21 @@ void init_ups_struct(UPSINFO *ups)
    ups->eventfile[0] = 0;          /* no events file as default */
    ups->eventfilemax = 10;         /* trim the events file at 10K as default */
    ups->event_fd = -1;             /* no file open */
+   ups->events = NULL;             /* none kept until events_open() */
+   ups->evwindow = 0;              /* no event coalescing as default */
+   ups->evmaxprocs = 4;            /* up to 4 apccontrol children at once */
+   ups->evhooks = NULL;            /* no built-in event hooks */
+   ups->smtpserver[0] = 0;         /* $SMTPSERVER or localhost */
+   ups->smtpfrom[0] = 0;           /* user@host */
+
+   ups->predfile[0] = 0;           /* runtime model kept in memory only */
+   ups->predict.runtime = -1;      /* nothing learned yet */
+   ups->histfile[0] = 0;           /* no history file as default */
+   ups->histsize = 2880;           /* two days of one minute samples */
+   ups->history = NULL;
+   ups->shmname[0] = 0;            /* no shared memory status as default */
+   ups->shm = NULL;
+   ups->metrics = NULL;
 
    /* Default paths */
    strlcpy(ups->scriptdir, SYSCONFDIR, sizeof(ups->scriptdir));
@@ -600,7 +734,12 @@ void init_ups_struct(UPSINFO *ups)
    ups->UPS_Cmd[CI_UPS_CAPS] = APC_CMD_UPS_CAPS;
 }
 
-void check_for_config(UPSINFO *ups, char *cfgfile)
+/*
+ * Parse a configuration file into ups. Returns the number of lines
+ * with errors (the first one in *erline) or -1 if the file cannot be
+ * opened.
+ */
+static int read_config(UPSINFO *ups, const char *cfgfile, int *erline)
 {
    FILE *apcconf;
    char line[MAXSTRING];
@@ -610,8 +749,11 @@ void check_for_config(UPSINFO *ups, char *cfgfile)
 
    if ((fd = open(cfgfile, O_RDONLY|O_CLOEXEC)) == -1 ||
        (apcconf = fdopen(fd, "r")) == NULL) {
-      Error_abort("Error opening configuration file (%s): %s\n",
-         cfgfile, strerror(errno));
+      int err = errno;
+      if (fd != -1)
+         close(fd);
+      errno = err;
+      return -1;
    }
    strlcpy(ups->configfile, cfgfile, sizeof(ups->configfile));
 
@@ -649,31 +791,23 @@ jump_into_the_loop:
       erpos++;
 
       if (ParseConfig(ups, line)) {
-         errors++;
+         if (errors++ == 0)
+            *erline = erpos;
          Dmsg(100, "%s\n", line);
          Dmsg(100, "Parsing error at line %d of config file %s.\n", erpos, cfgfile);
       }
    }
 
    fclose(apcconf);
+   return errors;
+}
 
-   /*
-    * The next step will need a good ups struct.
-    * Of course if here we have errors, the apc struct is not good
-    * so don't bother to post-process it.
-    */
-   if (errors) {
-      /*
-       * Lock path isn't valid until postprocessing below runs. Since we're
-       * aborting early we need to ensure that no lock file cleanup is
-       * attempted
-       */
-      ups->lockpath[0] = '\0';
-      Error_abort("Terminating due to configuration file errors.\n");
-   }
-
-   /* post-process the configuration stored in the ups structure */
-
+/*
+ * Derive the final settings from what was parsed. Returns NULL on
+ * success or a description of an unusable combination.
+ */
+static const char *post_process_config(UPSINFO *ups)
+{
    /*
     * If annoy time is greater than initial delay, don't bother about
     * initial delay and set it to 0.
@@ -685,6 +819,7 @@ jump_into_the_loop:
       ups->maxtime = 0;
       ups->percent = 10;
       ups->runtime = 5;
+      ups->predshutdown = FALSE;
    }
 
    // Sanitize cable type & UPS mode. Since UPSTYPE (aka mode) and UPSCABLE
@@ -706,7 +841,7 @@ jump_into_the_loop:
    case MODBUS_UPS:
       // Abort if user specified MODBUS UPS type with dumb cable
       if (ups->cable.type < CABLE_SMART)
-         Error_abort("Invalid cable specified for MODBUS UPS\n");
+         return "Invalid cable specified for MODBUS UPS";
        break;
    case APCSMART_UPS:
       match_range(ups, WHERE(cable), cables, "smart");
@@ -714,7 +849,7 @@ jump_into_the_loop:
    case DUMB_UPS:
       // Abort if user specified dumb UPS type with smart cable
       if (ups->cable.type >= CABLE_SMART)
-         Error_abort("Invalid cable specified for Dumb UPS\n");
+         return "Invalid cable specified for Dumb UPS";
       break;      
    case TEST_UPS:
       // Allow anything in test mode
@@ -777,5 +912,248 @@ jump_into_the_loop:
       break;
    }
 
-   return;
+   return NULL;
+}
+
+void check_for_config(UPSINFO *ups, char *cfgfile)
+{
+   const char *err;
+   int errors, erline = 0;
+
+   errors = read_config(ups, cfgfile, &erline);
+   if (errors < 0) {
+      Error_abort("Error opening configuration file (%s): %s\n",
+         cfgfile, strerror(errno));
+   }
+
+   /*
+    * The next step will need a good ups struct.
+    * Of course if here we have errors, the apc struct is not good
+    * so don't bother to post-process it.
+    */
+   if (errors) {
+      /*
+       * Lock path isn't valid until postprocessing below runs. Since we're
+       * aborting early we need to ensure that no lock file cleanup is
+       * attempted
+       */
+      ups->lockpath[0] = '\0';
+      Error_abort("Terminating due to configuration file errors.\n");
+   }
+
+   /* post-process the configuration stored in the ups structure */
+   if ((err = post_process_config(ups)) != NULL)
+      Error_abort("%s\n", err);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Directives that need the device or listening sockets to be set up
+ * again. A reload only warns when they change.
+ */
+static const char *const restart_only[] = {
+   "UPSCABLE", "UPSTYPE", "DEVICE", "LOCKFILE", "NETSERVER",
+   "METRICSPORT", "UPSCLASS", "UPSMODE", NULL
+};
+
+/*
+ * EEPROM values are only used by --configure and share their members
+ * with what the UPS reports, so a reload leaves them alone.
+ */
+static const char *const eeprom_keys[] = {
+   "SELFTEST", "HITRANSFER", "LOTRANSFER", "LOWBATT", "WAKEUP",
+   "RETURNCHARGE", "OUTPUTVOLTS", "SLEEP", "BEEPSTATE", "BATTDATE",
+   "SENSITIVITY", NULL
+};
+
+/* Directives whose new value the report code must pick up */
+static const char *const report_keys[] = {
+   "POLLTIME", "NETTIME", "STATFILE", "LOGSTATS", "STATTIME", "DATATIME",
+   "HISTORYFILE", "HISTORYSIZE", "STATUSSHM", NULL
+};
+
+static bool key_in(const char *key, const char *const *list)
+{
+   for (; *list; list++)
+      if (strcmp(key, *list) == 0)
+         return true;
+   return false;
+}
+
+/* Size of the UPSINFO member a table entry stores into, or 0 */
+static size_t field_size(const PAIRS *p)
+{
+   if (p->handler == match_int || p->handler == match_index)
+      return sizeof(int);
+   if (p->handler == match_str)
+      return (size_t)p->values;
+   if (p->handler == match_range)
+      return sizeof(INTERNALGENINFO);
+   return 0;
+}
+
+static bool hooks_equal(const EVHOOK *a, const EVHOOK *b)
+{
+   for (; a && b; a = a->next, b = b->next) {
+      if (a->type != b->type || strcmp(a->event, b->event) != 0 ||
+          strcmp(a->arg, b->arg) != 0)
+         return false;
+   }
+   return a == b;
+}
+
+static bool upsfiles_equal(const UPSFILE *a, const UPSFILE *b)
+{
+   for (; a && b; a = a->next, b = b->next) {
+      if (strcmp(a->path, b->path) != 0)
+         return false;
+   }
+   return a == b;
+}
+
+/* Bumped once per SIGHUP; each UPS applies it from its own loop */
+static volatile int reload_gen = 0;
+
+/* Held while the EVENTHOOK list of a UPS is walked or replaced */
+pthread_mutex_t evhooks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Signal handler: ask the main loops to reload their configuration */
+void request_reload(int sig)
+{
+   reload_gen++;
+}
+
+bool reload_pending(UPSINFO *ups)
+{
+   return ups->reload_gen != reload_gen;
+}
+
+/*
+ * Re-read the configuration file into a fresh UPSINFO and apply the
+ * differences to the live one without touching the device. Returns
+ * -1 if the new file is unusable (the running configuration is kept),
+ * otherwise a mask of RELOAD_* bits telling the caller which
+ * subsystems must pick up new settings.
+ */
+int reload_config(UPSINFO *ups)
+{
+   UPSINFO *fresh;
+   const PAIRS *p;
+   const char *err;
+   int errors, erline = 0, nchanged = 0, rc = 0, fd;
+   size_t size;
+   EVHOOK *hooks;
+
+   ups->reload_gen = reload_gen;
+
+   fresh = new_ups();
+   init_ups_struct(fresh);
+
+   errors = read_config(fresh, ups->configfile, &erline);
+   err = NULL;
+   if (errors == 0)
+      err = post_process_config(fresh);
+
+   if (errors || err) {
+      if (errors < 0) {
+         log_event(ups, LOG_ERR, "Reload: cannot open %s: %s",
+            ups->configfile, strerror(errno));
+      } else if (errors) {
+         log_event(ups, LOG_ERR, "Reload: error at line %d of %s; "
+            "keeping current configuration", erline, ups->configfile);
+      } else {
+         log_event(ups, LOG_ERR, "Reload: %s; keeping current configuration",
+            err);
+      }
+      /* match_facility() may have reopened the log already */
+      if (fresh->sysfac != ups->sysfac) {
+         closelog();
+         openlog("apcupsd", LOG_CONS | LOG_PID, ups->sysfac);
+      }
+      detach_ups(fresh);
+      return -1;
+   }
+
+   /* An unset name was filled in from the UPS or hostname at startup */
+   if (fresh->upsname[0] == 0)
+      strlcpy(fresh->upsname, ups->upsname, sizeof(fresh->upsname));
+
+   /* Open the new events file before switching over to it */
+   if (strcmp(fresh->eventfile, ups->eventfile) != 0 && fresh->eventfile[0]) {
+      fresh->event_fd = open(fresh->eventfile,
+         O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if (fresh->event_fd < 0) {
+         log_event(ups, LOG_WARNING, "Could not open events file %s: %s",
+            fresh->eventfile, strerror(errno));
+      }
+   }
+
+   write_lock(ups);
+
+   for (p = table; p->key; p++) {
+      size = field_size(p);
+      if (size == 0 || key_in(p->key, eeprom_keys) ||
+          memcmp((char *)AT(ups, p->offset),
+                 (char *)AT(fresh, p->offset), size) == 0)
+         continue;
+
+      Dmsg(10, "Reload: %s changed\n", p->key);
+      if (key_in(p->key, restart_only)) {
+         continue;
+      }
+
+      memcpy((char *)AT(ups, p->offset), (char *)AT(fresh, p->offset), size);
+      if (key_in(p->key, report_keys))
+         rc |= RELOAD_REPORTS;
+      nchanged++;
+   }
+
+   /* Derived from the settings above by post_process_config() */
+   ups->nologin_time = fresh->nologin_time;
+   ups->sysfac = fresh->sysfac;
+
+   if (!hooks_equal(ups->evhooks, fresh->evhooks)) {
+      /* The old list goes away with fresh, nobody may be walking it */
+      P(evhooks_mutex);
+      hooks = ups->evhooks;
+      ups->evhooks = fresh->evhooks;
+      fresh->evhooks = hooks;
+      V(evhooks_mutex);
+      rc |= RELOAD_HOOKS;
+      nchanged++;
+   }
+
+   fd = -1;
+   if (strcmp(fresh->eventfile, ups->eventfile) != 0) {
+      fd = ups->event_fd;
+      ups->event_fd = fresh->event_fd;
+      fresh->event_fd = -1;
+   }
+
+   write_unlock(ups);
+
+   if (fd >= 0)
+      close(fd);
+
+   /* Say which changes were not applied */
+   for (p = table; p->key; p++) {
+      size = field_size(p);
+      if (size && key_in(p->key, restart_only) &&
+          memcmp((char *)AT(ups, p->offset), (char *)AT(fresh, p->offset), size)) {
+         log_event(ups, LOG_WARNING, "Reload: %s changed; restart apcupsd "
+            "for it to take effect", p->key);
+      }
+   }
+
+   if (!upsfiles_equal(ups->upsfiles, fresh->upsfiles)) {
+      log_event(ups, LOG_WARNING, "Reload: UPSCONF changed; restart apcupsd "
+         "for it to take effect");
+   }
+
+   log_event(ups, LOG_NOTICE, "Configuration reloaded from %s: %d setting%s changed",
+      ups->configfile, nchanged, nchanged == 1 ? "" : "s");
+
+   detach_ups(fresh);
+   return rc;
 }
@@ -26,6 +26,28 @@
 
 #define NLE   50                   /* number of events to send and keep */
 
+/*
+ * The last NLE events are also kept in memory, each with a sequence
+ * number, so that a client can ask with "events since <seq>" for only
+ * those it has not seen. Events logged by this run are numbered on
+ * from the time it started, in milliseconds, so the numbers keep
+ * growing across restarts as long as events come slower than one per
+ * millisecond. Those read back from the events file at startup are
+ * numbered from 1, so only a client that asks for everything gets them.
+ */
+typedef struct {
+   unsigned long long seq;
+   char text[MAXSTRING];
+} EVENTREC;
+
+struct eventring {
+   pthread_mutex_t mutex;
+   unsigned long long seq;         /* of the newest event */
+   int first;                      /* slot of the oldest event */
+   int count;                      /* of slots in use */
+   EVENTREC ev[NLE];
+};
+
 /*
  * If the ups->eventfile exceeds ups->eventfilemax kilobytes, trim it to
  * slightly less than that maximum, preserving lines at end of the file.
@@ -109,8 +131,127 @@ trim_done:
    return status;
 }
 
+static void ring_add(struct eventring *r, unsigned long long seq,
+   const char *text)
+{
+   EVENTREC *ev;
+   size_t len;
+
+   if (r->count < NLE) {
+      ev = &r->ev[(r->first + r->count++) % NLE];
+   } else {
+      ev = &r->ev[r->first];
+      r->first = (r->first + 1) % NLE;
+   }
+
+   ev->seq = seq;
+   len = strlcpy(ev->text, text, sizeof(ev->text));
+   if (len >= sizeof(ev->text))    /* keep the end of line cut off */
+      ev->text[sizeof(ev->text) - 2] = '\n';
+   r->seq = seq;
+}
+
+/*
+ * Set up the numbered events of a UPS, starting with what the events
+ * file already holds. Called once at startup.
+ */
+void events_open(UPSINFO *ups)
+{
+   struct eventring *r;
+   struct timeval now;
+   char line[MAXSTRING];
+   unsigned long long start;
+   FILE *fp;
+   int fd;
+
+   r = (struct eventring *)calloc(1, sizeof(*r));
+   if (r == NULL)
+      return;
+   pthread_mutex_init(&r->mutex, NULL);
+
+   if (ups->eventfile[0] != 0 &&
+       (fd = open(ups->eventfile, O_RDONLY | O_CLOEXEC)) >= 0) {
+      if ((fp = fdopen(fd, "r")) != NULL) {
+         while (fgets(line, sizeof(line), fp) != NULL)
+            ring_add(r, r->seq + 1, line);
+         fclose(fp);
+      } else {
+         close(fd);
+      }
+   }
+
+   gettimeofday(&now, NULL);
+   start = (unsigned long long)now.tv_sec * 1000 + now.tv_usec / 1000;
+   if (start > r->seq)
+      r->seq = start;
+
+   ups->events = r;
+}
+
+/* Number and keep an event as it is written to the events file */
+void events_add(const UPSINFO *ups, const char *datetime, const char *msg)
+{
+   struct eventring *r = ups->events;
+   char text[MAXSTRING];
+
+   asnprintf(text, sizeof(text), "%s%s", datetime, msg);
+
+   P(r->mutex);
+   ring_add(r, r->seq + 1, text);
+   V(r->mutex);
+}
+
 #ifdef HAVE_NISSERVER
 
+/*
+ * Send the events numbered after since, oldest first, each preceded by
+ * its number. The first line gives the number of the newest event,
+ * which the client passes as since the next time.
+ *
+ * Returns:
+ *          -1 error or EOF
+ *           0 OK
+ */
+int output_events_since(UPSINFO *ups, int sockfd, unsigned long long since)
+{
+   struct eventring *r = ups->events;
+   EVENTREC *evs;
+   char buf[MAXSTRING + 32];
+   unsigned long long seq;
+   int i, n = 0, len, stat = 0;
+
+   evs = (EVENTREC *)malloc(sizeof(EVENTREC) * NLE);
+   if (evs == NULL)
+      return -1;
+
+   /* Copy them out so as not to hold the lock on the network */
+   P(r->mutex);
+   seq = r->seq;
+   for (i = 0; i < r->count; i++) {
+      const EVENTREC *ev = &r->ev[(r->first + i) % NLE];
+      if (ev->seq > since)
+         evs[n++] = *ev;
+   }
+   V(r->mutex);
+
+   len = asnprintf(buf, sizeof(buf), "SEQ %llu\n", seq);
+   if (net_send(sockfd, buf, len) <= 0)
+      stat = -1;
+
+   for (i = 0; i < n && stat == 0; i++) {
+      len = asnprintf(buf, sizeof(buf), "%llu %s", evs[i].seq, evs[i].text);
+      if (net_send(sockfd, buf, len) <= 0)
+         stat = -1;
+   }
+
+   free(evs);
+
+   if (net_send(sockfd, NULL, 0) < 0)   /* send eof */
+      stat = -1;
+
+   return stat;
+}
+
 /*
  * Send the last events.
  * Returns:
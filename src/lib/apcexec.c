@@ -25,6 +25,7 @@
  */
 
 #include "apc.h"
+#include "autil.h"
 
 static pthread_t thread_id[MAX_THREADS];
 static const char *thread_name[MAX_THREADS];
@@ -74,13 +75,112 @@ void clean_threads(void)
    }
 }
 
+/*
+ * Events are not launched by the thread that generates them. Instead
+ * execute_command() queues a request and returns at once, so the UPS
+ * write lock is not held across process creation. A launcher thread
+ * drains the queue, starting at most ups->evmaxprocs copies of
+ * apccontrol at a time and reaping its own children.
+ *
+ * If ups->evwindow is non-zero the launcher waits that many seconds
+ * after the first event of a burst and then runs only the last
+ * occurrence of each command, in the order of those last occurrences.
+ * A flapping sequence such as onbattery, mainsback, onbattery,
+ * mainsback thus runs each script once and still ends in the final
+ * state.
+ *
+ * Before the launcher is started (and in programs that never start
+ * it) commands are spawned synchronously as before.
+ */
+
+#define EXEC_QUEUE_MAX   64        /* pending requests */
+#define EXEC_PROCS_MAX   32        /* upper bound on evmaxprocs */
+#define EXEC_STATS_MAX   32        /* distinct commands tracked */
+
+typedef struct {
+   const char *command;
+   char upsname[UPSNAMELEN];
+   char connected[20];
+   char powered[20];
+   char scriptdir[APC_FILENAME_MAX];
+   struct timeval queued;
+} EXECREQ;
+
+typedef struct {
+   int pid;
+   int stat;                       /* index into exec_stats[] */
+   struct timeval started;
+} EXECCHILD;
+
+typedef struct {
+   const char *command;
+   unsigned long launched;
+   unsigned long coalesced;
+   unsigned long failed;
+   unsigned long queue_ms;         /* total enqueue to spawn */
+   unsigned long queue_max;
+   unsigned long run_ms;           /* total spawn to exit */
+   unsigned long run_max;
+   unsigned long finished;
+} EXECSTAT;
+
+static pthread_mutex_t exec_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t exec_cond = PTHREAD_COND_INITIALIZER;
+static EXECREQ *exec_queue[EXEC_QUEUE_MAX];
+static int exec_queued = 0;
+static bool exec_launcher_running = false;
+static EXECSTAT exec_stats[EXEC_STATS_MAX];
+static int exec_nstats = 0;
+static EXECCHILD exec_direct[EXEC_PROCS_MAX];   /* from launch_command() */
+static int exec_ndirect = 0;
+
+static void fill_request(UPSINFO *ups, UPSCOMMANDS cmd, EXECREQ *req)
+{
+   req->command = cmd.command;
+   strlcpy(req->upsname, ups->upsname, sizeof(req->upsname));
+   asnprintf(req->connected, sizeof(req->connected), "%d", !ups->is_slave());
+   asnprintf(req->powered, sizeof(req->powered), "%d", (int)ups->is_plugged());
+   strlcpy(req->scriptdir, ups->scriptdir, sizeof(req->scriptdir));
+   gettimeofday(&req->queued, NULL);
+}
+
+/* Milliseconds from a to b, never negative */
+static unsigned long elapsed_ms(const struct timeval &a, const struct timeval &b)
+{
+   long ms = TV_DIFF_MS(a, b);
+
+   return ms > 0 ? ms : 0;
+}
+
+/* Must be called with exec_mutex held */
+static EXECSTAT *find_stat(const char *command)
+{
+   int i;
+
+   for (i = 0; i < exec_nstats; i++) {
+      if (strcmp(exec_stats[i].command, command) == 0)
+         return &exec_stats[i];
+   }
+
+   if (exec_nstats >= EXEC_STATS_MAX)
+      return NULL;
+
+   memset(&exec_stats[exec_nstats], 0, sizeof(EXECSTAT));
+   exec_stats[exec_nstats].command = command;
+   return &exec_stats[exec_nstats++];
+}
+
 #ifdef HAVE_MINGW
 
 #include "winapi.h"
 
 char sbindir[MAXSTRING];
 
-int execute_command(UPSINFO *ups, UPSCOMMANDS cmd)
+/*
+ * Start apccontrol for a request. Returns the child pid, 0 if the
+ * child cannot be waited for, or -1 on failure.
+ */
+static int spawn_apccontrol(UPSINFO *ups, const EXECREQ *req)
 {
    char cmdline[MAXSTRING];
    char *comspec;
@@ -88,32 +188,24 @@ int execute_command(UPSINFO *ups, UPSCOMMANDS cmd)
    STARTUPINFOA startinfo;
    BOOL rc;
 
-   if (cmd.pid && (kill(cmd.pid, 0) == 0)) {
-      /*
-       * Command is already running. No point in running it two
-       * times.
-       */
-      return SUCCESS;
-   }
-
    /* Find command interpreter */
    comspec = getenv("COMSPEC");
    if (comspec == NULL)
-      return FAILURE;
+      return -1;
 
    /* Build the command line */
    if (g_os_version_info.dwPlatformId == VER_PLATFORM_WIN32_WINDOWS) {
       /* Win95/98/ME need environment size parameter and no extra quotes */
       asnprintf(cmdline, sizeof(cmdline), 
-         "\"%s\" /E:4096 /c \"%s%s\" %s \"%s\" %d %d \"%s\"",
-         comspec, ups->scriptdir, APCCONTROL_FILE, cmd.command,
-         ups->upsname, !ups->is_slave(), ups->is_plugged(), sbindir);
+         "\"%s\" /E:4096 /c \"%s%s\" %s \"%s\" %s %s \"%s\"",
+         comspec, req->scriptdir, APCCONTROL_FILE, req->command,
+         req->upsname, req->connected, req->powered, sbindir);
    } else {
       /* WinNT/2K/Vista need quotes around the entire sub-command */
       asnprintf(cmdline, sizeof(cmdline), 
-         "\"%s\" /c \"\"%s%s\" %s \"%s\" %d %d \"%s\"\"",
-         comspec, ups->scriptdir, APCCONTROL_FILE, cmd.command,
-         ups->upsname, !ups->is_slave(), ups->is_plugged(), sbindir);
+         "\"%s\" /c \"\"%s%s\" %s \"%s\" %s %s \"%s\"\"",
+         comspec, req->scriptdir, APCCONTROL_FILE, req->command,
+         req->upsname, req->connected, req->powered, sbindir);
    }
 
    /* Initialize the STARTUPINFOA struct to hide the console window */
@@ -132,111 +224,365 @@ int execute_command(UPSINFO *ups, UPSCOMMANDS cmd)
                        TRUE,           // handles are inherited
                        0,              // creation flags
                        NULL,           // use parent's environment
-                       ups->scriptdir, // working directory
+                       (char *)req->scriptdir, // working directory
                        &startinfo,     // STARTUPINFO pointer
                        &procinfo);     // receives PROCESS_INFORMATION
    if (!rc) {
       log_event(ups, LOG_WARNING, "execute failed: CreateProcessA(NULL, %s, ...)=%d\n",
          cmdline, GetLastError());
-      return FAILURE;
+      return -1;
    }
 
-   /* Extract pid */
-   cmd.pid = procinfo.dwProcessId;
-
    /* Don't need handles */
    CloseHandle(procinfo.hProcess);
    CloseHandle(procinfo.hThread);
 
-   return SUCCESS;
+   /* No waitpid() here, so the child is not tracked */
+   return 0;
+}
+
+/* Returns true if the given child has exited */
+static bool child_exited(int pid)
+{
+   return true;
 }
+
 #else
-int execute_command(UPSINFO *ups, UPSCOMMANDS cmd)
+
+#if defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0 && !defined(HAVE_QNX_OS)
+# include <spawn.h>
+extern char **environ;
+#endif
+
+static int spawn_apccontrol(UPSINFO *ups, const EXECREQ *req)
 {
    const char *argv[6];
-   char connected[20], powered[20];
    char apccontrol[MAXSTRING];
+   int pid;
 
-   if (cmd.pid && (kill(cmd.pid, 0) == 0)) {
-      /*
-       * Command is already running. No point in running it two
-       * times.
-       */
-      return SUCCESS;
-   }
+   asnprintf(apccontrol, sizeof(apccontrol), "%s%s", req->scriptdir, APCCONTROL_FILE);
 
-   asnprintf(connected, sizeof(connected), "%d", !ups->is_slave());
-   asnprintf(powered, sizeof(powered), "%d", (int)ups->is_plugged());
-   asnprintf(apccontrol, sizeof(apccontrol), "%s%s", ups->scriptdir, APCCONTROL_FILE);
+   argv[0] = apccontrol;        /* Shell script to execute. */
+   argv[1] = req->command;      /* Parameter to script. */
+   argv[2] = req->upsname;      /* UPS name */
+   argv[3] = req->connected;
+   argv[4] = req->powered;
+   argv[5] = NULL;
 
 #ifdef HAVE_QNX_OS
    /* fork() is supported only in single-threaded applications */
-   argv[0] = apccontrol;        /* Shell script to execute. */
-   argv[1] = cmd.command;       /* Parameter to script. */
-   argv[2] = ups->upsname;      /* UPS name */
-   argv[3] = connected;
-   argv[4] = powered;
-   argv[5] = NULL;
-   if (spawnv(P_NOWAIT, apccontrol, (char * const *)argv) == -1) {
+   if ((pid = spawnv(P_NOWAIT, apccontrol, (char * const *)argv)) == -1) {
       log_event(ups, LOG_WARNING, "execute: cannot spawn(). ERR=%s",
          strerror(errno));
-      return FAILURE;
+      return -1;
+   }
+#elif defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0
+   /*
+    * posix_spawn() does not duplicate our address space the way fork()
+    * does. Descriptors we own are opened close-on-exec, so the child
+    * inherits only stdin/stdout/stderr.
+    */
+   int rc = posix_spawn(&pid, apccontrol, NULL, NULL, (char * const *)argv, environ);
+   if (rc != 0) {
+      log_event(ups, LOG_WARNING, "execute: cannot spawn %s %s. ERR=%s",
+         apccontrol, req->command, strerror(rc));
+      return -1;
    }
 #else
    /* fork() and exec() */
-   switch (cmd.pid = fork()) {
+   switch (pid = fork()) {
    case -1:     /* error */
       log_event(ups, LOG_WARNING, "execute: cannot fork(). ERR=%s",
          strerror(errno));
-      return FAILURE;
+      return -1;
 
    case 0:      /* child */
       /* Don't leak unnecessary fds to child */
       for (int i=0; i<sysconf(_SC_OPEN_MAX); i++) {
-         if (i != STDIN_FILENO && i != STDOUT_FILENO && i != STDERR_FILENO) {
-            if (close(i) == 0)
-               Dmsg(200, "exec closed fd %d\n", i);
-         }
+         if (i != STDIN_FILENO && i != STDOUT_FILENO && i != STDERR_FILENO)
+            close(i);
       }
 
-      argv[0] = apccontrol;        /* Shell script to execute. */
-      argv[1] = cmd.command;       /* Parameter to script. */
-      argv[2] = ups->upsname;      /* UPS name */
-      argv[3] = connected;
-      argv[4] = powered;
-      argv[5] = NULL;
       execv(apccontrol, (char **)argv);
 
-      /* NOT REACHED */
-      log_event(ups, LOG_WARNING, "Cannot exec %s %s: %s",
-         apccontrol, cmd.command, strerror(errno));
-
       /* Child must exit if fails exec'ing. */
-      exit(-1);
-      break;
+      _exit(-1);
 
    default:      /* parent */
-      /*
-       * NOTE, we do a nonblocking waitpid) here to
-       * pick up any previous children. We also]
-       * increment a counter, and then in do_action()
-       * in apcaction.c, we wait again each pass until
-       * all the children are reaped.  This is for
-       * BSD systems where SIG_IGN does not prevent
-       * zombies.
-       */
-      if (ups->num_execed_children < 0)
-         ups->num_execed_children = 1;
+      break;
+   }
+#endif /* HAVE_QNX_OS */
+
+   Dmsg(200, "execute_command: started %s %s pid=%d\n",
+      apccontrol, req->command, pid);
+   return pid;
+}
+
+/* Returns true if the given child has exited (and reaps it) */
+static bool child_exited(int pid)
+{
+   int rc = waitpid(pid, NULL, WNOHANG);
+
+   return rc == pid || (rc < 0 && errno == ECHILD);
+}
+
+#endif /* HAVE_MINGW */
+
+/*
+ * Reap finished children, updating their run time statistics.
+ * Returns the number still running. Called with exec_mutex held.
+ */
+static int reap_children(EXECCHILD *children, int nchildren)
+{
+   struct timeval now;
+   unsigned long ms;
+   int i;
+
+   gettimeofday(&now, NULL);
+   for (i = 0; i < nchildren; ) {
+      if (children[i].pid > 0 && !child_exited(children[i].pid)) {
+         i++;
+         continue;
+      }
+
+      if (children[i].stat >= 0) {
+         EXECSTAT *st = &exec_stats[children[i].stat];
+
+         ms = elapsed_ms(children[i].started, now);
+         st->run_ms += ms;
+         st->run_max = MAX(st->run_max, ms);
+         st->finished++;
+      }
+      children[i] = children[--nchildren];
+   }
+
+   return nchildren;
+}
+
+/*
+ * Drop all but the last pending occurrence of each command for
+ * each UPS. Called with exec_mutex held.
+ */
+static void coalesce_queue(void)
+{
+   int i, j, n = 0;
+
+   for (i = 0; i < exec_queued; i++) {
+      for (j = i + 1; j < exec_queued; j++) {
+         if (strcmp(exec_queue[i]->command, exec_queue[j]->command) == 0 &&
+             strcmp(exec_queue[i]->upsname, exec_queue[j]->upsname) == 0)
+            break;
+      }
+
+      if (j < exec_queued) {
+         EXECSTAT *st = find_stat(exec_queue[i]->command);
+         if (st)
+            st->coalesced++;
+         Dmsg(100, "execute_command: coalesced %s\n", exec_queue[i]->command);
+         free(exec_queue[i]);
+      } else {
+         exec_queue[n++] = exec_queue[i];
+      }
+   }
+   exec_queued = n;
+}
+
+/*
+ * Launcher thread. Runs queued apccontrol requests subject to the
+ * coalescing window and the concurrency limit.
+ */
+static void exec_launcher(UPSINFO *ups)
+{
+   EXECCHILD children[EXEC_PROCS_MAX];
+   int nchildren = 0;
+   struct timespec abstime;
+   struct timeval now;
+   EXECREQ *req;
+   EXECSTAT *st;
+   int maxprocs, window, pid;
+   unsigned long ms;
+
+   P(exec_mutex);
+   for (;;) {
+      nchildren = reap_children(children, nchildren);
+
+      maxprocs = ups->evmaxprocs;
+      if (maxprocs < 1)
+         maxprocs = 1;
+      if (maxprocs > EXEC_PROCS_MAX)
+         maxprocs = EXEC_PROCS_MAX;
+      window = ups->evwindow;
+
+      /* Nothing to do: sleep, polling for children if any are running */
+      if (exec_queued == 0 || nchildren >= maxprocs) {
+         if (nchildren > 0) {
+            calc_abstimeout(100, &abstime);
+            pthread_cond_timedwait(&exec_cond, &exec_mutex, &abstime);
+         } else {
+            pthread_cond_wait(&exec_cond, &exec_mutex);
+         }
+         continue;
+      }
+
+      /* Hold a new burst open until its window has passed */
+      if (window > 0) {
+         gettimeofday(&now, NULL);
+         ms = elapsed_ms(exec_queue[0]->queued, now);
+         if (ms < (unsigned long)window * 1000) {
+            calc_abstimeout((int)MIN(window * 1000 - ms, 100UL), &abstime);
+            pthread_cond_timedwait(&exec_cond, &exec_mutex, &abstime);
+            continue;
+         }
+         coalesce_queue();
+      }
+
+      req = exec_queue[0];
+      memmove(exec_queue, exec_queue + 1, --exec_queued * sizeof(exec_queue[0]));
+      V(exec_mutex);
+
+      pid = spawn_apccontrol(ups, req);
+
+      P(exec_mutex);
+      gettimeofday(&now, NULL);
+      st = find_stat(req->command);
+      if (st) {
+         if (pid < 0) {
+            st->failed++;
+         } else {
+            ms = elapsed_ms(req->queued, now);
+            st->launched++;
+            st->queue_ms += ms;
+            st->queue_max = MAX(st->queue_max, ms);
+         }
+      }
+      if (pid >= 0) {
+         children[nchildren].pid = pid;
+         children[nchildren].stat = st ? st - exec_stats : -1;
+         children[nchildren].started = now;
+         nchildren++;
+      }
+      free(req);
+   }
+}
+
+/* Start the launcher thread; later commands are run asynchronously */
+void start_exec_launcher(UPSINFO *ups, char *argv0)
+{
+   P(exec_mutex);
+   exec_launcher_running = true;
+   V(exec_mutex);
+
+   start_thread(ups, exec_launcher, "apcexec", argv0);
+}
+
+/*
+ * Run apccontrol for the given command now, without queueing. Used
+ * for shutdown, which must not wait behind other events, and when the
+ * launcher thread is not running.
+ */
+int launch_command(UPSINFO *ups, UPSCOMMANDS cmd)
+{
+   EXECREQ *req = (EXECREQ *)malloc(sizeof(EXECREQ));
+   EXECSTAT *st;
+   int pid;
+
+   fill_request(ups, cmd, req);
+   pid = spawn_apccontrol(ups, req);
+   free(req);
+
+   P(exec_mutex);
+   st = find_stat(cmd.command);
+   if (st) {
+      if (pid < 0)
+         st->failed++;
       else
-         ups->num_execed_children++;
+         st->launched++;
+   }
 
-      while (ups->num_execed_children > 0 && waitpid(-1, NULL, WNOHANG) > 0)
-         ups->num_execed_children--;
+   /*
+    * Children spawned here are not tracked by the launcher. Reap those
+    * of ours that have finished, and only those, so they do not remain
+    * as zombies; a final one is reaped by the next call or when we exit.
+    */
+   exec_ndirect = reap_children(exec_direct, exec_ndirect);
+   if (pid > 0 && exec_ndirect < EXEC_PROCS_MAX) {
+      exec_direct[exec_ndirect].pid = pid;
+      exec_direct[exec_ndirect].stat = st ? (int)(st - exec_stats) : -1;
+      gettimeofday(&exec_direct[exec_ndirect].started, NULL);
+      exec_ndirect++;
+   }
+   V(exec_mutex);
 
-      break;
+   return pid < 0 ? FAILURE : SUCCESS;
+}
+
+int execute_command(UPSINFO *ups, UPSCOMMANDS cmd)
+{
+   EXECREQ *req;
+
+   P(exec_mutex);
+   if (!exec_launcher_running) {
+      V(exec_mutex);
+      return launch_command(ups, cmd);
+   }
+
+   if (exec_queued >= EXEC_QUEUE_MAX) {
+      EXECSTAT *st = find_stat(cmd.command);
+      if (st)
+         st->failed++;
+      V(exec_mutex);
+      log_event(ups, LOG_WARNING, "execute: event queue full, dropping %s",
+         cmd.command);
+      return FAILURE;
    }
-#endif /* HAVE_QNX_OS */
 
+   req = (EXECREQ *)malloc(sizeof(EXECREQ));
+   fill_request(ups, cmd, req);
+   exec_queue[exec_queued++] = req;
+   V(exec_mutex);
+
+   pthread_cond_signal(&exec_cond);
    return SUCCESS;
 }
-#endif /* HAVE_MINGW */
+
+#ifdef HAVE_NISSERVER
+
+/*
+ * Send per-command launch statistics, one line per command.
+ * Returns -1 on error or EOF, 0 otherwise.
+ */
+int output_exec_stats(int sockfd)
+{
+   EXECSTAT stats[EXEC_STATS_MAX];
+   char buf[MAXSTRING];
+   int i, n, len, stat = 0;
+
+   P(exec_mutex);
+   n = exec_nstats;
+   memcpy(stats, exec_stats, n * sizeof(EXECSTAT));
+   V(exec_mutex);
+
+   len = asnprintf(buf, sizeof(buf), "%-14s %8s %8s %8s %8s %8s %8s %8s\n",
+      "EVENT", "LAUNCHED", "COALESCE", "FAILED", "QAVG_MS", "QMAX_MS",
+      "RAVG_MS", "RMAX_MS");
+   if (net_send(sockfd, buf, len) <= 0)
+      stat = -1;
+
+   for (i = 0; i < n && stat == 0; i++) {
+      const EXECSTAT *st = &stats[i];
+
+      len = asnprintf(buf, sizeof(buf), "%-14s %8lu %8lu %8lu %8lu %8lu %8lu %8lu\n",
+         st->command, st->launched, st->coalesced, st->failed,
+         st->launched ? st->queue_ms / st->launched : 0, st->queue_max,
+         st->finished ? st->run_ms / st->finished : 0, st->run_max);
+      if (net_send(sockfd, buf, len) <= 0)
+         stat = -1;
+   }
+
+   if (net_send(sockfd, NULL, 0) < 0)
+      stat = -1;
+
+   return stat;
+}
+
+#endif /* HAVE_NISSERVER */
@@ -0,0 +1,518 @@
+/*
+ * apchistory.c
+ *
+ * On-disk time-series store for periodic UPS samples.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * The history file is a small header followed by HIST_TIERS rings of
+ * fixed-size records. Tier 0 receives one record per sample; every
+ * HIST_FACTOR records written to a tier are averaged into one record
+ * of the next tier, so each tier covers HIST_FACTOR times the span of
+ * the one below it with the same number of records.
+ *
+ * Values are stored as 16-bit fixed-point quantities (see hist_fields)
+ * so a record is 32 bytes and can be located by index, which lets a
+ * time range be found with a binary search over the ring. The file is
+ * mapped into memory and written in place; a record is always written
+ * before the ring head is advanced past it.
+ */
+
+#include "apc.h"
+
+#ifndef HAVE_MINGW
+# include <sys/mman.h>
+#endif
+
+#define HIST_MAGIC    "APCHIST"
+#define HIST_VERSION  1
+#define HIST_TIERS    3
+#define HIST_FACTOR   10           /* records averaged into next tier */
+
+/* Field indexes within HISTREC.val[] */
+enum {
+   HF_LINEV = 0,
+   HF_OUTPUTV,
+   HF_BATTV,
+   HF_LOADPCT,
+   HF_BCHARGE,
+   HF_ITEMP,
+   HF_AMBTEMP,
+   HF_HUMIDITY,
+   HF_TIMELEFT,
+   HF_LINEFREQ,
+   HF_MAX
+};
+
+static const struct {
+   const char *name;
+   int ci;                         /* capability that makes it valid */
+   double scale;                   /* stored value = real value * scale */
+   const char *fmt;
+} hist_fields[HF_MAX] = {
+   { "LINEV",    CI_VLINE,   10.0,  "%.1f" },
+   { "OUTPUTV",  CI_VOUT,    10.0,  "%.1f" },
+   { "BATTV",    CI_VBATT,   100.0, "%.2f" },
+   { "LOADPCT",  CI_LOAD,    10.0,  "%.1f" },
+   { "BCHARGE",  CI_BATTLEV, 10.0,  "%.1f" },
+   { "ITEMP",    CI_ITEMP,   10.0,  "%.1f" },
+   { "AMBTEMP",  CI_ATEMP,   10.0,  "%.1f" },
+   { "HUMIDITY", CI_HUMID,   10.0,  "%.1f" },
+   { "TIMELEFT", CI_RUNTIM,  10.0,  "%.1f" },
+   { "LINEFREQ", CI_FREQ,    10.0,  "%.1f" },
+};
+
+typedef struct {
+   uint32_t time;                  /* seconds since the epoch */
+   uint32_t status;                /* UPS_* status bits */
+   uint16_t valid;                 /* bitmask of valid val[] entries */
+   int16_t val[HF_MAX];            /* fixed-point values */
+   uint16_t pad;
+} HISTREC;
+
+typedef struct {
+   uint32_t interval;              /* nominal seconds per record */
+   uint32_t capacity;              /* records in ring */
+   uint32_t head;                  /* next slot to write */
+   uint32_t count;                 /* records in use */
+} HISTTIER;
+
+typedef struct {
+   char magic[8];
+   uint32_t version;
+   uint32_t recsize;
+   uint32_t ntiers;
+   uint32_t factor;
+   HISTTIER tier[HIST_TIERS];
+} HISTHDR;
+
+/* Running sums used to build the next record of a tier */
+typedef struct {
+   double sum[HF_MAX];
+   int n[HF_MAX];
+   uint32_t status;
+   uint32_t time;
+   int samples;
+} HISTACC;
+
+struct apchist {
+   int fd;
+   size_t size;
+   HISTHDR *hdr;
+   HISTREC *recs[HIST_TIERS];
+   HISTACC acc[HIST_TIERS];
+};
+
+static pthread_mutex_t hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void hist_layout(struct apchist *h)
+{
+   HISTREC *rec = (HISTREC *)(h->hdr + 1);
+   int i;
+
+   for (i = 0; i < HIST_TIERS; i++) {
+      h->recs[i] = rec;
+      rec += h->hdr->tier[i].capacity;
+   }
+}
+
+static bool hist_valid(const HISTHDR *hdr, uint32_t capacity)
+{
+   int i;
+
+   if (memcmp(hdr->magic, HIST_MAGIC, sizeof(HIST_MAGIC)) != 0 ||
+       hdr->version != HIST_VERSION || hdr->recsize != sizeof(HISTREC) ||
+       hdr->ntiers != HIST_TIERS || hdr->factor != HIST_FACTOR)
+      return false;
+
+   for (i = 0; i < HIST_TIERS; i++) {
+      if (hdr->tier[i].capacity != capacity ||
+          hdr->tier[i].head >= capacity ||
+          hdr->tier[i].count > capacity)
+         return false;
+   }
+
+   return true;
+}
+
+static void hist_init_header(HISTHDR *hdr, uint32_t capacity, uint32_t interval)
+{
+   int i;
+
+   memset(hdr, 0, sizeof(*hdr));
+   memcpy(hdr->magic, HIST_MAGIC, sizeof(HIST_MAGIC));
+   hdr->version = HIST_VERSION;
+   hdr->recsize = sizeof(HISTREC);
+   hdr->ntiers = HIST_TIERS;
+   hdr->factor = HIST_FACTOR;
+
+   for (i = 0; i < HIST_TIERS; i++) {
+      hdr->tier[i].interval = interval;
+      hdr->tier[i].capacity = capacity;
+      interval *= HIST_FACTOR;
+   }
+}
+
+/*
+ * Open (creating if necessary) the history file named by
+ * ups->histfile. A file whose layout does not match the current
+ * configuration is reinitialized.
+ *
+ * Returns 0 on success (or if history is disabled), -1 on error.
+ */
+int history_open(UPSINFO *ups, int interval)
+{
+#ifdef HAVE_MINGW
+   if (ups->histfile[0] != 0)
+      log_event(ups, LOG_WARNING, "HISTORYFILE is not supported on this platform");
+   return 0;
+#else
+   struct apchist *h;
+   struct stat st;
+   size_t size;
+   void *map;
+   int fd;
+
+   if (ups->histfile[0] == 0 || ups->history != NULL)
+      return 0;
+
+   if (ups->histsize <= 0) {
+      log_event(ups, LOG_WARNING, "Invalid HISTORYSIZE %d, history disabled",
+         ups->histsize);
+      return -1;
+   }
+
+   size = sizeof(HISTHDR) + (size_t)HIST_TIERS * ups->histsize * sizeof(HISTREC);
+
+   fd = open(ups->histfile, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      log_event(ups, LOG_WARNING, "Could not open history file %s: %s",
+         ups->histfile, strerror(errno));
+      return -1;
+   }
+
+   if (fstat(fd, &st) < 0 || ((size_t)st.st_size != size && ftruncate(fd, size) < 0)) {
+      log_event(ups, LOG_WARNING, "Could not size history file %s: %s",
+         ups->histfile, strerror(errno));
+      close(fd);
+      return -1;
+   }
+
+   map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED) {
+      log_event(ups, LOG_WARNING, "Could not map history file %s: %s",
+         ups->histfile, strerror(errno));
+      close(fd);
+      return -1;
+   }
+
+   h = (struct apchist *)calloc(1, sizeof(*h));
+   h->fd = fd;
+   h->size = size;
+   h->hdr = (HISTHDR *)map;
+
+   if ((size_t)st.st_size != size || !hist_valid(h->hdr, ups->histsize)) {
+      if (st.st_size != 0) {
+         log_event(ups, LOG_WARNING, "History file %s has a different layout; "
+            "reinitializing", ups->histfile);
+      }
+      memset(map, 0, size);
+      hist_init_header(h->hdr, ups->histsize, interval);
+   } else {
+      int i;
+
+      /* Sample interval may have changed since the file was created */
+      for (i = 0; i < HIST_TIERS; i++) {
+         h->hdr->tier[i].interval = interval;
+         interval *= HIST_FACTOR;
+      }
+   }
+
+   hist_layout(h);
+
+   P(hist_mutex);
+   ups->history = h;
+   V(hist_mutex);
+
+   Dmsg(100, "History file %s opened, %d records per tier\n",
+      ups->histfile, ups->histsize);
+   return 0;
+#endif
+}
+
+void history_close(UPSINFO *ups)
+{
+#ifndef HAVE_MINGW
+   struct apchist *h;
+
+   P(hist_mutex);
+   h = ups->history;
+   ups->history = NULL;
+   V(hist_mutex);
+
+   if (h == NULL)
+      return;
+
+   msync(h->hdr, h->size, MS_SYNC);
+   munmap(h->hdr, h->size);
+   close(h->fd);
+   free(h);
+#endif
+}
+
+static int16_t hist_quantize(double value, double scale)
+{
+   double v = value * scale;
+
+   v += (v < 0) ? -0.5 : 0.5;
+   if (v > 32767)
+      return 32767;
+   if (v < -32767)
+      return -32767;
+   return (int16_t)v;
+}
+
+static double hist_value(const UPSINFO *ups, int field)
+{
+   switch (field) {
+   case HF_LINEV:    return ups->LineVoltage;
+   case HF_OUTPUTV:  return ups->OutputVoltage;
+   case HF_BATTV:    return ups->BattVoltage;
+   case HF_LOADPCT:  return ups->UPSLoad;
+   case HF_BCHARGE:  return ups->BattChg;
+   case HF_ITEMP:    return ups->UPSTemp;
+   case HF_AMBTEMP:  return ups->ambtemp;
+   case HF_HUMIDITY: return ups->humidity;
+   case HF_TIMELEFT: return ups->TimeLeft;
+   case HF_LINEFREQ: return ups->LineFreq;
+   }
+   return 0;
+}
+
+static void hist_accumulate(HISTACC *acc, const HISTREC *rec)
+{
+   int i;
+
+   for (i = 0; i < HF_MAX; i++) {
+      if (rec->valid & (1 << i)) {
+         acc->sum[i] += rec->val[i];
+         acc->n[i]++;
+      }
+   }
+   acc->status |= rec->status;
+   acc->time = rec->time;
+   acc->samples++;
+}
+
+static void hist_put(struct apchist *h, int tier, const HISTREC *rec)
+{
+   HISTTIER *t = &h->hdr->tier[tier];
+   HISTACC *acc;
+   HISTREC avg;
+   int i;
+
+   h->recs[tier][t->head] = *rec;
+   t->head = (t->head + 1) % t->capacity;
+   if (t->count < t->capacity)
+      t->count++;
+
+   if (tier + 1 >= HIST_TIERS)
+      return;
+
+   acc = &h->acc[tier + 1];
+   hist_accumulate(acc, rec);
+   if (acc->samples < HIST_FACTOR)
+      return;
+
+   /* Status bits are OR'ed so any condition seen in the period shows */
+   memset(&avg, 0, sizeof(avg));
+   avg.time = acc->time;
+   avg.status = acc->status;
+   for (i = 0; i < HF_MAX; i++) {
+      if (acc->n[i]) {
+         avg.valid |= 1 << i;
+         avg.val[i] = hist_quantize(acc->sum[i] / acc->n[i], 1.0);
+      }
+   }
+   memset(acc, 0, sizeof(*acc));
+
+   hist_put(h, tier + 1, &avg);
+}
+
+/*
+ * Record the current UPS values as a new tier 0 sample.
+ */
+void history_add(UPSINFO *ups, time_t now)
+{
+   HISTREC rec;
+   int i;
+
+   if (ups->history == NULL)
+      return;
+
+   memset(&rec, 0, sizeof(rec));
+   rec.time = (uint32_t)now;
+   rec.status = ups->Status;
+   for (i = 0; i < HF_MAX; i++) {
+      if (ups->UPS_Cap[hist_fields[i].ci]) {
+         rec.valid |= 1 << i;
+         rec.val[i] = hist_quantize(hist_value(ups, i), hist_fields[i].scale);
+      }
+   }
+
+   P(hist_mutex);
+   if (ups->history)
+      hist_put(ups->history, 0, &rec);
+   V(hist_mutex);
+}
+
+/* Ring index of the i'th oldest record in a tier */
+static inline uint32_t hist_slot(const HISTTIER *t, uint32_t i)
+{
+   return (t->head + t->capacity - t->count + i) % t->capacity;
+}
+
+/* Number of records in a tier older than the given time */
+static uint32_t hist_lower_bound(struct apchist *h, int tier, uint32_t when)
+{
+   const HISTTIER *t = &h->hdr->tier[tier];
+   uint32_t lo = 0, hi = t->count;
+
+   while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+
+      if (h->recs[tier][hist_slot(t, mid)].time < when)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+/*
+ * Pick the finest tier that still reaches back to the start of the
+ * requested range, or the coarsest tier holding data if none does.
+ */
+static int hist_pick_tier(struct apchist *h, uint32_t start)
+{
+   int i, best = 0;
+
+   for (i = 0; i < HIST_TIERS; i++) {
+      const HISTTIER *t = &h->hdr->tier[i];
+
+      if (t->count == 0)
+         continue;
+      best = i;
+      if (h->recs[i][hist_slot(t, 0)].time <= start)
+         return i;
+   }
+   return best;
+}
+
+/*
+ * Send the history records with start <= time <= end over the
+ * network, one CSV line per message, preceded by a column header and
+ * followed by the usual zero length message. A negative start is
+ * taken relative to the current time; end == 0 means now. If tier is
+ * negative a suitable tier is chosen automatically.
+ *
+ * Returns -1 on error or EOF, 0 otherwise.
+ */
+int output_history(UPSINFO *ups, int sockfd, long start, long end, int tier)
+{
+   const char notavail[] = "Not available\n";
+   struct apchist *h;
+   HISTREC *recs = NULL;
+   uint32_t first, last, n = 0, i, interval = 0;
+   time_t now = time(NULL);
+   char buf[MAXSTRING];
+   int len, stat = 0, f;
+
+   if (start < 0)
+      start += now;
+   if (end <= 0)
+      end = now;
+
+   P(hist_mutex);
+   h = ups->history;
+   if (h == NULL || tier >= HIST_TIERS) {
+      V(hist_mutex);
+      net_send(sockfd, notavail, strlen(notavail));
+      return net_send(sockfd, NULL, 0) < 0 ? -1 : 0;
+   }
+
+   if (tier < 0)
+      tier = hist_pick_tier(h, start);
+
+   /* Copy the matching records out so the network I/O is unlocked */
+   first = hist_lower_bound(h, tier, start);
+   last = hist_lower_bound(h, tier, end + 1);
+   if (last > first) {
+      n = last - first;
+      recs = (HISTREC *)malloc(n * sizeof(HISTREC));
+      for (i = 0; i < n; i++)
+         recs[i] = h->recs[tier][hist_slot(&h->hdr->tier[tier], first + i)];
+   }
+   interval = h->hdr->tier[tier].interval;
+   V(hist_mutex);
+
+   len = asnprintf(buf, sizeof(buf), "# tier %d interval %u records %u\n",
+      tier, interval, n);
+   if (net_send(sockfd, buf, len) <= 0)
+      goto bailout;
+
+   len = asnprintf(buf, sizeof(buf), "TIME,STATUS");
+   for (f = 0; f < HF_MAX; f++)
+      len += asnprintf(buf + len, sizeof(buf) - len, ",%s", hist_fields[f].name);
+   len += asnprintf(buf + len, sizeof(buf) - len, "\n");
+   if (net_send(sockfd, buf, len) <= 0)
+      goto bailout;
+
+   for (i = 0; i < n; i++) {
+      const HISTREC *rec = &recs[i];
+
+      len = asnprintf(buf, sizeof(buf), "%u,0x%08X", rec->time, rec->status);
+      for (f = 0; f < HF_MAX; f++) {
+         buf[len++] = ',';
+         buf[len] = 0;
+         if (rec->valid & (1 << f)) {
+            len += asnprintf(buf + len, sizeof(buf) - len, hist_fields[f].fmt,
+               rec->val[f] / hist_fields[f].scale);
+         }
+      }
+      len += asnprintf(buf + len, sizeof(buf) - len, "\n");
+
+      if (net_send(sockfd, buf, len) <= 0)
+         goto bailout;
+   }
+
+   goto goodout;
+
+bailout:
+   stat = -1;
+
+goodout:
+   free(recs);
+   if (net_send(sockfd, NULL, 0) < 0)
+      stat = -1;
+
+   return stat;
+}
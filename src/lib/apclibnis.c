@@ -25,6 +25,10 @@
 
 #include "apc.h"
 
+#ifndef HAVE_MINGW
+# include <sys/uio.h>
+#endif
+
 #ifdef HAVE_NISLIB
 
 /* Some Win32 specific screwery */
@@ -47,47 +51,57 @@ int dummy = WSA_Init();
 
 
 /*
- * Read nbytes from the network.
- * It is possible that the total bytes require in several
- * read requests
+ * Wait for data from the network and read what there is of it, up to
+ * nbytes. Returns the count read, 0 on EOF or -errno.
  */
-
-static int read_nbytes(sock_t fd, char *ptr, int nbytes)
+static int recv_some(sock_t fd, char *ptr, int nbytes)
 {
-   int nleft, nread = 0;
    struct timeval timeout;
-   int rc;
+   int rc, nread;
    fd_set fds;
 
-   nleft = nbytes;
+   for (;;) {
+      /* Expect data from the server within 15 seconds */
+      timeout.tv_sec = 15;
+      timeout.tv_usec = 0;
 
-   while (nleft > 0) {
-      do {
-         /* Expect data from the server within 15 seconds */
-         timeout.tv_sec = 15;
-         timeout.tv_usec = 0;
+      FD_ZERO(&fds);
+      FD_SET(fd, &fds);
 
-         FD_ZERO(&fds);
-         FD_SET(fd, &fds);
+      rc = select(fd + 1, &fds, NULL, NULL, &timeout);
 
-         rc = select(fd + 1, &fds, NULL, NULL, &timeout);
+      switch (rc) {
+      case -1:
+         if (errno == EINTR || errno == EAGAIN)
+            continue;
+         return -errno;       /* error */
+      case 0:
+         return -ETIMEDOUT;   /* timeout */
+      }
 
-         switch (rc) {
-         case -1:
-            if (errno == EINTR || errno == EAGAIN)
-               continue;
-            return -errno;       /* error */
-         case 0:
-            return -ETIMEDOUT;   /* timeout */
-         }
+      nread = recv(fd, ptr, nbytes, 0);
+      if (nread >= 0)
+         return nread;
+      if (errno != EINTR && errno != EAGAIN)
+         return -errno;       /* error */
+   }
+}
 
-         nread = recv(fd, ptr, nleft, 0);
-      } while (nread == -1 && (errno == EINTR || errno == EAGAIN));
+/*
+ * Read nbytes from the network.
+ * It is possible that the total bytes require in several
+ * read requests
+ */
+static int read_nbytes(sock_t fd, char *ptr, int nbytes)
+{
+   int nleft, nread;
 
-      if (nread == 0)
-         return 0;               /* EOF */
-      if (nread < 0)
-         return -errno;          /* error */
+   nleft = nbytes;
+
+   while (nleft > 0) {
+      nread = recv_some(fd, ptr, nleft);
+      if (nread <= 0)
+         return nread;        /* EOF or error */
 
       nleft -= nread;
       ptr += nread;
@@ -124,6 +138,177 @@ static int write_nbytes(sock_t fd, const char *ptr, int nbytes)
    return nbytes - nleft;
 }
 
+/*
+ * Write a message header and its data with one system call where the
+ * platform allows it. Returns the count of data bytes written or
+ * -errno.
+ */
+static int write_message(sock_t fd, const char *hdr, int hlen,
+   const char *buff, int len)
+{
+#ifndef HAVE_MINGW
+   struct iovec iov[2];
+   ssize_t n;
+   int i = 0;
+
+   iov[0].iov_base = (void *)hdr;
+   iov[0].iov_len = hlen;
+   iov[1].iov_base = (void *)buff;
+   iov[1].iov_len = len;
+
+   while (i < 2) {
+      n = writev(fd, iov + i, 2 - i);
+      if (n < 0) {
+         if (errno == EINTR || errno == EAGAIN)
+            continue;
+         return -errno;
+      }
+      if (n == 0)
+         return -EPIPE;
+
+      /* Step over what went out, the rest is tried again */
+      for (; i < 2 && (size_t)n >= iov[i].iov_len; i++)
+         n -= iov[i].iov_len;
+      if (i < 2) {
+         iov[i].iov_base = (char *)iov[i].iov_base + n;
+         iov[i].iov_len -= n;
+      }
+   }
+   return len;
+#else
+   int rc;
+
+   rc = write_nbytes(fd, hdr, hlen);
+   if (rc <= 0)
+      return rc;
+   if (rc != hlen)
+      return -EINVAL;
+
+   rc = write_nbytes(fd, buff, len);
+   if (rc < 0)
+      return rc;
+   if (rc != len)
+      return -EINVAL;
+   return rc;
+#endif
+}
+
+/*
+ * While a thread batches what it sends to a socket, net_send() frames
+ * the messages into a buffer that net_batch_end() sends in one go, so
+ * a response costs one system call and goes out in as few segments as
+ * it fits in. With framing 2 the messages of the response are also
+ * merged into one, with a 32 bit length, ended as usual by an empty
+ * message.
+ */
+#define BATCH_FLUSH 65536          /* framing 1: send early past this */
+#define BATCH_EXTHDR 6             /* NIS_EXTLEN and the 32 bit length */
+
+typedef struct {
+   sock_t fd;                      /* INVALID_SOCKET when not batching */
+   int framing;
+   char *buf;
+   int len, size;
+   int hdr;                        /* framing 2: header of merged data, or -1 */
+   int err;                        /* first error, returned from then on */
+} NETBATCH;
+
+static __thread NETBATCH batch = { INVALID_SOCKET, 1, NULL, 0, 0, -1, 0 };
+
+static void batch_append(const void *data, int len)
+{
+   if (batch.len + len > batch.size) {
+      batch.size = (batch.len + len) * 2;
+      batch.buf = (char *)realloc(batch.buf, batch.size);
+   }
+   memcpy(batch.buf + batch.len, data, len);
+   batch.len += len;
+}
+
+static int batch_flush(void)
+{
+   int rc;
+
+   if (batch.err == 0 && batch.len > 0) {
+      rc = write_nbytes(batch.fd, batch.buf, batch.len);
+      if (rc < 0)
+         batch.err = rc;
+      else if (rc != batch.len)
+         batch.err = -EPIPE;
+   }
+   batch.len = 0;
+   return batch.err;
+}
+
+/* End the data merged so far with its length */
+static void batch_end_merged(void)
+{
+   unsigned short ext = htons(NIS_EXTLEN);
+   uint32_t len = htonl(batch.len - batch.hdr - BATCH_EXTHDR);
+
+   memcpy(batch.buf + batch.hdr, &ext, sizeof(ext));
+   memcpy(batch.buf + batch.hdr + sizeof(ext), &len, sizeof(len));
+   batch.hdr = -1;
+}
+
+static int batch_send(const char *buff, int len)
+{
+   unsigned short pktsiz;
+
+   if (batch.err)
+      return batch.err;
+
+   if (batch.framing >= 2) {
+      if (len > 0) {
+         if (batch.hdr < 0) {
+            batch.hdr = batch.len;
+            batch_append("\0\0\0\0\0\0", BATCH_EXTHDR);
+         }
+         batch_append(buff, len);
+         return len;
+      }
+      if (batch.hdr >= 0)
+         batch_end_merged();
+   }
+
+   if (len > NIS_MAXMSG)
+      return -EMSGSIZE;
+   pktsiz = htons((unsigned short)len);
+   batch_append(&pktsiz, sizeof(pktsiz));
+   batch_append(buff, len);
+
+   if (batch.framing < 2 && batch.len >= BATCH_FLUSH && batch_flush() < 0)
+      return batch.err;
+   return len;
+}
+
+void net_batch_begin(sock_t sockfd, int framing)
+{
+   batch.fd = sockfd;
+   batch.framing = framing;
+   batch.len = 0;
+   batch.hdr = -1;
+   batch.err = 0;
+}
+
+int net_batch_end(void)
+{
+   int rc;
+
+   if (batch.fd == INVALID_SOCKET)
+      return 0;
+
+   if (batch.hdr >= 0)
+      batch_end_merged();
+   rc = batch_flush();
+
+   free(batch.buf);
+   batch.buf = NULL;
+   batch.size = 0;
+   batch.fd = INVALID_SOCKET;
+   return rc;
+}
+
 /* 
  * Receive a message from the other end. Each message consists of
  * two packets. The first is a header that contains the size
@@ -137,6 +322,8 @@ int net_recv(sock_t sockfd, char *buff, int maxlen)
 {
    int nbytes;
    unsigned short pktsiz;
+   uint32_t extsiz, size;
+   int len;
 
    /* get data size -- in short */
    if ((nbytes = read_nbytes(sockfd, (char *)&pktsiz, sizeof(pktsiz))) <= 0) {
@@ -146,111 +333,173 @@ int net_recv(sock_t sockfd, char *buff, int maxlen)
    if (nbytes != sizeof(pktsiz))
       return -EINVAL;
 
-   pktsiz = ntohs(pktsiz);         /* decode no. of bytes that follow */
-   if (pktsiz > maxlen)
+   size = ntohs(pktsiz);           /* decode no. of bytes that follow */
+   if (size == NIS_EXTLEN) {
+      if ((nbytes = read_nbytes(sockfd, (char *)&extsiz, sizeof(extsiz))) <= 0)
+         return nbytes;
+      size = ntohl(extsiz);
+   }
+   /* Checked before narrowing so no frame size can turn negative */
+   if (maxlen < 0 || size > (uint32_t)maxlen)
       return -EINVAL;
-   if (pktsiz == 0)
+   len = size;
+   if (len == 0)
       return 0;                    /* soft EOF */
 
    /* now read the actual data */
-   if ((nbytes = read_nbytes(sockfd, buff, pktsiz)) <= 0)
+   if ((nbytes = read_nbytes(sockfd, buff, len)) <= 0)
       return nbytes;
-   if (nbytes != pktsiz)
+   if (nbytes != len)
       return -EINVAL;
 
    return nbytes;                /* return actual length of message */
 }
 
+void net_reader_init(NETREADER *r, sock_t sockfd)
+{
+   r->fd = sockfd;
+   r->start = r->end = 0;
+}
+
+/*
+ * Have at least need bytes of the reader buffered. Returns 1, 0 on EOF
+ * or -errno.
+ */
+static int reader_fill(NETREADER *r, int need)
+{
+   int n;
+
+   if (r->end - r->start >= need)
+      return 1;
+
+   if (r->start > 0) {
+      memmove(r->buf, r->buf + r->start, r->end - r->start);
+      r->end -= r->start;
+      r->start = 0;
+   }
+   while (r->end < need) {
+      n = recv_some(r->fd, r->buf + r->end, sizeof(r->buf) - r->end);
+      if (n <= 0)
+         return n;
+      r->end += n;
+   }
+   return 1;
+}
+
+/*
+ * As net_recv(), but reading as much as has arrived into the reader's
+ * buffer, so that a response of many messages takes a few system
+ * calls instead of two per message.
+ */
+int net_recv_buffered(NETREADER *r, char *buff, int maxlen)
+{
+   unsigned short pktsiz;
+   uint32_t extsiz, size;
+   int len, n, have;
+
+   if ((n = reader_fill(r, sizeof(pktsiz))) <= 0)
+      return n;
+   memcpy(&pktsiz, r->buf + r->start, sizeof(pktsiz));
+   r->start += sizeof(pktsiz);
+
+   size = ntohs(pktsiz);
+   if (size == NIS_EXTLEN) {
+      if ((n = reader_fill(r, sizeof(extsiz))) <= 0)
+         return n;
+      memcpy(&extsiz, r->buf + r->start, sizeof(extsiz));
+      r->start += sizeof(extsiz);
+      size = ntohl(extsiz);
+   }
+   if (maxlen < 0 || size > (uint32_t)maxlen)
+      return -EINVAL;
+   len = size;
+   if (len == 0)
+      return 0;                    /* soft EOF */
+
+   /* What is buffered, then the rest of a large message directly */
+   have = MIN(len, r->end - r->start);
+   memcpy(buff, r->buf + r->start, have);
+   r->start += have;
+   if (have < len) {
+      if ((n = read_nbytes(r->fd, buff + have, len - have)) <= 0)
+         return n;
+      if (n != len - have)
+         return -EINVAL;
+   }
+
+   return len;
+}
+
 /*
- * Send a message over the network. The send consists of
- * two network packets. The first is sends a short containing
- * the length of the data packet which follows.
+ * Send a message over the network: a short containing the length of
+ * the data, then the data, in one system call. Within a batch of this
+ * thread the message is only added to the batch.
  * Returns number of bytes sent, 0 for EOF
  * Returns -errno on error
  */
 int net_send(sock_t sockfd, const char *buff, int len)
 {
-   int rc;
-   short pktsiz;
+   unsigned short pktsiz;
+
+   if (sockfd == batch.fd && sockfd != INVALID_SOCKET)
+      return batch_send(buff, len);
+
+   if (len > NIS_MAXMSG)
+      return -EMSGSIZE;
 
    /* send short containing size of data packet */
-   pktsiz = htons((short)len);
-   rc = write_nbytes(sockfd, (char *)&pktsiz, sizeof(short));
-   if (rc <= 0)
-      return rc;
-   if (rc != sizeof(short))
-      return -EINVAL;
+   pktsiz = htons((unsigned short)len);
+   return write_message(sockfd, (const char *)&pktsiz, sizeof(pktsiz),
+      buff, len);
+}
 
-   /* send data packet */
-   rc = write_nbytes(sockfd, buff, len);
-   if (rc <= 0)
-      return rc;
-   if (rc != len)
-      return -EINVAL;
+/*
+ * Split a host[:port] as given by users into host and port, leaving
+ * port alone if the spec has none. An IPv6 address may be given bare,
+ * without a port, or in brackets with or without one. The path of a
+ * Unix domain socket is taken whole.
+ */
+void net_split_host(const char *spec, char *host, size_t size, int *port)
+{
+   const char *end, *p;
 
-   return rc;
+   if (spec[0] == '/') {
+      strlcpy(host, spec, size);
+      return;
+   }
+
+   if (spec[0] == '[' && (end = strchr(spec, ']')) != NULL) {
+      strlcpy(host, spec + 1, MIN((size_t)(end - spec), size));
+      if (end[1] == ':')
+         *port = atoi(end + 2);
+      return;
+   }
+
+   /* A second colon makes it an address without a port */
+   p = strchr(spec, ':');
+   if (p == NULL || strchr(p + 1, ':') != NULL) {
+      strlcpy(host, spec, size);
+      return;
+   }
+   strlcpy(host, spec, MIN((size_t)(p - spec + 1), size));
+   *port = atoi(p + 1);
 }
 
-/*     
- * Open a TCP connection to the UPS network server
+/*
+ * Connect a new socket to one address of the server, giving up after
+ * 5 seconds.
  * Returns -errno on error
  * Returns socket file descriptor otherwise
  */
-sock_t net_open(const char *host, char *service, int port)
+static sock_t net_connect(const struct sockaddr *addr, socklen_t addrlen)
 {
    int nonblock = 1;
    int block = 0;
    sock_t sockfd;
    int rc;
-   struct sockaddr_in tcp_serv_addr;  /* socket information */
 
-#ifndef HAVE_MINGW
-   // Every platform has their own magic way to avoid getting a SIGPIPE
-   // when writing to a stream socket where the remote end has closed. 
-   // This method works pretty much everywhere which avoids the mess
-   // of figuring out which incantation this platform supports. (Excepting
-   // for win32 which doesn't support signals at all.)
-   struct sigaction sa;
-   memset(&sa, 0, sizeof(sa));
-   sa.sa_handler = SIG_IGN;
-   sigaction(SIGPIPE, &sa, NULL);
-#endif
-
-   /* 
-    * Fill in the structure serv_addr with the address of
-    * the server that we want to connect with.
-    */
-   memset((char *)&tcp_serv_addr, 0, sizeof(tcp_serv_addr));
-   tcp_serv_addr.sin_family = AF_INET;
-   tcp_serv_addr.sin_port = htons(port);
-   tcp_serv_addr.sin_addr.s_addr = inet_addr(host);
-   if (tcp_serv_addr.sin_addr.s_addr == INADDR_NONE) {
-      struct hostent he;
-      char *tmphstbuf = NULL;
-      size_t hstbuflen = 0;
-      struct hostent *hp = gethostname_re(host, &he, &tmphstbuf, &hstbuflen);
-      if (!hp)
-      {
-         free(tmphstbuf);
-         Dmsg(100, "%s: gethostname fails: %d\n", __func__, h_errno);
-         return -ENXIO;
-      }
-
-      if (hp->h_length != sizeof(tcp_serv_addr.sin_addr.s_addr) || 
-          hp->h_addrtype != AF_INET)
-      {
-         free(tmphstbuf);
-         Dmsg(100, "%s: Bad address returned from gethostbyname\n", __func__);
-         return -EAFNOSUPPORT;
-      }
-
-      memcpy(&tcp_serv_addr.sin_addr.s_addr, hp->h_addr, 
-             sizeof(tcp_serv_addr.sin_addr.s_addr));
-      free(tmphstbuf);
-   }
-
-   /* Open a TCP socket */
-   if ((sockfd = socket_cloexec(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+   /* Open a stream socket */
+   if ((sockfd = socket_cloexec(addr->sa_family, SOCK_STREAM, 0)) == INVALID_SOCKET)
    {
       rc = -errno;
       Dmsg(100, "%s: socket fails: %s\n", __func__, strerror(-rc));
@@ -268,7 +517,7 @@ sock_t net_open(const char *host, char *service, int port)
    }
 
    /* Initiate connection attempt */
-   rc = connect(sockfd, (struct sockaddr *)&tcp_serv_addr, sizeof(tcp_serv_addr));
+   rc = connect(sockfd, addr, addrlen);
    if (rc == -1 && errno != EINPROGRESS) {
       rc = -errno;
       close(sockfd);
@@ -338,6 +587,66 @@ sock_t net_open(const char *host, char *service, int port)
    return sockfd;
 }
 
+/*     
+ * Open a connection to the UPS network server. The host may be a name
+ * or an IPv4 or IPv6 address, each address of a name being tried in
+ * turn, or the path of a Unix domain socket, for which port is unused.
+ * Returns -errno on error
+ * Returns socket file descriptor otherwise
+ */
+sock_t net_open(const char *host, char *service, int port)
+{
+   struct addrinfo hints, *res, *ai;
+   char portstr[16];
+   sock_t sockfd;
+   int rc;
+
+#ifndef HAVE_MINGW
+   // Every platform has their own magic way to avoid getting a SIGPIPE
+   // when writing to a stream socket where the remote end has closed. 
+   // This method works pretty much everywhere which avoids the mess
+   // of figuring out which incantation this platform supports. (Excepting
+   // for win32 which doesn't support signals at all.)
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = SIG_IGN;
+   sigaction(SIGPIPE, &sa, NULL);
+
+   if (host[0] == '/') {
+      struct sockaddr_un un_addr;
+
+      memset(&un_addr, 0, sizeof(un_addr));
+      un_addr.sun_family = AF_UNIX;
+      if (strlen(host) >= sizeof(un_addr.sun_path))
+         return -ENAMETOOLONG;
+      strlcpy(un_addr.sun_path, host, sizeof(un_addr.sun_path));
+      return net_connect((struct sockaddr *)&un_addr, sizeof(un_addr));
+   }
+#endif
+
+   /* 
+    * Look up the addresses of the server that we want to connect with.
+    */
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_ADDRCONFIG;
+   asnprintf(portstr, sizeof(portstr), "%d", port);
+   if ((rc = getaddrinfo(host, portstr, &hints, &res)) != 0) {
+      Dmsg(100, "%s: getaddrinfo fails: %s\n", __func__, gai_strerror(rc));
+      return -ENXIO;
+   }
+
+   sockfd = -EAFNOSUPPORT;
+   for (ai = res; ai; ai = ai->ai_next) {
+      if ((sockfd = net_connect(ai->ai_addr, ai->ai_addrlen)) >= 0)
+         break;
+   }
+   freeaddrinfo(res);
+
+   return sockfd;
+}
+
 /* Close the network connection */
 void net_close(sock_t sockfd)
 {
@@ -345,11 +654,11 @@ void net_close(sock_t sockfd)
 }
 
 /*     
- * Accept a TCP connection.
- * Returns -1 on error.
+ * Accept a connection.
+ * Returns -errno on error.
  * Returns file descriptor of new connection otherwise.
  */
-sock_t net_accept(sock_t fd, struct sockaddr_in *cli_addr)
+sock_t net_accept(sock_t fd, struct sockaddr_storage *cli_addr)
 {
 #ifdef HAVE_MINGW                                       
    /* kludge because some idiot defines socklen_t as unsigned */
@@ -61,17 +61,24 @@ void log_event(const UPSINFO *ups, int level, const char *fmt, ...)
    syslog(level, "%s", msg);       /* log the event */
    Dmsg(100, "%s\n", msg);
 
-   /* Write out to our temp file. LOG_INFO is DATA logging, so
-    * do not write it to our temp events file. */
-   if (event_fd >= 0 && level != LOG_INFO) {
+   /* Write out to our temp file and keep it in memory. LOG_INFO is
+    * DATA logging, so do not write it to our temp events file. */
+   if ((event_fd >= 0 || (ups && ups->events)) && level != LOG_INFO) {
       format_date(time(NULL), datetime, sizeof(datetime));
-      write(event_fd, datetime, strlen(datetime));
 
       int lm = strlen(msg);
-      if (msg[lm - 1] != '\n')
+      if (lm == sizeof(msg) - 1)
+         lm--;
+      if (lm == 0 || msg[lm - 1] != '\n')
          msg[lm++] = '\n';
+      msg[lm] = '\0';
 
-      write(event_fd, msg, lm);
+      if (event_fd >= 0) {
+         write(event_fd, datetime, strlen(datetime));
+         write(event_fd, msg, lm);
+      }
+      if (ups && ups->events)
+         events_add(ups, datetime, msg);
    }
 }
 
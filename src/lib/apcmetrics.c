@@ -0,0 +1,424 @@
+/*
+ * apcmetrics.c
+ *
+ * Status of the UPSes as Prometheus metrics, rendered ahead of time
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * Every pass of do_reports() formats the samples of one UPS while it
+ * holds the data anyway, family by family, and bumps a generation
+ * count. The metrics server puts the document together from these
+ * pieces only when some generation has moved on, so a scrape costs a
+ * send() of text that is already there.
+ *
+ * The output is the Prometheus text format, version 0.0.4. Samples of
+ * one family must be together, so each UPS keeps where each family
+ * starts in its text and the document interleaves them.
+ */
+
+#include "apc.h"
+
+#define METRICS_TEXTSIZE 32768        /* ~60 lines with the longest UPSNAME */
+
+enum {
+   MF_LINEV,
+   MF_OUTPUTV,
+   MF_LINEFREQ,
+   MF_LOAD,
+   MF_BCHARGE,
+   MF_TIMELEFT,
+   MF_PREDTIME,
+   MF_BATTV,
+   MF_ITEMP,
+   MF_XFERS,
+   MF_TONBATT,
+   MF_STATUS,
+   MF_LASTPOLL,
+   MF_LINKATTEMPTS,
+   MF_LINKFAILURES,
+   MF_LINKOUTAGES,
+   MF_LINKRECOVERIES,
+   MF_EVENTLAT,
+   MF_COUNT
+};
+
+static const struct {
+   const char *name;
+   const char *type;
+   const char *help;
+} families[MF_COUNT] = {
+   { "apcupsd_line_voltage_volts", "gauge", "Input line voltage" },
+   { "apcupsd_output_voltage_volts", "gauge", "Output voltage" },
+   { "apcupsd_line_frequency_hertz", "gauge", "Input line frequency" },
+   { "apcupsd_load_percent", "gauge", "Output load as a percentage of capacity" },
+   { "apcupsd_battery_charge_percent", "gauge", "Battery charge" },
+   { "apcupsd_battery_runtime_seconds", "gauge", "Runtime left on battery as estimated by the UPS" },
+   { "apcupsd_predicted_runtime_seconds", "gauge", "Runtime left on battery as learned by apcupsd" },
+   { "apcupsd_battery_voltage_volts", "gauge", "Battery voltage" },
+   { "apcupsd_internal_temperature_celsius", "gauge", "Internal UPS temperature" },
+   { "apcupsd_transfers_total", "counter", "Transfers to battery since apcupsd started" },
+   { "apcupsd_battery_time_seconds_total", "counter", "Time on battery since apcupsd started" },
+   { "apcupsd_status", "gauge", "UPS status flags, 1 if set" },
+   { "apcupsd_last_poll_timestamp_seconds", "gauge", "Time the UPS was last polled" },
+   { "apcupsd_link_attempts_total", "counter", "Attempts to talk to the UPS" },
+   { "apcupsd_link_failures_total", "counter", "Attempts to talk to the UPS that failed" },
+   { "apcupsd_link_outages_total", "counter", "Times communication with the UPS was lost" },
+   { "apcupsd_link_recoveries_total", "counter", "Times communication with the UPS came back" },
+   { "apcupsd_event_latency_seconds", "histogram", "Delay from a status change to its event" },
+};
+
+struct metrics {
+   pthread_mutex_t mutex;
+   unsigned long gen;              /* bumped by every render */
+   int off[MF_COUNT + 1];          /* where each family starts in text */
+   char text[METRICS_TEXTSIZE];
+};
+
+/* A render under way, outside the lock */
+typedef struct {
+   int len;
+   bool overflow;
+   int off[MF_COUNT + 1];
+   char text[METRICS_TEXTSIZE];
+} RENDER;
+
+static void add(RENDER *r, const char *fmt, ...)
+{
+   va_list ap;
+   int len;
+
+   if (r->overflow)
+      return;
+
+   va_start(ap, fmt);
+   len = avsnprintf(r->text + r->len, sizeof(r->text) - r->len, fmt, ap);
+   va_end(ap);
+
+   if (len < 0 || len >= (int)sizeof(r->text) - r->len)
+      r->overflow = true;
+   else
+      r->len += len;
+}
+
+/* One sample of family f labelled with the UPS, and more labels if any */
+static void sample(RENDER *r, int f, const char *lbl, const char *more,
+                   double value)
+{
+   add(r, "%s{%s%s} %.10g\n", families[f].name, lbl, more ? more : "",
+      value);
+}
+
+/* A label value with backslash, quote and newline escaped */
+static void escape_label(char *dst, size_t size, const char *src)
+{
+   size_t n = 0;
+
+   for (; *src && n + 2 < size; src++) {
+      if (*src == '\\' || *src == '"') {
+         dst[n++] = '\\';
+         dst[n++] = *src;
+      } else if (*src == '\n') {
+         dst[n++] = '\\';
+         dst[n++] = 'n';
+      } else {
+         dst[n++] = *src;
+      }
+   }
+   dst[n] = 0;
+}
+
+static void render_status(RENDER *r, UPSINFO *ups, const char *lbl)
+{
+   static const struct {
+      const char *flag;
+      int32_t bit;
+   } flags[] = {
+      { "online",      UPS_online },
+      { "onbatt",      UPS_onbatt },
+      { "battlow",     UPS_battlow },
+      { "replacebatt", UPS_replacebatt },
+      { "overload",    UPS_overload },
+      { "trim",        UPS_trim },
+      { "boost",       UPS_boost },
+      { "calibration", UPS_calibration },
+      { "commlost",    UPS_commlost },
+      { "shutdown",    UPS_shutdown },
+      { "battpresent", UPS_battpresent },
+   };
+   char more[32];
+   unsigned int i;
+
+   for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+      asnprintf(more, sizeof(more), ",flag=\"%s\"", flags[i].flag);
+      sample(r, MF_STATUS, lbl, more, (ups->Status & flags[i].bit) ? 1 : 0);
+   }
+}
+
+/* LATHIST buckets are already powers of two; Prometheus wants them summed */
+static void render_lathist(RENDER *r, int f, const char *lbl,
+                           const LATHIST *h)
+{
+   unsigned long cum = 0;
+   int i;
+
+   for (i = 0; i < LATHIST_BUCKETS - 1; i++) {
+      cum += h->bucket[i];
+      add(r, "%s_bucket{%s,le=\"%.10g\"} %lu\n", families[f].name, lbl,
+         (2ULL << i) / 1e6, cum);
+   }
+   add(r, "%s_bucket{%s,le=\"+Inf\"} %lu\n", families[f].name, lbl, h->count);
+   add(r, "%s_sum{%s} %.10g\n", families[f].name, lbl, h->sum_us / 1e6);
+   add(r, "%s_count{%s} %lu\n", families[f].name, lbl, h->count);
+}
+
+static bool enabled;
+
+/*
+ * Give every UPS somewhere to keep its metrics. Called once before
+ * the threads that render and serve them start.
+ */
+void metrics_enable(UPSINFO *head)
+{
+   UPSINFO *ups;
+
+   for (ups = head; ups; ups = ups->next_ups) {
+      ups->metrics = (struct metrics *)calloc(1, sizeof(struct metrics));
+      pthread_mutex_init(&ups->metrics->mutex, NULL);
+   }
+   enabled = true;
+}
+
+/* Called from do_reports() on every pass */
+void metrics_render(UPSINFO *ups)
+{
+   RENDER *r;
+   char name[2 * UPSNAMELEN];
+   char lbl[sizeof(name) + 8];
+   int f;
+
+   if (!enabled || ups->metrics == NULL)
+      return;
+
+   r = (RENDER *)malloc(sizeof(RENDER));
+   r->len = 0;
+   r->overflow = false;
+
+   read_lock(ups);
+
+   escape_label(name, sizeof(name), ups->upsname);
+   asnprintf(lbl, sizeof(lbl), "ups=\"%s\"", name);
+
+   /* Families in order, so each starts where the last one ended */
+   for (f = 0; f < MF_COUNT; f++) {
+      r->off[f] = r->len;
+
+      switch (f) {
+      case MF_LINEV:
+         if (ups->UPS_Cap[CI_VLINE])
+            sample(r, f, lbl, NULL, ups->LineVoltage);
+         break;
+      case MF_OUTPUTV:
+         if (ups->UPS_Cap[CI_VOUT])
+            sample(r, f, lbl, NULL, ups->OutputVoltage);
+         break;
+      case MF_LINEFREQ:
+         if (ups->UPS_Cap[CI_FREQ])
+            sample(r, f, lbl, NULL, ups->LineFreq);
+         break;
+      case MF_LOAD:
+         if (ups->UPS_Cap[CI_LOAD])
+            sample(r, f, lbl, NULL, ups->UPSLoad);
+         break;
+      case MF_BCHARGE:
+         if (ups->UPS_Cap[CI_BATTLEV])
+            sample(r, f, lbl, NULL, ups->BattChg);
+         break;
+      case MF_TIMELEFT:
+         if (ups->UPS_Cap[CI_RUNTIM])
+            sample(r, f, lbl, NULL, ups->TimeLeft * 60);
+         break;
+      case MF_PREDTIME:
+         if (ups->predict.runtime >= 0)
+            sample(r, f, lbl, NULL, ups->predict.runtime * 60);
+         break;
+      case MF_BATTV:
+         if (ups->UPS_Cap[CI_VBATT])
+            sample(r, f, lbl, NULL, ups->BattVoltage);
+         break;
+      case MF_ITEMP:
+         if (ups->UPS_Cap[CI_ITEMP])
+            sample(r, f, lbl, NULL, ups->UPSTemp);
+         break;
+      case MF_XFERS:
+         sample(r, f, lbl, NULL, ups->num_xfers);
+         break;
+      case MF_TONBATT:
+         sample(r, f, lbl, NULL, ups->cum_time_on_batt);
+         break;
+      case MF_STATUS:
+         render_status(r, ups, lbl);
+         break;
+      case MF_LASTPOLL:
+         if (ups->poll_time)
+            sample(r, f, lbl, NULL, ups->poll_time);
+         break;
+      case MF_LINKATTEMPTS:
+         sample(r, f, lbl, NULL, ups->linkstats.attempts);
+         break;
+      case MF_LINKFAILURES:
+         sample(r, f, lbl, NULL, ups->linkstats.failures);
+         break;
+      case MF_LINKOUTAGES:
+         sample(r, f, lbl, NULL, ups->linkstats.outages);
+         break;
+      case MF_LINKRECOVERIES:
+         sample(r, f, lbl, NULL, ups->linkstats.recoveries);
+         break;
+      case MF_EVENTLAT:
+         render_lathist(r, f, lbl, &ups->event_latency);
+         break;
+      }
+   }
+   r->off[MF_COUNT] = r->len;
+
+   read_unlock(ups);
+
+   if (r->overflow) {
+      log_event(ups, LOG_ERR, "Metrics for %s do not fit in %d bytes",
+         ups->upsname, METRICS_TEXTSIZE);
+   } else {
+      P(ups->metrics->mutex);
+      memcpy(ups->metrics->off, r->off, sizeof(r->off));
+      memcpy(ups->metrics->text, r->text, r->len);
+      ups->metrics->gen++;
+      V(ups->metrics->mutex);
+   }
+
+   free(r);
+}
+
+/* The document as last put together, shared by the metrics acceptors */
+static pthread_mutex_t doc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *doc;
+static size_t doclen, docsize;
+static unsigned long docgen;
+
+static void doc_add(const char *s, size_t len)
+{
+   if (doclen + len > docsize) {
+      docsize = (doclen + len) * 2;
+      doc = (char *)realloc(doc, docsize);
+   }
+   memcpy(doc + doclen, s, len);
+   doclen += len;
+}
+
+/*
+ * The metrics of all UPSes run by this daemon, as one document. It is
+ * only put together again when a UPS has rendered since the last call.
+ * Called with doc_mutex held.
+ */
+static void doc_update(UPSINFO *head)
+{
+   struct metrics **copy;
+   char line[MAXSTRING];
+   unsigned long gen = 0;
+   time_t start;
+   UPSINFO *ups;
+   int i, n, f;
+
+   for (ups = head; ups; ups = ups->next_ups) {
+      P(ups->metrics->mutex);
+      gen += ups->metrics->gen;
+      V(ups->metrics->mutex);
+   }
+   if (doc && gen == docgen)
+      return;
+
+   /* Take each UPS as of one render so its families agree */
+   for (n = 0, ups = head; ups; ups = ups->next_ups)
+      n++;
+   copy = (struct metrics **)malloc(n * sizeof(*copy));
+   gen = 0;
+   for (i = 0, ups = head; ups; ups = ups->next_ups, i++) {
+      copy[i] = (struct metrics *)malloc(sizeof(struct metrics));
+      P(ups->metrics->mutex);
+      memcpy(copy[i], ups->metrics, sizeof(struct metrics));
+      V(ups->metrics->mutex);
+      gen += copy[i]->gen;
+   }
+
+   read_lock(head);
+   start = head->start_time;
+   read_unlock(head);
+
+   doclen = 0;
+   i = asnprintf(line, sizeof(line),
+      "# HELP apcupsd_build_info Version of apcupsd\n"
+      "# TYPE apcupsd_build_info gauge\n"
+      "apcupsd_build_info{version=\"%s\"} 1\n"
+      "# HELP apcupsd_start_time_seconds Time apcupsd started\n"
+      "# TYPE apcupsd_start_time_seconds gauge\n"
+      "apcupsd_start_time_seconds %ld\n", APCUPSD_RELEASE, (long)start);
+   doc_add(line, i);
+
+   for (f = 0; f < MF_COUNT; f++) {
+      i = asnprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n",
+         families[f].name, families[f].help,
+         families[f].name, families[f].type);
+      doc_add(line, i);
+      for (i = 0; i < n; i++) {
+         /* Nothing rendered yet leaves every offset 0 */
+         doc_add(copy[i]->text + copy[i]->off[f],
+            copy[i]->off[f + 1] - copy[i]->off[f]);
+      }
+   }
+
+   for (i = 0; i < n; i++)
+      free(copy[i]);
+   free(copy);
+
+   docgen = gen;
+}
+
+/*
+ * A copy of the document for one request, to be freed by the caller.
+ * The acceptor threads share the cached document, so each sends its
+ * own copy while the next scrape may rebuild it.
+ */
+char *metrics_document(UPSINFO *head, size_t *len)
+{
+   char *copy = NULL;
+
+   *len = 0;
+   if (!enabled)
+      return NULL;
+
+   P(doc_mutex);
+   doc_update(head);
+   if ((copy = (char *)malloc(doclen)) != NULL) {
+      memcpy(copy, doc, doclen);
+      *len = doclen;
+   }
+   V(doc_mutex);
+
+   return copy;
+}
@@ -0,0 +1,229 @@
+/*
+ * apcpredict.c
+ *
+ * Runtime estimator that learns how fast the batteries drain from the
+ * outages the daemon has seen, rather than trusting the UPS estimate.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * A UPS that reports its charge gives one data point each time the
+ * charge has dropped by a whole percent on battery: the drain rate in
+ * percent per minute against the average load over that stretch. A
+ * least-squares line rate = a + b * load is kept through running sums
+ * that decay a little with every point, so the fit follows the
+ * batteries as they age. The predicted runtime is the charge left
+ * divided by the rate at the present load.
+ *
+ * A UPS that reports no charge, such as a dumb one, only tells us when
+ * the battery runs low. Outages that start with fully charged batteries
+ * and end in low battery give the minutes from full to low, averaged
+ * the same way, and the prediction is what remains of that.
+ *
+ * Every update costs the same whatever the length of the outage or of
+ * the history; the model is saved after each outage.
+ */
+
+#include "apc.h"
+
+#define PRED_MAGIC     "APCPRED"
+#define PRED_VERSION   1
+#define PRED_DECAY     0.98        /* weight kept by older points */
+#define PRED_MINPOINTS 5.0         /* weighted points before fitting */
+#define PRED_FULL_SECS (8 * 60 * 60)  /* on mains this long = full */
+
+static void predict_load(UPSINFO *ups)
+{
+   PREDICT *p = &ups->predict;
+   char magic[16];
+   int version;
+   FILE *fp;
+
+   if (ups->predfile[0] == 0 || (fp = fopen(ups->predfile, "re")) == NULL)
+      return;
+
+   if (fscanf(fp, "%15s %d", magic, &version) != 2 ||
+       strcmp(magic, PRED_MAGIC) != 0 || version != PRED_VERSION ||
+       fscanf(fp, " fit %lf %lf %lf %lf %lf", &p->n, &p->sx, &p->sy,
+          &p->sxx, &p->sxy) != 5 ||
+       fscanf(fp, " lowbatt %lf %lf", &p->nlow, &p->lowbatt_min) != 2) {
+      log_event(ups, LOG_WARNING, "Ignoring runtime model %s: bad format",
+         ups->predfile);
+      p->n = p->sx = p->sy = p->sxx = p->sxy = 0;
+      p->nlow = p->lowbatt_min = 0;
+   }
+   fclose(fp);
+}
+
+/*
+ * Save a copy of the model made by predict_update(). Called without the
+ * UPS lock, from the thread that runs do_action(). Written to a new file
+ * first so a crash cannot leave half a model.
+ */
+void predict_save(UPSINFO *ups, const PREDICT *p)
+{
+   char tmp[APC_FILENAME_MAX + 8];
+   FILE *fp;
+   bool ok;
+
+   if (ups->predfile[0] == 0)
+      return;
+
+   asnprintf(tmp, sizeof(tmp), "%s.new", ups->predfile);
+   if ((fp = fopen(tmp, "we")) == NULL) {
+      log_event(ups, LOG_WARNING, "Cannot write runtime model %s: %s",
+         tmp, strerror(errno));
+      return;
+   }
+
+   fprintf(fp, "%s %d\n", PRED_MAGIC, PRED_VERSION);
+   fprintf(fp, "fit %.17g %.17g %.17g %.17g %.17g\n", p->n, p->sx, p->sy,
+      p->sxx, p->sxy);
+   fprintf(fp, "lowbatt %.17g %.17g\n", p->nlow, p->lowbatt_min);
+   ok = !ferror(fp);
+   if (fclose(fp) != 0)
+      ok = false;
+
+   if (!ok || rename(tmp, ups->predfile) != 0) {
+      log_event(ups, LOG_WARNING, "Cannot write runtime model %s: %s",
+         ups->predfile, strerror(errno));
+      unlink(tmp);
+   }
+}
+
+static void add_point(PREDICT *p, double load, double rate)
+{
+   Dmsg(100, "Drain %.2f %%/min at %.1f%% load\n", rate, load);
+   p->n = p->n * PRED_DECAY + 1;
+   p->sx = p->sx * PRED_DECAY + load;
+   p->sy = p->sy * PRED_DECAY + rate;
+   p->sxx = p->sxx * PRED_DECAY + load * load;
+   p->sxy = p->sxy * PRED_DECAY + load * rate;
+}
+
+/* Drain in percent per minute at the given load, or 0 if not known */
+static double drain_rate(const PREDICT *p, double load)
+{
+   double det, a, b, rate;
+
+   if (p->n < PRED_MINPOINTS)
+      return 0;
+
+   /* The mean alone if the loads seen so far are too alike to fit */
+   rate = p->sy / p->n;
+   det = p->n * p->sxx - p->sx * p->sx;
+   if (det > p->n * p->n) {
+      b = (p->n * p->sxy - p->sx * p->sy) / det;
+      a = (p->sy - b * p->sx) / p->n;
+      if (a + b * load > 0)
+         rate = a + b * load;
+   }
+
+   return rate > 0 ? rate : 0;
+}
+
+/*
+ * Called with the UPS write lock held on every pass of do_action().
+ * Updates ups->predict.runtime, which is negative while nothing has
+ * been learned yet. Returns true with a copy of the model in save when
+ * it should be saved, which the caller does once it has let go of the
+ * lock.
+ */
+bool predict_update(UPSINFO *ups, PREDICT *save)
+{
+   PREDICT *p = &ups->predict;
+   bool has_charge = ups->UPS_Cap[CI_BATTLEV];
+   bool has_load = ups->UPS_Cap[CI_LOAD];
+   double load = has_load ? ups->UPSLoad : 0;
+   double rate, mins;
+   time_t now = time(NULL);
+   long long msec = mono_msec();
+   bool saving = false;
+
+   if (!p->started) {
+      p->started = true;
+      p->mains_since = now;
+      predict_load(ups);
+   }
+
+   if (ups->is_onbatt() && !p->active) {
+      /* Outage begins */
+      p->active = true;
+      p->full = now - p->mains_since >= PRED_FULL_SECS;
+      p->start = p->anchor_t = p->last_t = msec;
+      p->anchor_chg = ups->BattChg;
+      p->load_ms = 0;
+   } else if (!ups->is_onbatt() && p->active) {
+      /* Outage over: a dumb UPS only teaches us anything now */
+      p->active = false;
+      p->mains_since = now;
+      if (!has_charge && p->full && p->lowbatt_at) {
+         mins = (p->lowbatt_at - p->start) / 60000.0;
+         p->nlow = p->nlow * PRED_DECAY + 1;
+         p->lowbatt_min = p->lowbatt_min * PRED_DECAY + mins;
+         p->dirty = true;
+      }
+      p->lowbatt_at = 0;
+      if (p->dirty) {
+         *save = *p;
+         saving = true;
+         p->dirty = false;
+      }
+   }
+
+   if (p->active) {
+      p->load_ms += load * (msec - p->last_t);
+      p->last_t = msec;
+
+      if (ups->is_battlow() && !p->lowbatt_at)
+         p->lowbatt_at = msec;
+
+      /* A data point each time the charge has dropped a whole percent */
+      if (has_charge && p->anchor_chg - ups->BattChg >= 1.0 &&
+          msec > p->anchor_t) {
+         add_point(p, p->load_ms / (msec - p->anchor_t),
+            (p->anchor_chg - ups->BattChg) * 60000.0 / (msec - p->anchor_t));
+         p->anchor_t = msec;
+         p->anchor_chg = ups->BattChg;
+         p->load_ms = 0;
+         p->dirty = true;
+      } else if (has_charge && ups->BattChg > p->anchor_chg) {
+         /* Charge reading went up; start the stretch again from here */
+         p->anchor_t = msec;
+         p->anchor_chg = ups->BattChg;
+         p->load_ms = 0;
+      }
+   }
+
+   /* Runtime if the power failed now, or what is left of this outage */
+   if (has_charge) {
+      rate = drain_rate(p, load);
+      p->runtime = rate > 0 ? ups->BattChg / rate : -1;
+   } else if (p->nlow >= 1) {
+      mins = p->lowbatt_min / p->nlow;
+      if (p->active)
+         mins -= (msec - p->start) / 60000.0;
+      p->runtime = mins > 0 ? mins : 0;
+   } else {
+      p->runtime = -1;
+   }
+
+   return saving;
+}
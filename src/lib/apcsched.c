@@ -0,0 +1,202 @@
+/*
+ * apcsched.c
+ *
+ * Poll scheduler. The volatile CIs of a UPS are split into refresh
+ * groups, each with its own period, and a small timer heap on the
+ * monotonic clock decides which groups a poll of the UPS refreshes.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#include "apc.h"
+
+static const char *group_name[POLL_NGROUPS] = {
+   "status", "electrical", "environment"
+};
+
+/* Milliseconds on a clock that is not affected by setting the time */
+long long mono_msec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* The same clock in nanoseconds, for timing the daemon itself */
+long long mono_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Refresh group of a CI. Anything not listed is treated as status,
+ * so CIs that feed the status word are never polled less often than
+ * they used to be.
+ */
+static int ci_group(int ci)
+{
+   switch (ci) {
+   case CI_VLINE:
+   case CI_VMAX:
+   case CI_VMIN:
+   case CI_VOUT:
+   case CI_VBATT:
+   case CI_LOAD:
+   case CI_FREQ:
+   case CI_OutputCurrent:
+   case CI_LoadApparent:
+      return POLL_ELECTRICAL;
+
+   case CI_ITEMP:
+   case CI_ATEMP:
+   case CI_HUMID:
+   case CI_DIPSW:
+   case CI_ST_TIME:
+   case CI_BATTDAT:
+   case CI_BattReplaceDate:
+   case CI_CycleCount:
+      return POLL_ENVIRON;
+
+   default:
+      return POLL_STATUS;
+   }
+}
+
+/*
+ * Period of a group in msec. On mains the slower groups are polled
+ * less often than POLLTIME; during an outage every group tightens.
+ * So it does while COMMLOST, where the driver's LinkHealth decides
+ * how often it actually tries to reach the UPS.
+ */
+static long long group_period(UPSINFO *ups, int group, bool tight)
+{
+   int secs;
+
+   switch (group) {
+   case POLL_STATUS:
+      secs = tight ? TIMER_FAST : ups->polltime;
+      break;
+   case POLL_ELECTRICAL:
+      secs = tight ? TIMER_FAST * 5 : ups->polltime * 2;
+      break;
+   default:
+      secs = tight ? ups->polltime : ups->polltime * 10;
+      break;
+   }
+
+   if (secs < TIMER_FAST)
+      secs = TIMER_FAST;
+   return (long long)secs * 1000;
+}
+
+static void sift_down(POLLSCHED *s, int i)
+{
+   POLLTIMER t = s->heap[i];
+   int child;
+
+   while ((child = 2 * i + 1) < s->nheap) {
+      if (child + 1 < s->nheap && s->heap[child + 1].due < s->heap[child].due)
+         child++;
+      if (s->heap[child].due >= t.due)
+         break;
+      s->heap[i] = s->heap[child];
+      i = child;
+   }
+   s->heap[i] = t;
+}
+
+static void sched_init(UPSINFO *ups, long long now)
+{
+   POLLSCHED *s = &ups->pollsched;
+
+   /* Everything is due on the first pass */
+   for (s->nheap = 0; s->nheap < POLL_NGROUPS; s->nheap++) {
+      s->heap[s->nheap].group = s->nheap;
+      s->heap[s->nheap].due = now;
+   }
+   s->tight = false;
+}
+
+/*
+ * Decide which groups the coming poll refreshes. Returns false if
+ * none is due, in which case the poll can be skipped entirely.
+ */
+bool poll_sched_begin(UPSINFO *ups)
+{
+   POLLSCHED *s = &ups->pollsched;
+   long long now = mono_msec(), due;
+   bool tight = ups->is_onbatt() || ups->is_fastpoll() || ups->is_commlost();
+   int i;
+
+   if (s->nheap == 0)
+      sched_init(ups, now);
+
+   /* Pull in deadlines that lie beyond the tighter outage periods */
+   if (tight != s->tight) {
+      s->tight = tight;
+      for (i = 0; i < s->nheap; i++) {
+         due = now + group_period(ups, s->heap[i].group, tight);
+         if (tight && s->heap[i].due > due)
+            s->heap[i].due = due;
+      }
+      for (i = s->nheap / 2 - 1; i >= 0; i--)
+         sift_down(s, i);
+   }
+
+   s->skip = (1 << POLL_NGROUPS) - 1;
+   while (s->heap[0].due <= now) {
+      i = s->heap[0].group;
+      s->skip &= ~(1 << i);
+      Dmsg(100, "Poll %s group\n", group_name[i]);
+
+      s->heap[0].due = now + group_period(ups, i, tight);
+      sift_down(s, 0);
+   }
+
+   return s->skip != (1 << POLL_NGROUPS) - 1;
+}
+
+/* Done with the scheduled poll; other callers see every group due */
+void poll_sched_end(UPSINFO *ups)
+{
+   ups->pollsched.skip = 0;
+}
+
+/* True if the UPS has the CI and the current poll should refresh it */
+bool poll_ci_due(UPSINFO *ups, int ci)
+{
+   return ups->UPS_Cap[ci] && !(ups->pollsched.skip & (1 << ci_group(ci)));
+}
+
+/* Seconds until the next group falls due, rounded up */
+int poll_sched_wait(UPSINFO *ups)
+{
+   POLLSCHED *s = &ups->pollsched;
+   long long left;
+
+   if (s->nheap == 0)
+      return 0;
+
+   left = s->heap[0].due - mono_msec();
+   return left <= 0 ? 0 : (int)((left + 999) / 1000);
+}
@@ -0,0 +1,398 @@
+/*
+ * apcshm.c
+ *
+ * Shared memory status segment: publishing from apcupsd and reading
+ * it from local clients. See apcshm.h for the layout.
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+/*
+ * The segment is guarded by a sequence lock. apcupsd makes seq odd,
+ * copies in the new data and makes seq even again; a reader copies
+ * the data out and keeps the copy only if seq was the same even
+ * value before and after. Readers never block apcupsd, and apcupsd
+ * is the only writer.
+ */
+
+#include "apc.h"
+#include "apcshm.h"
+
+#ifndef HAVE_MINGW
+# include <sys/mman.h>
+#endif
+
+/* UPS_Cap[] must fit */
+typedef char shm_caps_fit[CI_MAXCI < APCSHM_NCAPS ? 1 : -1];
+
+/* Give up on a segment that never settles, e.g. a dead writer */
+#define SHM_READ_TRIES 1000
+
+#define COPYSTR(d, s) strlcpy((d), (s), sizeof(d))
+
+static void fill_data(UPSINFO *ups, APCSHMDATA *d)
+{
+   memset(d, 0, sizeof(*d));
+
+   read_lock(ups);
+
+   d->poll_time = ups->poll_time;
+   d->start_time = ups->start_time;
+   d->last_master_connect_time = ups->last_master_connect_time;
+   d->last_onbatt_time = ups->last_onbatt_time;
+   d->last_offbatt_time = ups->last_offbatt_time;
+   d->LastSelfTest = ups->LastSelfTest;
+
+   d->Status = ups->Status;
+   d->sharenet = ups->sharenet.type;
+   d->num_xfers = ups->num_xfers;
+   d->cum_time_on_batt = ups->cum_time_on_batt;
+   d->percent = ups->percent;
+   d->runtime = ups->runtime;
+   d->maxtime = ups->maxtime;
+   d->dwake = ups->dwake;
+   d->dshutd = ups->dshutd;
+   d->dlowbatt = ups->dlowbatt;
+   d->lotrans = ups->lotrans;
+   d->hitrans = ups->hitrans;
+   d->rtnpct = ups->rtnpct;
+   d->lastxfer = ups->lastxfer;
+   d->testresult = ups->testresult;
+   d->dipsw = ups->dipsw;
+   d->reg1 = ups->reg1;
+   d->reg2 = ups->reg2;
+   d->reg3 = ups->reg3;
+   d->NomOutputVoltage = ups->NomOutputVoltage;
+   d->NomInputVoltage = ups->NomInputVoltage;
+   d->NomPower = ups->NomPower;
+   d->NomApparentPower = ups->NomApparentPower;
+   d->extbatts = ups->extbatts;
+   d->badbatts = ups->badbatts;
+
+   d->LineVoltage = ups->LineVoltage;
+   d->UPSLoad = ups->UPSLoad;
+   d->LoadApparent = ups->LoadApparent;
+   d->BattChg = ups->BattChg;
+   d->TimeLeft = ups->TimeLeft;
+   d->PredRuntime = ups->predict.runtime;
+   d->LineMax = ups->LineMax;
+   d->LineMin = ups->LineMin;
+   d->OutputVoltage = ups->OutputVoltage;
+   d->UPSTemp = ups->UPSTemp;
+   d->BattVoltage = ups->BattVoltage;
+   d->LineFreq = ups->LineFreq;
+   d->OutputCurrent = ups->OutputCurrent;
+   d->nombattv = ups->nombattv;
+   d->humidity = ups->humidity;
+   d->ambtemp = ups->ambtemp;
+
+   memcpy(d->cap, ups->UPS_Cap, sizeof(ups->UPS_Cap));
+
+   COPYSTR(d->upsname, ups->upsname);
+   COPYSTR(d->upsmodel, ups->upsmodel);
+   COPYSTR(d->cable, ups->cable.long_name);
+   COPYSTR(d->driver, ups->mode.long_name);
+   COPYSTR(d->upsclass, ups->upsclass.long_name);
+   COPYSTR(d->share, ups->sharenet.long_name);
+   COPYSTR(d->master_name, ups->master_name);
+   COPYSTR(d->sensitivity, ups->sensitivity);
+   COPYSTR(d->beepstate, ups->beepstate);
+   COPYSTR(d->selftest, ups->selftest);
+   COPYSTR(d->birth, ups->birth);
+   COPYSTR(d->serial, ups->serial);
+   COPYSTR(d->battdat, ups->battdat);
+   COPYSTR(d->firmrev, ups->firmrev);
+
+   read_unlock(ups);
+}
+
+/*
+ * The reverse of fill_data(), into a UPSINFO that only serves to
+ * format the status with output_status().
+ */
+void shm_to_ups(const APCSHMDATA *d, UPSINFO *ups)
+{
+   ups->poll_time = d->poll_time;
+   ups->start_time = d->start_time;
+   ups->last_master_connect_time = d->last_master_connect_time;
+   ups->last_onbatt_time = d->last_onbatt_time;
+   ups->last_offbatt_time = d->last_offbatt_time;
+   ups->LastSelfTest = d->LastSelfTest;
+
+   ups->Status = d->Status;
+   ups->sharenet.type = d->sharenet;
+   ups->num_xfers = d->num_xfers;
+   ups->cum_time_on_batt = d->cum_time_on_batt;
+   ups->percent = d->percent;
+   ups->runtime = d->runtime;
+   ups->maxtime = d->maxtime;
+   ups->dwake = d->dwake;
+   ups->dshutd = d->dshutd;
+   ups->dlowbatt = d->dlowbatt;
+   ups->lotrans = d->lotrans;
+   ups->hitrans = d->hitrans;
+   ups->rtnpct = d->rtnpct;
+   ups->lastxfer = (LastXferCause)d->lastxfer;
+   ups->testresult = (SelfTestResult)d->testresult;
+   ups->dipsw = d->dipsw;
+   ups->reg1 = d->reg1;
+   ups->reg2 = d->reg2;
+   ups->reg3 = d->reg3;
+   ups->NomOutputVoltage = d->NomOutputVoltage;
+   ups->NomInputVoltage = d->NomInputVoltage;
+   ups->NomPower = d->NomPower;
+   ups->NomApparentPower = d->NomApparentPower;
+   ups->extbatts = d->extbatts;
+   ups->badbatts = d->badbatts;
+
+   ups->LineVoltage = d->LineVoltage;
+   ups->UPSLoad = d->UPSLoad;
+   ups->LoadApparent = d->LoadApparent;
+   ups->BattChg = d->BattChg;
+   ups->TimeLeft = d->TimeLeft;
+   ups->predict.runtime = d->PredRuntime;
+   ups->LineMax = d->LineMax;
+   ups->LineMin = d->LineMin;
+   ups->OutputVoltage = d->OutputVoltage;
+   ups->UPSTemp = d->UPSTemp;
+   ups->BattVoltage = d->BattVoltage;
+   ups->LineFreq = d->LineFreq;
+   ups->OutputCurrent = d->OutputCurrent;
+   ups->nombattv = d->nombattv;
+   ups->humidity = d->humidity;
+   ups->ambtemp = d->ambtemp;
+
+   memcpy(ups->UPS_Cap, d->cap, sizeof(ups->UPS_Cap));
+
+   COPYSTR(ups->upsname, d->upsname);
+   COPYSTR(ups->upsmodel, d->upsmodel);
+   COPYSTR(ups->cable.long_name, d->cable);
+   COPYSTR(ups->mode.long_name, d->driver);
+   COPYSTR(ups->upsclass.long_name, d->upsclass);
+   COPYSTR(ups->sharenet.long_name, d->share);
+   COPYSTR(ups->master_name, d->master_name);
+   COPYSTR(ups->sensitivity, d->sensitivity);
+   COPYSTR(ups->beepstate, d->beepstate);
+   COPYSTR(ups->selftest, d->selftest);
+   COPYSTR(ups->birth, d->birth);
+   COPYSTR(ups->serial, d->serial);
+   COPYSTR(ups->battdat, d->battdat);
+   COPYSTR(ups->firmrev, d->firmrev);
+}
+
+#ifndef HAVE_MINGW
+
+/*
+ * Create the segment named by STATUSSHM. Whatever was left under the
+ * name is unlinked first and the segment is created afresh, so a
+ * segment planted by someone else is never mapped. Returns 0 if all
+ * is well.
+ */
+static int shm_create(UPSINFO *ups)
+{
+   APCSHM *shm;
+   struct stat st;
+   int fd;
+
+   shm_unlink(ups->shmname);
+   if ((fd = shm_open(ups->shmname, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644)) == -1) {
+      log_event(ups, LOG_ERR, "Cannot create shared memory %s: %s",
+         ups->shmname, strerror(errno));
+      return -1;
+   }
+
+   if (fstat(fd, &st) == -1 || st.st_uid != geteuid()) {
+      log_event(ups, LOG_ERR, "Shared memory %s is not owned by us",
+         ups->shmname);
+      close(fd);
+      return -1;
+   }
+
+   if (ftruncate(fd, sizeof(APCSHM)) == -1) {
+      log_event(ups, LOG_ERR, "Cannot size shared memory %s: %s",
+         ups->shmname, strerror(errno));
+      close(fd);
+      shm_unlink(ups->shmname);
+      return -1;
+   }
+
+   shm = (APCSHM *)mmap(NULL, sizeof(APCSHM), PROT_READ|PROT_WRITE,
+      MAP_SHARED, fd, 0);
+   close(fd);
+   if (shm == MAP_FAILED) {
+      log_event(ups, LOG_ERR, "Cannot map shared memory %s: %s",
+         ups->shmname, strerror(errno));
+      shm_unlink(ups->shmname);
+      return -1;
+   }
+
+   /* Readers ignore the segment until magic and version are right */
+   __atomic_store_n(&shm->magic, 0, __ATOMIC_RELAXED);
+   memset((char *)shm + sizeof(shm->magic), 0,
+      sizeof(APCSHM) - sizeof(shm->magic));
+   shm->version = APCSHM_VERSION;
+   shm->size = sizeof(APCSHM);
+   shm->pid = getpid();
+   __atomic_store_n(&shm->magic, APCSHM_MAGIC, __ATOMIC_RELEASE);
+
+   ups->shm = shm;
+   return 0;
+}
+
+/*
+ * Copy the current status into the segment, creating it first if
+ * need be. Called by do_reports() on every pass. The segment is only
+ * recreated when a reload changes STATUSSHM.
+ */
+void shm_publish(UPSINFO *ups)
+{
+   APCSHMDATA data;
+   APCSHM *shm;
+   uint32_t seq;
+
+   if (strcmp(ups->shmopen, ups->shmname) != 0) {
+      shm_close(ups);
+      strlcpy(ups->shmopen, ups->shmname, sizeof(ups->shmopen));
+      if (ups->shmopen[0] != 0)
+         shm_create(ups);          /* logged once, not retried */
+   }
+   if (ups->shm == NULL)
+      return;
+
+   fill_data(ups, &data);
+
+   shm = ups->shm;
+   seq = shm->seq;
+   __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   memcpy(&shm->data, &data, sizeof(data));
+   __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Remove the segment under the name it was created with; readers
+ * still attached keep the last status
+ */
+void shm_close(UPSINFO *ups)
+{
+   if (ups->shm) {
+      munmap(ups->shm, sizeof(APCSHM));
+      shm_unlink(ups->shmopen);
+      ups->shm = NULL;
+   }
+   ups->shmopen[0] = 0;
+}
+
+/*
+ * Map a status segment for reading. Returns NULL with errno set if it
+ * does not exist or is not one we understand (EPROTO).
+ */
+const APCSHM *shm_attach(const char *name)
+{
+   const APCSHM *shm;
+   struct stat st;
+   int fd;
+
+   if ((fd = shm_open(name, O_RDONLY|O_CLOEXEC, 0)) == -1)
+      return NULL;
+
+   if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(APCSHM)) {
+      close(fd);
+      errno = EPROTO;
+      return NULL;
+   }
+
+   shm = (const APCSHM *)mmap(NULL, sizeof(APCSHM), PROT_READ, MAP_SHARED,
+      fd, 0);
+   close(fd);
+   if (shm == MAP_FAILED)
+      return NULL;
+
+   if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != APCSHM_MAGIC ||
+       shm->version != APCSHM_VERSION || shm->size < sizeof(APCSHM)) {
+      shm_detach(shm);
+      errno = EPROTO;
+      return NULL;
+   }
+
+   return shm;
+}
+
+/*
+ * Copy out a consistent snapshot. Returns false if none could be had,
+ * which only happens if apcupsd died in the middle of an update.
+ */
+bool shm_snapshot(const APCSHM *shm, APCSHMDATA *out)
+{
+   uint32_t before, after;
+   int i;
+
+   for (i = 0; i < SHM_READ_TRIES; i++) {
+      before = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+      if (before & 1)
+         continue;
+
+      memcpy(out, (const void *)&shm->data, sizeof(*out));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      after = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+      if (before == after)
+         return true;
+   }
+
+   return false;
+}
+
+void shm_detach(const APCSHM *shm)
+{
+   munmap((void *)shm, sizeof(APCSHM));
+}
+
+#else   /* HAVE_MINGW */
+
+void shm_publish(UPSINFO *ups)
+{
+   if (strcmp(ups->shmopen, ups->shmname) != 0) {
+      strlcpy(ups->shmopen, ups->shmname, sizeof(ups->shmopen));
+      if (ups->shmopen[0] != 0)
+         log_event(ups, LOG_WARNING, "STATUSSHM is not supported on this platform");
+   }
+}
+
+void shm_close(UPSINFO *ups)
+{
+   ups->shmopen[0] = 0;
+}
+
+const APCSHM *shm_attach(const char *name)
+{
+   errno = ENOSYS;
+   return NULL;
+}
+
+bool shm_snapshot(const APCSHM *shm, APCSHMDATA *out)
+{
+   return false;
+}
+
+void shm_detach(const APCSHM *shm)
+{
+}
+
+#endif   /* HAVE_MINGW */
@@ -26,6 +26,8 @@
 #include "apc.h"
 
 #ifndef HAVE_MINGW
+static void (*reload_handler) (int) = NULL;
+
 static void *terminate(void *arg)
 {
    // Create signal set containing SIGHUP, SIGINT, and SIGTERM
@@ -35,11 +37,17 @@ static void *terminate(void *arg)
    sigaddset(&sigset, SIGINT);
    sigaddset(&sigset, SIGTERM);
 
-   // Wait for signal delivery
+   // Wait for signal delivery. SIGHUP asks for a reload if the
+   // caller handles that; everything else terminates.
    int signum, err;
    do
    {
       err = sigwait(&sigset, &signum);
+      if (err == 0 && signum == SIGHUP && reload_handler)
+      {
+         reload_handler(signum);
+         err = EINTR;
+      }
    }
    while(err == EINTR);
 
@@ -50,14 +58,16 @@ static void *terminate(void *arg)
 }
 #endif
 
-void init_signals(void (*handler) (int))
+void init_signals(void (*handler) (int), void (*reload) (int))
 {
 #ifndef HAVE_MINGW
+   reload_handler = reload;
+
    // Block SIGPIPE and termination signals
    sigset_t sigset;
    sigemptyset(&sigset);
    sigaddset(&sigset, SIGPIPE); // Don't care
-   sigaddset(&sigset, SIGHUP);  // Will be handled by terminate thread
+   sigaddset(&sigset, SIGHUP);  // Will be handled by terminate thread (reload)
    sigaddset(&sigset, SIGINT);  // Will be handled by terminate thread
    sigaddset(&sigset, SIGTERM); // Will be handled by terminate thread
    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
@@ -0,0 +1,725 @@
+/*
+ * apcsmtp.c
+ *
+ * A simple SMTP mail client for apcupsd.
+ *
+ * The client is a small state machine over a non-blocking socket. All
+ * I/O goes through buffers and every wait is bounded, so a dead or slow
+ * mail server costs at most SMTP_MAXTIME. If the server offers ESMTP
+ * PIPELINING the envelope of each message is sent in one go, and any
+ * number of messages can be delivered over a single connection.
+ *
+ * Derived from a SMTPclient:
+ *
+ *     SMTPclient -- simple SMTP client
+ *     Copyright (C) 1997 Ralf S. Engelschall, All Rights Reserved.
+ *     rse@engelschall.com
+ *     www.engelschall.com
+ */
+
+/*
+ * Copyright (C) 2000-2004 Kern Sibbald and John Walker
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#include "apc.h"
+#include "apcsmtp.h"
+#include <pwd.h>
+
+#define SMTP_CONNECT_TIMEOUT 10    /* seconds to wait for the connection */
+#define SMTP_TIMEOUT   30          /* seconds to wait for a server reply */
+#define SMTP_MAXTIME   120         /* seconds for a whole session */
+#define SMTP_MAXPEND   64          /* replies outstanding at once */
+#define SMTP_MAXRCPT   (SMTP_MAXPEND - 2)
+
+/* Session states */
+enum {
+   SS_CONNECT,                     /* waiting for connect to complete */
+   SS_TALK,                        /* exchanging commands and replies */
+   SS_DONE,                        /* QUIT acknowledged */
+   SS_FAILED                       /* connection is unusable */
+};
+
+/* What a pending reply is the answer to */
+enum {
+   R_GREETING,
+   R_EHLO,
+   R_HELO,
+   R_MAIL,
+   R_RCPT,
+   R_DATA,
+   R_BODY,
+   R_RSET,
+   R_QUIT
+};
+
+/* Growable byte buffer */
+typedef struct {
+   char *data;
+   int len;
+   int size;
+} SMTPBUF;
+
+/* A queued message, fully formatted and ready to go */
+typedef struct smtpqmsg {
+   struct smtpqmsg *next;
+   char from[MAXSTRING];
+   char **rcpt;
+   int nrcpt;
+   SMTPBUF text;                   /* headers, dot-stuffed body, final "." */
+} SMTPQMSG;
+
+typedef struct {
+   sock_t s;
+   int state;
+   char mailhost[MAXSTRING];
+   char my_hostname[MAXSTRING];
+   bool pipelining;
+
+   long long idle_deadline;        /* msec, pushed forward on progress */
+   long long deadline;             /* msec, whole session */
+
+   char rbuf[4096];                /* unparsed input */
+   int rlen;
+   SMTPBUF wbuf;                   /* output not yet written */
+   int woff;
+
+   int expect[SMTP_MAXPEND];       /* FIFO of pending replies */
+   int ehead, nexpect;
+   bool ehlo_done;                 /* collecting EHLO keywords */
+
+   SMTPQMSG *msgs, *cur;
+   int rcpt_sent, rcpt_ok;
+   bool msg_failed;
+
+   int nsent;
+   char *errmsg;
+   int errlen;
+} SMTPSESS;
+
+static long long now_msec(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void buf_append(SMTPBUF *b, const char *data, int len)
+{
+   if (b->len + len + 1 > b->size) {
+      b->size = (b->len + len + 1) * 2;
+      b->data = (char *)realloc(b->data, b->size);
+   }
+   memcpy(b->data + b->len, data, len);
+   b->len += len;
+   b->data[b->len] = 0;
+}
+
+static void buf_printf(SMTPBUF *b, const char *fmt, ...)
+{
+   char temp[MAXSTRING];
+   va_list ap;
+   int len;
+
+   va_start(ap, fmt);
+   len = avsnprintf(temp, sizeof(temp), fmt, ap);
+   va_end(ap);
+
+   if (len >= (int)sizeof(temp))
+      len = sizeof(temp) - 1;
+   buf_append(b, temp, len);
+}
+
+/* Record the first error of the session; later ones are only logged */
+static void sess_error(SMTPSESS *c, const char *fmt, ...)
+{
+   char temp[MAXSTRING];
+   va_list ap;
+
+   va_start(ap, fmt);
+   avsnprintf(temp, sizeof(temp), fmt, ap);
+   va_end(ap);
+
+   Dmsg(20, "SMTP: %s\n", temp);
+   if (c->errmsg[0] == 0)
+      strlcpy(c->errmsg, temp, c->errlen);
+}
+
+static void sess_fail(SMTPSESS *c, const char *fmt, ...)
+{
+   char temp[MAXSTRING];
+   va_list ap;
+
+   va_start(ap, fmt);
+   avsnprintf(temp, sizeof(temp), fmt, ap);
+   va_end(ap);
+
+   sess_error(c, "%s", temp);
+   c->state = SS_FAILED;
+}
+
+/* Queue a command and note which reply it will produce */
+static void command(SMTPSESS *c, int reply, const char *fmt, ...)
+{
+   char temp[MAXSTRING];
+   va_list ap;
+   int len;
+
+   va_start(ap, fmt);
+   len = avsnprintf(temp, sizeof(temp), fmt, ap);
+   va_end(ap);
+
+   if (len >= (int)sizeof(temp))
+      len = sizeof(temp) - 1;
+
+   Dmsg(10, "%s --> %s", c->my_hostname, temp);
+   buf_append(&c->wbuf, temp, len);
+
+   c->expect[(c->ehead + c->nexpect) % SMTP_MAXPEND] = reply;
+   c->nexpect++;
+}
+
+/* Find our own host name for HELO, fully qualified if possible */
+static void get_my_hostname(char *name, int len)
+{
+   struct hostent he, *hp;
+   char *tmphstbuf = NULL;
+   size_t hstbuflen = 0;
+
+   if (gethostname(name, len - 1) == -1) {
+      strlcpy(name, "localhost", len);
+      return;
+   }
+   name[len - 1] = 0;
+
+   hp = gethostname_re(name, &he, &tmphstbuf, &hstbuflen);
+   if (hp)
+      strlcpy(name, hp->h_name, len);
+   free(tmphstbuf);
+
+   Dmsg(20, "My hostname is: %s\n", name);
+}
+
+/* Default sender address: user@host */
+static void get_my_address(const char *host, char *addr, int len)
+{
+   struct passwd *pwd;
+
+   if ((pwd = getpwuid(getuid())) == 0)
+      asnprintf(addr, len, "userid-%d@%s", (int)getuid(), host);
+   else
+      asnprintf(addr, len, "%s@%s", pwd->pw_name, host);
+}
+
+static void format_date(char *buf, int len)
+{
+   time_t now = time(NULL);
+   struct tm tm;
+
+   /* RFC822 date */
+   localtime_r(&now, &tm);
+
+#ifdef HAVE_MINGW
+   // Annoyingly, Windows does not properly implement %z (it always spells
+   // out the timezone name) so we need to emulate it manually.
+   int i = strftime(buf, len, "%a, %d %b %Y %H:%M:%S ", &tm);
+   tzset();
+   unsigned int offset = abs(_timezone) / 60;
+   snprintf(buf+i, len-i, "%c%02u%02u",
+      _timezone < 0 ? '+' : '-', // _timezone is UTC-local
+      offset/60, offset%60);
+#else
+   strftime(buf, len, "%a, %d %b %Y %H:%M:%S %z", &tm);
+#endif
+}
+
+/*
+ * Format a message for the DATA phase: headers, then the body with
+ * any line starting with '.' dot-stuffed, then the terminating ".".
+ */
+static SMTPQMSG *format_message(SMTPSESS *c, const SMTPMSG *msg)
+{
+   SMTPQMSG *m = (SMTPQMSG *)calloc(1, sizeof(SMTPQMSG));
+   char sender[MAXSTRING], date[MAXSTRING];
+   const char *body, *eol;
+   int i, len;
+
+   get_my_address(c->my_hostname, sender, sizeof(sender));
+   if (msg->from && *msg->from)
+      strlcpy(m->from, msg->from, sizeof(m->from));
+   else
+      strlcpy(m->from, sender, sizeof(m->from));
+
+   m->rcpt = (char **)calloc(msg->nto + 1, sizeof(char *));
+   for (i = 0; i < msg->nto && m->nrcpt < SMTP_MAXRCPT; i++)
+      m->rcpt[m->nrcpt++] = strdup(msg->to[i]);
+   if (msg->cc && m->nrcpt < SMTP_MAXRCPT)
+      m->rcpt[m->nrcpt++] = strdup(msg->cc);
+
+   buf_printf(&m->text, "From: %s\r\n", m->from);
+   if (msg->subject)
+      buf_printf(&m->text, "Subject: %s\r\n", msg->subject);
+   if (msg->reply_to)
+      buf_printf(&m->text, "Reply-To: %s\r\n", msg->reply_to);
+   if (msg->errors_to)
+      buf_printf(&m->text, "Errors-To: %s\r\n", msg->errors_to);
+   buf_printf(&m->text, "Sender: %s\r\n", sender);
+
+   if (msg->nto > 0) {
+      buf_printf(&m->text, "To: %s", msg->to[0]);
+      for (i = 1; i < msg->nto; i++)
+         buf_printf(&m->text, ",%s", msg->to[i]);
+      buf_printf(&m->text, "\r\n");
+   }
+   if (msg->cc)
+      buf_printf(&m->text, "Cc: %s\r\n", msg->cc);
+
+   format_date(date, sizeof(date));
+   buf_printf(&m->text, "Date: %s\r\n\r\n", date);
+
+   for (body = msg->body; body && *body; ) {
+      eol = strchr(body, '\n');
+      len = eol ? eol - body : strlen(body);
+      if (len && body[len - 1] == '\r')
+         len--;
+
+      if (*body == '.')
+         buf_append(&m->text, ".", 1);
+      buf_append(&m->text, body, len);
+      buf_append(&m->text, "\r\n", 2);
+
+      body = eol ? eol + 1 : body + strlen(body);
+   }
+   buf_append(&m->text, ".\r\n", 3);
+
+   return m;
+}
+
+static void free_messages(SMTPQMSG *m)
+{
+   SMTPQMSG *next;
+   int i;
+
+   for ( ; m; m = next) {
+      next = m->next;
+      for (i = 0; i < m->nrcpt; i++)
+         free(m->rcpt[i]);
+      free(m->rcpt);
+      free(m->text.data);
+      free(m);
+   }
+}
+
+/*
+ * Begin the next queued message, or say goodbye if there are none.
+ * With PIPELINING the envelope and DATA go out in one write.
+ */
+static void start_message(SMTPSESS *c, SMTPQMSG *m)
+{
+   int i;
+
+   c->cur = m;
+   c->rcpt_sent = c->rcpt_ok = 0;
+   c->msg_failed = false;
+
+   if (m == NULL) {
+      command(c, R_QUIT, "QUIT\r\n");
+      return;
+   }
+
+   command(c, R_MAIL, "MAIL FROM:<%s>\r\n", m->from);
+   if (c->pipelining) {
+      for (i = 0; i < m->nrcpt; i++)
+         command(c, R_RCPT, "RCPT TO:<%s>\r\n", m->rcpt[i]);
+      c->rcpt_sent = m->nrcpt;
+      command(c, R_DATA, "DATA\r\n");
+   }
+}
+
+/* Give up on the current message and move to the next one */
+static void abandon_message(SMTPSESS *c, const char *why)
+{
+   sess_error(c, "Message %d rejected by %s: %s",
+      c->nsent + 1, c->mailhost, why);
+   c->msg_failed = true;
+}
+
+/* Send the next envelope command when not pipelining */
+static void next_envelope(SMTPSESS *c)
+{
+   if (c->rcpt_sent < c->cur->nrcpt)
+      command(c, R_RCPT, "RCPT TO:<%s>\r\n", c->cur->rcpt[c->rcpt_sent++]);
+   else
+      command(c, R_DATA, "DATA\r\n");
+}
+
+/* Act on one complete (possibly multi-line) server reply */
+static void handle_reply(SMTPSESS *c, int code, const char *text)
+{
+   int what;
+
+   if (c->nexpect == 0) {
+      sess_fail(c, "Unexpected reply from %s: %d %s", c->mailhost, code, text);
+      return;
+   }
+   what = c->expect[c->ehead];
+   c->ehead = (c->ehead + 1) % SMTP_MAXPEND;
+   c->nexpect--;
+
+   switch (what) {
+   case R_GREETING:
+      if (code / 100 != 2) {
+         sess_fail(c, "Server %s refused connection: %d %s",
+            c->mailhost, code, text);
+         break;
+      }
+      command(c, R_EHLO, "EHLO %s\r\n", c->my_hostname);
+      break;
+
+   case R_EHLO:
+      c->ehlo_done = false;
+      if (code / 100 == 2)
+         start_message(c, c->msgs);
+      else
+         command(c, R_HELO, "HELO %s\r\n", c->my_hostname);
+      break;
+
+   case R_HELO:
+      if (code / 100 != 2) {
+         sess_fail(c, "Server %s refused HELO: %d %s", c->mailhost, code, text);
+         break;
+      }
+      start_message(c, c->msgs);
+      break;
+
+   case R_MAIL:
+      if (code / 100 != 2)
+         abandon_message(c, text);
+      if (c->pipelining)
+         break;
+      if (c->msg_failed)
+         command(c, R_RSET, "RSET\r\n");
+      else
+         next_envelope(c);
+      break;
+
+   case R_RCPT:
+      if (code / 100 == 2)
+         c->rcpt_ok++;
+      else
+         sess_error(c, "Recipient refused by %s: %d %s", c->mailhost, code, text);
+      if (!c->pipelining && !c->msg_failed)
+         next_envelope(c);
+      break;
+
+   case R_DATA:
+      if (code == 354 && (c->msg_failed || c->rcpt_ok == 0)) {
+         /* Server accepted DATA anyway; end it without content */
+         if (!c->msg_failed)
+            abandon_message(c, "no valid recipients");
+         command(c, R_BODY, ".\r\n");
+      } else if (code == 354) {
+         Dmsg(10, "%s --> (%d bytes of message)\n", c->my_hostname,
+            c->cur->text.len);
+         buf_append(&c->wbuf, c->cur->text.data, c->cur->text.len);
+         c->expect[(c->ehead + c->nexpect) % SMTP_MAXPEND] = R_BODY;
+         c->nexpect++;
+      } else {
+         if (!c->msg_failed)
+            abandon_message(c, text);
+         command(c, R_RSET, "RSET\r\n");
+      }
+      break;
+
+   case R_BODY:
+      if (code / 100 == 2 && !c->msg_failed)
+         c->nsent++;
+      else if (!c->msg_failed)
+         abandon_message(c, text);
+      start_message(c, c->cur->next);
+      break;
+
+   case R_RSET:
+      start_message(c, c->cur->next);
+      break;
+
+   case R_QUIT:
+      c->state = SS_DONE;
+      break;
+   }
+}
+
+/* Split buffered input into lines and assemble them into replies */
+static void parse_input(SMTPSESS *c)
+{
+   char *line = c->rbuf, *eol;
+   int code;
+
+   while (c->state == SS_TALK &&
+          (eol = (char *)memchr(line, '\n', c->rlen - (line - c->rbuf)))) {
+      *eol = 0;
+      if (eol > line && eol[-1] == '\r')
+         eol[-1] = 0;
+      Dmsg(10, "%s --> %s\n", c->mailhost, line);
+
+      if (strlen(line) < 3 || !isdigit((int)line[0]) ||
+          !isdigit((int)line[1]) || !isdigit((int)line[2])) {
+         sess_fail(c, "Fatal malformed reply from %s: %s", c->mailhost, line);
+         break;
+      }
+      code = atoi(line);
+
+      /* Note extensions we care about as the EHLO reply goes by */
+      if (c->nexpect && c->expect[c->ehead] == R_EHLO && code == 250) {
+         if (c->ehlo_done && strncasecmp(line + 4, "PIPELINING", 10) == 0 &&
+             (line[14] == 0 || line[14] == ' '))
+            c->pipelining = true;
+         c->ehlo_done = true;      /* first line is the greeting */
+      }
+
+      if (line[3] != '-')
+         handle_reply(c, code, line[3] ? line + 4 : "");
+
+      line = eol + 1;
+   }
+
+   c->rlen -= line - c->rbuf;
+   memmove(c->rbuf, line, c->rlen);
+
+   if (c->rlen == sizeof(c->rbuf))
+      sess_fail(c, "Reply line too long from %s", c->mailhost);
+}
+
+/*
+ * Advance the session as far as possible without blocking.
+ * Returns 1 while there is more to do, 0 when finished and -1 on
+ * failure.
+ */
+static int smtp_step(SMTPSESS *c, bool readable, bool writable)
+{
+   int rc, err;
+   socklen_t errlen = sizeof(err);
+
+   if (c->state == SS_CONNECT) {
+      if (!writable)
+         return 1;
+      if (getsockopt(c->s, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen) == -1)
+         err = errno;
+      if (err) {
+         sess_fail(c, "Fatal connect error to %s: ERR=%s",
+            c->mailhost, strerror(err));
+         return -1;
+      }
+      Dmsg(20, "Connected\n");
+      c->state = SS_TALK;
+      c->idle_deadline = now_msec() + SMTP_TIMEOUT * 1000;
+      c->expect[0] = R_GREETING;
+      c->nexpect = 1;
+      return 1;
+   }
+
+   if (writable && c->woff < c->wbuf.len) {
+      rc = send(c->s, c->wbuf.data + c->woff, c->wbuf.len - c->woff, 0);
+      if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+         sess_fail(c, "Write to %s failed: ERR=%s", c->mailhost, strerror(errno));
+         return -1;
+      }
+      if (rc > 0) {
+         c->woff += rc;
+         if (c->woff == c->wbuf.len)
+            c->woff = c->wbuf.len = 0;
+         c->idle_deadline = now_msec() + SMTP_TIMEOUT * 1000;
+      }
+   }
+
+   if (readable) {
+      rc = recv(c->s, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen, 0);
+      if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                      errno != EINTR)) {
+         sess_fail(c, "No reply from %s", c->mailhost);
+         return -1;
+      }
+      if (rc > 0) {
+         c->rlen += rc;
+         c->idle_deadline = now_msec() + SMTP_TIMEOUT * 1000;
+         parse_input(c);
+      }
+   }
+
+   if (c->state == SS_FAILED)
+      return -1;
+   return c->state == SS_DONE ? 0 : 1;
+}
+
+/* Drive the session until it completes, fails or runs out of time */
+static int smtp_run(SMTPSESS *c)
+{
+   struct timeval tv;
+   fd_set rfds, wfds;
+   long long now, limit;
+   int rc = 1;
+
+   while (rc > 0) {
+      now = now_msec();
+      limit = c->idle_deadline < c->deadline ? c->idle_deadline : c->deadline;
+      if (now >= limit) {
+         sess_fail(c, "Timeout talking to %s", c->mailhost);
+         return -1;
+      }
+
+      FD_ZERO(&rfds);
+      FD_ZERO(&wfds);
+      if (c->state == SS_CONNECT || c->woff < c->wbuf.len)
+         FD_SET(c->s, &wfds);
+      if (c->state == SS_TALK)
+         FD_SET(c->s, &rfds);
+
+      tv.tv_sec = (limit - now) / 1000;
+      tv.tv_usec = ((limit - now) % 1000) * 1000;
+
+      rc = select(c->s + 1, &rfds, &wfds, NULL, &tv);
+      if (rc < 0) {
+         if (errno == EINTR)
+            rc = 1;
+         else
+            sess_fail(c, "select failed: ERR=%s", strerror(errno));
+         continue;
+      }
+      if (rc == 0) {
+         rc = 1;
+         continue;
+      }
+
+      rc = smtp_step(c, FD_ISSET(c->s, &rfds), FD_ISSET(c->s, &wfds));
+   }
+
+   return rc;
+}
+
+/* Resolve the server and start a non-blocking connect */
+static sock_t start_connect(const char *host, int port)
+{
+   struct sockaddr_in addr;
+   int nonblock = 1;
+   sock_t s;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+
+   if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+      struct hostent he, *hp;
+      char *tmphstbuf = NULL;
+      size_t hstbuflen = 0;
+
+      hp = gethostname_re(host, &he, &tmphstbuf, &hstbuflen);
+      if (!hp || hp->h_addrtype != AF_INET ||
+          hp->h_length != sizeof(addr.sin_addr)) {
+         free(tmphstbuf);
+         return -ENXIO;
+      }
+      memcpy(&addr.sin_addr, hp->h_addr, sizeof(addr.sin_addr));
+      free(tmphstbuf);
+   }
+
+   if ((s = socket_cloexec(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+      return -errno;
+
+   if (ioctl(s, FIONBIO, &nonblock) != 0 ||
+       (connect(s, (struct sockaddr *)&addr, sizeof(addr)) == -1 &&
+        errno != EINPROGRESS)) {
+      int rc = -errno;
+      close(s);
+      return rc;
+   }
+
+   return s;
+}
+
+int smtp_send_batch(const SMTPMSG *msgs, int nmsgs, char *errmsg, int errlen)
+{
+   SMTPSESS sess;
+   SMTPSESS *c = &sess;
+   SMTPQMSG **tail;
+   const char *host;
+   char *cp;
+   int i, port;
+
+   memset(c, 0, sizeof(*c));
+   c->errmsg = errmsg;
+   c->errlen = errlen;
+   errmsg[0] = 0;
+
+   if (nmsgs <= 0)
+      return 0;
+
+   /* Determine SMTP server; all messages go through the first one's */
+   host = msgs[0].mailhost;
+   if (host == NULL || *host == 0) {
+      if ((cp = getenv("SMTPSERVER")) != NULL)
+         host = cp;
+      else
+         host = "localhost";
+   }
+   strlcpy(c->mailhost, host, sizeof(c->mailhost));
+   port = msgs[0].mailport ? msgs[0].mailport : 25;
+
+   get_my_hostname(c->my_hostname, sizeof(c->my_hostname));
+
+   for (tail = &c->msgs, i = 0; i < nmsgs; i++) {
+      *tail = format_message(c, &msgs[i]);
+      tail = &(*tail)->next;
+   }
+
+   /* Connect to smtp daemon on mailhost. */
+   c->s = start_connect(c->mailhost, port);
+   if (c->s == -ENXIO && strcasecmp(c->mailhost, "localhost") != 0) {
+      Dmsg(0, "Error unknown mail host \"%s\"\n", c->mailhost);
+      Dmsg(0, "Retrying connection using \"localhost\".\n");
+      strlcpy(c->mailhost, "localhost", sizeof(c->mailhost));
+      c->s = start_connect(c->mailhost, port);
+   }
+   if (c->s < 0) {
+      asnprintf(errmsg, errlen, "Fatal connect error to %s: ERR=%s",
+         c->mailhost, strerror(-c->s));
+      free_messages(c->msgs);
+      return -1;
+   }
+
+   c->state = SS_CONNECT;
+   c->idle_deadline = now_msec() + SMTP_CONNECT_TIMEOUT * 1000;
+   c->deadline = now_msec() + SMTP_MAXTIME * 1000;
+
+   if (smtp_run(c) < 0 && c->nsent == 0 && c->errmsg[0] == 0)
+      asnprintf(errmsg, errlen, "Session with %s failed", c->mailhost);
+
+   Dmsg(20, "Sent %d of %d messages via %s%s\n", c->nsent, nmsgs,
+      c->mailhost, c->pipelining ? " (pipelined)" : "");
+
+   net_close(c->s);
+   free(c->wbuf.data);
+   free_messages(c->msgs);
+
+   if (c->state == SS_FAILED && c->nsent == 0)
+      return -1;
+   return c->nsent;
+}
+
+int smtp_send(const SMTPMSG *msg, char *errmsg, int errlen)
+{
+   return smtp_send_batch(msg, 1, errmsg, errlen) == 1 ? 0 : -1;
+}
@@ -0,0 +1,184 @@
+/*
+ * apcstats.c
+ *
+ * Latency histograms and counters kept by the daemon about itself
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#include "apc.h"
+
+/*
+ * Bucket i counts samples below 2^(i+1) usec that did not fit in the
+ * bucket before it. The last bucket takes everything longer.
+ */
+void lathist_add(LATHIST *h, long long usec)
+{
+   int i = 0;
+
+   if (usec < 0)
+      usec = 0;
+   while (i < LATHIST_BUCKETS - 1 && usec >= (2LL << i))
+      i++;
+
+   h->bucket[i]++;
+   h->count++;
+   h->sum_us += usec;
+   h->last_us = usec;
+   if ((unsigned long long)usec > h->max_us)
+      h->max_us = usec;
+}
+
+/*
+ * Count retries by a driver's transport. Drivers may be called with
+ * the UPS lock held or not, so this does without it.
+ */
+void stats_retries(UPSINFO *ups, unsigned long n)
+{
+   if (n)
+      __atomic_add_fetch(&ups->selfstats.retries, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Time a NIS request. Every request lands here, so it takes a mutex of
+ * its own rather than the UPS write lock the driver competes for.
+ */
+void stats_nis_request(UPSINFO *ups, long long usec)
+{
+   P(ups->stats_mutex);
+   lathist_add(&ups->selfstats.nis_request, usec);
+   V(ups->stats_mutex);
+}
+
+#ifdef HAVE_NISSERVER
+
+/* Column headings for the summary lines of output_lathist() */
+int output_lathist_header(int sockfd)
+{
+   char buf[MAXSTRING];
+   int len;
+
+   len = asnprintf(buf, sizeof(buf), "%-14s %8s %10s %10s %10s\n",
+      "HISTOGRAM", "COUNT", "AVG_USEC", "MAX_USEC", "LAST_USEC");
+   return net_send(sockfd, buf, len) <= 0 ? -1 : 0;
+}
+
+/*
+ * Send a histogram to a NIS client: a summary, then the count in each
+ * bucket that has any, labelled with its upper bound in usec.
+ */
+int output_lathist(int sockfd, const char *name, const LATHIST *h)
+{
+   char buf[MAXSTRING];
+   int i, len;
+
+   len = asnprintf(buf, sizeof(buf), "%-14s %8lu %10llu %10llu %10llu\n",
+      name, h->count, h->count ? h->sum_us / h->count : 0ULL,
+      h->max_us, h->last_us);
+   if (net_send(sockfd, buf, len) <= 0)
+      return -1;
+
+   for (i = 0; i < LATHIST_BUCKETS; i++) {
+      if (h->bucket[i] == 0)
+         continue;
+      if (i < LATHIST_BUCKETS - 1)
+         len = asnprintf(buf, sizeof(buf), "  LT_USEC %-10llu %8lu\n",
+            2ULL << i, h->bucket[i]);
+      else
+         len = asnprintf(buf, sizeof(buf), "  LT_USEC %-10s %8lu\n",
+            "+Inf", h->bucket[i]);
+      if (net_send(sockfd, buf, len) <= 0)
+         return -1;
+   }
+
+   return 0;
+}
+
+/*
+ * Send everything apcupsd has measured about itself for one UPS: the
+ * histograms, then the counters, then the terminating empty record.
+ */
+int output_selfstats(UPSINFO *ups, int sockfd)
+{
+   SELFSTATS st;
+   LATHIST event;
+   LINKSTATS link;
+   char driver[MAXSTRING];
+   char buf[MAXSTRING];
+   unsigned int i;
+   int len;
+
+   read_lock(ups);
+   st = ups->selfstats;
+   event = ups->event_latency;
+   link = ups->linkstats;
+   strlcpy(driver, ups->mode.long_name, sizeof(driver));
+   read_unlock(ups);
+   st.retries = __atomic_load_n(&ups->selfstats.retries, __ATOMIC_RELAXED);
+   P(ups->stats_mutex);
+   st.nis_request = ups->selfstats.nis_request;
+   V(ups->stats_mutex);
+
+   const struct {
+      const char *name;
+      const LATHIST *h;
+   } hists[] = {
+      { "POLL_VOLATILE", &st.poll_volatile },
+      { "POLL_STATIC",   &st.poll_static },
+      { "LOCK_WAIT",     &st.lock_wait },
+      { "LOCK_READ",     &st.read_hold },
+      { "LOCK_WRITE",    &st.write_hold },
+      { "NIS_REQUEST",   &st.nis_request },
+      { "EVENT",         &event },
+   };
+
+   const struct {
+      const char *name;
+      unsigned long value;
+   } counters[] = {
+      { "POLL_ERRORS",    st.poll_errors },
+      { "RETRIES",        st.retries },
+      { "LINK_ATTEMPTS",  link.attempts },
+      { "LINK_FAILURES",  link.failures },
+      { "LINK_OUTAGES",   link.outages },
+      { "LINK_RECOVER",   link.recoveries },
+   };
+
+   len = asnprintf(buf, sizeof(buf), "%-14s : %s\n", "DRIVER", driver);
+   if (net_send(sockfd, buf, len) <= 0)
+      return -1;
+
+   if (output_lathist_header(sockfd) < 0)
+      return -1;
+   for (i = 0; i < sizeof(hists) / sizeof(hists[0]); i++) {
+      if (output_lathist(sockfd, hists[i].name, hists[i].h) < 0)
+         return -1;
+   }
+
+   for (i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+      len = asnprintf(buf, sizeof(buf), "%-14s : %lu\n", counters[i].name,
+         counters[i].value);
+      if (net_send(sockfd, buf, len) <= 0)
+         return -1;
+   }
+
+   return net_send(sockfd, NULL, 0) < 0 ? -1 : 0;
+}
+
+#endif /* HAVE_NISSERVER */
@@ -148,6 +148,9 @@ int output_status(UPSINFO *ups, int sockfd,
    if (ups->UPS_Cap[CI_RUNTIM])
       s_write(ups, "TIMELEFT : %.1f Minutes\n", ups->TimeLeft);
 
+   if (ups->predict.runtime >= 0)
+      s_write(ups, "PREDTIME : %.1f Minutes\n", ups->predict.runtime);
+
    s_write(ups, "MBATTCHG : %d Percent\n", ups->percent);
    s_write(ups, "MINTIMEL : %d Minutes\n", ups->runtime);
    s_write(ups, "MAXTIME  : %d Seconds\n", ups->maxtime);
@@ -0,0 +1,148 @@
+/*
+ * linkhealth.cpp
+ *
+ * Link health tracking and reconnect pacing shared by the drivers
+ */
+
+/*
+ * Copyright (C) 2026 The apcupsd contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1335, USA.
+ */
+
+#include "apc.h"
+
+LinkHealth::LinkHealth(UPSINFO *ups, int threshold, int grace_ms,
+                       int min_ms, int max_ms)
+   : _ups(ups),
+     _threshold(threshold),
+     _grace_ms(grace_ms),
+     _min_ms(min_ms),
+     _max_ms(max_ms),
+     _failures(0),
+     _lost(false),
+     _backoff_ms(0),
+     _first_fail(0),
+     _next_try(0),
+     _last_log(0),
+     _seed((unsigned int)time(NULL) ^ (unsigned int)(unsigned long)this)
+{
+}
+
+bool LinkHealth::ready() const
+{
+   return _failures == 0 || mono_msec() >= _next_try;
+}
+
+int LinkHealth::delay_ms() const
+{
+   long long left;
+
+   if (_failures == 0)
+      return 0;
+
+   left = _next_try - mono_msec();
+   return left > 0 ? (int)left : 0;
+}
+
+void LinkHealth::wait() const
+{
+   struct timespec ts;
+   int msec = delay_ms();
+
+   ts.tv_sec = msec / 1000;
+   ts.tv_nsec = (msec % 1000) * 1000000L;
+   nanosleep(&ts, NULL);
+}
+
+/* Let the next attempt through at once, e.g. when a trap arrives */
+void LinkHealth::kick()
+{
+   _next_try = 0;
+}
+
+void LinkHealth::success()
+{
+   LINKSTATS *st = &_ups->linkstats;
+   long long now;
+
+   st->attempts++;
+   if (_failures == 0)
+      return;
+
+   now = mono_msec();
+   Dmsg(50, "Link up after %d failures in %lld ms\n", _failures,
+      now - _first_fail);
+
+   if (_ups->is_commlost())
+      _ups->clear_commlost();
+   if (_lost) {
+      st->recoveries++;
+      st->last_outage_ms = now - _first_fail;
+      generate_event(_ups, CMDCOMMOK);
+      _lost = false;
+   }
+
+   _failures = 0;
+   _backoff_ms = 0;
+   _next_try = 0;
+   _last_log = 0;
+}
+
+void LinkHealth::failure()
+{
+   LINKSTATS *st = &_ups->linkstats;
+   long long now = mono_msec();
+   time_t t = time(NULL);
+   int delay;
+
+   st->attempts++;
+   st->failures++;
+
+   if (_failures++ == 0)
+      _first_fail = now;
+
+   /*
+    * Retry at once the first time. After that double the ceiling each
+    * time and wait a random half to all of it.
+    */
+   if (_failures == 1) {
+      delay = 0;
+   } else {
+      _backoff_ms = _backoff_ms ? _backoff_ms * 2 : _min_ms;
+      if (_backoff_ms > _max_ms)
+         _backoff_ms = _max_ms;
+      delay = _backoff_ms / 2 + rand_r(&_seed) % (_backoff_ms / 2 + 1);
+   }
+   _next_try = now + delay;
+   st->backoff_ms = delay;
+
+   Dmsg(50, "Link failure %d, next attempt in %d ms\n", _failures, delay);
+
+   if (!_lost) {
+      if (_failures >= _threshold && now - _first_fail >= _grace_ms) {
+         st->outages++;
+         _lost = true;
+         _ups->set_commlost();
+         generate_event(_ups, CMDCOMMFAILURE);
+         _last_log = t;
+      }
+   } else if (t - _last_log >= 10 * 60) {
+      /* Log every 10 minutes while the link stays down */
+      _last_log = t;
+      log_event(_ups, event_msg[CMDCOMMFAILURE].level,
+         event_msg[CMDCOMMFAILURE].msg);
+   }
+}
@@ -45,6 +45,11 @@ UPSINFO *new_ups()
       free(ups);
       return NULL;
    }
+   if ((stat = pthread_mutex_init(&ups->stats_mutex, NULL)) != 0) {
+      Error_abort("Could not create pthread mutex. ERR=%s\n", strerror(stat));
+      free(ups);
+      return NULL;
+   }
 
    /* Most drivers do not support this, so preset it to true */
    ups->set_battpresent();
@@ -80,31 +85,68 @@ void detach_ups(UPSINFO *ups)
 void destroy_ups(UPSINFO *ups)
 {
    pthread_mutex_destroy(&ups->mutex);
+   pthread_mutex_destroy(&ups->stats_mutex);
    if (ups->refcnt == 0) {
+      while (ups->evhooks) {
+         EVHOOK *next = ups->evhooks->next;
+         free(ups->evhooks);
+         ups->evhooks = next;
+      }
+      while (ups->upsfiles) {
+         UPSFILE *next = ups->upsfiles->next;
+         free(ups->upsfiles);
+         ups->upsfiles = next;
+      }
       free(ups);
    }
 }
 
+/*
+ * Read and write locks share one mutex. How long each waited for it
+ * and held it goes into the histograms of SELFSTATS, which the lock
+ * itself protects.
+ */
+static void lock_taken(UPSINFO *ups, long long asked)
+{
+   long long now = mono_nsec();
+
+   lathist_add(&ups->selfstats.lock_wait, (now - asked) / 1000);
+   ups->selfstats.lock_taken = now;
+}
+
+static void lock_released(UPSINFO *ups, LATHIST *hold)
+{
+   lathist_add(hold, (mono_nsec() - ups->selfstats.lock_taken) / 1000);
+}
+
 void _read_lock(const char *file, int line, UPSINFO *ups)
 {
+   long long asked = mono_nsec();
+
    Dmsg(100, "read_lock at %s:%d\n", file, line);
    P(ups->mutex);
+   lock_taken(ups, asked);
 }
 
 void _read_unlock(const char *file, int line, UPSINFO *ups)
 {
    Dmsg(100, "read_unlock at %s:%d\n", file, line);
+   lock_released(ups, &ups->selfstats.read_hold);
    V(ups->mutex);
 }
 
 void _write_lock(const char *file, int line, UPSINFO *ups)
 {
+   long long asked = mono_nsec();
+
    Dmsg(100, "write_lock at %s:%d\n", file, line);
    P(ups->mutex);
+   lock_taken(ups, asked);
 }
 
 void _write_unlock(const char *file, int line, UPSINFO *ups)
 {
    Dmsg(100, "write_unlock at %s:%d\n", file, line);
+   lock_released(ups, &ups->selfstats.write_hold);
    V(ups->mutex);
 }
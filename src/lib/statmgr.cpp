@@ -21,17 +21,28 @@
 #include <stdarg.h>
 
 StatMgr::StatMgr(const char *host, unsigned short port)
-   : m_host(host),
+   : m_text(NULL),
+     m_textsize(0),
+     m_stats(NULL),
+     m_nstats(0),
+     m_maxstats(0),
+     m_hash(NULL),
+     m_hashsize(0),
+     m_gen(0),
+     m_sum(0),
+     m_host(host),
      m_port(port),
      m_socket(INVALID_SOCKET)
 {
-   memset(m_stats, 0, sizeof(m_stats));
 }
 
 StatMgr::~StatMgr()
 {
    lock();
    close();
+   free(m_text);
+   free(m_stats);
+   free(m_hash);
 }
 
 bool StatMgr::Update()
@@ -43,6 +54,8 @@ bool StatMgr::Update()
    {
       if (m_socket == INVALID_SOCKET && !open()) {
          // Hard failure: bail immediately
+         m_nstats = 0;
+         index();
          unlock();
          return false;
       }
@@ -53,71 +66,171 @@ bool StatMgr::Update()
          continue;
       }
 
-      memset(m_stats, 0, sizeof(m_stats));
-
+      // Each line goes after the last, NUL-terminated; index() splits them
+      unsigned int used = 0;
       int len = 0;
-      int i = 0;
-      while (i < MAX_STATS &&
-             (len = net_recv(m_socket, m_stats[i].data, sizeof(m_stats[i].data)-1)) > 0)
+      m_nstats = 0;
+      for (;;)
       {
-         char *key, *value;
-
-         // NUL-terminate the string
-         m_stats[i].data[len] = '\0';
-
-         // Find separator
-         value = strchr(m_stats[i].data, ':');
-
-         // Trim whitespace from value
-         if (value) {
-            *value++ = '\0';
-            value = trim(value);
+         if (m_textsize - used < MAXSTRING + 1) {
+            m_textsize = m_textsize ? m_textsize * 2 : 4096;
+            m_text = (char *)realloc(m_text, m_textsize);
          }
 
-         // Trim whitespace from key;
-         key = trim(m_stats[i].data);
+         if ((len = net_recv(m_socket, m_text + used, MAXSTRING)) <= 0)
+            break;
 
-         m_stats[i].key = key;
-         m_stats[i].value = value;
-         i++;
+         m_text[used + len] = '\0';
+         used += len + 1;
+         m_nstats++;
       }
 
       // Good update, bail now
-      if (i > 0 && len == 0)
+      if (m_nstats > 0 && len == 0)
          break;
 
       // Soft failure: close and try again
+      m_nstats = 0;
       close();
    }
 
+   index();
    unlock();
    return tries > 0;
 }
 
+/* Last generation given out, by any StatMgr */
+static unsigned int s_gen;
+
+/* FNV-1a, continuing from h */
+static uint32_t hash32(const char *str, uint32_t h = 2166136261U)
+{
+   while (*str)
+      h = (h ^ (unsigned char)*str++) * 16777619U;
+   return h;
+}
+
+static uint64_t hash64(const char *str, uint64_t h)
+{
+   do
+      h = (h ^ (unsigned char)*str) * 1099511628211ULL;
+   while (*str++);
+   return h;
+}
+
+/*
+ * Split the m_nstats lines in m_text into keys and values and hash the
+ * keys. A new generation starts if any value has changed other than
+ * the times at which apcupsd wrote the status.
+ */
+void StatMgr::index()
+{
+   if (m_nstats > m_maxstats) {
+      m_maxstats = m_nstats;
+      m_stats = (keyval *)realloc(m_stats, m_maxstats * sizeof(*m_stats));
+   }
+
+   // Keep the table no more than half full
+   unsigned int size = 64;
+   while (size < 2U * m_nstats)
+      size *= 2;
+   if (size != m_hashsize) {
+      m_hashsize = size;
+      m_hash = (int *)realloc(m_hash, m_hashsize * sizeof(*m_hash));
+   }
+   memset(m_hash, 0xff, m_hashsize * sizeof(*m_hash));
+
+   uint64_t sum = 14695981039346656037ULL;
+   char *line = m_text;
+   for (int i = 0; i < m_nstats; i++)
+   {
+      char *next = line + strlen(line) + 1;
+      char *key, *value;
+
+      // Find separator
+      value = strchr(line, ':');
+
+      // Trim whitespace from value
+      if (value) {
+         *value++ = '\0';
+         value = trim(value);
+      }
+
+      // Trim whitespace from key;
+      key = trim(line);
+
+      m_stats[i].key = key;
+      m_stats[i].value = value;
+
+      // The first of the same name is the one found, as it always was
+      if (find(key) < 0) {
+         unsigned int h = hash32(key) & (m_hashsize - 1);
+         while (m_hash[h] >= 0)
+            h = (h + 1) & (m_hashsize - 1);
+         m_hash[h] = i;
+      }
+
+      if (value && strcmp(key, "DATE") != 0 && strcmp(key, "END APC") != 0)
+         sum = hash64(value, hash64(key, sum));
+
+      line = next;
+   }
+
+   if (m_gen == 0 || sum != m_sum) {
+      m_sum = sum;
+      m_gen = __atomic_add_fetch(&s_gen, 1, __ATOMIC_RELAXED);
+   }
+}
+
+/* Index into m_stats of a key, or -1 */
+int StatMgr::find(const char *key)
+{
+   if (m_hashsize == 0)
+      return -1;
+
+   unsigned int h = hash32(key) & (m_hashsize - 1);
+   while (m_hash[h] >= 0) {
+      if (strcmp(m_stats[m_hash[h]].key, key) == 0)
+         return m_hash[h];
+      h = (h + 1) & (m_hashsize - 1);
+   }
+   return -1;
+}
+
 astring StatMgr::Get(const char* key)
 {
    astring ret;
 
    lock();
-   for (int idx=0; idx < MAX_STATS && m_stats[idx].key; idx++) {
-      if (strcmp(key, m_stats[idx].key) == 0) {
-         if (m_stats[idx].value)
-            ret = m_stats[idx].value;
-         break;
-      }
-   }
+   int idx = find(key);
+   if (idx >= 0 && m_stats[idx].value)
+      ret = m_stats[idx].value;
    unlock();
 
    return ret;
 }
 
+/*
+ * Changes each time Update() brings a status that differs from the one
+ * before. Generations are never reused by another StatMgr, so a caller
+ * that starts over with a new one sees a change too; 0 means no update
+ * has been done yet.
+ */
+unsigned int StatMgr::Generation()
+{
+   lock();
+   unsigned int gen = m_gen;
+   unlock();
+   return gen;
+}
+
 bool StatMgr::GetAll(alist<astring> &keys, alist<astring> &values)
 {
    keys.clear();
    values.clear();
 
    lock();
-   for (int idx=0; idx < MAX_STATS && m_stats[idx].key; idx++)
+   for (int idx=0; idx < m_nstats; idx++)
    {
       keys.append(m_stats[idx].key);
       values.append(m_stats[idx].value);
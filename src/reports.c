@@ -25,29 +25,27 @@
 
 #include "apc.h"
 
+/* The status buffer is shared by all UPSes; held from open to close */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static char largebuf[4096];
 static int stat_recs;
-static int logstats = 0;
-static time_t last_time_status;
-static time_t last_time_logging;
-static FILE *statusfile = NULL;    /* initial value set to NULL for terminate */
 
 
-void clear_files(void)
+void clear_files(UPSINFO *ups)
 {
-   if (statusfile != NULL) {
-      fflush(statusfile);
-      fclose(statusfile);
-      statusfile = NULL;
+   if (ups->statusfile != NULL) {
+      fflush(ups->statusfile);
+      fclose(ups->statusfile);
+      ups->statusfile = NULL;
    }
 }
 
 static void log_status_open(UPSINFO *ups)
 {
+   P(mutex);
    largebuf[0] = 0;
    stat_recs = 0;
-   rewind(statusfile);
-   logstats = ups->logstats;
+   rewind(ups->statusfile);
 }
 
 #define STAT_REV 1
@@ -59,21 +57,22 @@ static int log_status_close(UPSINFO *ups, int fd)
 
    i = strlen(largebuf);
    if (i > (int)sizeof(largebuf) - 1) {
+      V(mutex);
       log_event(ups, LOG_ERR, "Status buffer overflow %d bytes\n",
          i - sizeof(largebuf));
       return -1;
    }
    asnprintf(buf, sizeof(buf), "APC      : %03d,%03d,%04d\n",
       STAT_REV, stat_recs, i);
-   fputs(buf, statusfile);
-   fputs(largebuf, statusfile);
-   fflush(statusfile);
+   fputs(buf, ups->statusfile);
+   fputs(largebuf, ups->statusfile);
+   fflush(ups->statusfile);
 
    /*
     * Write out the status log to syslog() one record at a 
     * time.
     */
-   if (logstats) {
+   if (ups->logstats) {
       buf[strlen(buf) - 1] = 0;
       log_event(ups, LOG_NOTICE, buf);
 
@@ -89,6 +88,7 @@ static int log_status_close(UPSINFO *ups, int fd)
       }
    }
 
+   V(mutex);
    return 0;
 }
 
@@ -125,7 +125,6 @@ static void log_status_write(UPSINFO *ups, const char *fmt, ...)
 static void log_data(UPSINFO *ups)
 {
    const char *ptr;
-   static int toggle = 0;
 
    if (ups->datatime == 0)
       return;
@@ -153,7 +152,7 @@ static void log_data(UPSINFO *ups)
    case APCSMART_UPS:
    case PCNET_UPS:
    case SNMPLITE_UPS:
-      toggle = !toggle;            /* flip bit */
+      ups->data_toggle = !ups->data_toggle;   /* flip bit */
       log_event(ups, LOG_INFO,
          "%05.1f,%05.1f,%05.1f,%05.2f,%05.2f,%04.1f,%04.1f,%05.1f,%05.1f,%05.1f,%05.1f,%d",
          ups->LineMin,
@@ -163,7 +162,8 @@ static void log_data(UPSINFO *ups)
          ups->LineFreq,
          ups->UPSLoad,
          ups->UPSTemp,
-         ups->ambtemp, ups->humidity, ups->LineVoltage, ups->BattChg, toggle);
+         ups->ambtemp, ups->humidity, ups->LineVoltage, ups->BattChg,
+         ups->data_toggle);
       break;
    default:
       break;
@@ -172,42 +172,68 @@ static void log_data(UPSINFO *ups)
 }
 
 
+/*
+ * Close the status and history files so that the next do_reports()
+ * opens them again with the current settings. The shared memory
+ * segment is left alone; shm_publish() notices a new STATUSSHM.
+ */
+void reset_reports(UPSINFO *ups)
+{
+   clear_files(ups);
+   history_close(ups);
+   ups->reports_started = false;
+}
+
 void do_reports(UPSINFO *ups)
 {
-   static int first_time = TRUE;
    time_t now = time(NULL);
+   int histtime = ups->datatime > 0 ? ups->datatime : ups->polltime;
    int fd;
 
-   if (first_time) {
-      first_time = FALSE;
+   if (!ups->reports_started) {
+      ups->reports_started = true;
 
       /* Set up logging and status timers. */
-      last_time_logging = 0;
-      last_time_status = 0;
+      ups->last_time_logging = 0;
+      ups->last_time_status = 0;
+      ups->last_time_history = 0;
 
       if (ups->stattime != 0) {
          if ((fd = open(ups->statfile, O_WRONLY|O_TRUNC|O_CREAT|O_CLOEXEC, 0666)) == -1 ||
-             (statusfile = fdopen(fd, "w")) == NULL) {
+             (ups->statusfile = fdopen(fd, "w")) == NULL) {
             log_event(ups, LOG_ERR, "Cannot open STATUS file %s: %s\n",
                ups->statfile, strerror(errno));
           }
       } else {
          unlink(ups->statfile);
       }
+
+      /* History is sampled every DATATIME, or every POLLTIME if unset */
+      history_open(ups, histtime);
    }
 
    /* Check if it is time to log DATA record */
-   if ((ups->datatime > 0) && (now - last_time_logging) >= ups->datatime) {
-      last_time_logging = now;
+   if ((ups->datatime > 0) && (now - ups->last_time_logging) >= ups->datatime) {
+      ups->last_time_logging = now;
       log_data(ups);
    }
 
+   /* Check if it is time to record a history sample */
+   if (ups->history != NULL && (now - ups->last_time_history) >= histtime) {
+      ups->last_time_history = now;
+      history_add(ups, now);
+   }
+
    /* Check if it is time to write STATUS file */
-   if ((statusfile != NULL) && (now - last_time_status) >= ups->stattime) {
-      last_time_status = now;
+   if ((ups->statusfile != NULL) && (now - ups->last_time_status) >= ups->stattime) {
+      ups->last_time_status = now;
       output_status(ups, 0, log_status_open, log_status_write, log_status_close);
    }
 
+   /* Local readers see every pass through the shared memory status */
+   shm_publish(ups);
+   metrics_render(ups);
+
    /* Trim the EVENTS file */
    trim_eventfile(ups);
 }
@@ -23,6 +23,7 @@
 upsStatus::upsStatus(HINSTANCE appinst, upsMenu *menu) :
    _hwnd(NULL),
    _appinst(appinst),
+   _gen(0),
    _menu(menu)
 {
 }
@@ -94,6 +95,7 @@ BOOL upsStatus::DialogProcess(
       // Important to do this AFTER everything needed by FillStatusBox() is
       // initialized and ready to go since that function may be called at any
       // time from the wintray timer thread.
+      _gen = 0;
       _hwnd = hwnd;
 
       // Show the dialog
@@ -168,6 +170,15 @@ void upsStatus::Update(StatMgr *statmgr)
       return;
    }
 
+   // Nothing to redraw if the status has not changed
+   unsigned int gen = statmgr->Generation();
+   if (gen == _gen)
+   {
+      _mutex.unlock();
+      return;
+   }
+   _gen = gen;
+
    // Fetch full status from apcupsd
    alist<astring> keys, values;
    if (!statmgr->GetAll(keys, values) || keys.empty())
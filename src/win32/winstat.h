@@ -44,6 +44,7 @@ private:
    Meter *_bmeter;
    Meter *_lmeter;
    ListView *_grid;
+   unsigned int _gen;              // of the status shown
    amutex _mutex;
    upsMenu *_menu;
 };